@@ -0,0 +1,7 @@
+find_path(ZSTD_INCLUDE_DIRS zstd.h)
+
+find_library(ZSTD_LIBRARIES zstd)
+
+find_package_handle_standard_args(zstd DEFAULT_MSG ZSTD_LIBRARIES ZSTD_INCLUDE_DIRS)
+
+mark_as_advanced(ZSTD_INCLUDE_DIRS ZSTD_LIBRARIES)
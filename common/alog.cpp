@@ -35,6 +35,9 @@ limitations under the License.
 #include <photon/common/iovector.h>
 #include <sys/uio.h>
 #include <vector>
+#include <string>
+#include <memory>
+#include <unordered_map>
 #include <sys/time.h>
 using namespace std;
 
@@ -103,6 +106,10 @@ public:
         std::ignore = ::writev(log_file_fd, iov.start(), iov.count());
         throttle_block();
     }
+    void writev(int, const struct iovec* iov, int iovcnt) override {
+        std::ignore = ::writev(log_file_fd, iov, iovcnt);
+        throttle_block();
+    }
     void throttle_block() {
         if (throttle == -1UL) return;
         if (ts != now0) { ts = now0; count = 0; }
@@ -122,8 +129,16 @@ ILogOutput* const log_output_stderr = &_log_output_stderr;
 class LogOutputNull : public BaseLogOutput {
 public:
     void write(int, const char* , const char* ) override { throttle_block(); }
+    void writev(int, const struct iovec*, int) override { throttle_block(); }
 };
 
+void ILogOutput::writev(int level, const struct iovec* iov, int iovcnt) {
+    for (int i = 0; i < iovcnt; ++i) {
+        auto p = (const char*)iov[i].iov_base;
+        write(level, p, p + iov[i].iov_len);
+    }
+}
+
 static LogOutputNull _log_output_null;
 ILogOutput* const log_output_null = &_log_output_null;
 
@@ -280,9 +295,20 @@ public:
 
     void write(int level, const char* begin, const char* end) override {
         if (log_file_fd < 0) return;
-        uint64_t length = end - begin;
-        // iovec iov{(void*)begin, length};
         BaseLogOutput::write(level, begin, end);
+        account(end - begin);
+    }
+
+    void writev(int level, const struct iovec* iov, int iovcnt) override {
+        if (log_file_fd < 0) return;
+        BaseLogOutput::writev(level, iov, iovcnt);
+        uint64_t length = 0;
+        for (int i = 0; i < iovcnt; ++i)
+            length += iov[i].iov_len;
+        account(length);
+    }
+
+    void account(uint64_t length) {
         if (log_file_name && log_file_size_limit) {
             log_file_size += length;
             if (log_file_size > log_file_size_limit) {
@@ -391,94 +417,216 @@ public:
     }
 };
 
-static const uint64_t SPSC_CAPACITY     = 1024 * 1024UL;
-static const int      MIN_NUM_OF_QUEUES = 1;
-static const int      MAX_NUM_OF_QUEUES = 128;
-static const uint32_t MAX_YIELD_TURNS   = 1024;
+static const uint32_t MIN_QUEUE_SIZE    = 64 * 1024;
+static const uint32_t MAX_NUM_OF_QUEUES = 128;
+static const int      MAX_BATCH_IOV     = 256;
+
+struct LogQueue {
+    typedef FlexLockfreeSPSCRingQueue<char> spsc;
+    spsc* q;
+    // for the shared queue, producers push with it locked
+    photon::spinlock lock;
+    // updated by the producer only
+    std::atomic<uint64_t> lines{0}, dropped{0}, sampled{0}, blocked{0};
+    uint64_t sample_count = 0;
+    const bool shared;
+    std::atomic<bool> owned{false};     // by an OS thread, if not shared
+    std::atomic<bool> closed{false};    // the output has been destructed
+
+    LogQueue(size_t size, bool shared_) : q(spsc::create(size)), shared(shared_) { }
+    ~LogQueue() { spsc::destroy(q); }
+    static void inc(std::atomic<uint64_t>& x) {
+        x.store(x.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+};
 
-class AsyncLogOutput final : public BaseLogOutput {
+// the queues that an OS thread logs into, one for each async output; they
+// are shared with the outputs, so that either of them may go first
+struct LogQueueRef {
+    uint64_t owner;
+    std::shared_ptr<LogQueue> queue;
+};
+
+struct LogQueueRefs : public std::vector<LogQueueRef> {
+    ~LogQueueRefs() {
+        // the thread exits, and gives up its queues
+        for (auto& r : *this)
+            if (!r.queue->shared)
+                r.queue->owned.store(false, std::memory_order_release);
+    }
+};
+
+static thread_local LogQueueRefs log_queues;
+static thread_local void* log_drainer = nullptr;
+static std::atomic<uint64_t> async_log_output_id{0};
+
+class AsyncLogOutput : public BaseLogOutput {
 public:
     ILogOutput* log_output;
+    AsyncLogOptions opts;
+    uint64_t id = ++async_log_output_id;
     photon::semaphore sem;
     std::thread background;
-    typedef LockfreeSPSCRingQueue<char, SPSC_CAPACITY> spsc;
-    std::vector<std::unique_ptr<spsc>> buf;
-    std::vector<std::unique_ptr<photon::spinlock>> lock;
-    int num_of_queues;
-    bool stopped = false;
+    std::atomic<bool> stopped{false};
+    std::vector<std::shared_ptr<LogQueue>> queues;
 
-    AsyncLogOutput(ILogOutput* output, int num) : log_output(output), num_of_queues(num) {
+    AsyncLogOutput(ILogOutput* output, const AsyncLogOptions& options)
+        : log_output(output), opts(options) {
         // no colors by default when log into files
         BaseLogOutput::clear_color();
-        if (num_of_queues < MIN_NUM_OF_QUEUES) num_of_queues = MIN_NUM_OF_QUEUES;
-        if (num_of_queues > MAX_NUM_OF_QUEUES) num_of_queues = MAX_NUM_OF_QUEUES;
-        num_of_queues = 1 << (31 - __builtin_clz(num_of_queues));  // Aligned to 2^n
-        buf.reserve(num_of_queues);
-        lock.reserve(num_of_queues);
-        for (int i = 0; i < num_of_queues; ++i) {
-            buf.emplace_back(new spsc());
-            lock.emplace_back(new photon::spinlock());
+        if (opts.queue_size < MIN_QUEUE_SIZE) opts.queue_size = MIN_QUEUE_SIZE;
+        if (opts.sample_rate == 0) opts.sample_rate = 1;
+        opts.num_of_queues = std::min(std::max(opts.num_of_queues, 1u), MAX_NUM_OF_QUEUES);
+        for (uint32_t i = 0; i < opts.num_of_queues; ++i) {
+            auto q = std::make_shared<LogQueue>(opts.queue_size, i == 0);
+            if (!q->q) break;
+            queues.push_back(std::move(q));
         }
+    }
+
+    virtual ~AsyncLogOutput() {
+        for (auto& q : queues)
+            q->closed.store(true, std::memory_order_release);
+    }
+
+    AsyncLogOutput* start() {
         background = std::thread(&AsyncLogOutput::worker, this);
+        return this;
     }
 
     void worker() {
+        log_drainer = this;
         photon::vcpu_init();
         photon::fd_events_init(photon::INIT_EVENT_EPOLL);
-        uint32_t yield_turn = 0;
-        while (!stopped) {
-            if (writeback() == 0) {
-                if (yield_turn < MAX_YIELD_TURNS) {
-                    photon::thread_yield();
-                    ++yield_turn;
-                } else {
-                    // wait for 100ms
-                    sem.wait(1, 100UL * 1000);
-                }
-            } else {
-                yield_turn = 0;
-            }
+        while (!stopped.load(std::memory_order_acquire)) {
+            // producers wake us up when a queue gets half full
+            if (writeback() == 0) sem.wait(1, 10UL * 1000);
         }
         photon::fd_events_fini();
         photon::vcpu_fini();
-        (void)writeback();
+        while (writeback()) { }
     }
 
     uint64_t writeback() {
+        iovec iov[MAX_BATCH_IOV];
+        size_t peeked[MAX_BATCH_IOV];
         uint64_t cc = 0;
-        for (int i = 0; i < num_of_queues; ++i) {
-            cc += buf[i]->consume_pop_batch(UINT32_MAX, [&](const char* p1, size_t n1,
-                                                            const char* p2, size_t n2) {
-                // no level and coloring again, by passing -1
-                log_output->write(-1, p1, p1 + n1);
-                if (n2) log_output->write(-1, p2, p2 + n2);
+        int n = 0, k = 0;
+        auto commit = [&](size_t upto) {
+            if (n) consume(iov, n);
+            for (size_t i = upto - k; i < upto; ++i)
+                queues[i]->q->pop_peeked(peeked[i - (upto - k)]);
+            n = k = 0;
+        };
+        for (size_t i = 0; i < queues.size(); ++i) {
+            peeked[k] = queues[i]->q->consume_peek_batch(UINT32_MAX,
+                    [&](const char* p1, size_t n1, const char* p2, size_t n2) {
+                iov[n++] = {(void*)p1, n1};
+                if (n2) iov[n++] = {(void*)p2, n2};
             });
+            cc += peeked[k++];
+            if (n + 2 > MAX_BATCH_IOV || k == MAX_BATCH_IOV) commit(i + 1);
         }
+        commit(queues.size());
+        if (cc) flush();
         return cc;
     }
 
-    void write(int level, const char* begin, const char* end) override {
-        static thread_local uint64_t index = 0;
-        auto current = (++index) & (num_of_queues - 1);
+    virtual void consume(const iovec* iov, int iovcnt) {
+        // no level and coloring again, by passing -1
+        log_output->writev(-1, iov, iovcnt);
+    }
+
+    virtual void flush() { }
+
+    LogQueue* get_queue() {
+        for (auto& r : log_queues)
+            if (r.owner == id) return r.queue.get();
+        if (queues.empty()) return nullptr;
+        // forget the queues of destructed outputs
+        log_queues.erase(std::remove_if(log_queues.begin(), log_queues.end(), [](LogQueueRef& r) {
+            return r.queue->closed.load(std::memory_order_acquire);
+        }), log_queues.end());
+        auto q = queues[0];
+        for (size_t i = 1; i < queues.size(); ++i) {
+            bool owned = false;
+            if (queues[i]->owned.compare_exchange_strong(owned, true, std::memory_order_acq_rel)) {
+                q = queues[i];
+                break;
+            }
+        }
+        log_queues.push_back({id, q});
+        return q.get();
+    }
+
+    // push a line into `lq`, with it locked if shared;
+    // return false if it is full, with the lock released
+    bool try_push(LogQueue* lq, const iovec* iov, int iovcnt, size_t length, size_t& ra) {
+        if (lq->shared) lq->lock.lock();
+        auto q = lq->q;
+        ra = q->read_available();
+        if (opts.overflow == ALOG_OVERFLOW_SAMPLE && ra + length > q->capacity / 4 * 3 &&
+                (lq->sample_count++ % opts.sample_rate) != 0) {
+            LogQueue::inc(lq->sampled);
+        } else if (q->produce_push_batch_fully(length, [&](char* p1, size_t n1, char* p2, size_t n2) {
+                iovec d[2] = {{p1, n1}, {p2, n2}};
+                iovector_view dest(d, 2), src((iovec*)iov, iovcnt);
+                dest.memcpy_from(&src, length);
+            })) {
+            LogQueue::inc(lq->lines);
+        } else {
+            if (lq->shared) lq->lock.unlock();
+            return false;
+        }
+        if (lq->shared) lq->lock.unlock();
+        return true;
+    }
+
+    void push(const iovec* iov, int iovcnt, size_t length) {
+        auto lq = get_queue();
+        if (!lq) return;
         size_t ra;
-        LineIOV iov(get_color(level), begin, end); {
-            SCOPED_LOCK(lock[current].get());
-            ra = buf[current]->read_available();
-            (void)buf[current]->produce_push_batch_fully(iov.total_length,
-                [&](char* p1, size_t n1, char* p2, size_t n2) {
-                    iovec d[2] = {{p1, n1}, {p2, n2}};
-                    iovector_view dest(d, 2), src(iov.start(), iov.count());
-                    dest.memcpy_from(&src, iov.total_length);
-                });
-        }
-        if (ra + iov.total_length > spsc::SLOTS_NUM / 2 && ra <= spsc::SLOTS_NUM / 2) { sem.signal(1); }
+        bool blocked = false;
+        while (!try_push(lq, iov, iovcnt, length, ra)) {
+            // never wait for the background thread in itself
+            if (opts.overflow != ALOG_OVERFLOW_BLOCK || length > lq->q->capacity ||
+                    log_drainer == this || stopped.load(std::memory_order_relaxed)) {
+                SCOPED_LOCK(lq->lock, lq->shared);
+                return LogQueue::inc(lq->dropped);
+            }
+            if (!blocked) {
+                blocked = true;
+                SCOPED_LOCK(lq->lock, lq->shared);
+                LogQueue::inc(lq->blocked);
+                sem.signal(1);
+            }
+            if (photon::CURRENT) photon::thread_usleep(100);
+            else std::this_thread::yield();
+        }
+        auto half = lq->q->capacity / 2;
+        if (ra + length > half && ra <= half) { sem.signal(1); }
+    }
+
+    void get_stats(AsyncLogStats* stats) {
+        *stats = {};
+        for (auto& q : queues) {
+            stats->lines += q->lines;
+            stats->dropped += q->dropped;
+            stats->sampled += q->sampled;
+            stats->blocked += q->blocked;
+            stats->queues += q->owned.load(std::memory_order_relaxed);
+        }
+    }
+
+    void write(int level, const char* begin, const char* end) override {
+        LineIOV iov(get_color(level), begin, end);
+        push(iov.start(), iov.count(), iov.total_length);
     }
     virtual int get_log_file_fd() override { return log_output->get_log_file_fd(); }
     virtual uint64_t set_throttle(uint64_t t = -1UL) override { return log_output->set_throttle(t); }
     virtual uint64_t get_throttle() override { return log_output->get_throttle(); }
     virtual void destruct() override {
-        if (!stopped) {
-            stopped = true;
+        if (!stopped.exchange(true)) {
             sem.signal(1);
             if (background.joinable()) background.join();
         }
@@ -513,7 +661,21 @@ ILogOutput* new_log_output_file(int fd, uint64_t throttle) {
 }
 
 ILogOutput* new_async_log_output(ILogOutput* output, int num_of_queues) {
-    return output ? new AsyncLogOutput(output, num_of_queues) : nullptr;
+    AsyncLogOptions opts;
+    opts.num_of_queues = std::max(num_of_queues, 1);
+    return new_async_log_output(output, opts);
+}
+
+ILogOutput* new_async_log_output(ILogOutput* output, const AsyncLogOptions& opts) {
+    return output ? (new AsyncLogOutput(output, opts))->start() : nullptr;
+}
+
+int get_async_log_stats(ILogOutput* output, AsyncLogStats* stats) {
+    auto async = dynamic_cast<AsyncLogOutput*>(output);
+    if (!async || !stats)
+        LOG_ERROR_RETURN(EINVAL, -1, "not an async log output");
+    async->get_stats(stats);
+    return 0;
 }
 
 // default_log_file is not defined in header
@@ -552,7 +714,19 @@ static void __init_timezone() { tzset(); }
 struct TM : tm {
     uint64_t tsdelta = 0;
     uint32_t dayid = -1, minuteid = -1, tm_usec;
+    time_t last_sec = -1;
     TM() : tm{0} { }
+    // set from a local time in us, as stamped by alog_stamp_record()
+    void set(uint64_t ts) {
+        tm_usec = ts % 1000000ul;
+        time_t sec = ts / 1000000ul;
+        if (sec != last_sec) {
+            last_sec = sec;
+            gmtime_r(&sec, this);
+            tm_year += 1900;
+            tm_mon++;
+        }
+    }
     template<typename T>
     T cut(T& x, uint64_t mod) {
         T r = x % mod;
@@ -588,36 +762,437 @@ struct TM : tm {
 
 static thread_local TM alog_time;
 
+template<typename...Ts>
+static void alog_put(ALogBuffer& buf, const Ts&...xs) {
+    int _[] = {0, (log_formatter.put(buf, xs), 0)...};
+    (void)_;
+}
+
+static void put_prologue(ALogBuffer& log, const TM* t, int level, const void* thread,
+                         const char* file, int len_file, int line,
+                         const char* func, int len_func)
+{
+    #define DEC_W2P0(x) DEC(x).width(2).padding('0')
+    alog_put(log, t->tm_year, '/');
+    alog_put(log, DEC_W2P0(t->tm_mon),  '/');
+    alog_put(log, DEC_W2P0(t->tm_mday), ' ');
+    alog_put(log, DEC_W2P0(t->tm_hour), ':');
+    alog_put(log, DEC_W2P0(t->tm_min),  ':');
+    alog_put(log, DEC_W2P0(t->tm_sec), '.');
+    alog_put(log, DEC(t->tm_usec).width(6).padding('0'));
+    #undef DEC_W2P0
+
+    static const char levels[] = "|DEBUG|th=|INFO |th=|WARN |th=|ERROR|th=|FATAL|th=|TEMP |th=|AUDIT|th=";
+    alog_put(log, ALogString(&levels[level * 10], 10));
+    alog_put(log, thread, '|');
+    if (level != ALOG_AUDIT) {
+        alog_put(log, ALogString(file, len_file), ':');
+        alog_put(log, line, '|');
+        alog_put(log, ALogString(func, len_func), ':');
+    }
+    static_assert(24 == sizeof(make_named_value("levels", levels)), "...");
+}
+
 LogBuffer& operator << (LogBuffer& log, const Prologue& pro)
 {
 #ifndef LOG_BENCHMARK
     alog_time.update(photon::__update_now());
 #endif
-    const auto t = &alog_time;
-    #define DEC_W2P0(x) DEC(x).width(2).padding('0')
-    log.printf(t->tm_year, '/');
-    log.printf(DEC_W2P0(t->tm_mon),  '/');
-    log.printf(DEC_W2P0(t->tm_mday), ' ');
-    log.printf(DEC_W2P0(t->tm_hour), ':');
-    log.printf(DEC_W2P0(t->tm_min),  ':');
-    log.printf(DEC_W2P0(t->tm_sec), '.');
-    log.printf(DEC(t->tm_usec).width(6).padding('0'));
-
-    static const char levels[] = "|DEBUG|th=|INFO |th=|WARN |th=|ERROR|th=|FATAL|th=|TEMP |th=|AUDIT|th=";
     log.level = pro.level;
-    log.printf(ALogString(&levels[pro.level * 10], 10));
-    log.printf(photon::CURRENT, '|');
-    if (pro.level != ALOG_AUDIT) {
-        log.printf(ALogString(pro.addr_file, pro.len_file), ':');
-        log.printf(pro.line, '|');
-        log.printf(ALogString(pro.addr_func, pro.len_func), ':');
-    }
+    put_prologue(log, &alog_time, pro.level, photon::CURRENT, pro.addr_file,
+                 pro.len_file, pro.line, pro.addr_func, pro.len_func);
     return log;
-
-    static_assert(24 == sizeof(make_named_value("levels", levels)), "...");
 }
 
 LogBuffer& operator << (LogBuffer& log, ERRNO e) {
     auto no = e.no ? e.no : errno;
     return log.printf("errno=", no, '(', strerror(no), ')');
 }
+
+void alog_stamp_record(ALogRecord* rec) {
+    auto now = photon::__update_now();
+    alog_time.update(now);
+    rec->ts = now + alog_time.tsdelta;
+    rec->thread = photon::CURRENT;
+}
+
+struct ALogSite {
+    const char *file, *func, *fmt;
+    int len_file, len_func, line;
+    uint32_t len_fmt;
+};
+
+// format an argument of a record, and move `p` forward
+static bool put_record_arg(ALogBuffer& buf, const char*& p, const char* end) {
+    if (p >= end) return false;
+    auto type = (uint8_t)*p++;
+    auto get = [&](void* x, size_t n) {
+        if ((size_t)(end - p) < n) return false;
+        memcpy(x, p, n);
+        p += n;
+        return true;
+    };
+    switch (type) {
+        case ALOG_ARG_CHAR: {
+            char x;
+            if (!get(&x, sizeof(x))) return false;
+            log_formatter.put(buf, x);
+            break;
+        }
+        case ALOG_ARG_INT: {
+            int64_t x;
+            if (!get(&x, sizeof(x))) return false;
+            log_formatter.put(buf, x);
+            break;
+        }
+        case ALOG_ARG_UINT: {
+            uint64_t x;
+            if (!get(&x, sizeof(x))) return false;
+            log_formatter.put(buf, x);
+            break;
+        }
+        case ALOG_ARG_DOUBLE: {
+            double x;
+            if (!get(&x, sizeof(x))) return false;
+            log_formatter.put(buf, x);
+            break;
+        }
+        case ALOG_ARG_POINTER: {
+            uint64_t x;
+            if (!get(&x, sizeof(x))) return false;
+            log_formatter.put(buf, (const void*)x);
+            break;
+        }
+        case ALOG_ARG_STRING: {
+            uint32_t n;
+            if (!get(&n, sizeof(n)) || (size_t)(end - p) < n) return false;
+            log_formatter.put(buf, ALogString(p, n));
+            p += n;
+            break;
+        }
+        case ALOG_ARG_INTEGER: {
+            ALogInteger x(0, 10);
+            if (!get(&x, sizeof(x))) return false;
+            log_formatter.put(buf, x);
+            break;
+        }
+        case ALOG_ARG_FP: {
+            FP x(0);
+            if (!get(&x, sizeof(x))) return false;
+            log_formatter.put(buf, x);
+            break;
+        }
+        default:
+            return false;
+    }
+    return true;
+}
+
+// format a record the same way as STFMTLogBuffer::print_fmt() does
+static bool format_record(ALogBuffer& buf, TM* t, const ALogSite& site,
+                          int level, int nalt, int nargs, uint64_t ts,
+                          const void* thread, const char* p, const char* end) {
+    t->set(ts);
+    put_prologue(buf, t, level, thread, site.file, site.len_file,
+                 site.line, site.func, site.len_func);
+    int i = 0;
+    for (; i < nalt; ++i)
+        if (!put_record_arg(buf, p, end)) return false;
+    auto f = site.fmt, fend = f + site.len_fmt;
+    while (i < nargs) {
+        if (f == fend) {
+            if (!put_record_arg(buf, p, end)) return false;
+            ++i;
+            continue;
+        }
+        auto q = (const char*)memchr(f, '`', fend - f);
+        if (!q) q = fend;
+        log_formatter.put(buf, ALogString(f, q - f));
+        if (q + 1 < fend && q[1] == '`') {
+            log_formatter.put(buf, '`');
+            f = q + 2;
+            continue;
+        }
+        if (!put_record_arg(buf, p, end)) return false;
+        ++i;
+        f = (q == fend) ? fend : q + 1;
+    }
+    if (f < fend) log_formatter.put(buf, ALogString(f, fend - f));
+    return true;
+}
+
+// records in binary log files, each of which begins with
+// uint32_t size, and uint8_t type
+enum : uint8_t {
+    BINLOG_SESSION,     // magic; site ids are reset
+    BINLOG_SITE,        // uint32_t id, int32_t line, uint16_t len_file,
+                        // uint16_t len_func, uint32_t len_fmt, file, func, fmt
+    BINLOG_LOG,         // uint32_t id, uint8_t level, uint8_t nalt,
+                        // uint16_t nargs, uint64_t ts, uint64_t thread, args
+    BINLOG_TEXT,        // uint8_t level, text
+};
+
+static const char BINLOG_MAGIC[8] = {'P', 'H', 'B', 'I', 'N', 'L', 'O', 'G'};
+static const size_t BINLOG_BATCH_SIZE = 256 * 1024;
+
+class BinaryLogOutput final : public AsyncLogOutput {
+public:
+    bool keep_binary;
+    std::unique_ptr<char[]> batch{new char[BINLOG_BATCH_SIZE]};
+    size_t batch_len = 0;
+    std::string pending;    // a record wrapped around the end of the ring
+    std::unordered_map<std::string, uint32_t> sites;    // by line, lengths and strings
+    TM tm;
+
+    BinaryLogOutput(ILogOutput* output, const AsyncLogOptions& opts, bool keep_binary_)
+        : AsyncLogOutput(output, opts), keep_binary(keep_binary_) {
+        if (keep_binary) {
+            append_header(BINLOG_SESSION, sizeof(BINLOG_MAGIC));
+            append(BINLOG_MAGIC, sizeof(BINLOG_MAGIC));
+            flush();
+        }
+    }
+
+    ~BinaryLogOutput() override {
+        if (keep_binary) log_output->destruct();
+    }
+
+    bool binary() override { return true; }
+
+    void write_record(const char* begin, const char* end) override {
+        iovec iov{(void*)begin, (size_t)(end - begin)};
+        push(&iov, 1, iov.iov_len);
+    }
+
+    // lines that are already formatted, e.g. by LOG_EVERY_T()
+    void write(int level, const char* begin, const char* end) override {
+        ALogRecord rec{};
+        rec.size = sizeof(rec) + (end - begin);
+        rec.level = level;
+        iovec iov[2] = {{&rec, sizeof(rec)}, {(void*)begin, (size_t)(end - begin)}};
+        push(iov, 2, rec.size);
+    }
+
+    // a record may be split into 2 adjacent iovs, at the end of the ring
+    void consume(const iovec* iov, int iovcnt) override {
+        for (int i = 0; i < iovcnt; ++i)
+            consume((const char*)iov[i].iov_base, iov[i].iov_len);
+    }
+
+    void consume(const char* p, size_t n) {
+        ALogRecord rec;
+        while (n) {
+            if (!pending.empty()) {
+                if (pending.size() < sizeof(rec)) {
+                    auto m = std::min(n, sizeof(rec) - pending.size());
+                    pending.append(p, m);
+                    p += m; n -= m;
+                    if (pending.size() < sizeof(rec)) continue;
+                }
+                memcpy(&rec, pending.data(), sizeof(rec));
+                auto m = std::min(n, rec.size - pending.size());
+                pending.append(p, m);
+                p += m; n -= m;
+                if (pending.size() < rec.size) continue;
+                handle(pending.data(), rec);
+                pending.clear();
+                continue;
+            }
+            if (n < sizeof(rec)) { pending.assign(p, n); return; }
+            memcpy(&rec, p, sizeof(rec));
+            if (n < rec.size) { pending.assign(p, n); return; }
+            handle(p, rec);
+            p += rec.size; n -= rec.size;
+        }
+    }
+
+    void handle(const char* p, const ALogRecord& rec) {
+        auto args = p + sizeof(rec), end = p + rec.size;
+        if (!rec.len_file) {
+            size_t len = end - args;
+            if (!keep_binary) {
+                if (len > BINLOG_BATCH_SIZE - batch_len) flush();
+                if (len > BINLOG_BATCH_SIZE) return log_output->write(rec.level, args, end);
+                append(args, len);
+            } else {
+                if (len + 6 > BINLOG_BATCH_SIZE - batch_len) flush();
+                append_header(BINLOG_TEXT, 1 + len);
+                append(&rec.level, 1);
+                if (len + 6 > BINLOG_BATCH_SIZE) { flush(); return log_output->write(-1, args, end); }
+                append(args, len);
+            }
+            return;
+        }
+        auto file = args, func = file + rec.len_file, fmt = func + rec.len_func;
+        args += rec.site_size();
+        size_t len = end - args;
+        if (!keep_binary) {
+            if (BINLOG_BATCH_SIZE - batch_len < LOG_BUFFER_SIZE) flush();
+            ALogSite site{file, func, fmt, rec.len_file, rec.len_func, rec.line, rec.len_fmt};
+            ALogBuffer buf{&batch[batch_len], LOG_BUFFER_SIZE - 2, 0};
+            format_record(buf, &tm, site, rec.level, rec.nalt, rec.nargs,
+                          rec.ts, rec.thread, args, end);
+            batch_len = buf.ptr - batch.get();
+            return;
+        }
+        std::string key((const char*)&rec.line, 8);
+        key.append(file, rec.site_size());
+        auto it = sites.find(key);
+        if (it == sites.end()) {
+            it = sites.emplace(std::move(key), (uint32_t)sites.size()).first;
+            size_t n = 16 + rec.site_size();
+            if (n + 5 > BINLOG_BATCH_SIZE - batch_len) flush();
+            append_header(BINLOG_SITE, n);
+            append(&it->second, 4); append(&rec.line, 4);
+            append(&rec.len_file, 2); append(&rec.len_func, 2); append(&rec.len_fmt, 4);
+            append(file, rec.site_size());
+        }
+        uint64_t thread = (uint64_t)rec.thread;
+        if (len + 29 > BINLOG_BATCH_SIZE - batch_len) flush();
+        append_header(BINLOG_LOG, 24 + len);
+        append(&it->second, 4);
+        append(&rec.level, 1); append(&rec.nalt, 1); append(&rec.nargs, 2);
+        append(&rec.ts, 8); append(&thread, 8);
+        append(args, len);
+    }
+
+    void append_header(uint8_t type, size_t n) {
+        uint32_t size = 5 + n;
+        append(&size, 4);
+        append(&type, 1);
+    }
+
+    void append(const void* x, size_t n) {
+        memcpy(&batch[batch_len], x, n);
+        batch_len += n;
+    }
+
+    void flush() override {
+        if (!batch_len) return;
+        log_output->write(-1, batch.get(), batch.get() + batch_len);
+        batch_len = 0;
+    }
+};
+
+ILogOutput* new_binary_log_output(ILogOutput* output, int num_of_queues) {
+    AsyncLogOptions opts;
+    opts.num_of_queues = std::max(num_of_queues, 1);
+    return new_binary_log_output(output, opts);
+}
+
+ILogOutput* new_binary_log_output(ILogOutput* output, const AsyncLogOptions& opts) {
+    return output ? (new BinaryLogOutput(output, opts, false))->start() : nullptr;
+}
+
+ILogOutput* new_binary_log_output_file(const char* fn, int num_of_queues) {
+    AsyncLogOptions opts;
+    opts.num_of_queues = std::max(num_of_queues, 1);
+    return new_binary_log_output_file(fn, opts);
+}
+
+ILogOutput* new_binary_log_output_file(const char* fn, const AsyncLogOptions& opts) {
+    auto output = new_log_output_file(fn);
+    if (!output) return nullptr;
+    return (new BinaryLogOutput(output, opts, true))->start();
+}
+
+ssize_t decode_binary_log(int fd, ILogOutput* output) {
+    struct Site {
+        std::string file, func, fmt;
+        int line;
+    };
+    std::vector<Site> sites;
+    std::vector<char> data;
+    size_t pos = 0;
+    ssize_t lines = 0;
+    uint64_t offset = 0;
+    bool eof = false, session = false;
+    TM t;
+    char line[LOG_BUFFER_SIZE];
+    while (true) {
+        if (data.size() - pos < 5 || data.size() - pos < *(uint32_t*)&data[pos]) {
+            if (eof) break;
+            data.erase(data.begin(), data.begin() + pos);
+            pos = 0;
+            auto size = data.size();
+            data.resize(size + BINLOG_BATCH_SIZE);
+            auto ret = ::read(fd, &data[size], BINLOG_BATCH_SIZE);
+            if (ret < 0)
+                LOG_ERRNO_RETURN(0, -1, "failed to read binary log");
+            data.resize(size + ret);
+            if (ret == 0) eof = true;
+            continue;
+        }
+        auto p = &data[pos];
+        uint32_t size;
+        memcpy(&size, p, 4);
+        auto type = (uint8_t)p[4];
+        auto q = p + 5, end = p + size;
+        if (size < 5 || (!session && type != BINLOG_SESSION))
+            LOG_ERROR_RETURN(EINVAL, -1, "invalid binary log record at offset ", offset);
+        auto get = [&](void* x, size_t n) {
+            if ((size_t)(end - q) < n) return false;
+            memcpy(x, q, n);
+            q += n;
+            return true;
+        };
+        switch (type) {
+            case BINLOG_SESSION: {
+                if (size != 5 + sizeof(BINLOG_MAGIC) ||
+                        memcmp(q, BINLOG_MAGIC, sizeof(BINLOG_MAGIC)) != 0)
+                    LOG_ERROR_RETURN(EINVAL, -1, "not a binary log at offset ", offset);
+                session = true;
+                sites.clear();
+                break;
+            }
+            case BINLOG_SITE: {
+                uint32_t id, lfmt;
+                int32_t ln;
+                uint16_t lfile, lfunc;
+                if (!get(&id, 4) || !get(&ln, 4) || !get(&lfile, 2) || !get(&lfunc, 2) ||
+                        !get(&lfmt, 4) || (size_t)(end - q) != (size_t)lfile + lfunc + lfmt)
+                    LOG_ERROR_RETURN(EINVAL, -1, "invalid call site record at offset ", offset);
+                if (id >= sites.size()) sites.resize(id + 1);
+                auto& s = sites[id];
+                s.file.assign(q, lfile); q += lfile;
+                s.func.assign(q, lfunc); q += lfunc;
+                s.fmt.assign(q, lfmt);
+                s.line = ln;
+                break;
+            }
+            case BINLOG_LOG: {
+                uint32_t id;
+                uint8_t level, nalt;
+                uint16_t nargs;
+                uint64_t ts, thread;
+                if (!get(&id, 4) || !get(&level, 1) || !get(&nalt, 1) || !get(&nargs, 2) ||
+                        !get(&ts, 8) || !get(&thread, 8) || id >= sites.size() || level > ALOG_AUDIT)
+                    LOG_ERROR_RETURN(EINVAL, -1, "invalid log record at offset ", offset);
+                auto& s = sites[id];
+                ALogSite site{s.file.data(), s.func.data(), s.fmt.data(), (int)s.file.size(),
+                              (int)s.func.size(), s.line, (uint32_t)s.fmt.size()};
+                ALogBuffer buf{line, sizeof(line) - 2, 0};
+                if (!format_record(buf, &t, site, level, nalt, nargs, ts, (void*)thread, q, end))
+                    LOG_ERROR_RETURN(EINVAL, -1, "invalid log arguments at offset ", offset);
+                output->write(level, line, buf.ptr);
+                lines++;
+                break;
+            }
+            case BINLOG_TEXT: {
+                uint8_t level;
+                if (!get(&level, 1))
+                    LOG_ERROR_RETURN(EINVAL, -1, "invalid text record at offset ", offset);
+                output->write(level, q, end);
+                lines++;
+                break;
+            }
+            default:
+                LOG_ERROR_RETURN(EINVAL, -1, "unknown record type ", type, " at offset ", offset);
+        }
+        pos += size;
+        offset += size;
+    }
+    if (pos != data.size())
+        LOG_ERROR_RETURN(EINVAL, -1, "truncated binary log at offset ", offset);
+    return lines;
+}
@@ -51,6 +51,8 @@ DEFINE_ALOG_COLOR(00, ALOG_COLOR_NOTHING);
 #undef DEFINE_ALOG_COLOR
 
 
+struct iovec;
+
 class ILogOutput {
 protected:
     // output object should be destructed via `destruct()`
@@ -64,6 +66,14 @@ public:
     virtual uint64_t get_throttle() = 0;
     virtual void destruct() = 0;
     virtual int set_level_color(int level, unsigned char code) { return 0; /* ignored by default */ }
+    // (new virtual functions go after all the existing ones, to keep the
+    // vtable layout of outputs built against older versions of this header)
+    // binary outputs receive compact records (see ALogRecord) from LOG_*,
+    // instead of formatted text, and format them lazily by themselves
+    virtual bool binary() { return false; }
+    virtual void write_record(const char* begin, const char* end) { }
+    // write a batch of lines, write() each of them by default
+    virtual void writev(int level, const struct iovec* iov, int iovcnt);
     void preset_color();
     void clear_color();
 };
@@ -75,7 +85,52 @@ extern ILogOutput * const log_output_stdout;
 ILogOutput* new_log_output_file(const char* fn, uint64_t rotate_limit = UINT64_MAX, int max_log_files = 10,
                                 uint64_t throttle = -1UL, bool rotate_on_start = false);
 ILogOutput* new_log_output_file(int fd, uint64_t throttle = -1UL);
+// what to do when a queue of an async log output is full
+enum {
+    ALOG_OVERFLOW_DROP,     // drop the line
+    ALOG_OVERFLOW_BLOCK,    // wait for the background thread to catch up
+    ALOG_OVERFLOW_SAMPLE,   // keep only 1 of `sample_rate` lines once the
+                            // queue is 3/4 full, and drop when it is full
+};
+
+struct AsyncLogOptions {
+    int overflow = ALOG_OVERFLOW_DROP;
+    uint32_t sample_rate = 16;
+    uint32_t queue_size = 1024 * 1024;  // bytes, of each queue
+    uint32_t num_of_queues = 1;         // 1 ~ 128, see new_async_log_output()
+};
+
+struct AsyncLogStats {
+    uint64_t lines;         // lines queued
+    uint64_t dropped;       // lines dropped as the queue was full
+    uint64_t sampled;       // lines dropped by sampling
+    uint64_t blocked;       // times of waiting for the background thread
+    uint64_t queues;        // number of queues owned by live OS threads
+};
+
+// async log output: a background thread writes lines from `num_of_queues`
+// queues (of `queue_size` bytes each, allocated in advance) into `output`
+// in batch. The first queue is shared by all OS threads with a spinlock.
+// Each of the others is owned by one OS thread at a time, which logs into
+// it without locking, and gives it up when it exits; threads that log
+// when none of them is free use the shared one.
 ILogOutput* new_async_log_output(ILogOutput* output, int num_of_queues = 1);
+ILogOutput* new_async_log_output(ILogOutput* output, const AsyncLogOptions& opts);
+// get statistics of an async (or binary) log output
+int get_async_log_stats(ILogOutput* output, AsyncLogStats* stats);
+
+// binary log output: LOG_* pushes records of (call site, timestamp, raw
+// arguments) to the queues, and a background thread formats them into text,
+// which is then written to `output`
+ILogOutput* new_binary_log_output(ILogOutput* output, int num_of_queues = 1);
+ILogOutput* new_binary_log_output(ILogOutput* output, const AsyncLogOptions& opts);
+// binary log output that keeps the records binary in file `fn`,
+// to be turned into text offline by decode_binary_log()
+ILogOutput* new_binary_log_output_file(const char* fn, int num_of_queues = 1);
+ILogOutput* new_binary_log_output_file(const char* fn, const AsyncLogOptions& opts);
+// decode a file created by new_binary_log_output_file() into `output`,
+// return the number of log lines, or -1 for failure
+ssize_t decode_binary_log(int fd, ILogOutput* output);
 
 // old-style log_output_file & log_output_file_close
 // return 0 when successed, -1 for failed
@@ -466,9 +521,172 @@ struct STFMTLogBuffer : public LogBuffer
     }
 };
 
+// header of a binary log record, followed by the call site (file, func and
+// fmt, copied rather than pointed to, as the module that logged it may be
+// unloaded before the record is formatted), then `nargs` arguments, each of
+// which is a type byte (ALOG_ARG_*) and the raw value
+struct ALogRecord
+{
+    uint32_t size;          // of the whole record
+    uint8_t level;
+    uint8_t nalt;           // the first `nalt` args are from the `alt` tuple
+    uint16_t nargs;
+    int32_t line;
+    uint16_t len_file;      // 0 for a line of pre-formatted text
+    uint16_t len_func;
+    uint32_t len_fmt;
+    uint64_t ts;            // local time in us
+    const void* thread;
+    size_t site_size() const { return (size_t)len_file + len_func + len_fmt; }
+};
+
+enum : uint8_t {
+    ALOG_ARG_CHAR,
+    ALOG_ARG_INT,
+    ALOG_ARG_UINT,
+    ALOG_ARG_DOUBLE,
+    ALOG_ARG_POINTER,
+    ALOG_ARG_STRING,        // uint32_t length + bytes
+    ALOG_ARG_INTEGER,       // struct ALogInteger
+    ALOG_ARG_FP,            // struct FP
+};
+
+// fill in ts and thread
+void alog_stamp_record(ALogRecord* rec);
+
+template<typename T>
+using alog_arg_type = std::integral_constant<int,
+    std::is_same<T, char>::value                ? ALOG_ARG_CHAR     :
+    std::is_base_of<ALogString, T>::value       ? ALOG_ARG_STRING   :
+    std::is_same<T, bool>::value                ? ALOG_ARG_UINT     :
+    std::is_integral<T>::value                  ?
+        (std::is_signed<T>::value ? ALOG_ARG_INT : ALOG_ARG_UINT)   :
+    std::is_floating_point<T>::value            ? ALOG_ARG_DOUBLE   :
+    std::is_same<T, ALogInteger>::value         ? ALOG_ARG_INTEGER  :
+    std::is_same<T, FP>::value                  ? ALOG_ARG_FP       :
+    (std::is_pointer<T>::value && std::is_object<
+        typename std::remove_pointer<T>::type>::value) ? ALOG_ARG_POINTER :
+    -1 /* other types, enums included as they may have their own operator<<,
+          are formatted eagerly, and stored as string */>;
+
+struct ALogRecordBuffer : public ALogBuffer
+{
+    ALogRecord* rec;
+    ALogRecordBuffer(char* bf, size_t sz, int level, const Prologue& prolog,
+                     const char* fmt, uint32_t fmt_len) {
+        rec = (ALogRecord*)bf;
+        ptr = bf + sizeof(ALogRecord);
+        size = sz - sizeof(ALogRecord) - 2;  // reserved for the trailing '\n'
+        uint16_t len_file = prolog.len_file < 256 ? prolog.len_file : 256;
+        uint16_t len_func = prolog.len_func < 256 ? prolog.len_func : 256;
+        if (fmt_len > size / 2) fmt_len = size / 2;
+        *rec = {0, (uint8_t)level, 0, 0, prolog.line, len_file, len_func,
+                fmt_len, 0, nullptr};
+        put_site(prolog.addr_file, len_file);
+        put_site(prolog.addr_func, len_func);
+        put_site(fmt, fmt_len);
+    }
+    template<typename...Ts>
+    void printf(Ts&&...xs) {
+        int _[] = {0, (put(alog_forwarding(std::forward<Ts>(xs))), 0)...};
+        (void)_;
+    }
+    template<typename Tuple, std::size_t...I>
+    void printf_tuple(const Tuple& x, std::index_sequence<I...>) {
+        printf(std::get<I>(x)...);
+    }
+    void finish() {
+        size += 2;
+        put_raw(ALOG_ARG_CHAR, "\n", 1);
+        rec->size = ptr - (char*)rec;
+    }
+
+protected:
+    void put_site(const char* s, size_t n) {
+        memcpy(ptr, s, n);
+        consume(n);
+    }
+    void put_raw(uint8_t type, const void* x, size_t n) {
+        if (size < n + 1) return;
+        *ptr = type;
+        memcpy(ptr + 1, x, n);
+        consume(n + 1);
+        rec->nargs++;
+    }
+    void put_string(const char* s, uint32_t n) {
+        if (size < 5) return;
+        if (n > size - 5) n = size - 5;
+        *ptr = ALOG_ARG_STRING;
+        memcpy(ptr + 1, &n, 4);
+        if (s != ptr + 5) memcpy(ptr + 5, s, n);
+        consume(n + 5);
+        rec->nargs++;
+    }
+    template<typename T>
+    void put(const T& x) {
+        put(x, alog_arg_type<typename std::decay<T>::type>());
+    }
+    template<typename T, int I>
+    void put(const T& x, std::integral_constant<int, I>) {
+        put_raw(I, &x, sizeof(x));
+    }
+    template<typename T>
+    void put(const T& x, std::integral_constant<int, ALOG_ARG_INT>) {
+        int64_t v = (int64_t)x;
+        put_raw(ALOG_ARG_INT, &v, sizeof(v));
+    }
+    template<typename T>
+    void put(const T& x, std::integral_constant<int, ALOG_ARG_UINT>) {
+        uint64_t v = (uint64_t)x;
+        put_raw(ALOG_ARG_UINT, &v, sizeof(v));
+    }
+    template<typename T>
+    void put(const T& x, std::integral_constant<int, ALOG_ARG_DOUBLE>) {
+        double v = x;
+        put_raw(ALOG_ARG_DOUBLE, &v, sizeof(v));
+    }
+    template<typename T>
+    void put(const T& x, std::integral_constant<int, ALOG_ARG_POINTER>) {
+        uint64_t v = (uint64_t)x;
+        put_raw(ALOG_ARG_POINTER, &v, sizeof(v));
+    }
+    template<typename T>
+    void put(const T& x, std::integral_constant<int, ALOG_ARG_STRING>) {
+        put_string(x.s, x.size);
+    }
+    template<typename T>
+    void put(const T& x, std::integral_constant<int, -1>);
+};
+
+// formatted at the call site, as LogBuffer may have user-defined operator<<
+template<typename T>
+void ALogRecordBuffer::put(const T& x, std::integral_constant<int, -1>) {
+    if (size < 5) return;
+    LogBuffer log(ptr + 5, size - 5 + 2, log_output_null);
+    log.level = 0;
+    log.printf(x);
+    put_string(ptr + 5, log.ptr - (ptr + 5));
+}
+
+template<typename...Ps, typename FMT, typename...Ts>
+__attribute__((noinline))
+void __log_record__(int level, ILogOutput* output, const Prologue& prolog,
+                    const std::tuple<Ps...>& alt, FMT, Ts&&...xs) {
+    char buf[LOG_BUFFER_SIZE];
+    ALogRecordBuffer rec(buf, sizeof(buf), level, prolog, FMT::chars, FMT::len);
+    rec.printf_tuple(alt, std::make_index_sequence<sizeof...(Ps)>{});
+    rec.rec->nalt = rec.rec->nargs;
+    rec.printf(std::forward<Ts>(xs)...);
+    rec.finish();
+    alog_stamp_record(rec.rec);
+    output->write_record(buf, rec.ptr);
+}
+
 template<typename...Ps, typename FMT, typename...Ts> inline __INLINE__
 void __log__(int level, ILogOutput* output, const Prologue& prolog,
                        const std::tuple<Ps...>& alt, FMT fmt, Ts&&...xs) {
+    if (unlikely(output->binary()))
+        return __log_record__(level, output, prolog, alt, fmt, std::forward<Ts>(xs)...);
     char buf[LOG_BUFFER_SIZE];
     STFMTLogBuffer log(buf, sizeof(buf), output);
     log << prolog << alt;
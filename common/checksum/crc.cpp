@@ -121,13 +121,40 @@ uint64_t crc64ecma_sw(const uint8_t *buffer, size_t nbytes, uint64_t crc) {
     return ~calc(buffer, nbytes, ~crc);
 }
 
+// copy a block small enough to stay in L1, then checksum it from there
+template<typename T, typename F> inline
+T copy_then_crc(void* dst, const void* src, size_t nbytes, T crc, F calc) {
+    const size_t BLOCK = 4096;
+    auto d = (uint8_t*)dst;
+    auto s = (const uint8_t*)src;
+    while (nbytes) {
+        auto n = std::min(nbytes, BLOCK);
+        memcpy(d, s, n);
+        crc = calc(d, n, crc);
+        d += n; s += n; nbytes -= n;
+    }
+    return crc;
+}
+
+uint32_t crc32c_copy_sw(void* dst, const void* src, size_t nbytes, uint32_t crc) {
+    return copy_then_crc(dst, src, nbytes, crc, &crc32c_sw);
+}
+
+uint64_t crc64ecma_copy_sw(void* dst, const void* src, size_t nbytes, uint64_t crc) {
+    return copy_then_crc(dst, src, nbytes, crc, &crc64ecma_sw);
+}
+
 uint64_t crc64ecma_hw_sse128(const uint8_t *buf, size_t len, uint64_t crc);
 uint64_t crc64ecma_hw_avx512(const uint8_t *buf, size_t len, uint64_t crc);
+uint64_t crc64ecma_copy_hw_sse128(void* dst, const void* src, size_t nbytes, uint64_t crc);
+uint64_t crc64ecma_copy_hw_avx512(void* dst, const void* src, size_t nbytes, uint64_t crc);
 uint32_t (*crc32c_auto)(const uint8_t*, size_t, uint32_t) = nullptr;
+uint32_t (*crc32c_copy_auto)(void* dst, const void* src, size_t nbytes, uint32_t crc);
 uint32_t (*crc32c_combine_auto)(uint32_t crc1, uint32_t crc2, uint32_t len2);
 uint32_t (*crc32c_combine_series_auto)(uint32_t* crc, uint32_t part_size, uint32_t n_parts);
 void (*crc32c_series_auto)(const uint8_t *buffer, uint32_t part_size, uint32_t n_parts, uint32_t* crc_parts);
 uint64_t (*crc64ecma_auto)(const uint8_t *data, size_t nbytes, uint64_t crc);
+uint64_t (*crc64ecma_copy_auto)(void* dst, const void* src, size_t nbytes, uint64_t crc);
 uint64_t (*crc64ecma_combine_auto)(uint64_t crc1, uint64_t crc2, uint32_t len2);
 uint64_t (*crc64ecma_combine_series_auto)(uint64_t* crc, uint32_t part_size, uint32_t n_parts);
 void (*crc64ecma_series_auto)(const uint8_t *buffer, uint32_t part_size, uint32_t n_parts, uint64_t* crc_parts);
@@ -136,9 +163,9 @@ uint64_t (*crc64ecma_trim_auto)(CRC64ECMA_Component all, CRC64ECMA_Component pre
 
 __attribute__((constructor))
 static void crc_init() {
-    auto tie32 = std::tie(crc32c_auto, crc32c_series_auto, crc32c_combine_auto, crc32c_combine_series_auto, crc32c_trim_auto);
-    auto hw32 = std::make_tuple(crc32c_hw, crc32c_series_hw, crc32c_combine_hw, crc32c_combine_series_hw, crc32c_trim_hw); (void)hw32;
-    auto sw32 = std::make_tuple(crc32c_sw, crc32c_series_sw, crc32c_combine_sw, crc32c_combine_series_sw, crc32c_trim_sw); (void)sw32;
+    auto tie32 = std::tie(crc32c_auto, crc32c_series_auto, crc32c_combine_auto, crc32c_combine_series_auto, crc32c_trim_auto, crc32c_copy_auto);
+    auto hw32 = std::make_tuple(crc32c_hw, crc32c_series_hw, crc32c_combine_hw, crc32c_combine_series_hw, crc32c_trim_hw, crc32c_copy_hw); (void)hw32;
+    auto sw32 = std::make_tuple(crc32c_sw, crc32c_series_sw, crc32c_combine_sw, crc32c_combine_series_sw, crc32c_trim_sw, crc32c_copy_sw); (void)sw32;
 #if defined(__x86_64__)
     __builtin_cpu_init();
     tie32       = __builtin_cpu_supports("sse4.2") ? hw32 : sw32;
@@ -146,25 +173,31 @@ static void crc_init() {
                   __builtin_cpu_supports("avx512dq") &&
                   __builtin_cpu_supports("avx512vl") &&
                   __builtin_cpu_supports("vpclmulqdq");
+    auto pclmul = __builtin_cpu_supports("sse") &&
+                  __builtin_cpu_supports("pclmul");
     crc64ecma_auto = avx512 ? crc64ecma_hw_avx512 :
-                 (__builtin_cpu_supports("sse") &&
-                  __builtin_cpu_supports("pclmul")) ?
-                        crc64ecma_hw_sse128 : crc64ecma_sw;
+                     pclmul ? crc64ecma_hw_sse128 : crc64ecma_sw;
+    crc64ecma_copy_auto = avx512 ? crc64ecma_copy_hw_avx512 :
+                          pclmul ? crc64ecma_copy_hw_sse128 : crc64ecma_copy_sw;
 #elif defined(__aarch64__)
 #ifdef __APPLE__  // apple silicon has hw for both crc
     tie32 = hw32;
     crc64ecma_auto = crc64ecma_hw_sse128;
+    crc64ecma_copy_auto = crc64ecma_copy_hw_sse128;
 #elif defined(__linux__)  // linux on arm: runtime detection
     long hwcaps= getauxval(AT_HWCAP);
     tie32 = (hwcaps & HWCAP_CRC32) ? hw32 : sw32;
     crc64ecma_auto = (hwcaps & HWCAP_PMULL) ? crc64ecma_hw_sse128 : crc64ecma_sw;
+    crc64ecma_copy_auto = (hwcaps & HWCAP_PMULL) ? crc64ecma_copy_hw_sse128 : crc64ecma_copy_sw;
 #else
     tie32 = sw32;
     crc64ecma_auto = crc64ecma_sw;
+    crc64ecma_copy_auto = crc64ecma_copy_sw;
 #endif
 #else // not __aarch64__, not __x86_64__
     tie32 = sw32;
     crc64ecma_auto = crc64ecma_sw;
+    crc64ecma_copy_auto = crc64ecma_copy_sw;
 #endif
     crc64ecma_combine_auto = (crc64ecma_auto == crc64ecma_sw) ?
                               crc64ecma_combine_sw :
@@ -185,6 +218,8 @@ static void crc_init() {
 #else // __GNUC__
 #pragma GCC push_options
 #pragma GCC target ("crc32,sse4.1,pclmul")
+// the load policies are always inlined, including those of 512-bit vectors
+#pragma GCC diagnostic ignored "-Wpsabi"
 #pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
 #pragma GCC diagnostic ignored "-Wuninitialized"
 #pragma GCC diagnostic ignored "-Winit-self"
@@ -233,6 +268,50 @@ inline __attribute__((always_inline)) uint32_t crc32c(uint32_t crc, uint64_t dat
 #error "Unsupported architecture"
 #endif
 
+// =============================================================================
+// Load policies
+// =============================================================================
+
+// The kernels below read their input through a load policy. PlainLoad only
+// reads, while CopyLoad also stores every word it reads to the destination,
+// fusing a memcpy() into the checksum pass. Bytes that the kernels read in
+// other ways (e.g. the head and tail) are passed to copy().
+struct PlainLoad {
+    template<typename T> inline __attribute__((always_inline))
+    T operator()(const T* p) const {
+        T x;
+        memcpy(&x, p, sizeof(x));
+        return x;
+    }
+    void copy(const void* p, size_t n) const { }
+    inline __attribute__((always_inline))
+    void prefetch(const void* p) const { __builtin_prefetch(p, 0, 0); }
+};
+
+struct CopyLoad {
+    uintptr_t delta;    // dst - src
+    template<typename T> inline __attribute__((always_inline))
+    T operator()(const T* p) const {
+        T x;
+        memcpy(&x, p, sizeof(x));
+        memcpy((void*)((uintptr_t)p + delta), &x, sizeof(x));
+        return x;
+    }
+    inline __attribute__((always_inline))
+    void copy(const void* p, size_t n) const {
+        memcpy((void*)((uintptr_t)p + delta), p, n);
+    }
+    inline __attribute__((always_inline))
+    void prefetch(const void* p) const {
+        __builtin_prefetch(p, 0, 0);
+        __builtin_prefetch((void*)((uintptr_t)p + delta), 1, 0);
+    }
+};
+
+inline CopyLoad copy_load(void* dst, const void* src) {
+    return {(uintptr_t)dst - (uintptr_t)src};
+}
+
 // =============================================================================
 // SIMD helpers
 // =============================================================================
@@ -263,12 +342,12 @@ inline __attribute__((always_inline)) v128 load_small(const void* data, size_t n
     return _mm_loadu_si128((const v128*)vals);
 }
 
-template<size_t blksz, typename T> inline __attribute__((always_inline))
-void crc32c_hw_block(const uint8_t*& data, size_t& nbytes, uint32_t& crc) {
+template<size_t blksz, typename T, typename L> inline __attribute__((always_inline))
+void crc32c_hw_block(const uint8_t*& data, size_t& nbytes, uint32_t& crc, const L& load) {
     if (nbytes & blksz) {
-        static_loop<0, blksz - sizeof(T), sizeof(T)>([&](size_t i) {
-            crc = crc32c(crc, *(T*)(data + i));
-        });
+        #pragma GCC unroll 16
+        for (size_t i = 0; i < blksz; i += sizeof(T))
+            crc = crc32c(crc, load((const T*)(data + i)));
         nbytes -= blksz;
         data += blksz;
     }
@@ -282,16 +361,17 @@ void crc32c_hw_tiny(uint64_t d, size_t nbytes, uint32_t& crc) {
     if (nbytes & 4) { crc = crc32c(crc, (uint32_t)d); }
 }
 
-inline __attribute__((always_inline))
-void crc32c_hw_small(const uint8_t*& data, size_t nbytes, uint32_t& crc) {
+template<typename L> inline __attribute__((always_inline))
+void crc32c_hw_small(const uint8_t*& data, size_t nbytes, uint32_t& crc, const L& load) {
     assert(nbytes < 256);
     if (unlikely(!nbytes || !data)) return;
-    crc32c_hw_block<128, uint64_t>(data, nbytes, crc);
-    crc32c_hw_block<64,  uint64_t>(data, nbytes, crc);
-    crc32c_hw_block<32,  uint64_t>(data, nbytes, crc);
-    crc32c_hw_block<16,  uint64_t>(data, nbytes, crc);
-    crc32c_hw_block<8,   uint64_t>(data, nbytes, crc);
+    crc32c_hw_block<128, uint64_t>(data, nbytes, crc, load);
+    crc32c_hw_block<64,  uint64_t>(data, nbytes, crc, load);
+    crc32c_hw_block<32,  uint64_t>(data, nbytes, crc, load);
+    crc32c_hw_block<16,  uint64_t>(data, nbytes, crc, load);
+    crc32c_hw_block<8,   uint64_t>(data, nbytes, crc, load);
     if (unlikely(nbytes)) {
+        load.copy(data, nbytes);
         auto x = 8 - nbytes; // buffer size >= 8
         auto d = *(uint64_t*)(data - x);
         d >>= x * 8;
@@ -300,23 +380,24 @@ void crc32c_hw_small(const uint8_t*& data, size_t nbytes, uint32_t& crc) {
     }
 }
 
-template<uint16_t blksz> inline __attribute__((always_inline))
-bool crc32c_3way_ILP(const uint8_t*& data, size_t& nbytes, uint32_t& crc) {
+template<uint16_t blksz, typename L> inline __attribute__((always_inline))
+bool crc32c_3way_ILP(const uint8_t*& data, size_t& nbytes, uint32_t& crc, const L& load) {
     static_assert((blksz & (blksz - 1)) == 0, "blksz must be 2^n");
     static_assert(blksz >= 32, "blksz must be >= 32");
     if (nbytes < blksz * 3) return false;
     auto ptr = (const uint64_t*)data;
     const size_t blksz_8 = blksz / 8;
     uint32_t crc1 = 0, crc2 = 0;
-    static_loop<0, blksz_8 - 2, 1>([&](size_t i) {
+    #pragma GCC unroll 64
+    for (size_t i = 0; i < blksz_8 - 1; i++) {
         if (i < blksz_8 * 3 / 4)
-            __builtin_prefetch(data + blksz*3 + i*8*4, 0, 0);
-        crc  = crc32c(crc,  ptr[i]);
-        crc1 = crc32c(crc1, ptr[i + blksz_8]);
-        crc2 = crc32c(crc2, ptr[i + blksz_8 * 2]);
-    });
-    crc = crc32c(crc, ptr[blksz_8 - 1]);
-    crc1 = crc32c(crc1, ptr[blksz_8 * 2 - 1]);
+            load.prefetch(data + blksz*3 + i*8*4);
+        crc  = crc32c(crc,  load(ptr + i));
+        crc1 = crc32c(crc1, load(ptr + i + blksz_8));
+        crc2 = crc32c(crc2, load(ptr + i + blksz_8 * 2));
+    }
+    crc = crc32c(crc, load(ptr + blksz_8 - 1));
+    crc1 = crc32c(crc1, load(ptr + blksz_8 * 2 - 1));
     // crc2 = crc32c(crc2, ptr[blksz_8 * 3 - 1]);
 
     auto ki = __builtin_ctz(blksz) - 4;
@@ -325,7 +406,7 @@ bool crc32c_3way_ILP(const uint8_t*& data, size_t& nbytes, uint32_t& crc) {
                             crc32c_lshift_table_hw[ki]);
     auto t = _mm_clmulepi64_si128(a, b, 0x00) ^
              _mm_clmulepi64_si128(a, b, 0x11);
-    crc = crc32c(crc2, ptr[blksz_8 * 3 - 1] ^ (uint64_t&)t);
+    crc = crc32c(crc2, load(ptr + blksz_8 * 3 - 1) ^ (uint64_t&)t);
     data += blksz * 3;
     nbytes -= blksz * 3;
     return true;
@@ -336,27 +417,34 @@ bool crc32c_3way_ILP(const uint8_t*& data, size_t& nbytes, uint32_t& crc) {
 // latter one for both small and big data blocks. And it is
 // event faster than the ARMv8 counterpart in ISA-L, i.e.
 // crc32_iscsi_crc_ext().
-uint32_t crc32c_hw_portable(const uint8_t *data, size_t nbytes, uint32_t crc) {
+template<typename L> inline __attribute__((always_inline))
+uint32_t crc32c_hw_portable(const uint8_t *data, size_t nbytes, uint32_t crc, const L& load) {
     if (unlikely(!nbytes)) return crc;
     if (unlikely(nbytes < 8)) {
+        load.copy(data, nbytes);
         while(nbytes--)
             crc = crc32c(crc, *data++);
         return crc;
     }
     uint8_t l = (~((uint64_t)data) + 1) & 7;
     if (unlikely(l)) {
+        load.copy(data, l);
         auto d = *(uint64_t*)data; // nbytes >= 8
         data += l; nbytes -= l;
         crc32c_hw_tiny(d, l, crc);
     }
-    while(crc32c_3way_ILP<512>(data, nbytes, crc));
-    crc32c_3way_ILP<256>(data, nbytes, crc);
-    crc32c_3way_ILP<128>(data, nbytes, crc);
-    crc32c_3way_ILP<64 >(data, nbytes, crc);
-    crc32c_hw_small(data, nbytes, crc);
+    while(crc32c_3way_ILP<512>(data, nbytes, crc, load));
+    crc32c_3way_ILP<256>(data, nbytes, crc, load);
+    crc32c_3way_ILP<128>(data, nbytes, crc, load);
+    crc32c_3way_ILP<64 >(data, nbytes, crc, load);
+    crc32c_hw_small(data, nbytes, crc, load);
     return crc;
 }
 
+uint32_t crc32c_hw_portable(const uint8_t *data, size_t nbytes, uint32_t crc) {
+    return crc32c_hw_portable(data, nbytes, crc, PlainLoad());
+}
+
 uint32_t crc32c_hw_simple(const uint8_t *data, size_t nbytes, uint32_t crc) {
     auto f1 = [](uint32_t crc, uint8_t x)  { return crc32c(crc, x); };
     auto f8 = [](uint32_t crc, uint64_t x) { return crc32c(crc, x); };
@@ -367,6 +455,10 @@ uint32_t crc32c_hw(const uint8_t *data, size_t nbytes, uint32_t crc) {
     return crc32c_hw_portable(data, nbytes, crc);
 }
 
+uint32_t crc32c_copy_hw(void* dst, const void* src, size_t nbytes, uint32_t crc) {
+    return crc32c_hw_portable((const uint8_t*)src, nbytes, crc, copy_load(dst, src));
+}
+
 // *virtually* pad or remove `len` bytes of trailing 0s
 // to source data, and return resulting crc value
 template<typename T> inline
@@ -544,15 +636,15 @@ inline v128 get_shift_constant(size_t i) {
 #define CRC64_RK_1_2    LOAD_RK64(16)     // shift 256 bytes
 #define CRC64_RK7       LOAD_RK64(20)     // barrett constants
 
-inline __attribute__((always_inline))
-v128 crc64ecma_hw_big_sse(const uint8_t*& data, size_t& nbytes, uint64_t crc) {
+template<typename L> inline __attribute__((always_inline))
+v128 crc64ecma_hw_big_sse(const uint8_t*& data, size_t& nbytes, uint64_t crc, const L& load) {
     v128 xmm[8], rk3 = CRC64_RK3;
     auto& ptr = (const v128*&)data;
-    static_loop<0, 7, 1>([&](size_t i){ xmm[i] = _mm_loadu_si128(ptr+i); });
+    static_loop<0, 7, 1>([&](size_t i){ xmm[i] = load(ptr+i); });
     xmm[0] ^= _mm_cvtsi64_si128(crc); ptr += 8; nbytes -= 128;
     do {
         static_loop<0, 7, 1>([&](size_t i) {
-            xmm[i] = fold(xmm[i], rk3) ^ _mm_loadu_si128(ptr+i);
+            xmm[i] = fold(xmm[i], rk3) ^ load(ptr+i);
         });
         ptr += 8; nbytes -= 128;
     } while (nbytes >= 128);
@@ -569,18 +661,20 @@ inline uint64_t barrett_reduce_64(v128 x) {
     return (x ^ _mm_bslli_si128(y, 8) ^ z)[1];
 }
 
-template<typename F> inline __attribute__((always_inline))
-uint64_t crc64ecma_hw_portable(const uint8_t *data, size_t nbytes, uint64_t crc, F hw_big) {
+template<typename F, typename L> inline __attribute__((always_inline))
+uint64_t crc64ecma_hw_portable(const uint8_t *data, size_t nbytes, uint64_t crc,
+                               F hw_big, const L& load) {
     if (unlikely(!nbytes || !data)) return crc;
     v128 rk1 = CRC64_RK1;
     v128 xmm7 = _mm_cvtsi64_si128(crc);
     auto& ptr = (const v128*&)data;
     if (nbytes >= 256) {
-        xmm7 = hw_big(data, nbytes, crc);
+        xmm7 = hw_big(data, nbytes, crc, load);
     } else if (nbytes >= 16) {
-        xmm7 = xmm7 ^ _mm_loadu_si128(ptr++);
+        xmm7 = xmm7 ^ load(ptr++);
         nbytes -= 16;
     } else /* 0 < nbytes < 16*/ {
+        load.copy(data, nbytes);
         xmm7 = xmm7 ^ load_small(data, nbytes);
         if (nbytes >= 8) {
             auto shf = get_shift_constant(nbytes);
@@ -594,13 +688,14 @@ uint64_t crc64ecma_hw_portable(const uint8_t *data, size_t nbytes, uint64_t crc,
     }
 
     while (nbytes >= 16) {
-        xmm7 = fold(xmm7, rk1) ^ _mm_loadu_si128(ptr++);
+        xmm7 = fold(xmm7, rk1) ^ load(ptr++);
         nbytes -= 16;
     }
 
     if (nbytes) {
         auto p = data + nbytes - 16;
-        auto remainder = _mm_loadu_si128((const v128*)p);
+        // the last 16 bytes, overlapping with those loaded before
+        auto remainder = load((const v128*)p);
         auto xmm0 = get_shift_constant(nbytes);
         auto xmm2 = xmm7;
         xmm7 = _mm_shuffle_epi8(xmm7, xmm0);
@@ -616,8 +711,20 @@ _barrett:
     return barrett_reduce_64(xmm7);
 }
 
+template<typename L> inline __attribute__((always_inline))
+uint64_t crc64ecma_hw_sse128(const uint8_t *buf, size_t len, uint64_t crc, const L& load) {
+    auto big = [](const uint8_t*& data, size_t& nbytes, uint64_t crc, const L& load) {
+        return crc64ecma_hw_big_sse(data, nbytes, crc, load);
+    };
+    return ~crc64ecma_hw_portable(buf, len, ~crc, big, load);
+}
+
 uint64_t crc64ecma_hw_sse128(const uint8_t *buf, size_t len, uint64_t crc) {
-    return ~crc64ecma_hw_portable(buf, len, ~crc, crc64ecma_hw_big_sse);
+    return crc64ecma_hw_sse128(buf, len, crc, PlainLoad());
+}
+
+uint64_t crc64ecma_copy_hw_sse128(void* dst, const void* src, size_t nbytes, uint64_t crc) {
+    return crc64ecma_hw_sse128((const uint8_t*)src, nbytes, crc, copy_load(dst, src));
 }
 
 static uint64_t clmul_modp_crc64ecma_hw(uint64_t crc, uint64_t x) {
@@ -694,37 +801,32 @@ v512 fold512(v512 a, v512 b, v512 c) {
     return   _mm512_ternarylogic_epi64(x, y, c, 0x96);
 };
 
-inline __attribute__((always_inline))
-v512 fold512(v512 a, v512 b, const v512* c) {
-    return fold512(a, b, _mm512_loadu_si512(c));
-}
-
-inline __attribute__((always_inline))
-__m128i crc64ecma_hw_big_avx512(const uint8_t*& data, size_t& nbytes, uint64_t crc) {
+template<typename L> inline __attribute__((always_inline))
+__m128i crc64ecma_hw_big_avx512(const uint8_t*& data, size_t& nbytes, uint64_t crc, const L& load) {
     assert(nbytes >= 256);
     __attribute__((aligned(16)))
     v512 crc0 = {(long)crc};
     auto& ptr = (const v512*&)data;
-    auto zmm0 = _mm512_loadu_si512(ptr++); zmm0 ^= crc0;
-    auto zmm4 = _mm512_loadu_si512(ptr++);
+    auto zmm0 = load(ptr++); zmm0 ^= crc0;
+    auto zmm4 = load(ptr++);
     auto rk3 = _mm512_broadcast_i32x4(CRC64_RK3);
     nbytes -= 128;
     if (nbytes < 384) {
         do { // fold 128 bytes each iteration
-            zmm0 = fold512(zmm0, rk3, ptr++);
-            zmm4 = fold512(zmm4, rk3, ptr++);
+            zmm0 = fold512(zmm0, rk3, load(ptr++));
+            zmm4 = fold512(zmm4, rk3, load(ptr++));
             nbytes -= 128;
         } while (nbytes >= 128);
     } else { // nbytes >= 384
         auto rk_1_2 = _mm512_broadcast_i32x4(CRC64_RK_1_2);
-        auto zmm7   = _mm512_loadu_si512(ptr++);
-        auto zmm8   = _mm512_loadu_si512(ptr++);
+        auto zmm7   = load(ptr++);
+        auto zmm8   = load(ptr++);
         nbytes -= 128;
         do { // fold 256 bytes each iteration
-            zmm0 = fold512(zmm0, rk_1_2, ptr++);
-            zmm4 = fold512(zmm4, rk_1_2, ptr++);
-            zmm7 = fold512(zmm7, rk_1_2, ptr++);
-            zmm8 = fold512(zmm8, rk_1_2, ptr++);
+            zmm0 = fold512(zmm0, rk_1_2, load(ptr++));
+            zmm4 = fold512(zmm4, rk_1_2, load(ptr++));
+            zmm7 = fold512(zmm7, rk_1_2, load(ptr++));
+            zmm8 = fold512(zmm8, rk_1_2, load(ptr++));
             nbytes -= 256;
         } while (nbytes >= 256);
         zmm0 = fold512(zmm0, rk3, zmm7);
@@ -738,8 +840,20 @@ __m128i crc64ecma_hw_big_avx512(const uint8_t*& data, size_t& nbytes, uint64_t c
            _mm256_extracti64x2_epi64(ymm8, 1) ;
 }
 
+template<typename L> inline __attribute__((always_inline))
+uint64_t crc64ecma_hw_avx512(const uint8_t *buf, size_t len, uint64_t crc, const L& load) {
+    auto big = [](const uint8_t*& data, size_t& nbytes, uint64_t crc, const L& load) {
+        return crc64ecma_hw_big_avx512(data, nbytes, crc, load);
+    };
+    return ~crc64ecma_hw_portable(buf, len, ~crc, big, load);
+}
+
 uint64_t crc64ecma_hw_avx512(const uint8_t *buf, size_t len, uint64_t crc) {
-    return ~crc64ecma_hw_portable(buf, len, ~crc, crc64ecma_hw_big_avx512);
+    return crc64ecma_hw_avx512(buf, len, crc, PlainLoad());
+}
+
+uint64_t crc64ecma_copy_hw_avx512(void* dst, const void* src, size_t nbytes, uint64_t crc) {
+    return crc64ecma_hw_avx512((const uint8_t*)src, nbytes, crc, copy_load(dst, src));
 }
 #ifdef __clang__
 #pragma clang attribute pop
@@ -752,6 +866,10 @@ uint64_t crc64ecma_hw(const uint8_t *buffer, size_t nbytes, uint64_t crc) {
     return crc64ecma_auto(buffer, nbytes, crc);
 }
 
+uint64_t crc64ecma_copy_hw(void* dst, const void* src, size_t nbytes, uint64_t crc) {
+    return crc64ecma_copy_auto(dst, src, nbytes, crc);
+}
+
 // Pop the basic SSE/PCLMUL pragma that was pushed at the beginning of this file
 #if defined(__x86_64__)
 #ifdef __clang__
@@ -86,6 +86,15 @@ inline uint32_t crc32c_trim(CRC32C_Component all, CRC32C_Component prefix, CRC32
     return crc32c_trim_auto(all, prefix, suffix);
 }
 
+/// @brief Copy `nbytes` from `src` to `dst` (not overlapping), while extending `crc`
+/// over the data in the same pass, instead of a memcpy() followed by crc32c_extend().
+uint32_t crc32c_copy_sw(void* dst, const void* src, size_t nbytes, uint32_t crc);
+uint32_t crc32c_copy_hw(void* dst, const void* src, size_t nbytes, uint32_t crc);
+inline uint32_t crc32c_copy(void* dst, const void* src, size_t nbytes, uint32_t crc = 0) {
+    extern uint32_t (*crc32c_copy_auto)(void* dst, const void* src, size_t nbytes, uint32_t crc);
+    return crc32c_copy_auto(dst, src, nbytes, crc);
+}
+
 inline bool is_crc32c_hw_available() {
     extern uint32_t (*crc32c_auto)(const uint8_t *data, size_t nbytes, uint32_t crc);
     return crc32c_auto != crc32c_sw;
@@ -37,6 +37,15 @@ inline uint64_t crc64ecma(const void *buffer, size_t nbytes, uint64_t crc) {
     return crc64ecma_extend(buffer, nbytes, crc);
 }
 
+// copy `nbytes` from `src` to `dst` (not overlapping), while extending `crc`
+// over the data in the same pass, see crc32c_copy()
+uint64_t crc64ecma_copy_sw(void* dst, const void* src, size_t nbytes, uint64_t crc);
+uint64_t crc64ecma_copy_hw(void* dst, const void* src, size_t nbytes, uint64_t crc);
+inline uint64_t crc64ecma_copy(void* dst, const void* src, size_t nbytes, uint64_t crc = 0) {
+    extern uint64_t (*crc64ecma_copy_auto)(void* dst, const void* src, size_t nbytes, uint64_t crc);
+    return crc64ecma_copy_auto(dst, src, nbytes, crc);
+}
+
 inline bool is_crc64ecma_hw_available() {
     extern uint64_t (*crc64ecma_auto)(const uint8_t *data, size_t nbytes, uint64_t crc);
     return crc64ecma_auto != crc64ecma_sw;
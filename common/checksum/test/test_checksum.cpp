@@ -307,6 +307,64 @@ TEST(TestChecksum, crc64_combine) {
     test_crc64_combine("sw", crc64ecma_combine_sw, crc64ecma_trim_sw);
 }
 
+template<typename CRC, typename Copy, typename Ref>
+void do_test_copy_crc(const char* name, Copy copy, Ref ref) {
+    static unsigned char src[16 * 1024 + 64], dst[16 * 1024 + 64];
+    for (size_t i = 0; i < sizeof(src); ++i) src[i] = rand();
+    for (size_t n : {0, 1, 7, 15, 16, 63, 64, 100, 255, 256, 511, 512,
+                     1000, 1024, 4095, 4096, 4097, 10000, 16 * 1024}) {
+        for (size_t sa : {0, 1, 7}) for (size_t da : {0, 3, 8}) {
+            memset(dst, 0, sizeof(dst));
+            CRC crc = copy(dst + da, src + sa, n, (CRC)0x12345678);
+            EXPECT_EQ(ref(src + sa, n, (CRC)0x12345678), crc)
+                << name << " n=" << n << " sa=" << sa << " da=" << da;
+            EXPECT_EQ(0, memcmp(dst + da, src + sa, n));
+            // bytes around the destination are untouched
+            for (size_t i = 0; i < da; ++i) EXPECT_EQ(0, dst[i]);
+            EXPECT_EQ(0, dst[da + n]);
+        }
+    }
+}
+
+TEST(TestChecksum, crc32c_copy) {
+    do_test_copy_crc<uint32_t>("crc32c_copy", crc32c_copy, crc32c_sw);
+    do_test_copy_crc<uint32_t>("crc32c_copy_sw", crc32c_copy_sw, crc32c_sw);
+    if (is_crc32c_hw_available())
+        do_test_copy_crc<uint32_t>("crc32c_copy_hw", crc32c_copy_hw, crc32c_sw);
+}
+
+TEST(TestChecksum, crc64ecma_copy) {
+    do_test_copy_crc<uint64_t>("crc64ecma_copy", crc64ecma_copy, crc64ecma_sw);
+    do_test_copy_crc<uint64_t>("crc64ecma_copy_sw", crc64ecma_copy_sw, crc64ecma_sw);
+    if (is_crc64ecma_hw_available())
+        do_test_copy_crc<uint64_t>("crc64ecma_copy_hw", crc64ecma_copy_hw, crc64ecma_sw);
+}
+
+// memcpy() followed by a checksum, compared with the fused copy
+TEST(Perf, copy_crc) {
+    static unsigned char dst[4 * 1024 * 1024];
+    auto copy_crc32c = [](const uint8_t *buffer, size_t nbytes, uint32_t) -> uint32_t {
+        memcpy(dst, buffer, nbytes);
+        return crc32c_extend(dst, nbytes, 0);
+    };
+    auto fused_crc32c = [](const uint8_t *buffer, size_t nbytes, uint32_t) -> uint32_t {
+        return crc32c_copy(dst, buffer, nbytes, 0);
+    };
+    auto copy_crc64 = [](const uint8_t *buffer, size_t nbytes, uint64_t) -> uint64_t {
+        memcpy(dst, buffer, nbytes);
+        return crc64ecma(dst, nbytes, 0);
+    };
+    auto fused_crc64 = [](const uint8_t *buffer, size_t nbytes, uint64_t) -> uint64_t {
+        return crc64ecma_copy(dst, buffer, nbytes, 0);
+    };
+    for (size_t size : {4096UL, 64 * 1024UL, _1MB, sizeof(dst)}) {
+        do_perf_crc("memcpy+crc32c", copy_crc32c, size);
+        do_perf_crc("crc32c_copy", fused_crc32c, size);
+        do_perf_crc("memcpy+crc64ecma", copy_crc64, size);
+        do_perf_crc("crc64ecma_copy", fused_crc64, size);
+    }
+}
+
 TEST(Perf, crc32c_hw_series) {
     const uint32_t PART_SIZE = 4096;
     static uint32_t crc[1024*1024];
@@ -42,20 +42,53 @@ public:
 
     struct CallArg {
         Delegate<void> task;
-        photon::thread *backth;
     };
 
+    // The task runs right away, and the main loop goes on when it blocks
+    // or finishes, so tasks that do not block are performed one after
+    // another by a single pooled thread, rather than piling up threads
+    // beyond the capacity of the pool when the queue is long.
     static void *do_event(void *arg) {
         auto a = (CallArg *)arg;
         auto task = a->task;
-        photon::thread_yield_to(a->backth);
         task();
         return nullptr;
     }
 
+    // a BatchCall is gone as soon as it is finished for the last time
+    static void finish(BatchCall *call) {
+        if (call->remain.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            call->done();
+    }
+
+    static void *batch_worker(void *arg) {
+        auto call = (BatchCall *)arg;
+        auto n = call->n;
+        auto i = call->next.fetch_add(1, std::memory_order_relaxed);
+        while (i < n) {
+            call->task(i);
+            auto j = call->next.fetch_add(1, std::memory_order_relaxed);
+            finish(call);
+            i = j;
+        }
+        return nullptr;
+    }
+
+    // Workers are spawned one at a time, whenever the previous ones have
+    // blocked, so operations that do not block share a single thread,
+    // and those that do are still performed concurrently.
+    static void launch_batch(void *arg) {
+        auto call = (BatchCall *)arg;
+        auto pool = call->e->pool;
+        while (call->next.load(std::memory_order_relaxed) < call->n) {
+            pool->thread_create(&batch_worker, call);
+            photon::thread_yield();
+        }
+        finish(call);
+    }
+
     void main_loop() {
         CallArg arg;
-        arg.backth = photon::CURRENT;
         for (;;) {
             arg.task = queue.recv();
             if (!arg.task) {
@@ -96,6 +129,46 @@ void Executor::_issue(ExecutorImpl *e, Delegate<void> act) {
     e->queue.send<ThreadPause>(act);
 }
 
+void Executor::_issue_batch(ExecutorImpl *e, BatchCall *call) {
+    call->e = e;
+    _issue(e, {&ExecutorImpl::launch_batch, call});
+}
+
+int Executor::FutureStateBase::wait(Timeout timeout) {
+    if (ready()) return 0;
+    if (photon::CURRENT) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (ready()) return 0;
+            m_photon_waiter = true;
+        }
+        while (!ready()) {
+            if (m_sem.wait(1, timeout) < 0 && !ready()) return -1;
+        }
+        return 0;
+    }
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto duration = timeout.std_duration();
+    if (duration == std::chrono::microseconds().max()) {
+        m_cv.wait(lock, [&] { return ready(); });
+    } else if (!m_cv.wait_for(lock, duration, [&] { return ready(); })) {
+        errno = ETIMEDOUT;
+        return -1;
+    }
+    return 0;
+}
+
+void Executor::FutureStateBase::set_ready() {
+    bool photon_waiter;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_ready.store(true, std::memory_order_release);
+        photon_waiter = m_photon_waiter;
+    }
+    m_cv.notify_all();
+    if (photon_waiter) m_sem.signal(1);
+}
+
 Executor *Executor::export_as_executor() {
     auto ret = new Executor(create_on_current_vcpu());
     auto th = photon::thread_create11(&Executor::ExecutorImpl::do_loop, ret->e);
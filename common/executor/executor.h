@@ -16,6 +16,10 @@ limitations under the License.
 
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
+#include <iterator>
+#include <mutex>
 #include <photon/common/callback.h>
 #include <photon/photon.h>
 #include <photon/thread/awaiter.h>
@@ -100,9 +104,107 @@ public:
         _issue(e, {func, task});
     }
 
+    // Performs the operations in [first, last) (callable with no argument)
+    // in the executor, concurrently if they block, with a single submission
+    // and a single wakeup of the caller, when all of them have completed.
+    // Results (and errno) are supposed to be kept by the operations.
+    template <typename Context = AutoContext, typename Iter>
+    void perform_batch(Iter first, Iter last) {
+        auto n = (size_t)std::distance(first, last);
+        if (n == 0) return;
+        Awaiter<Context> aop;
+        auto task = [&](size_t i) {
+            auto it = first;
+            std::advance(it, i);
+            (*it)();
+        };
+        auto done = [&] { aop.resume(); };
+        BatchCall call(task, done, n);
+        _issue_batch(e, &call);
+        aop.suspend();
+    }
+
+    template <typename R>
+    class Future;
+
+    // Performs `act` in the executor, returning a Future of its result.
+    // Unlike perform(), the caller may go on, and wait later, in either a
+    // photon thread or a std::thread, without a photon environment.
+    template <
+        typename Func,
+#if __cplusplus < 201703L
+        typename R = typename std::result_of<Func()>::type>
+#else
+        typename R = typename std::invoke_result<Func>::type>
+#endif
+    Future<R> async_call(Func &&act) {
+        struct Task : FutureState<R> {
+            typename std::decay<Func>::type act;
+            Task(Func &&act) : act(std::forward<Func>(act)) {}
+            static void run(void *task) {
+                auto t = (Task *)task;
+                t->set(t->act);
+                t->release();
+            }
+        };
+        auto task = new Task(std::forward<Func>(act));
+        _issue(e, {&Task::run, task});
+        return Future<R>(task);
+    }
+
     static Executor *export_as_executor();
 
 protected:
+    struct BatchCall {
+        Delegate<void, size_t> task;    // performs the i-th operation
+        Delegate<void> done;            // called once all have completed
+        size_t n;
+        std::atomic<size_t> next{0};
+        std::atomic<size_t> remain;     // operations, and the launcher
+        ExecutorImpl *e = nullptr;
+        BatchCall(Delegate<void, size_t> task, Delegate<void> done, size_t n)
+            : task(task), done(done), n(n), remain(n + 1) {}
+    };
+
+    // the state shared by a Future and its task
+    class FutureStateBase {
+    public:
+        bool ready() const { return m_ready.load(std::memory_order_acquire); }
+        int wait(Timeout timeout);
+        void release() {
+            if (m_refs.fetch_sub(1, std::memory_order_acq_rel) == 1) delete this;
+        }
+        virtual ~FutureStateBase() = default;
+
+    protected:
+        std::atomic<int> m_refs{2};
+        std::atomic<bool> m_ready{false};
+        bool m_photon_waiter = false;
+        int m_errno = 0;
+        std::mutex m_mutex;
+        std::condition_variable m_cv;
+        photon::semaphore m_sem;
+        void set_ready();
+    };
+
+    template <typename R>
+    class FutureState : public FutureStateBase {
+    public:
+        template <typename F>
+        void set(F &f) {
+            value = f();
+            m_errno = errno;
+            set_ready();
+        }
+        R get() {
+            errno = m_errno;
+            return std::move(value);
+        }
+
+    protected:
+        R value{};
+    };
+
     static constexpr int64_t kCondWaitMaxTime = 100L * 1000;
 
     struct create_on_current_vcpu {};
@@ -110,6 +212,66 @@ protected:
     Executor(create_on_current_vcpu);
 
     static void _issue(ExecutorImpl *e, Delegate<void> cb);
+    static void _issue_batch(ExecutorImpl *e, BatchCall *call);
+};
+
+template <>
+class Executor::FutureState<void> : public FutureStateBase {
+public:
+    template <typename F>
+    void set(F &f) {
+        f();
+        m_errno = errno;
+        set_ready();
+    }
+    void get() { errno = m_errno; }
+};
+
+// A handle to the result of Executor::async_call(), like std::future, that
+// may be waited for in either a photon thread or a std::thread.
+template <typename R>
+class Executor::Future {
+public:
+    Future() = default;
+    Future(Future &&rhs) : m_state(rhs.m_state) { rhs.m_state = nullptr; }
+    Future &operator=(Future &&rhs) {
+        if (this != &rhs) {
+            reset();
+            m_state = rhs.m_state;
+            rhs.m_state = nullptr;
+        }
+        return *this;
+    }
+    ~Future() { reset(); }
+
+    bool valid() const { return m_state; }
+    bool ready() const { return m_state && m_state->ready(); }
+
+    // returns 0 when the result is ready, or -1 with errno ETIMEDOUT
+    int wait(Timeout timeout = {}) {
+        assert(m_state);
+        return m_state->wait(timeout);
+    }
+
+    // waits for the result, and takes it, along with the errno of the
+    // operation; the Future is no longer valid() afterwards
+    R get() {
+        assert(m_state);
+        m_state->wait({});
+        auto state = m_state;
+        m_state = nullptr;
+        DEFER(state->release());
+        return state->get();
+    }
+
+protected:
+    friend class Executor;
+    FutureState<R> *m_state = nullptr;
+    explicit Future(FutureState<R> *state) : m_state(state) {}
+    void reset() {
+        if (m_state) m_state->release();
+        m_state = nullptr;
+    }
 };
 
 }  // namespace photon
@@ -23,6 +23,11 @@ limitations under the License.
 #include <photon/common/executor/executor.h>
 #include "../../../test/gtest.h"
 
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+
 using namespace photon;
 
 std::atomic<int> count;
@@ -112,6 +117,99 @@ TEST(std_executor, with_exportfs) {
            10000L * 1000000 / microsec);
 }
 
+TEST(std_executor, perform_batch) {
+    photon::Executor eth;
+    std::vector<std::function<void()>> ops;
+    std::vector<int> results(100, 0);
+    std::atomic<int> in_flight{0}, peak{0};
+    for (int i = 0; i < 100; i++) {
+        ops.emplace_back([&, i] {
+            auto n = ++in_flight;
+            for (int p = peak; n > p && !peak.compare_exchange_weak(p, n); ) { }
+            photon::thread_usleep(1000);    // performed concurrently
+            in_flight--;
+            results[i] = i * 2;
+        });
+    }
+    eth.perform_batch(ops.begin(), ops.end());
+    EXPECT_EQ(0, in_flight);
+    EXPECT_GT(peak, 1);
+    for (int i = 0; i < 100; i++) EXPECT_EQ(i * 2, results[i]);
+    eth.perform_batch(ops.end(), ops.end());
+}
+
+TEST(std_executor, async_call) {
+    photon::Executor eth;
+    auto f = eth.async_call([] {
+        photon::thread_usleep(100 * 1000);
+        errno = EEXIST;
+        return std::string("done");
+    });
+    EXPECT_TRUE(f.valid());
+    EXPECT_FALSE(f.ready());
+    EXPECT_EQ(-1, f.wait(1000));
+    EXPECT_EQ(ETIMEDOUT, errno);
+    EXPECT_EQ("done", f.get());
+    EXPECT_EQ(EEXIST, errno);
+    EXPECT_FALSE(f.valid());
+
+    std::atomic<int> n{0};
+    {   // dropped without waiting
+        auto g = eth.async_call([&] { photon::thread_usleep(10 * 1000); n++; });
+    }
+    auto g = eth.async_call([&] { n++; });
+    g.get();
+    while (n != 2) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    // waited for in a photon thread of another executor
+    photon::Executor eth2;
+    auto ret = eth2.perform([&] {
+        auto h = eth.async_call([] {
+            photon::thread_usleep(10 * 1000);
+            return 42;
+        });
+        return h.get();
+    });
+    EXPECT_EQ(42, ret);
+}
+
+// calls/sec of a trivial operation from 16 std::threads
+TEST(std_executor, perf_calls) {
+    const int nthreads = 16, ncalls = 64 * 320, batch = 64;
+    photon::Executor eth;
+    auto run = [&](const char* name, std::function<void(std::atomic<uint64_t>&)> calls) {
+        std::atomic<uint64_t> done{0};
+        std::vector<std::thread> ths;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < nthreads; i++)
+            ths.emplace_back([&] { calls(done); });
+        for (auto& th : ths) th.join();
+        auto microsec = std::chrono::duration_cast<std::chrono::microseconds>(
+                            std::chrono::steady_clock::now() - start).count();
+        EXPECT_EQ((uint64_t)nthreads * ncalls, done.load());
+        printf("%s: %d threads * %d calls, take %ld us, qps=%ld\n", name,
+               nthreads, ncalls, microsec, nthreads * ncalls * 1000000L / microsec);
+    };
+    run("perform", [&](std::atomic<uint64_t>& done) {
+        for (int j = 0; j < ncalls; j++)
+            eth.perform([&] { done++; });
+    });
+    run("perform_batch", [&](std::atomic<uint64_t>& done) {
+        std::vector<std::function<void()>> ops(batch, [&] { done++; });
+        for (int j = 0; j < ncalls; j += batch)
+            eth.perform_batch(ops.begin(), ops.end());
+    });
+    run("async_call", [&](std::atomic<uint64_t>& done) {
+        std::vector<photon::Executor::Future<void>> fs;
+        for (int j = 0; j < ncalls; j += batch) {
+            for (int k = 0; k < batch; k++)
+                fs.push_back(eth.async_call([&] { done++; }));
+            for (auto& f : fs) f.get();
+            fs.clear();
+        }
+    });
+}
+
 // int astask(Executor::HybridExecutor *eth) {
 //     for (int i = 0; i < 1000; i++) {
 //         auto ret = eth->async_perform([] {
@@ -27,7 +27,10 @@ limitations under the License.
 #include <cstdint>
 #include <tuple>
 #include <type_traits>
+#include <unordered_map>
 #include <unordered_set>
+#include <vector>
+#include <atomic>
 #include <utility>
 
 /**
@@ -216,6 +219,194 @@ public:
     }
 };
 
+// An expire container backed by a coarse hashed timing wheel, for large
+// numbers of items refreshed at high rates. Items are spread over shards by
+// key hash, each with its own lock, index and wheel. Refreshing an item
+// only updates its deadline (O(1), no re-linking); the background timer
+// visits due slots every lifespan/16, evicts items whose deadline passed,
+// and moves the others to the slots of their new deadlines. Items live
+// between `lifespan` and `lifespan` plus one tick.
+template <typename KeyType, typename... Ts>
+class WheelExpireContainer {
+public:
+    constexpr static bool _is_string_key =
+        std::is_base_of<std::string, KeyType>::value ||
+        std::is_base_of<std::string_view, KeyType>::value ||
+        std::is_same<const char*, const KeyType>::value;
+    using ItemKey = typename std::conditional<_is_string_key, std::string,
+                                              KeyType>::type;
+    using InterfaceKey = typename std::conditional<_is_string_key,
+                                              std::string_view, ItemKey>::type;
+
+    class Item : public intrusive_list_node<Item> {
+    public:
+        ItemKey _key;
+        std::tuple<Ts...> payload;
+        std::atomic<uint64_t> _deadline{0};
+        uint32_t _slot = 0;
+
+        template <typename... Gs>
+        Item(const InterfaceKey& key, Gs&&... gs)
+            : _key(key), payload(std::forward<Gs>(gs)...) {}
+
+        template <size_t idx,
+                  typename = typename std::enable_if<(idx > 0)>::type>
+        decltype(auto) get_payload() {
+            return std::get<idx - 1>(payload);
+        }
+        template <size_t idx,
+                  typename = typename std::enable_if<(idx == 0)>::type>
+        InterfaceKey get_payload() {
+            return _key;
+        }
+        const ItemKey& key() { return _key; }
+    };
+
+    explicit WheelExpireContainer(uint64_t lifespan, size_t nshards = 16)
+        : _lifespan(lifespan), _tick(std::max(lifespan / 16, (uint64_t)1000)),
+          _shards(nshards ? nshards : 1),
+          _timer(_tick, {this, &WheelExpireContainer::expire}, true,
+                 8UL * 1024 * 1024) {
+        for (auto& s : _shards) s.tick = photon::now / _tick;
+    }
+
+    ~WheelExpireContainer() {
+        _timer.stop();
+        clear();
+    }
+
+    // returns false if the key exists already
+    template <typename... Gs>
+    bool insert(const InterfaceKey& key, Gs&&... xs) {
+        auto item = new Item(key, std::forward<Gs>(xs)...);
+        auto& s = shard(key);
+        SCOPED_LOCK(s.lock);
+        if (!s.map.emplace(InterfaceKey(item->_key), item).second) {
+            delete item;
+            return false;
+        }
+        link(s, item);
+        return true;
+    }
+
+    // calls `f(Item*)` under the lock of its shard, returns whether found
+    template <typename F>
+    bool find(const InterfaceKey& key, F&& f) {
+        auto& s = shard(key);
+        SCOPED_LOCK(s.lock);
+        auto it = s.map.find(key);
+        if (it == s.map.end()) return false;
+        f(it->second);
+        return true;
+    }
+
+    bool refresh(const InterfaceKey& key) {
+        return find(key, [&](Item* item) { refresh(item); });
+    }
+
+    // the item must be protected from expiring, e.g. inside find()
+    void refresh(Item* item) {
+        item->_deadline.store(photon::now + _lifespan, std::memory_order_relaxed);
+    }
+
+    bool keep_alive(const InterfaceKey& key, bool insert_if_not_exists) {
+        if (refresh(key)) return true;
+        return insert_if_not_exists && (insert(key) || refresh(key));
+    }
+
+    bool erase(const InterfaceKey& key) {
+        Item* item = nullptr;
+        {
+            auto& s = shard(key);
+            SCOPED_LOCK(s.lock);
+            auto it = s.map.find(key);
+            if (it == s.map.end()) return false;
+            item = it->second;
+            s.map.erase(it);
+            s.slots[item->_slot].pop(item);
+        }
+        delete item;
+        return true;
+    }
+
+    // visit the slots due since the last run, usually only one of them
+    uint64_t expire() {
+        auto now = photon::now;
+        auto now_tick = now / _tick;
+        for (auto& s : _shards) {
+            intrusive_list<Item> expired;
+            {
+                SCOPED_LOCK(s.lock);
+                auto n = std::min(now_tick - s.tick, (uint64_t)SLOTS);
+                auto t = s.tick;
+                s.tick = now_tick;
+                while (n--) {
+                    intrusive_list<Item> list;
+                    std::swap(list.node, s.slots[++t % SLOTS].node);
+                    while (auto item = list.pop_front()) {
+                        if (item->_deadline.load(std::memory_order_relaxed) <= now) {
+                            s.map.erase(InterfaceKey(item->_key));
+                            expired.push_back(item);
+                        } else {
+                            link(s, item, false);
+                        }
+                    }
+                }
+            }
+            expired.delete_all();
+        }
+        return 0;
+    }
+
+    void clear() {
+        for (auto& s : _shards) {
+            SCOPED_LOCK(s.lock);
+            s.map.clear();
+            for (auto& x : s.slots) x.delete_all();
+        }
+    }
+
+    size_t size() {
+        size_t n = 0;
+        for (auto& s : _shards) {
+            SCOPED_LOCK(s.lock);
+            n += s.map.size();
+        }
+        return n;
+    }
+    size_t lifespan() { return _lifespan; }
+
+protected:
+    // enough slots for a lifespan, plus the ones of timer lag
+    constexpr static uint64_t SLOTS = 32;
+
+    struct Shard {
+        photon::spinlock lock;
+        uint64_t tick;
+        std::unordered_map<InterfaceKey, Item*> map;
+        intrusive_list<Item> slots[SLOTS];
+        char _padding[64];
+    };
+
+    uint64_t _lifespan;
+    uint64_t _tick;
+    std::vector<Shard> _shards;
+    photon::Timer _timer;
+
+    Shard& shard(const InterfaceKey& key) {
+        return _shards[std::hash<InterfaceKey>()(key) % _shards.size()];
+    }
+
+    // slot by deadline, but never one that was visited already
+    void link(Shard& s, Item* item, bool refresh_deadline = true) {
+        if (refresh_deadline) refresh(item);
+        auto t = item->_deadline.load(std::memory_order_relaxed) / _tick;
+        t = std::min(std::max(t, s.tick + 1), s.tick + SLOTS);
+        item->_slot = t % SLOTS;
+        s.slots[item->_slot].push_back(item);
+    }
+};
+
 class ObjectCacheBase : public ExpireContainerBase {
 protected:
     using Base = ExpireContainerBase;
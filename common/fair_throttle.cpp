@@ -0,0 +1,406 @@
+/*
+Copyright 2022 The Photon Authors
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "fair_throttle.h"
+#include <photon/common/alog.h>
+
+namespace photon {
+
+// rates beyond 1T units per second are treated as the cap, to keep
+// micro-unit arithmetic within 64 bits
+static const uint64_t MAX_RATE = 1UL << 40;
+static const uint64_t MICRO = 1000 * 1000;
+
+void fair_throttle::Bucket::reset(uint64_t rate, uint64_t burst, bool fill) {
+    this->rate = rate;
+    if (unlimited()) {
+        tokens = capacity = 0;
+        return;
+    }
+    capacity = (int64_t)(std::min(rate, MAX_RATE) * burst);
+    if (fill || tokens > capacity) tokens = capacity;
+}
+
+void fair_throttle::Bucket::refill(uint64_t elapsed) {
+    if (unlimited() || rate == 0) return;
+    __int128 t = (__int128)tokens + (__int128)elapsed * std::min(rate, MAX_RATE);
+    tokens = (t > capacity) ? capacity : (int64_t)t;
+}
+
+void fair_throttle::Bucket::charge(uint64_t amount) {
+    if (unlimited()) return;
+    tokens -= (int64_t)(std::min(amount, MAX_RATE) * MICRO);
+}
+
+uint64_t fair_throttle::Bucket::time_to_ready() const {
+    if (ready()) return 0;
+    if (rate == 0) return -1UL;
+    return (uint64_t)(-tokens) / std::min(rate, MAX_RATE) + 1;
+}
+
+fair_throttle::fair_throttle(uint64_t limit, uint64_t reserved, uint64_t burst) :
+    m_burst(burst ? burst : 1), m_last_refill(photon::now) {
+    m_root = new Class(ROOT, nullptr, m_last_refill);
+    m_default = new Class(0, m_root, m_last_refill);
+    m_default->assured.reset(0, m_burst, true);
+    m_default->ceil.reset(-1UL, m_burst, true);
+    m_root->nchildren = 1;
+    m_classes.emplace(0, m_default);
+    update(limit, reserved);
+    m_main.tokens = m_main.capacity;
+    m_reserve.tokens = m_reserve.capacity;
+}
+
+fair_throttle::~fair_throttle() {
+    assert(m_nwaiters == 0);
+    for (auto& x : m_classes) delete x.second;
+    delete m_root;
+}
+
+void fair_throttle::update(uint64_t limit, uint64_t reserved) {
+    SCOPED_LOCK(m_lock);
+    refill();
+    m_limit = limit;
+    if (limit == -1UL) {
+        m_main.reset(-1UL, m_burst, false);
+        m_reserve.reset(0, m_burst, false);
+        return;
+    }
+    if (reserved > limit) reserved = limit;
+    m_main.reset(limit - reserved, m_burst, false);
+    m_reserve.reset(reserved, m_burst, false);
+}
+
+int fair_throttle::set_class(uint32_t id, const ClassLimits& limits, uint32_t parent) {
+    if (id == ROOT)
+        LOG_ERROR_RETURN(EINVAL, -1, "invalid class id `", id);
+    SCOPED_LOCK(m_lock);
+    refill();
+    Class* p = m_root;
+    if (parent != ROOT) {
+        auto it = m_classes.find(parent);
+        if (it == m_classes.end())
+            LOG_ERROR_RETURN(EINVAL, -1, "parent class ` not found", parent);
+        p = it->second;
+    }
+    for (auto x = p; x; x = x->parent)
+        if (x->id == id)
+            LOG_ERROR_RETURN(EINVAL, -1, "class ` can not be attached under itself", id);
+
+    uint32_t weight = limits.weight ? limits.weight : 1;
+    Class* c;
+    auto it = m_classes.find(id);
+    if (it == m_classes.end()) {
+        c = new Class(id, p, m_last_refill);
+        c->limits = limits;
+        c->limits.weight = weight;
+        c->assured.reset(limits.rate, m_burst, true);
+        c->ceil.reset(limits.ceil, m_burst, true);
+        c->vtime = m_vclock;
+        p->nchildren++;
+        m_classes.emplace(id, c);
+        return 0;
+    }
+    c = it->second;
+    refill(c);
+    if (c->parent != p) {
+        if (c->backlog || c->nwaiting)
+            LOG_ERROR_RETURN(EBUSY, -1, "class ` has waiters, can not be moved", id);
+        c->parent->nchildren--;
+        p->nchildren++;
+        c->parent = p;
+    }
+    if (c->backlog)
+        c->parent->active_weight += weight - c->limits.weight;
+    if (!c->waiters.empty())
+        c->active_weight += weight - c->limits.weight;
+    c->limits = limits;
+    c->limits.weight = weight;
+    c->assured.reset(limits.rate, m_burst, false);
+    c->ceil.reset(limits.ceil, m_burst, false);
+    return 0;
+}
+
+int fair_throttle::remove_class(uint32_t id) {
+    SCOPED_LOCK(m_lock);
+    auto it = m_classes.find(id);
+    if (it == m_classes.end())
+        LOG_ERROR_RETURN(ENOENT, -1, "class ` not found", id);
+    auto c = it->second;
+    if (c == m_default)
+        LOG_ERROR_RETURN(EINVAL, -1, "the default class can not be removed");
+    if (c->nchildren || c->nwaiting)
+        LOG_ERROR_RETURN(EBUSY, -1, "class ` still has children or waiters", id);
+    c->parent->nchildren--;
+    m_classes.erase(it);
+    delete c;
+    return 0;
+}
+
+int fair_throttle::get_stats(uint32_t id, Stats* stats) {
+    SCOPED_LOCK(m_lock);
+    auto it = m_classes.find(id);
+    if (it == m_classes.end())
+        LOG_ERROR_RETURN(ENOENT, -1, "class ` not found", id);
+    *stats = it->second->stats;
+    return 0;
+}
+
+fair_throttle::Class* fair_throttle::get_class(uint32_t id) {
+    auto it = m_classes.find(id);
+    return (it == m_classes.end()) ? m_default : it->second;
+}
+
+// Only the root buckets are refilled here, and a class is brought up to
+// date when it is touched, so that a dispatch costs O(classes involved)
+// rather than O(all classes). As refilling is capped at the capacity and
+// nothing is charged to a class before it is touched, the result is the
+// same as refilling all of them every time.
+void fair_throttle::refill() {
+    auto now = photon::now;
+    if (now <= m_last_refill) return;
+    auto elapsed = now - m_last_refill;
+    m_last_refill = now;
+    m_main.refill(elapsed);
+    m_reserve.refill(elapsed);
+}
+
+void fair_throttle::refill(Class* c) {
+    if (c->last_refill >= m_last_refill) return;
+    auto elapsed = m_last_refill - c->last_refill;
+    c->last_refill = m_last_refill;
+    c->assured.refill(elapsed);
+    c->ceil.refill(elapsed);
+}
+
+bool fair_throttle::root_ready(Priority prio) {
+    if (m_main.ready()) return true;
+    if (m_reserve.rate == 0) return false;
+    if (prio == Priority::High) return m_reserve.ready();
+    // normal requests only borrow the reserve when it is idle enough
+    return m_high.empty() && m_reserve.tokens > m_reserve.capacity / 2;
+}
+
+void fair_throttle::charge_root(Priority prio, uint64_t amount) {
+    if (prio == Priority::High) {
+        (m_reserve.ready() ? m_reserve : m_main).charge(amount);
+    } else if (m_main.ready()) {
+        m_main.charge(amount);
+    } else {
+        // borrow no more than the idle half of the reserve, and
+        // leave the rest as a debt of the main bucket
+        int64_t micro = std::min(amount, MAX_RATE) * MICRO;
+        int64_t lent = std::min(micro, m_reserve.tokens - m_reserve.capacity / 2);
+        m_reserve.tokens -= lent;
+        m_main.tokens -= micro - lent;
+    }
+}
+
+bool fair_throttle::path_ready(Class* c) {
+    for (; c != m_root; c = c->parent) {
+        refill(c);
+        if (!c->ceil.ready()) return false;
+    }
+    return true;
+}
+
+void fair_throttle::charge_path(Class* c, uint64_t amount, bool green) {
+    if (green) c->assured.charge(amount);
+    c->stats.granted += amount;
+    c->stats.requests++;
+    for (; c != m_root; c = c->parent) {
+        refill(c);
+        c->ceil.charge(amount);
+    }
+}
+
+double fair_throttle::effective_weight(Class* c) const {
+    // its own share within the subtree, then the share of each level
+    double w = (double)c->limits.weight / c->active_weight;
+    for (; c != m_root; c = c->parent)
+        w *= (double)c->limits.weight / c->parent->active_weight;
+    return w;
+}
+
+void fair_throttle::enqueue(Waiter* w) {
+    auto c = w->cls;
+    c->nwaiting++;
+    m_nwaiters++;
+    if (w->prio == Priority::High) {
+        m_high.push_back(w);
+        return;
+    }
+    if (c->waiters.empty()) {
+        c->active_weight += c->limits.weight;
+        if (c->vtime < m_vclock) c->vtime = m_vclock;
+        m_backlog.push_back(c);
+    }
+    c->waiters.push_back(w);
+    for (auto x = c; x; x = x->parent)
+        if (x->backlog++ == 0 && x->parent)
+            x->parent->active_weight += x->limits.weight;
+}
+
+void fair_throttle::dequeue(Waiter* w) {
+    auto c = w->cls;
+    c->nwaiting--;
+    m_nwaiters--;
+    if (m_leader == w) m_leader = nullptr;
+    if (w->prio == Priority::High) {
+        m_high.pop(w);
+        return;
+    }
+    c->waiters.pop(w);
+    if (c->waiters.empty()) {
+        c->active_weight -= c->limits.weight;
+        m_backlog.pop(c);
+    }
+    for (auto x = c; x; x = x->parent)
+        if (--x->backlog == 0 && x->parent)
+            x->parent->active_weight -= x->limits.weight;
+}
+
+void fair_throttle::grant(Waiter* w, bool green) {
+    dequeue(w);
+    charge_root(w->prio, w->amount);
+    charge_path(w->cls, w->amount, green);
+    w->granted = true;
+    if (w->th != CURRENT)
+        thread_interrupt(w->th, 0);
+}
+
+void fair_throttle::dispatch() {
+    refill();
+    // latency-sensitive requests come first, in FIFO order
+    while (!m_high.empty() && root_ready(Priority::High)) {
+        auto w = m_high.front();
+        refill(w->cls);
+        grant(w, w->cls->assured.ready());
+    }
+    // then the assured rates of the classes
+    for (bool progress = true; progress && !m_backlog.empty() &&
+                               root_ready(Priority::Normal); ) {
+        progress = false;
+        m_scan.clear();
+        for (auto c : m_backlog) m_scan.push_back(c);
+        for (auto c : m_scan) {
+            if (!root_ready(Priority::Normal)) break;
+            if (!path_ready(c) || !c->assured.ready()) continue;
+            grant(c->waiters.front(), true);
+            progress = true;
+        }
+    }
+    // and then spare capacity, lent by effective weights
+    while (!m_backlog.empty() && root_ready(Priority::Normal)) {
+        Class* best = nullptr;
+        for (auto c : m_backlog)
+            if (path_ready(c) && (!best || c->vtime < best->vtime)) best = c;
+        if (!best) break;
+        auto w = best->waiters.front();
+        m_vclock = best->vtime;
+        best->vtime += w->amount / effective_weight(best);
+        grant(w, false);
+    }
+    if (!m_leader) wake_leader();
+}
+
+uint64_t fair_throttle::next_wakeup() {
+    uint64_t t = -1UL;
+    if (!m_high.empty())
+        t = std::min(m_main.time_to_ready(), m_reserve.time_to_ready());
+    auto root = m_main.time_to_ready();
+    for (auto c : m_backlog) {
+        auto x = root;
+        for (auto p = c; p != m_root; p = p->parent) {
+            refill(p);
+            x = std::max(x, p->ceil.time_to_ready());
+        }
+        t = std::min(t, x);
+    }
+    return std::max(t, 1UL);
+}
+
+void fair_throttle::wake_leader() {
+    Waiter* w = m_high.front();
+    if (!w && !m_backlog.empty())
+        w = m_backlog.front()->waiters.front();
+    if (!w) return;
+    m_leader = w;
+    if (w->th != CURRENT)
+        thread_interrupt(w->th, 0);
+}
+
+int fair_throttle::try_consume(uint32_t id, uint64_t amount, Priority prio) {
+    SCOPED_LOCK(m_lock);
+    auto c = get_class(id);
+    refill();
+    refill(c);
+    bool ready = (prio == Priority::High) ? m_high.empty() :
+                 (m_nwaiters == 0 && path_ready(c));
+    if (!ready || !root_ready(prio)) {
+        errno = EAGAIN;
+        return -1;
+    }
+    charge_root(prio, amount);
+    charge_path(c, amount, c->assured.ready());
+    return 0;
+}
+
+int fair_throttle::consume(uint32_t id, uint64_t amount, Priority prio, Timeout timeout) {
+    if (amount == 0) return 0;
+    if (try_consume(id, amount, prio) == 0) return 0;
+
+    m_lock.lock();
+    Waiter w(get_class(id), amount, prio);
+    enqueue(&w);
+    dispatch();
+    auto start = photon::now;
+    bool waited = !w.granted;
+    while (!w.granted) {
+        if (timeout.expired()) {
+            dequeue(&w);
+            if (!m_leader) wake_leader();
+            m_lock.unlock();
+            errno = ETIMEDOUT;
+            return -1;
+        }
+        if (!m_leader) m_leader = &w;
+        uint64_t t = timeout.timeout();
+        if (m_leader == &w) t = std::min(t, next_wakeup());
+        // the lock is released only after CURRENT is asleep, so
+        // that a grant (and its interrupt) can not be missed
+        int ret = thread_usleep_defer(t, {&m_lock, &spinlock::unlock});
+        int err = errno;
+        m_lock.lock();
+        if (w.granted) break;
+        if (ret < 0 && err != 0) {
+            dequeue(&w);
+            if (!m_leader) wake_leader();
+            m_lock.unlock();
+            errno = err;
+            return -1;
+        }
+        dispatch();
+    }
+    if (waited) {
+        w.cls->stats.waited++;
+        w.cls->stats.wait_time += photon::now - start;
+    }
+    m_lock.unlock();
+    return 0;
+}
+
+}  // namespace photon
@@ -0,0 +1,180 @@
+/*
+Copyright 2022 The Photon Authors
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+#include <photon/common/timeout.h>
+#include <photon/common/utility.h>
+#include <photon/thread/thread.h>
+#include <photon/common/intrusive_list.h>
+
+namespace photon {
+
+/**
+ * A hierarchical, work-conserving throttle shared by many tenants.
+ *
+ * The root enforces the device limit (units per second, e.g. bytes or IOs).
+ * Tenants are classes in a tree below the root, addressed by a 32-bit id:
+ *   - `rate` is the assured capacity of a class, served before anything is lent;
+ *   - `ceil` caps a class (and everything below it), including borrowed capacity;
+ *   - `weight` decides how spare capacity is split among backlogged siblings.
+ * Capacity that idle classes do not use is lent to busy ones, in proportion to
+ * their weights, level by level (start-time fair queuing on effective weights).
+ *
+ * A part of the device limit may be reserved for Priority::High requests
+ * (latency-sensitive reads). Normal requests only borrow the reserve while it
+ * is more than half full, so high priority requests always find some of it.
+ *
+ * Requests are charged in full when granted and buckets may go into debt, so
+ * a single request larger than a bucket is never starved.
+ *
+ * Class 0 always exists (directly below the root), and requests of unknown
+ * classes are charged to it. Rate, ceil and weight of an inner class apply to
+ * its whole subtree; the `rate` of an inner class is not enforced separately.
+ *
+ * The throttle may be shared by photon threads running on different vCPUs.
+ */
+class fair_throttle {
+public:
+    enum class Priority {
+        High,       // latency-sensitive, may use the reserved capacity
+        Normal,
+    };
+
+    struct ClassLimits {
+        uint64_t rate = 0;          // assured units per second
+        uint64_t ceil = -1UL;       // at most units per second, -1UL means no limit
+        uint32_t weight = 1;        // share of spare capacity, minimally 1
+    };
+
+    struct Stats {
+        uint64_t granted = 0;       // units granted
+        uint64_t requests = 0;      // requests granted
+        uint64_t waited = 0;        // requests that had to wait
+        uint64_t wait_time = 0;     // total time waited, in us
+    };
+
+    static const uint32_t ROOT = -1U;
+
+    /**
+     * @param limit device limit in units per second, -1UL means no limit
+     * @param reserved part of `limit` kept for Priority::High requests
+     * @param burst time (in us) of capacity a bucket may accumulate while idle
+     */
+    explicit fair_throttle(uint64_t limit, uint64_t reserved = 0,
+                           uint64_t burst = 10 * 1000);
+    fair_throttle(const fair_throttle&) = delete;
+    fair_throttle& operator=(const fair_throttle&) = delete;
+    ~fair_throttle();
+
+    void update(uint64_t limit, uint64_t reserved = 0);
+
+    // create or modify class `id`, attached to `parent`
+    // returns -1 with errno EINVAL for an invalid id or parent (or a parent
+    // that is a descendant of `id`)
+    int set_class(uint32_t id, const ClassLimits& limits, uint32_t parent = ROOT);
+
+    // returns -1 with errno EBUSY if the class still has children or waiters
+    int remove_class(uint32_t id);
+
+    // wait until `amount` units are granted to class `id`
+    // returns 0 on success, -1 with errno ETIMEDOUT on timeout,
+    // or with the errno given by the interrupter
+    int consume(uint32_t id, uint64_t amount, Priority prio = Priority::Normal,
+                Timeout timeout = {});
+
+    // returns 0 if granted immediately, otherwise -1 with errno EAGAIN
+    int try_consume(uint32_t id, uint64_t amount, Priority prio = Priority::Normal);
+
+    int get_stats(uint32_t id, Stats* stats);
+
+    uint64_t limit() const { return m_limit; }
+
+protected:
+    struct Bucket {
+        int64_t tokens = 0;         // in micro-units, negative for debt
+        int64_t capacity = 0;
+        uint64_t rate = 0;          // units per second, -1UL for no limit
+        bool unlimited() const { return rate == -1UL; }
+        bool ready() const { return unlimited() || tokens > 0; }
+        void reset(uint64_t rate, uint64_t burst, bool fill);
+        void refill(uint64_t elapsed);
+        void charge(uint64_t amount);
+        uint64_t time_to_ready() const;
+    };
+
+    struct Class;
+    struct Waiter : public intrusive_list_node<Waiter> {
+        photon::thread* th;
+        uint64_t amount;
+        Class* cls;
+        Priority prio;
+        bool granted = false;
+        Waiter(Class* c, uint64_t amount, Priority prio) :
+            th(CURRENT), amount(amount), cls(c), prio(prio) {}
+    };
+
+    struct Class : public intrusive_list_node<Class> {
+        uint32_t id;
+        Class* parent;
+        ClassLimits limits;
+        Bucket assured, ceil;
+        intrusive_list<Waiter> waiters;     // Priority::Normal only
+        uint64_t nwaiting = 0;              // waiters of any priority
+        uint64_t nchildren = 0;
+        uint64_t backlog = 0;               // Priority::Normal waiters in the subtree
+        uint64_t active_weight = 0;         // of backlogged children, and of itself
+        double vtime = 0;
+        uint64_t last_refill;               // buckets are refilled when touched
+        Stats stats;
+        Class(uint32_t id, Class* parent, uint64_t now) :
+            id(id), parent(parent), last_refill(now) {}
+    };
+
+    photon::spinlock m_lock;
+    uint64_t m_limit;
+    uint64_t m_burst;
+    uint64_t m_last_refill;
+    double m_vclock = 0;
+    Bucket m_main, m_reserve;
+    Class* m_root;
+    Class* m_default;
+    std::unordered_map<uint32_t, Class*> m_classes;
+    intrusive_list<Class> m_backlog;   // classes with waiters of Priority::Normal
+    intrusive_list<Waiter> m_high;     // waiters of Priority::High, FIFO
+    std::vector<Class*> m_scan;
+    Waiter* m_leader = nullptr;        // the waiter that sleeps for the next refill
+    uint64_t m_nwaiters = 0;
+
+    Class* get_class(uint32_t id);
+    void refill();
+    void refill(Class* c);
+    bool root_ready(Priority prio);
+    void charge_root(Priority prio, uint64_t amount);
+    bool path_ready(Class* c);
+    void charge_path(Class* c, uint64_t amount, bool green);
+    double effective_weight(Class* c) const;
+    void enqueue(Waiter* w);
+    void dequeue(Waiter* w);
+    void grant(Waiter* w, bool green);
+    void dispatch();
+    uint64_t next_wakeup();
+    void wake_leader();
+};
+
+}  // namespace photon
@@ -110,6 +110,7 @@ protected:
     }
 };
 
+// see also SlabAllocator in slab-alloc.h, with finer size classes and per-vCPU caches
 template<
     size_t MAX_ALLOCATION_SIZE = 1024 * 1024,
     size_t SLOT_CAPACITY = 32,
@@ -19,6 +19,8 @@ limitations under the License.
 #include "iovector.h"
 #include "utility.h"
 #include "alog.h"
+#include "checksum/crc32c.h"
+#include "checksum/crc64ecma.h"
 
 size_t iovector_view::sum() const
 {
@@ -272,14 +274,20 @@ inline size_t min(size_t a, size_t b, size_t c) {
     return std::min(a, std::min(b, c));
 }
 
-template<typename T, typename P> inline
-size_t _copy_pipe_iov(T&& dest, P&& src, size_t size) {
+struct plain_copy {
+    void operator()(void* dst, const void* src, size_t n) const {
+        memcpy(dst, src, n);
+    }
+};
+
+template<typename T, typename P, typename C = plain_copy> inline
+size_t _copy_pipe_iov(T&& dest, P&& src, size_t size, C copy = {}) {
     auto size0 = size;
     while (size && !dest.empty() && !src.empty()) {
         auto df = dest.front(), sf = src.front();
         size_t stepsize = min(size, df.iov_len, sf.iov_len);
         // LOG_DEBUG("memcpy(", df.iov_base, ", ", sf.iov_base, ", ", stepsize, ")");
-        memcpy(df.iov_base, sf.iov_base, stepsize);
+        copy(df.iov_base, sf.iov_base, stepsize);
         size -= stepsize;
         dest += stepsize;
         src += stepsize;
@@ -291,6 +299,20 @@ size_t iovector_view::memcpy_iov(iovector_view d, iovector_view s, size_t size)
     return _copy_pipe_iov(iov_iterator(d), iov_iterator(s), size);
 }
 
+size_t iovector_view::memcpy_iov_crc(iovector_view d, iovector_view s, size_t size, uint32_t* crc) {
+    return _copy_pipe_iov(iov_iterator(d), iov_iterator(s), size,
+        [crc](void* dst, const void* src, size_t n) {
+            *crc = crc32c_copy(dst, src, n, *crc);
+        });
+}
+
+size_t iovector_view::memcpy_iov_crc(iovector_view d, iovector_view s, size_t size, uint64_t* crc) {
+    return _copy_pipe_iov(iov_iterator(d), iov_iterator(s), size,
+        [crc](void* dst, const void* src, size_t n) {
+            *crc = crc64ecma_copy(dst, src, n, *crc);
+        });
+}
+
 template<typename T>
 struct src_extractor : public T {
     void operator+=(size_t n) {
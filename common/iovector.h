@@ -194,6 +194,28 @@ struct iovector_view
         return memcpy_iov(*this, *iov, size);
     }
 
+    // same as memcpy_to() and memcpy_from(), while extending `*crc` over the
+    // copied data in the same pass; `crc` is a uint32_t* for CRC32C, or a
+    // uint64_t* for CRC64ECMA, see common/checksum/
+    template<typename CRC>
+    size_t memcpy_to_with_crc(void* buf, size_t size, CRC* crc) const {
+        iovec v{buf, size};
+        return memcpy_iov_crc(iovector_view{&v, 1}, *this, size, crc);
+    }
+    template<typename CRC>
+    size_t memcpy_from_with_crc(const void* buf, size_t size, CRC* crc) const {
+        iovec v{(void*)buf, size};
+        return memcpy_iov_crc(*this, iovector_view{&v, 1}, size, crc);
+    }
+    template<typename CRC>
+    size_t memcpy_to_with_crc(const iovector_view* iov, size_t size, CRC* crc) const {
+        return memcpy_iov_crc(*iov, *this, size, crc);
+    }
+    template<typename CRC>
+    size_t memcpy_from_with_crc(const iovector_view* iov, size_t size, CRC* crc) const {
+        return memcpy_iov_crc(*this, *iov, size, crc);
+    }
+
     // copy data to a buffer of `size` bytes, while extracting from *this
     // return # of bytes actually copied (and extracted)
     size_t pipe_to(void* buf, size_t size) {
@@ -223,6 +245,10 @@ protected:
     // return # of bytes actually copied
     static size_t memcpy_iov(iovector_view dest, iovector_view src, size_t size);
 
+    // memcpy_iov() that extends a CRC32C or CRC64ECMA value over the data
+    static size_t memcpy_iov_crc(iovector_view dest, iovector_view src, size_t size, uint32_t* crc32c);
+    static size_t memcpy_iov_crc(iovector_view dest, iovector_view src, size_t size, uint64_t* crc64ecma);
+
     // copy data from one iovector_view to another, while extracting
     // from the source, up to `size` bytes
     // return # of bytes actually copied
@@ -675,6 +701,24 @@ public:
         return memcpy_from(&v, size);
     }
 
+    // see iovector_view::memcpy_to_with_crc()
+    template<typename CRC>
+    size_t memcpy_to_with_crc(void* buf, size_t size, CRC* crc) const {
+        return view().memcpy_to_with_crc(buf, size, crc);
+    }
+    template<typename CRC>
+    size_t memcpy_from_with_crc(const void* buf, size_t size, CRC* crc) const {
+        return view().memcpy_from_with_crc(buf, size, crc);
+    }
+    template<typename CRC>
+    size_t memcpy_to_with_crc(const iovector_view* iov, size_t size, CRC* crc) const {
+        return view().memcpy_to_with_crc(iov, size, crc);
+    }
+    template<typename CRC>
+    size_t memcpy_from_with_crc(const iovector_view* iov, size_t size, CRC* crc) const {
+        return view().memcpy_from_with_crc(iov, size, crc);
+    }
+
     // copy data to a buffer of `size` bytes, while extracting from *this
     // return # of bytes actually copied (and extracted)
     size_t pipe_to(void* buf, size_t size) {
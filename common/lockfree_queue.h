@@ -555,6 +555,29 @@ public:
         return n;
     }
 
+    // Same as consume_pop_batch(), but the data stays in the queue until
+    // pop_peeked(n), so that data from several queues can be consumed at once
+    template<typename Consumer>
+    size_t consume_peek_batch(size_t n, Consumer&& consume) {
+        auto h = head.load(std::memory_order_relaxed);
+        n = std::min(n, tail.load(std::memory_order_acquire) - h);
+        if (n == 0) return 0;
+        auto first_idx = idx(h);
+        auto part_length = Base::capacity - first_idx;
+        if (likely(part_length >= n)) {
+            consume(&slots[first_idx], n, nullptr, 0);
+        } else {
+            consume(&slots[first_idx], part_length,
+                    &slots[0], n - part_length);
+        }
+        return n;
+    }
+
+    void pop_peeked(size_t n) {
+        head.store(head.load(std::memory_order_relaxed) + n,
+                   std::memory_order_release);
+    }
+
     template <typename Pause = ThreadPause>
     T recv() {
         static_assert(std::is_base_of<PauseBase, Pause>::value,
@@ -0,0 +1,220 @@
+/*
+Copyright 2022 The Photon Authors
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "histogram.h"
+
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <photon/common/alog.h>
+#include <photon/common/thread-slots.h>
+
+namespace Metric {
+
+// a recycled shard keeps what it has counted
+int acquire_shard_index() {
+    static auto slots = new ThreadSlots(MAX_SHARDS);
+    return slots->get();
+}
+
+Histogram::~Histogram() {
+    for (auto& s : m_shards) delete s.load(std::memory_order_relaxed);
+}
+
+Histogram::Shard* Histogram::new_shard(int i) {
+    auto s = new Shard;
+    Shard* expected = nullptr;
+    if (!m_shards[i].compare_exchange_strong(expected, s, std::memory_order_acq_rel)) {
+        // the overflow shard is shared, and someone else has just created it
+        delete s;
+        return expected;
+    }
+    return s;
+}
+
+Histogram::Snapshot Histogram::snapshot() const {
+    Snapshot ret;
+    ret.buckets.resize(NR_BUCKETS);
+    for (auto& x : m_shards) {
+        auto s = x.load(std::memory_order_acquire);
+        if (!s) continue;
+        for (int i = 0; i < NR_BUCKETS; i++) {
+            auto n = s->buckets[i].load(std::memory_order_relaxed);
+            ret.buckets[i] += n;
+            ret.count += n;
+        }
+        ret.sum += s->sum.load(std::memory_order_relaxed);
+    }
+    return ret;
+}
+
+uint64_t Histogram::Snapshot::quantile(double q) const {
+    if (count == 0) return 0;
+    q = std::min(std::max(q, 0.0), 1.0);
+    auto rank = std::max((uint64_t)std::ceil(q * count), (uint64_t)1);
+    uint64_t acc = 0;
+    for (size_t i = 0; i < buckets.size(); i++) {
+        acc += buckets[i];
+        if (acc >= rank) return upper_bound(i);
+    }
+    return upper_bound(buckets.size() - 1);
+}
+
+struct Registry::Impl {
+    enum Type { COUNTER, GAUGE, HISTOGRAM };
+    struct Family {
+        Type type;
+        std::string help;
+        std::map<std::string, Counter*> counters;
+        std::map<std::string, LatencyHistogram*> histograms;
+    };
+    std::mutex mutex;
+    std::map<std::string, Family> families;
+
+    ~Impl() {
+        for (auto& f : families) {
+            for (auto& c : f.second.counters) delete c.second;
+            for (auto& h : f.second.histograms) delete h.second;
+        }
+    }
+
+    Family* get_family(std::string_view name, Type type, std::string_view help) {
+        std::string key(name);
+        auto it = families.find(key);
+        if (it == families.end()) {
+            auto& f = families[key];
+            f.type = type;
+            f.help = std::string(help);
+            return &f;
+        }
+        if (it->second.type != type)
+            LOG_ERROR_RETURN(EINVAL, nullptr, "metric ` is registered with another type",
+                             key.c_str());
+        return &it->second;
+    }
+
+    Counter* counter(std::string_view name, Type type,
+                     std::string_view labels, std::string_view help) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto f = get_family(name, type, help);
+        if (!f) return nullptr;
+        auto& c = f->counters[std::string(labels)];
+        if (!c) c = new Counter;
+        return c;
+    }
+};
+
+Registry::Registry() : m_impl(new Impl) {}
+
+Registry::~Registry() { delete m_impl; }
+
+Counter* Registry::counter(std::string_view name, std::string_view labels,
+                           std::string_view help) {
+    return m_impl->counter(name, Impl::COUNTER, labels, help);
+}
+
+Counter* Registry::gauge(std::string_view name, std::string_view labels,
+                         std::string_view help) {
+    return m_impl->counter(name, Impl::GAUGE, labels, help);
+}
+
+LatencyHistogram* Registry::histogram(std::string_view name, std::string_view labels,
+                                      std::string_view help) {
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+    auto f = m_impl->get_family(name, Impl::HISTOGRAM, help);
+    if (!f) return nullptr;
+    auto& h = f->histograms[std::string(labels)];
+    if (!h) h = new LatencyHistogram;
+    return h;
+}
+
+static void append_help(std::string& out, const std::string& help) {
+    for (auto c : help) {
+        if (c == '\\') out += "\\\\";
+        else if (c == '\n') out += "\\n";
+        else out += c;
+    }
+}
+
+static void append_series(std::string& out, const std::string& name, const char* suffix,
+                          const std::string& labels, const char* le, const std::string& value) {
+    out += name;
+    out += suffix;
+    if (!labels.empty() || le) {
+        out += '{';
+        out += labels;
+        if (le) {
+            if (!labels.empty()) out += ',';
+            out += "le=\"";
+            out += le;
+            out += '"';
+        }
+        out += '}';
+    }
+    out += ' ';
+    out += value;
+    out += '\n';
+}
+
+// Histograms are exposed with cumulative buckets at the powers of 2 (values
+// up to 2^k-1), up to the largest value recorded, to keep the output small.
+static void append_histogram(std::string& out, const std::string& name,
+                             const std::string& labels, const Histogram& h) {
+    auto s = h.snapshot();
+    int last = 0;
+    for (int i = 0; i < Histogram::NR_BUCKETS; i++)
+        if (s.buckets[i]) last = i;
+    uint64_t acc = 0;
+    for (int i = 0; i < Histogram::NR_BUCKETS; i++) {
+        acc += s.buckets[i];
+        auto ub = Histogram::upper_bound(i);
+        if (ub == -1UL || (ub & (ub + 1))) continue;
+        append_series(out, name, "_bucket", labels, std::to_string(ub).c_str(),
+                      std::to_string(acc));
+        if (i >= last) break;
+    }
+    append_series(out, name, "_bucket", labels, "+Inf", std::to_string(s.count));
+    append_series(out, name, "_sum", labels, nullptr, std::to_string(s.sum));
+    append_series(out, name, "_count", labels, nullptr, std::to_string(s.count));
+}
+
+void Registry::expose(std::string& out) {
+    static const char* type_names[] = {"counter", "gauge", "histogram"};
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+    for (auto& it : m_impl->families) {
+        auto& name = it.first;
+        auto& f = it.second;
+        if (!f.help.empty()) {
+            out += "# HELP " + name + " ";
+            append_help(out, f.help);
+            out += '\n';
+        }
+        out += "# TYPE " + name + " " + type_names[f.type] + "\n";
+        for (auto& c : f.counters)
+            append_series(out, name, "", c.first, nullptr,
+                          std::to_string(c.second->val()));
+        for (auto& h : f.histograms)
+            append_histogram(out, name, h.first, *h.second);
+    }
+}
+
+Registry& default_registry() {
+    // never destructed, metrics may be updated during static destruction
+    static auto r = new Registry;
+    return *r;
+}
+
+}  // namespace Metric
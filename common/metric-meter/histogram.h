@@ -0,0 +1,184 @@
+/*
+Copyright 2022 The Photon Authors
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <photon/common/metric-meter/metrics.h>
+#include <photon/common/string_view.h>
+
+namespace Metric {
+
+// Metrics in this file may be updated from any OS thread (vCPU). Each thread
+// writes its own shard with plain loads and stores, and readers merge the
+// shards. Threads beyond MAX_SHARDS share an extra shard, which falls back
+// to atomic read-modify-write.
+const int MAX_SHARDS = 64;
+
+// acquires a shard for current thread, released when the thread exits
+int acquire_shard_index();
+
+// index of the shard of current thread, in [0, MAX_SHARDS]
+inline int shard_index() {
+    static thread_local int index = -1;
+    if (unlikely(index < 0)) index = acquire_shard_index();
+    return index;
+}
+
+template<typename T>
+inline void shard_add(std::atomic<T>& x, T v, int shard) {
+    if (likely(shard < MAX_SHARDS)) {
+        x.store(x.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+    } else {
+        x.fetch_add(v, std::memory_order_relaxed);
+    }
+}
+
+// a counter (or a gauge, when sub() is used) sharded per thread
+class Counter {
+public:
+    Counter() = default;
+    Counter(const Counter&) = delete;
+    Counter& operator=(const Counter&) = delete;
+
+    void inc() { add(1); }
+    void dec() { add(-1); }
+    void add(int64_t x) {
+        auto i = shard_index();
+        shard_add(m_shards[i].value, x, i);
+    }
+    void sub(int64_t x) { add(-x); }
+    int64_t val() const {
+        int64_t sum = 0;
+        for (auto& s : m_shards) sum += s.value.load(std::memory_order_relaxed);
+        return sum;
+    }
+
+protected:
+    struct alignas(64) Shard {
+        std::atomic<int64_t> value{0};
+    };
+    Shard m_shards[MAX_SHARDS + 1];
+};
+
+/**
+ * A log-linear (HDR-style) histogram of non-negative integer values, such as
+ * latencies in microseconds. Every power of 2 is split into SUB_BUCKETS
+ * linear buckets, so recorded values keep a relative error below 1/16.
+ * Shards are allocated on the first put() of each thread.
+ */
+class Histogram {
+public:
+    static const int SUB_BITS = 4;
+    static const int SUB_BUCKETS = 1 << SUB_BITS;
+    static const int NR_BUCKETS = (64 - SUB_BITS + 1) * SUB_BUCKETS;
+
+    Histogram() = default;
+    Histogram(const Histogram&) = delete;
+    Histogram& operator=(const Histogram&) = delete;
+    ~Histogram();
+
+    static int bucket_of(uint64_t v) {
+        if (v < (uint64_t)SUB_BUCKETS) return (int)v;
+        int e = 63 - __builtin_clzll(v);
+        return (e - SUB_BITS + 1) * SUB_BUCKETS +
+               (int)((v >> (e - SUB_BITS)) & (SUB_BUCKETS - 1));
+    }
+    // the smallest value that falls into bucket `i`
+    static uint64_t lower_bound(int i) {
+        if (i < 2 * SUB_BUCKETS) return i;
+        int e = i / SUB_BUCKETS + SUB_BITS - 1;
+        return (1UL << e) | ((uint64_t)(i % SUB_BUCKETS) << (e - SUB_BITS));
+    }
+    // the largest value that falls into bucket `i`
+    static uint64_t upper_bound(int i) {
+        return (i + 1 < NR_BUCKETS) ? lower_bound(i + 1) - 1 : -1UL;
+    }
+
+    void put(uint64_t v) {
+        auto i = shard_index();
+        auto s = m_shards[i].load(std::memory_order_acquire);
+        if (unlikely(!s)) s = new_shard(i);
+        shard_add(s->buckets[bucket_of(v)], (uint64_t)1, i);
+        shard_add(s->sum, v, i);
+    }
+
+    struct Snapshot {
+        std::vector<uint64_t> buckets;
+        uint64_t count = 0;
+        uint64_t sum = 0;
+        // the upper bound of the bucket where the `q` (in [0, 1]) quantile falls
+        uint64_t quantile(double q) const;
+        uint64_t mean() const { return count ? sum / count : 0; }
+    };
+    // merge the shards, may run concurrently with put()
+    Snapshot snapshot() const;
+
+    uint64_t count() const { return snapshot().count; }
+    uint64_t quantile(double q) const { return snapshot().quantile(q); }
+
+protected:
+    struct Shard {
+        std::atomic<uint64_t> buckets[NR_BUCKETS];
+        std::atomic<uint64_t> sum{0};
+        Shard() { for (auto& b : buckets) b.store(0, std::memory_order_relaxed); }
+    };
+    std::atomic<Shard*> m_shards[MAX_SHARDS + 1] = {};
+
+    Shard* new_shard(int i);
+};
+
+class LatencyHistogram : public Histogram {
+public:
+    using MetricType = LatencyMetric<LatencyHistogram>;
+};
+
+/**
+ * Named metric families, each a set of series told apart by their labels,
+ * rendered in Prometheus text exposition format. Labels are given already
+ * formatted, e.g. `method="GET",code="200"`. Metrics are created on the
+ * first lookup and live as long as the registry; keep the returned pointer
+ * instead of looking it up on hot paths.
+ */
+class Registry {
+public:
+    Registry();
+    ~Registry();
+    Registry(const Registry&) = delete;
+    Registry& operator=(const Registry&) = delete;
+
+    Counter* counter(std::string_view name, std::string_view labels = {},
+                     std::string_view help = {});
+    Counter* gauge(std::string_view name, std::string_view labels = {},
+                   std::string_view help = {});
+    LatencyHistogram* histogram(std::string_view name, std::string_view labels = {},
+                                std::string_view help = {});
+
+    // append all families in Prometheus text format to `out`
+    void expose(std::string& out);
+
+protected:
+    struct Impl;
+    Impl* m_impl;
+};
+
+// the registry that photon components report to
+Registry& default_registry();
+
+}  // namespace Metric
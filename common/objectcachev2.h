@@ -229,4 +229,363 @@ public:
     }
 };
 
+/**
+
+`ShardedObjectCacheV2` has the same interface as `ObjectCacheV2`, for caches
+borrowed by many vCPUs at high rates:
+
+1. Keys are spread over shards by hash, each with its own lock, index and
+   LRU list.
+2. A hit is looked up without taking any lock. The index is an open
+   addressing table validated by a per-shard sequence number, and boxes
+   are never freed before the cache, so that a racing reader only ever sees
+   a valid box. It falls back to the locked path if the shard changed.
+3. LRU promotion is lazy. A released box is re-linked to the tail only if
+   it was linked more than lifespan/16 ago, and the reclaimer moves boxes
+   still in use or recently used to the tail instead of evicting them.
+
+**/
+
+template <typename K, typename VPtr>
+class ShardedObjectCacheV2 {
+protected:
+    using V = std::remove_pointer_t<VPtr>;
+
+    struct Box : public intrusive_list_node<Box> {
+        K key;
+        std::atomic<size_t> hash{0};
+        std::shared_ptr<V> ref;
+        photon::mutex createlock{0};
+        uint64_t lastcreate = 0;
+        // last access timestamp
+        uint64_t timestamp = 0;
+        // when the box was (re-)linked to the tail of lru list
+        uint64_t linktime = 0;
+        // in lru list, or in free list of the shard
+        bool alive = false;
+        std::atomic<uint64_t> rc{0};
+
+        std::shared_ptr<V> update(std::shared_ptr<V> r, uint64_t ts = 0) {
+            lastcreate = ts;
+            return std::atomic_exchange(&ref, r);
+        }
+        std::shared_ptr<V> reset(uint64_t ts = 0) {
+            return update({nullptr}, ts);
+        }
+        std::shared_ptr<V> reader() { return std::atomic_load(&ref); }
+
+        void acquire() {
+            timestamp = photon::now;
+            rc.fetch_add(1, std::memory_order_seq_cst);
+        }
+
+        void release() {
+            timestamp = photon::now;
+            rc.fetch_sub(1, std::memory_order_seq_cst);
+        }
+    };
+
+    // slots hold nullptr, TOMBSTONE, or a box; tables are recycled
+    // but never freed before the cache, neither are boxes
+    struct Table {
+        size_t mask;
+        std::unique_ptr<std::atomic<Box*>[]> slots;
+        explicit Table(size_t cap) : mask(cap - 1), slots(new std::atomic<Box*>[cap]) {
+            clear();
+        }
+        void clear() {
+            for (size_t i = 0; i <= mask; ++i)
+                slots[i].store(nullptr, std::memory_order_relaxed);
+        }
+    };
+    static Box* tombstone() { return (Box*)1; }
+
+    struct Shard {
+        photon::mutex lock{0};
+        // odd while boxes are being removed or the table is being rebuilt
+        std::atomic<uint64_t> seq{0};
+        std::atomic<Table*> table{nullptr};
+        std::vector<std::unique_ptr<Table>> tables;
+        std::vector<std::unique_ptr<Box>> boxes;
+        intrusive_list<Box> lru_list, free_list;
+        size_t used = 0, live = 0;
+        char _padding[64];
+
+        Shard() {
+            tables.emplace_back(new Table(64));
+            table.store(tables.back().get(), std::memory_order_release);
+        }
+        ~Shard() {
+            lru_list.node = nullptr;
+            free_list.node = nullptr;
+        }
+    };
+
+    std::vector<Shard> shards;
+    uint64_t lifespan;
+    uint64_t promote_interval;
+    photon::Timer _timer;
+
+    template <typename KeyType>
+    static size_t __hash(const KeyType& key) {
+        return std::hash<K>()(key);
+    }
+
+    Shard& __shard(size_t hash) {
+        return shards[(hash >> 32 ^ hash) % shards.size()];
+    }
+
+    // lock-free lookup, returns an acquired box, or nullptr to fall back
+    template <typename KeyType>
+    Box* __lookup(Shard& s, size_t hash, const KeyType& key) {
+        auto seq = s.seq.load(std::memory_order_acquire);
+        if (seq & 1) return nullptr;
+        auto t = s.table.load(std::memory_order_acquire);
+        for (size_t i = 0; i <= t->mask; ++i) {
+            auto box = t->slots[(hash + i) & t->mask].load(std::memory_order_acquire);
+            if (!box) return nullptr;
+            if (box == tombstone() ||
+                box->hash.load(std::memory_order_relaxed) != hash) continue;
+            // pin the box, then make sure it wasn't removed meanwhile
+            box->rc.fetch_add(1, std::memory_order_seq_cst);
+            if (s.seq.load(std::memory_order_seq_cst) != seq) {
+                box->rc.fetch_sub(1, std::memory_order_seq_cst);
+                return nullptr;
+            }
+            if (box->key == key) {
+                box->timestamp = photon::now;
+                return box;
+            }
+            box->rc.fetch_sub(1, std::memory_order_seq_cst);
+        }
+        return nullptr;
+    }
+
+    void __rebuild(Shard& s) {
+        auto old = s.table.load(std::memory_order_relaxed);
+        auto cap = old->mask + 1;
+        if (s.live * 4 > cap) cap *= 2;
+        Table* t = nullptr;
+        for (auto& x : s.tables)
+            if (x.get() != old && x->mask + 1 == cap) t = x.get();
+        if (!t) {
+            s.tables.emplace_back(new Table(cap));
+            t = s.tables.back().get();
+        }
+        s.seq.fetch_add(1, std::memory_order_seq_cst);
+        t->clear();
+        for (size_t i = 0; i <= old->mask; ++i) {
+            auto box = old->slots[i].load(std::memory_order_relaxed);
+            if (!box || box == tombstone()) continue;
+            auto h = box->hash.load(std::memory_order_relaxed);
+            for (size_t j = 0;; ++j) {
+                auto& slot = t->slots[(h + j) & t->mask];
+                if (!slot.load(std::memory_order_relaxed)) {
+                    slot.store(box, std::memory_order_relaxed);
+                    break;
+                }
+            }
+        }
+        s.used = s.live;
+        s.table.store(t, std::memory_order_release);
+        s.seq.fetch_add(1, std::memory_order_seq_cst);
+    }
+
+    template <typename KeyType>
+    Box& __find_or_create_box(KeyType&& key) {
+        auto hash = __hash(key);
+        auto& s = __shard(hash);
+        auto box = __lookup(s, hash, key);
+        if (box) return *box;
+        SCOPED_LOCK(s.lock);
+        auto t = s.table.load(std::memory_order_relaxed);
+        std::atomic<Box*>* vacancy = nullptr;
+        for (size_t i = 0; i <= t->mask; ++i) {
+            auto& slot = t->slots[(hash + i) & t->mask];
+            box = slot.load(std::memory_order_relaxed);
+            if (box == tombstone()) {
+                if (!vacancy) vacancy = &slot;
+                continue;
+            }
+            if (!box) {
+                if (!vacancy) {
+                    vacancy = &slot;
+                    s.used++;
+                }
+                break;
+            }
+            if (box->hash.load(std::memory_order_relaxed) == hash && box->key == key) {
+                box->acquire();
+                return *box;
+            }
+        }
+        box = s.free_list.pop_front();
+        if (!box) {
+            s.boxes.emplace_back(new Box);
+            box = s.boxes.back().get();
+        }
+        box->key = K(std::forward<KeyType>(key));
+        box->hash.store(hash, std::memory_order_relaxed);
+        box->lastcreate = 0;
+        box->linktime = photon::now;
+        box->alive = true;
+        box->acquire();
+        s.lru_list.push_back(box);
+        vacancy->store(box, std::memory_order_release);
+        s.live++;
+        if (s.used * 10 > t->mask * 7) __rebuild(s);
+        return *box;
+    }
+
+    void __erase(Shard& s, Box* box) {
+        auto t = s.table.load(std::memory_order_relaxed);
+        auto h = box->hash.load(std::memory_order_relaxed);
+        for (size_t i = 0; i <= t->mask; ++i) {
+            auto& slot = t->slots[(h + i) & t->mask];
+            if (slot.load(std::memory_order_relaxed) == box) {
+                slot.store(tombstone(), std::memory_order_release);
+                break;
+            }
+        }
+        s.live--;
+        box->alive = false;
+        s.free_list.push_back(box);
+    }
+
+    // called by Borrow, when the last reference is released
+    void __promote(Box* box) {
+        if (photon::sat_add(box->linktime, promote_interval) > photon::now) return;
+        auto& s = __shard(box->hash.load(std::memory_order_relaxed));
+        SCOPED_LOCK(s.lock);
+        // may have been reclaimed meanwhile
+        if (!box->alive) return;
+        s.lru_list.pop(box);
+        s.lru_list.push_back(box);
+        box->linktime = photon::now;
+    }
+
+    uint64_t __expire() {
+        std::vector<std::shared_ptr<V>> to_release;
+        uint64_t now = photon::now;
+        uint64_t reclaim_before = photon::sat_sub(now, lifespan);
+        for (auto& s : shards) {
+            SCOPED_LOCK(s.lock);
+            auto x = s.lru_list.front();
+            if (!x || x->linktime >= reclaim_before) continue;
+            s.seq.fetch_add(1, std::memory_order_seq_cst);
+            while (x && x->linktime < reclaim_before) {
+                s.lru_list.pop(x);
+                if (x->rc.load(std::memory_order_seq_cst) == 0 &&
+                    x->timestamp < reclaim_before) {
+                    // make vector holds those shared_ptr
+                    // prevent object destroy in critical zone
+                    to_release.push_back(x->reset());
+                    __erase(s, x);
+                } else {
+                    // lazily promoted
+                    s.lru_list.push_back(x);
+                    x->linktime = now;
+                }
+                x = s.lru_list.front();
+            }
+            s.seq.fetch_add(1, std::memory_order_seq_cst);
+        }
+        to_release.clear();
+        return 0;
+    }
+
+public:
+    struct Borrow {
+        ShardedObjectCacheV2* _oc = nullptr;
+        Box* _box = nullptr;
+        std::shared_ptr<V> _reader;
+        bool _recycle = false;
+
+        Borrow() : _reader(nullptr) {}
+
+        Borrow(ShardedObjectCacheV2* oc, Box* box, const std::shared_ptr<V>& reader)
+            : _oc(oc), _box(box), _reader(reader), _recycle(false) {
+            _box->acquire();
+        }
+
+        Borrow(Borrow&& rhs) : _reader(nullptr) { *this = std::move(rhs); }
+
+        Borrow& operator=(Borrow&& rhs) {
+            std::swap(_oc, rhs._oc);
+            std::swap(_box, rhs._box);
+            std::swap(_reader, rhs._reader);
+            std::swap(_recycle, rhs._recycle);
+            return *this;
+        }
+
+        ~Borrow() {
+            if (!_box) return;
+            if (_recycle) {
+                _box->reset();
+            }
+            _box->release();
+            if (_box->rc == 0) _oc->__promote(_box);
+        }
+
+        bool recycle() { return _recycle; }
+
+        bool recycle(bool x) { return _recycle = x; }
+
+        V& operator*() const { return *_reader; }
+        V* operator->() const { return &*_reader; }
+        operator bool() const { return (bool)_reader; }
+    };
+
+    template <typename KeyType, typename Ctor>
+    Borrow borrow(KeyType&& key, Ctor&& ctor, uint64_t cooldown = 0UL) {
+        auto& box = __find_or_create_box(std::forward<KeyType>(key));
+        DEFER(box.release());
+        std::shared_ptr<V> r = box.reader();
+        while (!r) {
+            if (box.createlock.try_lock() == 0) {
+                DEFER(box.createlock.unlock());
+                r = box.reader();
+                if (!r) {
+                    if (photon::sat_add(box.lastcreate, cooldown) <=
+                        photon::now) {
+                        auto r = std::shared_ptr<V>(ctor());
+                        box.update(r, photon::now);
+                        return Borrow(this, &box, r);
+                    }
+                    return Borrow(this, &box, r);
+                }
+            }
+            photon::thread_yield();
+            r = box.reader();
+        }
+        return Borrow(this, &box, r);
+    }
+
+    template <typename KeyType>
+    Borrow borrow(KeyType&& key) {
+        return borrow(std::forward<KeyType>(key),
+                      [&]() { return std::make_shared<V>(); });
+    }
+
+    template <typename KeyType, typename Ctor>
+    Borrow update(KeyType&& key, Ctor&& ctor) {
+        auto& box = __find_or_create_box(std::forward<KeyType>(key));
+        DEFER(box.release());
+        auto r = std::shared_ptr<V>(ctor());
+        box.update(r, photon::now);
+        return Borrow(this, &box, r);
+    }
+
+    explicit ShardedObjectCacheV2(uint64_t lifespan, size_t nshards = 64)
+        : shards(nshards ? nshards : 1),
+          lifespan(lifespan),
+          promote_interval(lifespan / 16),
+          _timer(1UL * 1000 * 1000, {this, &ShardedObjectCacheV2::__expire}, true,
+                 photon::DEFAULT_STACK_SIZE) {}
+
+    ~ShardedObjectCacheV2() {
+        _timer.stop();
+    }
+};
+
 #pragma GCC diagnostic pop
\ No newline at end of file
@@ -0,0 +1,398 @@
+/*
+Copyright 2022 The Photon Authors
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "slab-alloc.h"
+
+#include <ctype.h>
+#include <dirent.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#endif
+#include <algorithm>
+#include <photon/common/alog.h>
+#include <photon/common/thread-slots.h>
+
+namespace {
+
+// vCPUs (OS threads) are given the slots of exited ones, along with the
+// buffers they cached
+ThreadSlots& slots() {
+    static auto s = new ThreadSlots(SlabAllocator::MAX_VCPUS);
+    return *s;
+}
+
+// the NUMA node of the vCPU of each slot
+uint8_t slot_nodes[SlabAllocator::MAX_VCPUS + 1];
+
+uint8_t current_node() {
+#ifdef __linux__
+    unsigned cpu = 0, node = 0;
+    if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0)
+        return node % SlabAllocator::MAX_NODES;
+#endif
+    return 0;
+}
+
+int acquire_slot() {
+    auto i = slots().get();
+    if (i < SlabAllocator::MAX_VCPUS) slot_nodes[i] = current_node();
+    return i;
+}
+
+// the slot is only looked up once per thread
+inline int vcpu_slot() {
+    static thread_local int index = -1;
+    if (unlikely(index < 0)) index = acquire_slot();
+    return index;
+}
+
+int count_nodes() {
+    int n = 0;
+#ifdef __linux__
+    auto dir = opendir("/sys/devices/system/node");
+    if (!dir) return 1;
+    while (auto e = readdir(dir)) {
+        if (strncmp(e->d_name, "node", 4) == 0 && isdigit(e->d_name[4])) n++;
+    }
+    closedir(dir);
+#endif
+    return std::min(std::max(n, 1), (int)SlabAllocator::MAX_NODES);
+}
+
+}  // namespace
+
+const size_t SlabAllocator::PAGE_SIZE;
+const size_t SlabAllocator::SLAB_SIZE;
+const size_t SlabAllocator::LINEAR_MAX;
+const int SlabAllocator::NR_CLASSES;
+const int SlabAllocator::MAX_VCPUS;
+const int SlabAllocator::MAX_NODES;
+const int SlabAllocator::MAGAZINE_SIZE;
+
+SlabAllocator::SlabAllocator(const Options& options) :
+        m_max_alloc_size(std::min(options.max_alloc_size, SLAB_SIZE)),
+        m_numa(options.numa) {
+    for (int i = 0; i < NR_CLASSES; i++) {
+        auto n = 2 * 1024 * 1024 / class_size(i);
+        m_magazine_size[i] = (int)std::min(std::max(n, 4UL), (size_t)MAGAZINE_SIZE);
+    }
+    if (m_numa) m_nr_nodes = count_nodes();
+
+    // reserve a region aligned to SLAB_SIZE, to be populated on demand
+    auto nr_slabs = options.capacity / SLAB_SIZE;
+    auto len = nr_slabs * SLAB_SIZE;
+    if (nr_slabs == 0) return;
+    auto p = (char*)mmap(nullptr, len + SLAB_SIZE, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED)
+        LOG_ERRNO_RETURN(0, , "failed to reserve ` bytes for slabs, falling back to posix_memalign()", len);
+    auto base = (char*)(((uintptr_t)p + SLAB_SIZE - 1) & ~(SLAB_SIZE - 1));
+    if (base > p) munmap(p, base - p);
+    munmap(base + len, p + SLAB_SIZE - base);
+#ifdef MADV_HUGEPAGE
+    if (options.hugepage && madvise(base, len, MADV_HUGEPAGE) < 0)
+        LOG_WARN("madvise(MADV_HUGEPAGE) failed", ERRNO());
+#endif
+    m_base = base;
+    m_nr_slabs = nr_slabs;
+    m_slabs = new SlabInfo[nr_slabs];
+}
+
+SlabAllocator::~SlabAllocator() {
+    for (auto& c : m_vcpus) {
+        for (int i = 0; i < NR_CLASSES; i++) {
+            delete c.loaded[i];
+            delete c.previous[i];
+        }
+    }
+    for (auto& node : m_depots) {
+        for (auto& d : node) {
+            for (auto m : d.full) delete m;
+            for (auto m : d.empty) delete m;
+            delete d.loose;
+        }
+    }
+    if (m_base) munmap(m_base, m_nr_slabs * SLAB_SIZE);
+    delete [] m_slabs;
+}
+
+static void* fallback_alloc(size_t size) {
+    void* ptr = nullptr;
+    int err = ::posix_memalign(&ptr, SlabAllocator::PAGE_SIZE, size);
+    if (err) {
+        errno = err;
+        return nullptr;
+    }
+    return ptr;
+}
+
+int SlabAllocator::allocator(IOAlloc::RangeSize size, void** ptr) {
+    assert(size.min > 0 && size.max >= size.min);
+    size_t n = std::min((size_t)size.max, m_max_alloc_size);
+    if (n < (size_t)size.min) {
+        *ptr = fallback_alloc(size.max);
+        return *ptr ? size.max : -1;
+    }
+    // prefer a smaller class that fills the buffer, if it is large enough
+    int cls = size_class(n);
+    if (class_size(cls) > n && cls > 0 && class_size(cls - 1) >= (size_t)size.min)
+        n = class_size(--cls);
+    *ptr = alloc_class(cls);
+    if (unlikely(!*ptr)) *ptr = fallback_alloc(n);
+    return *ptr ? (int)n : -1;
+}
+
+int SlabAllocator::deallocator(void* ptr) {
+    dealloc(ptr);
+    return 0;
+}
+
+void* SlabAllocator::alloc(size_t size) {
+    int cls = size_class(size);
+    void* ptr = (cls < 0) ? nullptr : alloc_class(cls);
+    return likely(ptr) ? ptr : fallback_alloc(size);
+}
+
+#define NODE_OF(slot) (m_nr_nodes > 1 ? slot_nodes[slot] % m_nr_nodes : 0)
+
+void* SlabAllocator::alloc_class(int cls) {
+    auto slot = vcpu_slot();
+    auto& c = m_vcpus[slot];
+    SCOPED_LOCK(c.lock);
+    auto& m = c.loaded[cls];
+    if (likely(m && m->n)) return m->objs[--m->n];
+    auto& p = c.previous[cls];
+    if (p && p->n) {
+        std::swap(m, p);
+        return m->objs[--m->n];
+    }
+    m = exchange_full(NODE_OF(slot), cls, m);
+    return (m && m->n) ? m->objs[--m->n] : nullptr;
+}
+
+void SlabAllocator::dealloc(void* ptr) {
+    if (!ptr) return;
+    if (!owns(ptr)) return ::free(ptr);
+    auto& s = slab_of(ptr);
+    int cls = s.cls;
+    assert(cls >= 0);
+    auto slot = vcpu_slot();
+    auto node = NODE_OF(slot);
+    if (s.node != node) return put_remote(s.node, cls, ptr);
+    auto& c = m_vcpus[slot];
+    SCOPED_LOCK(c.lock);
+    auto cap = m_magazine_size[cls];
+    auto& m = c.loaded[cls];
+    if (unlikely(!m || m->n >= cap)) {
+        auto& p = c.previous[cls];
+        if (p && p->n < cap) {
+            std::swap(m, p);
+        } else {
+            auto e = exchange_empty(node, cls, p);
+            p = m;
+            m = e;
+        }
+    }
+    m->objs[m->n++] = ptr;
+}
+
+// returns a magazine with buffers, for `empty` (which may be null)
+SlabAllocator::Magazine* SlabAllocator::exchange_full(int node, int cls, Magazine* empty) {
+    auto& d = m_depots[node][cls];
+    SCOPED_LOCK(d.lock);
+    if (!d.full.empty()) {
+        auto m = d.full.back();
+        d.full.pop_back();
+        if (empty) d.empty.push_back(empty);
+        return m;
+    }
+    if (!empty) empty = new Magazine;
+    carve(d, node, cls, empty);
+    return empty;
+}
+
+// returns an empty magazine, for `full` (which may be null)
+SlabAllocator::Magazine* SlabAllocator::exchange_empty(int node, int cls, Magazine* full) {
+    auto& d = m_depots[node][cls];
+    Magazine* m = nullptr;
+    {
+        SCOPED_LOCK(d.lock);
+        if (full) d.full.push_back(full);
+        if (!d.empty.empty()) {
+            m = d.empty.back();
+            d.empty.pop_back();
+        }
+    }
+    return m ? m : new Magazine;
+}
+
+void SlabAllocator::put_remote(int node, int cls, void* ptr) {
+    auto& d = m_depots[node][cls];
+    SCOPED_LOCK(d.lock);
+    if (!d.loose) {
+        if (d.empty.empty()) {
+            d.loose = new Magazine;
+        } else {
+            d.loose = d.empty.back();
+            d.empty.pop_back();
+        }
+    }
+    d.loose->objs[d.loose->n++] = ptr;
+    if (d.loose->n >= m_magazine_size[cls]) {
+        d.full.push_back(d.loose);
+        d.loose = nullptr;
+    }
+}
+
+// fills `m` with buffers from the slab being carved, or from new slabs
+int SlabAllocator::carve(Depot& d, int node, int cls, Magazine* m) {
+    auto size = class_size(cls);
+    auto per_slab = SLAB_SIZE / size;
+    while (m->n < m_magazine_size[cls]) {
+        if (d.slab < 0 || d.carved >= per_slab) {
+            d.slab = new_slab(node, cls);
+            d.carved = 0;
+            if (d.slab < 0) break;
+        }
+        m->objs[m->n++] = m_base + d.slab * SLAB_SIZE + d.carved++ * size;
+    }
+    return m->n;
+}
+
+int64_t SlabAllocator::new_slab(int node, int cls) {
+    size_t i;
+    {
+        SCOPED_LOCK(m_free_slabs_lock);
+        if (!m_free_slabs.empty()) {
+            i = m_free_slabs.back();
+            m_free_slabs.pop_back();
+        } else if (m_next_slab < m_nr_slabs) {
+            i = m_next_slab++;
+        } else {
+            return -1;
+        }
+    }
+    m_slabs[i].cls = cls;
+    m_slabs[i].node = node;
+    m_slabs_used++;
+#ifdef __linux__
+    if (m_nr_nodes > 1) {
+        unsigned long mask = 1UL << node;
+        if (syscall(SYS_mbind, m_base + i * SLAB_SIZE, SLAB_SIZE,
+                    MPOL_PREFERRED, &mask, sizeof(mask) * 8, 0) < 0)
+            LOG_DEBUG("mbind() failed", ERRNO());
+    }
+#endif
+    return i;
+}
+
+void SlabAllocator::flush(VCPUCache& c, int node) {
+    SCOPED_LOCK(c.lock);
+    for (int i = 0; i < NR_CLASSES; i++) {
+        for (auto m : {&c.loaded[i], &c.previous[i]}) {
+            if (!*m) continue;
+            if ((*m)->n) {
+                auto& d = m_depots[node][i];
+                SCOPED_LOCK(d.lock);
+                d.full.push_back(*m);
+            } else {
+                delete *m;
+            }
+            *m = nullptr;
+        }
+    }
+}
+
+size_t SlabAllocator::trim() {
+    for (int i = 0; i <= MAX_VCPUS; i++)
+        flush(m_vcpus[i], NODE_OF(i));
+
+    std::vector<void*> objs;
+    std::vector<size_t> freed;
+    auto slab_index = [&](void* p) { return (size_t)((char*)p - m_base) / SLAB_SIZE; };
+    for (int cls = 0; cls < NR_CLASSES; cls++) {
+        // buffers of a slab may be cached in the depot of any node, if
+        // vCPUs have moved, so all the nodes are locked for the class
+        for (int n = 0; n < m_nr_nodes; n++)
+            m_depots[n][cls].lock.lock();
+        objs.clear();
+        for (int n = 0; n < m_nr_nodes; n++) {
+            auto& d = m_depots[n][cls];
+            if (d.loose) d.full.push_back(d.loose);
+            d.loose = nullptr;
+            for (auto m : d.full) {
+                objs.insert(objs.end(), m->objs, m->objs + m->n);
+                delete m;
+            }
+            for (auto m : d.empty) delete m;
+            d.full.clear();
+            d.empty.clear();
+        }
+
+        // sorted, the buffers of a slab are adjacent; those of the slabs
+        // that are entirely free are dropped, and the others kept in front
+        std::sort(objs.begin(), objs.end());
+        auto per_slab = SLAB_SIZE / class_size(cls);
+        size_t kept = 0;
+        for (size_t i = 0, j; i < objs.size(); i = j) {
+            auto slab = slab_index(objs[i]);
+            for (j = i + 1; j < objs.size() && slab_index(objs[j]) == slab; j++) { }
+            auto total = per_slab;
+            Depot* carving = nullptr;
+            for (int n = 0; n < m_nr_nodes; n++) {
+                if (m_depots[n][cls].slab == (int64_t)slab) {
+                    carving = &m_depots[n][cls];
+                    total = carving->carved;
+                }
+            }
+            if (j - i < total) {
+                while (i < j) objs[kept++] = objs[i++];
+                continue;
+            }
+            if (carving) carving->slab = -1;
+            m_slabs[slab].cls = -1;
+            freed.push_back(slab);
+        }
+        objs.resize(kept);
+
+        // put the rest back to the depots of their nodes
+        for (auto p : objs) {
+            auto& d = m_depots[slab_of(p).node][cls];
+            if (d.full.empty() || d.full.back()->n >= m_magazine_size[cls])
+                d.full.push_back(new Magazine);
+            auto m = d.full.back();
+            m->objs[m->n++] = p;
+        }
+        for (int n = m_nr_nodes - 1; n >= 0; n--)
+            m_depots[n][cls].lock.unlock();
+    }
+
+    // the freed slabs are out of reach until they are put in the free list,
+    // so they are returned to the OS without holding any lock
+    for (auto i : freed)
+        madvise(m_base + i * SLAB_SIZE, SLAB_SIZE, MADV_DONTNEED);
+    m_slabs_used -= freed.size();
+    {
+        SCOPED_LOCK(m_free_slabs_lock);
+        m_free_slabs.insert(m_free_slabs.end(), freed.begin(), freed.end());
+    }
+    return freed.size() * SLAB_SIZE;
+}
@@ -0,0 +1,155 @@
+/*
+Copyright 2022 The Photon Authors
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+#include <atomic>
+#include <vector>
+#include <photon/common/io-alloc.h>
+#include <photon/thread/thread.h>
+
+/**
+ * A slab allocator of I/O buffers, for allocation-heavy paths shared by many
+ * vCPUs, such as cache refill and RPC request bodies.
+ *
+ * Buffers are 4KB-aligned, and sizes are rounded up to size classes of 4KB
+ * steps up to 64KB, then powers of 2 up to `max_alloc_size`, so that a
+ * 36KB buffer wastes no more than 4KB (PooledAllocator rounds it to 64KB).
+ *
+ * Buffers are carved from 2MB slabs, laid out in a region of virtual memory
+ * reserved up-front, and backed by transparent huge pages. The size class of
+ * a buffer is found from its slab on free, instead of malloc_usable_size().
+ *
+ * Each vCPU caches free buffers in magazines (small stacks) of every class,
+ * and exchanges full and empty magazines with a depot of its NUMA node. Slabs
+ * are bound to the node of the vCPU that carves them, and buffers freed on
+ * another node go back to the depot of their own node.
+ *
+ * Memory is not returned to the OS, until trim() is called. Allocations
+ * larger than `max_alloc_size`, or beyond `capacity`, fall back to
+ * posix_memalign().
+ */
+class SlabAllocator {
+public:
+    static const size_t PAGE_SIZE = 4096;
+    static const size_t SLAB_SIZE = 2 * 1024 * 1024;
+    static const size_t LINEAR_MAX = 64 * 1024;   // end of the 4KB steps
+    static const int NR_CLASSES = LINEAR_MAX / PAGE_SIZE + 5;   // up to SLAB_SIZE
+    static const int MAX_VCPUS = 64;    // more vCPUs share an extra cache
+    static const int MAX_NODES = 8;
+    static const int MAGAZINE_SIZE = 64;
+
+    struct Options {
+        size_t capacity = 16UL * 1024 * 1024 * 1024;  // virtual memory reserved
+        size_t max_alloc_size = 1024 * 1024;          // up to SLAB_SIZE
+        bool hugepage = true;   // madvise(MADV_HUGEPAGE) on slabs
+        bool numa = true;       // bind slabs to the node of the vCPU
+    };
+
+    SlabAllocator() : SlabAllocator(Options()) { }
+    explicit SlabAllocator(const Options& options);
+    SlabAllocator(const SlabAllocator&) = delete;
+    SlabAllocator& operator=(const SlabAllocator&) = delete;
+    // all the buffers must have been freed
+    ~SlabAllocator();
+
+    IOAlloc get_io_alloc() {
+        return IOAlloc{{this, &SlabAllocator::allocator},
+                       {this, &SlabAllocator::deallocator}};
+    }
+
+    // the size class of `size`, or -1 if it is larger than max_alloc_size
+    int size_class(size_t size) const {
+        if (size > m_max_alloc_size) return -1;
+        if (size <= LINEAR_MAX)
+            return size ? (int)((size - 1) / PAGE_SIZE) : 0;
+        return LINEAR_MAX / PAGE_SIZE - 1 +
+               (64 - __builtin_clzl(size - 1)) - __builtin_ctzl(LINEAR_MAX);
+    }
+    static size_t class_size(int cls) {
+        return (cls < (int)(LINEAR_MAX / PAGE_SIZE)) ? (cls + 1) * PAGE_SIZE :
+               LINEAR_MAX << (cls + 1 - LINEAR_MAX / PAGE_SIZE);
+    }
+
+    // allocate a buffer of at least `size` bytes
+    void* alloc(size_t size);
+    void dealloc(void* ptr);
+
+    // return the free buffers cached by vCPUs to the depots, and the slabs
+    // that are entirely free to the OS, with their virtual memory kept for
+    // reuse; returns the number of bytes released
+    size_t trim();
+
+    // bytes of the slabs that hold buffers, allocated or cached
+    size_t slab_bytes() const {
+        return (m_slabs_used.load(std::memory_order_relaxed)) * SLAB_SIZE;
+    }
+
+protected:
+    struct Magazine {
+        int n = 0;
+        void* objs[MAGAZINE_SIZE];
+    };
+
+    struct alignas(64) VCPUCache {
+        photon::spinlock lock;
+        Magazine* loaded[NR_CLASSES] = {};
+        Magazine* previous[NR_CLASSES] = {};
+    };
+
+    struct Depot {
+        photon::spinlock lock;
+        std::vector<Magazine*> full, empty;
+        Magazine* loose = nullptr;  // buffers freed by vCPUs of other nodes
+        int64_t slab = -1;          // the slab being carved
+        uint32_t carved = 0;        // buffers carved from it
+    };
+
+    struct SlabInfo {
+        int8_t cls = -1;            // -1 for an unused slab
+        uint8_t node = 0;
+    };
+
+    char* m_base = nullptr;
+    size_t m_nr_slabs = 0;
+    size_t m_max_alloc_size;
+    bool m_numa;
+    int m_nr_nodes = 1;
+    SlabInfo* m_slabs = nullptr;
+    std::atomic<size_t> m_next_slab{0};     // slabs never used start here
+    std::atomic<size_t> m_slabs_used{0};
+    photon::spinlock m_free_slabs_lock;
+    std::vector<size_t> m_free_slabs;       // slabs released by trim()
+    int m_magazine_size[NR_CLASSES];
+    VCPUCache m_vcpus[MAX_VCPUS + 1];
+    Depot m_depots[MAX_NODES][NR_CLASSES];
+
+    int allocator(IOAlloc::RangeSize size, void** ptr);
+    int deallocator(void* ptr);
+
+    void* alloc_class(int cls);
+    bool owns(void* ptr) const {
+        return (char*)ptr >= m_base && (char*)ptr < m_base + m_nr_slabs * SLAB_SIZE;
+    }
+    SlabInfo& slab_of(void* ptr) const {
+        return m_slabs[((char*)ptr - m_base) / SLAB_SIZE];
+    }
+    Magazine* exchange_full(int node, int cls, Magazine* empty);
+    Magazine* exchange_empty(int node, int cls, Magazine* full);
+    void put_remote(int node, int cls, void* ptr);
+    int carve(Depot& d, int node, int cls, Magazine* m);
+    int64_t new_slab(int node, int cls);
+    void flush(VCPUCache& c, int node);
+};
@@ -11,10 +11,13 @@ inline static uint64_t GetSteadyTimeNs() {
   return std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count();
 }
 
+static int rounds = 1000000;
+
 void *task(void *arg) {
     auto id = *(uint64_t*)arg;
-    for (int i = 0; i < 1000000; ++i) {
-        LOG_AUDIT("my id `", id + i);
+    for (int i = 0; i < rounds; ++i) {
+        LOG_AUDIT("my id `, round ` of `, ratio `, ", id + i, i, rounds,
+                  FP(i * 1.0 / rounds).precision(4), HEX(id).width(8), " done");
         photon::thread_yield();
     }
     return nullptr;
@@ -25,7 +28,7 @@ void test_alog(int id) {
     LOG_INFO("Perf alog ", id);
     auto start = GetSteadyTimeNs();
     for (int i = 0; i < 4; i++) {
-        uint64_t arg = id * 100000000UL + i * 1000000UL;
+        uint64_t arg = id * 100000000UL + i * (uint64_t)rounds;
         auto th = photon::thread_create(task, &arg);
         photon::thread_yield_to(th);
         jhs.emplace_back(photon::thread_enable_join(th));
@@ -35,12 +38,13 @@ void test_alog(int id) {
     LOG_INFO("perf async log ` spent ` ms", id, (done - start) / 1000000);
 }
 
-int main() {
-    photon::init(0, 0);
-    DEFER(photon::fini());
-    default_audit_logger.log_output = new_async_log_output(new_log_output_file("./out.log"), 8);
+static int vcpus = 8;
+
+static void perf_backend(const char* name, ILogOutput* output) {
+    default_audit_logger.log_output = output;
+    auto start = GetSteadyTimeNs();
     std::vector<std::thread> ths;
-    for (int i = 0; i < 8; i++) {
+    for (int i = 0; i < vcpus; i++) {
         ths.emplace_back([&, id = i] {
             photon::init(0, 0);
             DEFER(photon::fini());
@@ -50,14 +54,49 @@ int main() {
     for (auto &x : ths) {
         x.join();
     }
+    auto logged = GetSteadyTimeNs();
     uint64_t cost = 0;
     for (int i = 0; i < 100; ++i) {
         auto t0 = GetSteadyTimeNs();
-        LOG_AUDIT("test async log ", i);
+        LOG_AUDIT("test async log ", i, ' ', FP(i / 3.0).precision(2), ' ', HEX(i));
         auto t1 = GetSteadyTimeNs();
         cost += (t1 - t0);
-        photon::thread_usleep(100*1000UL);
+        photon::thread_usleep(1000UL);
     }
-    LOG_INFO("single async log spent ` ns", cost/100);
+    default_audit_logger.log_output = log_output_null;
+    AsyncLogStats stats{};
+    get_async_log_stats(output, &stats);
+    // wait for the background thread to finish writing
+    output->destruct();
+    auto done = GetSteadyTimeNs();
+    uint64_t lines = 4UL * vcpus * rounds;
+    LOG_INFO("backend `: ` lines logged in ` ms (` Klines/s), written in ` ms, single log spent ` ns",
+             name, lines, (logged - start) / 1000000, lines * 1000000 / (logged - start + 1),
+             (done - start) / 1000000, cost / 100);
+    LOG_INFO("backend `: queued `, dropped `, sampled `, blocked `, queues `",
+             name, stats.lines, stats.dropped, stats.sampled, stats.blocked, stats.queues);
+}
+
+static AsyncLogOptions overflow(int mode) {
+    AsyncLogOptions opts;
+    opts.overflow = mode;
+    opts.num_of_queues = vcpus + 2;  // the shared one, the main thread and the vCPUs
+    return opts;
+}
+
+// usage: perf-alog [rounds per photon thread] [vcpus]
+int main(int argc, char** argv) {
+    if (argc > 1) rounds = atoi(argv[1]);
+    if (argc > 2) vcpus = atoi(argv[2]);
+    photon::init(0, 0);
+    DEFER(photon::fini());
+    // text formatted by the calling threads
+    perf_backend("async-drop", new_async_log_output(new_log_output_file("./out.log"), overflow(ALOG_OVERFLOW_DROP)));
+    perf_backend("async-block", new_async_log_output(new_log_output_file("./out.log"), overflow(ALOG_OVERFLOW_BLOCK)));
+    perf_backend("async-sample", new_async_log_output(new_log_output_file("./out.log"), overflow(ALOG_OVERFLOW_SAMPLE)));
+    // records formatted by the background thread
+    perf_backend("binary", new_binary_log_output(new_log_output_file("./out-lazy.log"), overflow(ALOG_OVERFLOW_BLOCK)));
+    // records kept binary, see decode_binary_log()
+    perf_backend("binary-file", new_binary_log_output_file("./out.binlog", overflow(ALOG_OVERFLOW_BLOCK)));
     return 0;
 }
@@ -0,0 +1,88 @@
+#include <photon/common/alog.h>
+#include <photon/photon.h>
+#include <photon/thread/thread.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "../expirecontainer.h"
+
+static size_t count = 1000UL * 1000;
+static std::vector<uint64_t> keys;
+
+inline static uint64_t GetSteadyTimeUs() {
+    auto now = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count();
+}
+
+// refresh `count` random keys from `vcpus` vCPUs
+template <typename Container>
+static uint64_t refresh(Container& c, int vcpus) {
+    auto start = GetSteadyTimeUs();
+    std::vector<std::thread> ths;
+    for (int i = 0; i < vcpus; i++) {
+        ths.emplace_back([&, i] {
+            photon::init(0, 0);
+            DEFER(photon::fini());
+            std::mt19937_64 rng(i);
+            for (size_t j = 0; j < count / vcpus; j++)
+                c.keep_alive(keys[rng() % count], false);
+        });
+    }
+    for (auto& th : ths) th.join();
+    return GetSteadyTimeUs() - start;
+}
+
+template <typename Container>
+static void perf(const char* name) {
+    Container c(60UL * 1000 * 1000);
+    auto t0 = GetSteadyTimeUs();
+    for (auto k : keys) c.keep_alive(k, true);
+    auto t1 = GetSteadyTimeUs();
+    LOG_INFO("`: inserted ` items in ` ms", name, c.size(), (t1 - t0) / 1000);
+    for (int vcpus = 1; vcpus <= 8; vcpus *= 2) {
+        auto us = refresh(c, vcpus);
+        LOG_INFO("`: ` refreshes from ` vCPUs in ` ms, ` ns/op", name, count,
+                 vcpus, us / 1000, us * 1000 / count);
+    }
+}
+
+// stalls seen by another vCPU while all the items expire at once
+template <typename Container>
+static void perf_expire(const char* name) {
+    Container c(1000UL * 1000);
+    for (auto k : keys) c.keep_alive(k, true);
+    uint64_t max_us = 0, ops = 0;
+    std::thread th([&] {
+        photon::init(0, 0);
+        DEFER(photon::fini());
+        auto deadline = GetSteadyTimeUs() + 3UL * 1000 * 1000;
+        for (uint64_t t; (t = GetSteadyTimeUs()) < deadline; ops++) {
+            c.keep_alive(keys[ops % 1024], false);
+            max_us = std::max(max_us, GetSteadyTimeUs() - t);
+            if (ops % 64 == 0) photon::thread_yield();
+        }
+    });
+    while (th.joinable() && c.size() > 1024) photon::thread_usleep(10 * 1000);
+    th.join();
+    LOG_INFO("`: ` items left after expiring, ` refreshes, max latency ` us",
+             name, c.size(), ops, max_us);
+}
+
+// usage: perf-expirecontainer [number of entries]
+int main(int argc, char** argv) {
+    if (argc > 1) count = atoll(argv[1]);
+    photon::init(0, 0);
+    DEFER(photon::fini());
+    std::mt19937_64 rng(std::random_device{}());
+    keys.resize(count);
+    for (auto& x : keys) x = rng();
+    perf<ExpireList<uint64_t>>("ExpireList");
+    perf<WheelExpireContainer<uint64_t>>("WheelExpireContainer");
+    perf_expire<ExpireList<uint64_t>>("ExpireList");
+    perf_expire<WheelExpireContainer<uint64_t>>("WheelExpireContainer");
+    return 0;
+}
@@ -1,6 +1,7 @@
 #include <photon/common/alog.h>
 #include <photon/photon.h>
 #include <photon/thread/thread.h>
+#include <photon/thread/thread11.h>
 
 #include <algorithm>
 #include <array>
@@ -81,11 +82,51 @@ void test(const char *name) {
     }
 }
 
-int main() {
+static int rounds = 20 * 1000;
+
+// hit-only lookups from `vcpus` vCPUs, 4 photon threads each
+template <template <class, class> class OC>
+void test_scaling(const char *name) {
+    OC<uint64_t, std::string *> oc(1000UL * 1000 * 1000);
+    for (auto &x : keys) oc.borrow(x, [&] { return new std::string(std::to_string(x)); });
+    for (int vcpus = 1; vcpus <= 16; vcpus *= 2) {
+        std::vector<std::thread> ths;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < vcpus; i++) {
+            ths.emplace_back([&, i] {
+                photon::vcpu_init();
+                DEFER(photon::vcpu_fini());
+                std::vector<photon::join_handle *> jhs;
+                for (int j = 0; j < 4; j++) {
+                    jhs.emplace_back(photon::thread_enable_join(photon::thread_create11([&, j] {
+                        size_t k = (i * 4 + j) * 7919;
+                        for (int r = 0; r < rounds; r++) {
+                            auto b = oc.borrow(keys[k++ % count], [] { return new std::string; });
+                            if (r % 64 == 0) photon::thread_yield();
+                        }
+                    })));
+                }
+                for (auto &x : jhs) photon::thread_join(x);
+            });
+        }
+        for (auto &x : ths) x.join();
+        auto done = std::chrono::steady_clock::now();
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(done - start).count();
+        LOG_INFO("`: ` vCPUs, ` borrows in ` ms, ` Kops/s", name, vcpus, 4UL * rounds * vcpus,
+                 us / 1000, 4UL * rounds * vcpus * 1000 / (us + 1));
+    }
+}
+
+// usage: perf-objcache [rounds of scaling test per photon thread]
+int main(int argc, char** argv) {
+    if (argc > 1) rounds = atoi(argv[1]);
     photon::vcpu_init();
     DEFER(photon::vcpu_fini());
     ready();
     test<ObjectCache>("ObjectCache");
     test<ObjectCacheV2>("ObjectCacheV2");
+    test<ShardedObjectCacheV2>("ShardedObjectCacheV2");
+    test_scaling<ObjectCacheV2>("ObjectCacheV2");
+    test_scaling<ShardedObjectCacheV2>("ShardedObjectCacheV2");
     return 0;
-}
\ No newline at end of file
+}
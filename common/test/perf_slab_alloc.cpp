@@ -0,0 +1,135 @@
+/*
+Copyright 2022 The Photon Authors
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Simulates the buffers of cache refills on several vCPUs: each vCPU keeps a
+// window of refills in flight, and some of them complete (and are freed) on
+// another vCPU. Compares the throughput of IOAlloc (malloc), PooledAllocator
+// and SlabAllocator, and the memory wasted by rounding up sizes.
+
+#include <photon/common/alog.h>
+#include <photon/common/io-alloc.h>
+#include <photon/common/slab-alloc.h>
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+static int nthreads = 4;
+static int seconds = 3;
+static const int WINDOW = 32;           // refills in flight per vCPU
+static const int HANDOFF_PERCENT = 25;  // refills completed by another vCPU
+
+// sizes of refills: aligned units, and odd tails of files and ranges
+static const size_t SIZES[] = {
+    4096, 12 * 1024, 36 * 1024, 64 * 1024, 100 * 1024,
+    256 * 1024, 384 * 1024, 1024 * 1024,
+};
+
+struct Handoff {
+    std::mutex mutex;
+    std::vector<void*> bufs;
+};
+
+static double run(const char* name, IOAlloc alloc) {
+    std::vector<Handoff> handoffs(nthreads);
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> total{0};
+    std::vector<std::thread> ths;
+    for (int i = 0; i < nthreads; i++) {
+        ths.emplace_back([&, i] {
+            std::mt19937 rng(i);
+            std::deque<void*> window;
+            std::vector<void*> mine;
+            uint64_t n = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                auto size = SIZES[rng() % (sizeof(SIZES) / sizeof(SIZES[0]))];
+                auto p = (char*)alloc.alloc(size);
+                p[0] = p[size - 1] = 1;     // the refill fills the buffer
+                window.push_back(p);
+                if (window.size() > WINDOW) {
+                    auto q = window.front();
+                    window.pop_front();
+                    if ((int)(rng() % 100) < HANDOFF_PERCENT) {
+                        auto& h = handoffs[(i + 1) % nthreads];
+                        std::lock_guard<std::mutex> lock(h.mutex);
+                        h.bufs.push_back(q);
+                    } else {
+                        alloc.dealloc(q);
+                    }
+                }
+                if ((n & 15) == 0) {
+                    auto& h = handoffs[i];
+                    {
+                        std::lock_guard<std::mutex> lock(h.mutex);
+                        std::swap(mine, h.bufs);
+                    }
+                    for (auto q : mine) alloc.dealloc(q);
+                    mine.clear();
+                }
+                n++;
+            }
+            for (auto q : window) alloc.dealloc(q);
+            total += n;
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    stop = true;
+    for (auto& th : ths) th.join();
+    for (auto& h : handoffs)
+        for (auto q : h.bufs) alloc.dealloc(q);
+    auto mops = total / 1e6 / seconds;
+    LOG_INFO("`: ` vCPUs, ` M alloc+free/s", name, nthreads, FP(mops).precision(3));
+    return mops;
+}
+
+// memory allocated for the buffers, over the memory requested
+static void report_waste() {
+    SlabAllocator slab;
+    double requested = 0, pow2 = 0, slabbed = 0;
+    for (auto size : SIZES) {
+        requested += size;
+        pow2 += 1UL << log2_round_up(size);
+        slabbed += SlabAllocator::class_size(slab.size_class(size));
+    }
+    LOG_INFO("rounding overhead: PooledAllocator `%, SlabAllocator `%",
+             FP((pow2 / requested - 1) * 100).precision(1),
+             FP((slabbed / requested - 1) * 100).precision(1));
+}
+
+// usage: perf-slab-alloc [vCPUs] [seconds per allocator]
+int main(int argc, char** argv) {
+    if (argc > 1) nthreads = atoi(argv[1]);
+    if (argc > 2) seconds = atoi(argv[2]);
+    set_log_output_level(ALOG_INFO);
+
+    report_waste();
+    run("IOAlloc (malloc)", IOAlloc());
+    {
+        PooledAllocator<> pooled;
+        run("PooledAllocator", pooled.get_io_alloc());
+    }
+    {
+        SlabAllocator slab;
+        run("SlabAllocator", slab.get_io_alloc());
+        auto used = slab.slab_bytes();
+        LOG_INFO("SlabAllocator: ` MB of slabs, ` MB trimmed", used >> 20, slab.trim() >> 20);
+    }
+    return 0;
+}
@@ -23,6 +23,7 @@ limitations under the License.
 #include "../alog.cpp"
 #include "../alog-audit.h"
 #include "../identity-pool.h"
+#include "../thread-slots.h"
 #include "../ring.cpp"
 #include "../alog-stdstring.h"
 #include "../alog-functionptr.h"
@@ -46,6 +47,7 @@ limitations under the License.
 #include <fcntl.h>
 #include <vector>
 #include <memory>
+#include <thread>
 #include <string>
 #include <string.h>
 //#include <gmock/gmock.h>
@@ -209,6 +211,22 @@ TEST(identity_pool, do_ops)
     do_randops(base1);
 }
 
+TEST(ThreadSlots, recycle)
+{
+    auto slots = new ThreadSlots(2);   // never destructed
+    auto a = slots->get();
+    EXPECT_EQ(a, slots->get());
+    int b = -1;
+    std::thread([&] { b = slots->get(); }).join();
+    EXPECT_NE(a, b);
+    // the slot of the exited thread is reused, and threads beyond
+    // the capacity share the extra one
+    std::thread([&] {
+        EXPECT_EQ(b, slots->get());
+        std::thread([&] { EXPECT_EQ(2, slots->get()); }).join();
+    }).join();
+}
+
 TEST(Callback, virtual_function)
 {
     const int RET = -1430789;
@@ -802,6 +820,41 @@ TEST(iovector, memcpy)
     }
 }
 
+TEST(iovector, memcpy_with_crc)
+{
+    char data[896];
+    for (size_t i = 0; i < sizeof(data); i++) data[i] = rand();
+    auto crc32 = crc32c_extend(data, sizeof(data), 0);
+    auto crc64 = crc64ecma(data, sizeof(data), 0);
+    IOVector iov1, iov2;
+    iov1.push_back(128);
+    iov1.push_back(256);
+    iov1.push_back(512);
+    iov2.push_back(512);
+    iov2.push_back(100);
+    iov2.push_back(284);
+
+    uint32_t c32 = 0;
+    EXPECT_EQ(896, iov1.memcpy_from_with_crc(data, sizeof(data), &c32));
+    EXPECT_EQ(crc32, c32);
+    uint64_t c64 = 0;
+    auto v2 = iov2.view();
+    EXPECT_EQ(896, iov1.memcpy_to_with_crc(&v2, -1, &c64));
+    EXPECT_EQ(crc64, c64);
+    char buf[1024];
+    c32 = 0;
+    EXPECT_EQ(896, iov2.memcpy_to_with_crc(buf, sizeof(buf), &c32));
+    EXPECT_EQ(crc32, c32);
+    EXPECT_EQ(0, memcmp(buf, data, sizeof(data)));
+
+    // partial copy, extending a given crc
+    c32 = crc32c_extend(data, 10, 0);
+    auto v1 = iov1.view();
+    memset(buf, 0, sizeof(buf));
+    EXPECT_EQ(300, iov2.memcpy_from_with_crc(&v1, 300, &c32));
+    EXPECT_EQ(crc32c_extend(data, 300, crc32c_extend(data, 10, 0)), c32);
+}
+
 TEST(iovector, pipe) {
     const size_t max = 16384;
     static char data[max];
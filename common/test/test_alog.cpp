@@ -23,6 +23,9 @@ limitations under the License.
 #include <photon/net/socket.h>
 #include <photon/net/utils-stdstring.h>
 #include <chrono>
+#include <thread>
+#include <atomic>
+#include <algorithm>
 #include <vector>
 #include <stdint.h>
 #include <unistd.h>
@@ -640,6 +643,218 @@ TEST(ALOG, log_with_color) {
     default_logger.log_output->preset_color();
 }
 
+struct LinesOutput : public LogOutputTest {
+    std::string all;
+    std::vector<std::string> lines;
+    void write(int, const char* begin, const char* end) override {
+        // binary outputs write formatted lines in batch
+        all.append(begin, end);
+        lines.clear();
+        for (size_t i = 0, j; i < all.size(); i = j + 1) {
+            j = all.find('\n', i);
+            if (j == std::string::npos) j = all.size();
+            // without the timestamp
+            auto ts = all.find('|', i);
+            lines.push_back(all.substr(ts < j ? ts : i, j - (ts < j ? ts : i)));
+        }
+    }
+};
+
+static void log_various_types() {
+    const char* xs = " a char* string! ";
+    char buf[32] = "char buf[32]";
+    enum { ENUM = 32 };
+    LOG_INFO("as`df``jkl`as`df``jkl`", 1, 2, 3, 4, 5);
+    LOG_INFO(2, buf, "asdf", xs, 'c', ENUM, true, (uint8_t)255, -1L);
+    LOG_INFO("Negative: ", -1, foobarasdf(), ERRNO(24), VALUE(xs));
+    LOG_INFO("more ` than ` args `", 1);
+    LOG_INFO(DEC(298345723731234).comma(true), HEX(255).width(8), std::string(" asdf"));
+    LOG_INFO(FP(5203.14159).width(10).precision(3), 1.5, (void*)0x1234);
+    LOG_WARN("`", std::string(5000, 'x'));
+    default_audit_logger << LOG_AUDIT("audit `", 1);
+}
+
+TEST(ALog, binary_output) {
+    LinesOutput text, lazy;
+    auto audit_output = default_audit_logger.log_output;
+    DEFER({ log_output = log_output_stdout; default_audit_logger.log_output = audit_output; });
+    log_output = default_audit_logger.log_output = &text;
+    log_various_types();
+    EXPECT_EQ(8UL, text.lines.size());
+
+    auto out = new_binary_log_output(&lazy);
+    log_output = default_audit_logger.log_output = out;
+    log_various_types();
+    LOG_EVERY_N(100, LOG_INFO("limited"));
+    log_output = log_output_stdout;
+    out->destruct();
+
+    // "limited", and its tail of LOG_EVERY_N as pre-formatted text
+    ASSERT_EQ(text.lines.size() + 2, lazy.lines.size());
+    for (size_t i = 0; i < text.lines.size(); ++i)
+        EXPECT_EQ(text.lines[i], lazy.lines[i]);
+    EXPECT_NE(std::string::npos, lazy.lines[text.lines.size()].find("limited"));
+    EXPECT_EQ(" <1 log(s)>", lazy.lines.back());
+}
+
+TEST(ALog, binary_output_file) {
+    LinesOutput text, decoded;
+    auto fn = "/tmp/alog_binary_test.log";
+    unlink(fn);
+    DEFER(unlink(fn));
+    log_output = &text;
+    log_various_types();
+    // twice, to check site ids of different sessions
+    for (int i = 0; i < 2; ++i) {
+        auto out = new_binary_log_output_file(fn);
+        ASSERT_NE(nullptr, out);
+        log_output = out;
+        log_various_types();
+        log_output = log_output_stdout;
+        out->destruct();
+    }
+
+    int fd = open(fn, O_RDONLY);
+    ASSERT_GE(fd, 0);
+    DEFER(close(fd));
+    EXPECT_EQ(14, decode_binary_log(fd, &decoded));
+    ASSERT_EQ(14UL, decoded.lines.size());
+    for (size_t i = 0; i < decoded.lines.size(); ++i)
+        EXPECT_EQ(text.lines[i % 7], decoded.lines[i]);
+}
+
+enum class Color { RED, GREEN };
+
+LogBuffer& operator << (LogBuffer& log, Color c) {
+    return log.printf(c == Color::RED ? "red" : "green");
+}
+
+static void log_colors(ALogLogger& logger) {
+    logger << LOG_INFO("color: ` `", Color::RED, Color::GREEN);
+}
+
+TEST(ALog, binary_output_enum) {
+    LinesOutput text, lazy;
+    ALogLogger logger{&text, ALOG_DEBUG};
+    log_colors(logger);
+    auto out = new_binary_log_output(&lazy);
+    logger.log_output = out;
+    log_colors(logger);
+    out->destruct();
+    ASSERT_EQ(1UL, lazy.lines.size());
+    EXPECT_EQ(text.lines[0], lazy.lines[0]);
+    EXPECT_NE(std::string::npos, lazy.lines[0].find("color: red green"));
+}
+
+TEST(ALog, binary_output_copies_site) {
+    LinesOutput lazy;
+    auto out = new_binary_log_output(&lazy);
+    // a call site in memory that goes away before the record is formatted,
+    // like that of a module unloaded by dlclose()
+    Prologue prolog(__func__, TSTRING("x"), 1234, ALOG_INFO);
+    char file[] = "unloaded.cpp", func[] = "unloaded_func";
+    prolog.addr_file = file;
+    prolog.len_file = sizeof(file) - 1;
+    prolog.addr_func = func;
+    prolog.len_func = sizeof(func) - 1;
+    __log__(ALOG_INFO, out, prolog, std::tuple<>(), TSTRING("value `"), 42);
+    memset(file, 'z', sizeof(file) - 1);
+    memset(func, 'z', sizeof(func) - 1);
+    out->destruct();
+    ASSERT_EQ(1UL, lazy.lines.size());
+    EXPECT_NE(std::string::npos, lazy.lines[0].find("unloaded.cpp:1234|unloaded_func:value 42"));
+}
+
+struct SlowOutput : public LogOutputTest {
+    std::atomic<uint64_t> lines{0};
+    void writev(int, const struct iovec* iov, int iovcnt) override {
+        for (int i = 0; i < iovcnt; ++i) {
+            auto p = (const char*)iov[i].iov_base;
+            lines += std::count(p, p + iov[i].iov_len, '\n');
+        }
+        ::usleep(10 * 1000);
+    }
+};
+
+static AsyncLogStats log_with_overflow(int overflow, SlowOutput* slow, int n) {
+    AsyncLogOptions opts;
+    opts.overflow = overflow;
+    opts.queue_size = 64 * 1024;
+    opts.sample_rate = 4;
+    auto out = new_async_log_output(slow, opts);
+    ALogLogger logger{out, ALOG_DEBUG};
+    for (int i = 0; i < n; ++i)
+        logger << LOG_INFO("overflow test line `, with some padding to make it longer", i);
+    AsyncLogStats stats;
+    EXPECT_EQ(0, get_async_log_stats(out, &stats));
+    out->destruct();
+    return stats;
+}
+
+TEST(ALog, async_overflow) {
+    const int N = 10000;
+    SlowOutput drop, block, sample;
+    auto stats = log_with_overflow(ALOG_OVERFLOW_DROP, &drop, N);
+    EXPECT_GT(stats.dropped, 0UL);
+    EXPECT_EQ((uint64_t)N, stats.lines + stats.dropped);
+    EXPECT_EQ(stats.lines, drop.lines);
+
+    stats = log_with_overflow(ALOG_OVERFLOW_BLOCK, &block, N);
+    EXPECT_GT(stats.blocked, 0UL);
+    EXPECT_EQ(0UL, stats.dropped);
+    EXPECT_EQ((uint64_t)N, block.lines);
+
+    stats = log_with_overflow(ALOG_OVERFLOW_SAMPLE, &sample, N);
+    EXPECT_GT(stats.sampled, 0UL);
+    EXPECT_EQ((uint64_t)N, stats.lines + stats.dropped + stats.sampled);
+    EXPECT_EQ(stats.lines, sample.lines);
+
+    AsyncLogStats x;
+    EXPECT_EQ(-1, get_async_log_stats(log_output_stdout, &x));
+}
+
+TEST(ALog, async_thread_queues) {
+    SlowOutput slow;
+    AsyncLogOptions opts;
+    opts.overflow = ALOG_OVERFLOW_BLOCK;
+    opts.num_of_queues = 3;
+    auto out = new_async_log_output(&slow, opts);
+    DEFER(out->destruct());
+    ALogLogger logger{out, ALOG_DEBUG};
+    std::atomic<int> started{0};
+    volatile bool go = false;
+    std::vector<std::thread> ths;
+    for (int i = 0; i < 4; ++i) {
+        ths.emplace_back([&, i] {
+            logger << LOG_INFO("thread ` started", i);
+            started++;
+            while (!go) ::usleep(1000);
+            for (int j = 0; j < 1000; ++j)
+                logger << LOG_INFO("thread ` line `", i, j);
+        });
+    }
+    while (started < 4) ::usleep(1000);
+    // 2 threads own a queue, and the others share the first one
+    AsyncLogStats stats;
+    EXPECT_EQ(0, get_async_log_stats(out, &stats));
+    EXPECT_EQ(2UL, stats.queues);
+    go = true;
+    for (auto& th : ths) th.join();
+    // exited threads have given up their queues
+    EXPECT_EQ(0, get_async_log_stats(out, &stats));
+    EXPECT_EQ(0UL, stats.queues);
+    EXPECT_EQ(4004UL, stats.lines);
+    // and they are owned by new threads
+    std::thread([&] {
+        logger << LOG_INFO("another thread");
+        EXPECT_EQ(0, get_async_log_stats(out, &stats));
+        EXPECT_EQ(1UL, stats.queues);
+    }).join();
+    for (int i = 0; i < 100 && slow.lines < 4005; ++i)
+        ::usleep(10 * 1000);
+    EXPECT_EQ(4005UL, slow.lines);
+}
+
 int main(int argc, char **argv)
 {
     if (!photon::is_using_default_engine()) return 0;
@@ -0,0 +1,133 @@
+/*
+Copyright 2022 The Photon Authors
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <photon/common/metric-meter/histogram.h>
+#include <photon/common/alog.h>
+#include <photon/photon.h>
+#include <photon/thread/thread.h>
+
+#include <thread>
+#include <string>
+#include <vector>
+
+#include "../../test/gtest.h"
+
+using namespace Metric;
+
+TEST(Histogram, buckets) {
+    for (uint64_t v = 0; v < 100000; v++) {
+        auto i = Histogram::bucket_of(v);
+        ASSERT_LE(Histogram::lower_bound(i), v);
+        ASSERT_GE(Histogram::upper_bound(i), v);
+    }
+    for (int i = 0; i + 1 < Histogram::NR_BUCKETS; i++) {
+        ASSERT_EQ(Histogram::upper_bound(i) + 1, Histogram::lower_bound(i + 1));
+        ASSERT_EQ(i, Histogram::bucket_of(Histogram::lower_bound(i)));
+        ASSERT_EQ(i, Histogram::bucket_of(Histogram::upper_bound(i)));
+    }
+    EXPECT_EQ(Histogram::NR_BUCKETS - 1, Histogram::bucket_of(-1UL));
+    EXPECT_EQ(-1UL, Histogram::upper_bound(Histogram::NR_BUCKETS - 1));
+    // relative error is below 1/16
+    for (uint64_t v = 16; v < (1UL << 40); v = v * 3 + 1) {
+        auto i = Histogram::bucket_of(v);
+        EXPECT_LE(Histogram::upper_bound(i) - Histogram::lower_bound(i), v / 16);
+    }
+}
+
+TEST(Histogram, quantile) {
+    Histogram h;
+    EXPECT_EQ(0UL, h.quantile(0.5));
+    for (uint64_t v = 1; v <= 1000; v++) h.put(v);
+    auto s = h.snapshot();
+    EXPECT_EQ(1000UL, s.count);
+    EXPECT_EQ(500500UL, s.sum);
+    EXPECT_EQ(500UL, s.mean());
+    auto near = [](uint64_t x, uint64_t expected) {
+        return x >= expected && x <= expected + expected / 16;
+    };
+    EXPECT_TRUE(near(s.quantile(0.5), 500)) << s.quantile(0.5);
+    EXPECT_TRUE(near(s.quantile(0.99), 990)) << s.quantile(0.99);
+    EXPECT_EQ(1UL, s.quantile(0));
+    EXPECT_TRUE(near(s.quantile(1), 1000)) << s.quantile(1);
+}
+
+TEST(Histogram, threads) {
+    // more threads than shards, some of them sharing the overflow shard
+    const int N = MAX_SHARDS + 16, M = 10000;
+    Histogram h;
+    Counter c;
+    std::vector<std::thread> ths;
+    for (int i = 0; i < N; i++) {
+        ths.emplace_back([&, i] {
+            for (int j = 0; j < M; j++) {
+                h.put(i);
+                c.inc();
+            }
+        });
+    }
+    for (auto& th : ths) th.join();
+    auto s = h.snapshot();
+    EXPECT_EQ((uint64_t)N * M, s.count);
+    EXPECT_EQ((uint64_t)N * (N - 1) / 2 * M, s.sum);
+    EXPECT_EQ((int64_t)N * M, c.val());
+    // indexes of exited threads are reused
+    std::thread([&] { EXPECT_LT(shard_index(), MAX_SHARDS); }).join();
+}
+
+TEST(Registry, expose) {
+    Registry r;
+    auto c = r.counter("requests_total", "code=\"200\"", "Requests served");
+    EXPECT_EQ(c, r.counter("requests_total", "code=\"200\""));
+    r.counter("requests_total", "code=\"404\"")->add(2);
+    c->add(3);
+    r.gauge("inflight")->sub(1);
+    EXPECT_EQ(nullptr, r.histogram("inflight"));
+    EXPECT_EQ(EINVAL, errno);
+    auto h = r.histogram("latency_us", {}, "Latency\nin us");
+    h->put(0);
+    h->put(5);
+    h->put(100);
+    {
+        SCOPE_LATENCY(*h);
+    }
+
+    std::string text;
+    r.expose(text);
+    LOG_INFO("`", text.c_str());
+    auto has = [&](const char* line) {
+        return text.find(std::string(line) + "\n") != std::string::npos;
+    };
+    EXPECT_TRUE(has("# HELP requests_total Requests served"));
+    EXPECT_TRUE(has("# TYPE requests_total counter"));
+    EXPECT_TRUE(has("requests_total{code=\"200\"} 3"));
+    EXPECT_TRUE(has("requests_total{code=\"404\"} 2"));
+    EXPECT_TRUE(has("# TYPE inflight gauge"));
+    EXPECT_TRUE(has("inflight -1"));
+    EXPECT_TRUE(has("# HELP latency_us Latency\\nin us"));
+    EXPECT_TRUE(has("# TYPE latency_us histogram"));
+    EXPECT_TRUE(has("latency_us_bucket{le=\"7\"} 3"));
+    EXPECT_TRUE(has("latency_us_bucket{le=\"127\"} 4"));
+    EXPECT_TRUE(has("latency_us_bucket{le=\"+Inf\"} 4"));
+    EXPECT_TRUE(has("latency_us_count 4"));
+    EXPECT_EQ(std::string::npos, text.find("le=\"255\""));
+}
+
+int main(int argc, char** arg) {
+    ::testing::InitGoogleTest(&argc, arg);
+    photon::init();
+    DEFER(photon::fini());
+    return RUN_ALL_TESTS();
+}
@@ -396,6 +396,61 @@ TEST(ObjectCacheV2, borrow_with_once) {
     EXPECT_EQ(2, count.load());
 }
 
+TEST(ShardedObjectCacheV2, borrow) {
+    set_log_output_level(ALOG_INFO);
+    DEFER(set_log_output_level(ALOG_DEBUG));
+    ShardedObjectCacheV2<int, std::atomic<int>*> ocache(1000UL * 1000 * 10, 8);
+    std::atomic<int> created{0};
+    std::vector<std::thread> ths;
+    for (int i = 0; i < 8; i++) {
+        ths.emplace_back([&] {
+            photon::vcpu_init();
+            DEFER(photon::vcpu_fini());
+            std::vector<photon::join_handle*> handles;
+            for (int j = 0; j < 4; j++) {
+                handles.emplace_back(photon::thread_enable_join(photon::thread_create11([&] {
+                    for (int k = 0; k < 5000; k++) {
+                        auto key = k % 1000;
+                        auto ret = ocache.borrow(key, [&] {
+                            created++;
+                            return new std::atomic<int>(key);
+                        });
+                        ASSERT_TRUE(ret);
+                        EXPECT_EQ(key, ret->load());
+                        if (k % 100 == 0) photon::thread_yield();
+                    }
+                })));
+            }
+            for (auto h : handles) photon::thread_join(h);
+        });
+    }
+    for (auto& x : ths) x.join();
+    // each key is created only once, however many borrowers race
+    EXPECT_EQ(1000, created.load());
+}
+
+TEST(ShardedObjectCacheV2, expire_and_recycle) {
+    set_log_output_level(ALOG_INFO);
+    DEFER(set_log_output_level(ALOG_DEBUG));
+    release_cnt = 0;
+    ShardedObjectCacheV2<int, ShowOnDtor*> ocache(1000UL * 1000);
+    for (int i = 0; i < 100; i++)
+        ocache.borrow(i, [&] { return new ShowOnDtor(i); });
+    {
+        auto held = ocache.borrow(0, [] { return new ShowOnDtor(-1); });
+        auto r = ocache.borrow(1, [] { return new ShowOnDtor(-1); });
+        r.recycle(true);
+    }
+    EXPECT_EQ(1, release_cnt);
+    auto held = ocache.borrow(0, [] { return new ShowOnDtor(-1); });
+    EXPECT_EQ(0, held->id);
+    // reclaimed in background, except the one in use
+    photon::thread_sleep(3);
+    EXPECT_EQ(99, release_cnt);
+    auto again = ocache.borrow(5, [&] { return new ShowOnDtor(500); });
+    EXPECT_EQ(500, again->id);
+}
+
 TEST(ExpireContainer, expire_container) {
     char key[10] = "hello";
     char key2[10] = "hello";
@@ -460,6 +515,41 @@ TEST(ExpireList, expire_container) {
     EXPECT_EQ(expire.end(), it);
 }
 
+TEST(WheelExpireContainer, expire_and_refresh) {
+    char key[] = "hello";
+    char key2[] = "wtf";
+    WheelExpireContainer<std::string, int, bool> expire(200 * 1000, 4);
+    EXPECT_TRUE(expire.insert(key, 0, true));
+    EXPECT_TRUE(expire.insert(key2, 1, true));
+    EXPECT_FALSE(expire.insert(key, 2, false));
+    EXPECT_EQ(2UL, expire.size());
+    int payload = -1;
+    EXPECT_TRUE(expire.find(key2, [&](decltype(expire)::Item* item) {
+        EXPECT_EQ(std::string(key2), item->get_payload<0>());
+        payload = item->get_payload<1>();
+    }));
+    EXPECT_EQ(1, payload);
+    // the background timer reclaims, while key is kept alive
+    for (int i = 0; i < 6; i++) {
+        photon::thread_usleep(50 * 1000);
+        EXPECT_TRUE(expire.refresh(key));
+    }
+    EXPECT_TRUE(expire.find(key, [](decltype(expire)::Item*) {}));
+    EXPECT_FALSE(expire.find(key2, [](decltype(expire)::Item*) {}));
+    EXPECT_FALSE(expire.refresh(key2));
+    EXPECT_TRUE(expire.erase(key));
+    EXPECT_FALSE(expire.erase(key));
+    EXPECT_EQ(0UL, expire.size());
+
+    WheelExpireContainer<int> list(200 * 1000);
+    EXPECT_FALSE(list.keep_alive(1, false));
+    EXPECT_TRUE(list.keep_alive(1, true));
+    EXPECT_TRUE(list.keep_alive(1, false));
+    photon::thread_usleep(300 * 1000);
+    list.expire();
+    EXPECT_FALSE(list.keep_alive(1, false));
+}
+
 struct simple_node : intrusive_list_node<simple_node> {
     int id;
 
@@ -0,0 +1,162 @@
+/*
+Copyright 2022 The Photon Authors
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <photon/common/slab-alloc.h>
+#include <photon/common/iovector.h>
+#include <photon/common/alog.h>
+
+#include <string.h>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "../../test/gtest.h"
+
+const size_t KB = 1024, MB = 1024 * 1024;
+
+TEST(SlabAllocator, size_class) {
+    SlabAllocator slab;
+    EXPECT_EQ(0, slab.size_class(0));
+    EXPECT_EQ(0, slab.size_class(1));
+    EXPECT_EQ(0, slab.size_class(4 * KB));
+    EXPECT_EQ(1, slab.size_class(4 * KB + 1));
+    EXPECT_EQ(8, slab.size_class(36 * KB));
+    EXPECT_EQ(15, slab.size_class(64 * KB));
+    EXPECT_EQ(16, slab.size_class(64 * KB + 1));
+    EXPECT_EQ(16, slab.size_class(128 * KB));
+    EXPECT_EQ(19, slab.size_class(1 * MB));
+    EXPECT_EQ(-1, slab.size_class(1 * MB + 1));
+    for (int i = 0; i < 19; i++) {
+        EXPECT_EQ(i, slab.size_class(SlabAllocator::class_size(i)));
+        EXPECT_EQ(i + 1, slab.size_class(SlabAllocator::class_size(i) + 1));
+    }
+    EXPECT_EQ(2 * MB, SlabAllocator::class_size(SlabAllocator::NR_CLASSES - 1));
+}
+
+TEST(SlabAllocator, basic) {
+    SlabAllocator slab;
+    std::vector<void*> ptrs;
+    for (size_t size : {1UL, 4 * KB, 12 * KB, 36 * KB, 64 * KB, 100 * KB, 1 * MB}) {
+        for (int i = 0; i < 100; i++) {
+            auto p = slab.alloc(size);
+            ASSERT_NE(nullptr, p);
+            EXPECT_EQ(0UL, (uint64_t)p % 4096);
+            memset(p, i, size);
+            ptrs.push_back(p);
+        }
+    }
+    EXPECT_GT(slab.slab_bytes(), 0UL);
+    for (auto p : ptrs) slab.dealloc(p);
+    // freed buffers are reused
+    auto p = slab.alloc(36 * KB);
+    EXPECT_EQ(ptrs[3 * 100 + 99], p);
+    slab.dealloc(p);
+
+    // larger than max_alloc_size
+    p = slab.alloc(4 * MB);
+    ASSERT_NE(nullptr, p);
+    memset(p, 0, 4 * MB);
+    slab.dealloc(p);
+
+    auto used = slab.slab_bytes();
+    EXPECT_EQ(used, slab.trim());
+    EXPECT_EQ(0UL, slab.slab_bytes());
+    // trimmed slabs are reused
+    p = slab.alloc(8 * KB);
+    memset(p, 0, 8 * KB);
+    EXPECT_EQ(SlabAllocator::SLAB_SIZE, slab.slab_bytes());
+    slab.dealloc(p);
+}
+
+TEST(SlabAllocator, io_alloc) {
+    SlabAllocator slab;
+    auto alloc = slab.get_io_alloc();
+    void* p = nullptr;
+    // the largest class within the range
+    EXPECT_EQ(64 * (int)KB, alloc.allocate({4 * KB, 100 * KB}, &p));
+    alloc.deallocate(p);
+    EXPECT_EQ(100 * (int)KB, alloc.allocate({100 * KB, 100 * KB}, &p));
+    memset(p, 0, 100 * KB);
+    alloc.deallocate(p);
+    EXPECT_EQ(1 * (int)MB, alloc.allocate({1 * MB, 4 * MB}, &p));
+    alloc.deallocate(p);
+    EXPECT_EQ(4 * (int)MB, alloc.allocate({2 * MB, 4 * MB}, &p));
+    memset(p, 0, 4 * MB);
+    alloc.deallocate(p);
+
+    IOVector iov(alloc);
+    iov.push_back(36 * KB);
+    iov.push_back(300 * KB);
+    EXPECT_EQ(336 * KB, iov.sum());
+    iov.clear();
+}
+
+TEST(SlabAllocator, exhausted) {
+    SlabAllocator::Options opts;
+    opts.capacity = 2 * SlabAllocator::SLAB_SIZE;
+    SlabAllocator slab(opts);
+    std::vector<void*> ptrs;
+    for (int i = 0; i < 10; i++) {
+        auto p = slab.alloc(1 * MB);
+        ASSERT_NE(nullptr, p);
+        memset(p, 0, 1 * MB);
+        ptrs.push_back(p);
+    }
+    EXPECT_EQ(opts.capacity, slab.slab_bytes());
+    for (auto p : ptrs) slab.dealloc(p);
+    EXPECT_EQ(opts.capacity, slab.trim());
+}
+
+TEST(SlabAllocator, threads) {
+    SlabAllocator slab;
+    const int N = 8, M = 20000;
+    const size_t sizes[] = {4 * KB, 12 * KB, 36 * KB, 64 * KB, 200 * KB};
+    // buffers are passed on to the next thread to be freed
+    std::mutex mutex;
+    std::vector<void*> handoff[N];
+    std::vector<std::thread> ths;
+    for (int i = 0; i < N; i++) {
+        ths.emplace_back([&, i] {
+            std::vector<void*> mine;
+            for (int j = 0; j < M; j++) {
+                auto size = sizes[(i + j) % 5];
+                auto p = (char*)slab.alloc(size);
+                p[0] = p[size - 1] = i;
+                if (j % 2) {
+                    slab.dealloc(p);
+                } else {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    handoff[(i + 1) % N].push_back(p);
+                    std::swap(mine, handoff[i]);
+                }
+                for (auto q : mine) slab.dealloc(q);
+                mine.clear();
+            }
+        });
+    }
+    for (auto& th : ths) th.join();
+    for (auto& v : handoff)
+        for (auto p : v) slab.dealloc(p);
+    auto used = slab.slab_bytes();
+    EXPECT_GT(used, 0UL);
+    EXPECT_EQ(used, slab.trim());
+    EXPECT_EQ(0UL, slab.slab_bytes());
+}
+
+int main(int argc, char** arg) {
+    ::testing::InitGoogleTest(&argc, arg);
+    return RUN_ALL_TESTS();
+}
@@ -3,6 +3,7 @@
 #include <chrono>
 #include <photon/common/alog.h>
 #include <photon/common/throttle.h>
+#include <photon/common/fair_throttle.h>
 #include <photon/common/utility.h>
 #include <photon/net/socket.h>
 #include <photon/photon.h>
@@ -457,6 +458,125 @@ TEST_P(ThrottlePriorityTest, run) {
 }
 #endif
 
+// keep `nth` photon threads per class consuming `chunk` units for `duration` us,
+// and return the units granted to each class
+static std::vector<uint64_t> run_fair(photon::fair_throttle& t, const std::vector<uint32_t>& ids,
+                                      uint64_t chunk, uint64_t duration, int nth = 2) {
+    std::vector<uint64_t> got(ids.size());
+    std::vector<photon::join_handle*> jhs;
+    photon::thread_yield();
+    auto deadline = photon::now + duration;
+    for (size_t i = 0; i < ids.size(); i++) {
+        for (int j = 0; j < nth; j++) {
+            auto th = photon::thread_create11([&, i] {
+                while (photon::now < deadline) {
+                    if (t.consume(ids[i], chunk) == 0) got[i] += chunk;
+                }
+            });
+            jhs.push_back(photon::thread_enable_join(th));
+        }
+    }
+    for (auto jh : jhs) photon::thread_join(jh);
+    return got;
+}
+
+TEST(FairThrottle, weighted) {
+    photon::fair_throttle t(10 * 1024 * 1024);
+    t.set_class(1, {0, -1UL, 1});
+    t.set_class(2, {0, -1UL, 3});
+    auto got = run_fair(t, {1, 2}, 64 * 1024, 1000 * 1000);
+    LOG_INFO(VALUE(got[0]), VALUE(got[1]));
+    double ratio = (double)got[1] / got[0];
+    EXPECT_GT(ratio, 2.5);
+    EXPECT_LT(ratio, 3.5);
+    // work-conserving: the device limit is fully used
+    EXPECT_GT(got[0] + got[1], 9UL * 1024 * 1024);
+    EXPECT_LT(got[0] + got[1], 12UL * 1024 * 1024);
+}
+
+TEST(FairThrottle, work_conserving) {
+    photon::fair_throttle t(10 * 1024 * 1024);
+    t.set_class(1, {0, -1UL, 1});
+    t.set_class(2, {0, -1UL, 100});   // idle
+    auto got = run_fair(t, {1}, 64 * 1024, 1000 * 1000);
+    LOG_INFO(VALUE(got[0]));
+    EXPECT_GT(got[0], 9UL * 1024 * 1024);
+}
+
+TEST(FairThrottle, assured_and_ceil) {
+    photon::fair_throttle t(10 * 1024 * 1024);
+    t.set_class(1, {6 * 1024 * 1024, -1UL, 1});
+    t.set_class(2, {0, -1UL, 100});
+    t.set_class(3, {0, 1024 * 1024, 100});
+    auto got = run_fair(t, {1, 2, 3}, 64 * 1024, 1000 * 1000);
+    LOG_INFO(VALUE(got[0]), VALUE(got[1]), VALUE(got[2]));
+    EXPECT_GT(got[0], 5UL * 1024 * 1024);
+    EXPECT_LT(got[2], 1536UL * 1024);
+    photon::fair_throttle::Stats stats;
+    EXPECT_EQ(0, t.get_stats(3, &stats));
+    EXPECT_EQ(got[2], stats.granted);
+    EXPECT_GT(stats.waited, 0UL);
+}
+
+TEST(FairThrottle, hierarchy) {
+    photon::fair_throttle t(8 * 1024 * 1024);
+    t.set_class(1, {0, -1UL, 1});
+    t.set_class(2, {0, -1UL, 1});
+    t.set_class(11, {0, -1UL, 1}, 1);
+    t.set_class(12, {0, -1UL, 1}, 1);
+    EXPECT_EQ(-1, t.set_class(1, {}, 11));
+    EXPECT_EQ(EINVAL, errno);
+    EXPECT_EQ(-1, t.remove_class(1));
+    EXPECT_EQ(EBUSY, errno);
+    auto got = run_fair(t, {11, 12, 2}, 32 * 1024, 1000 * 1000);
+    LOG_INFO(VALUE(got[0]), VALUE(got[1]), VALUE(got[2]));
+    double r0 = (double)got[0] / got[2], r1 = (double)got[1] / got[2];
+    EXPECT_GT(r0, 0.4);
+    EXPECT_LT(r0, 0.6);
+    EXPECT_GT(r1, 0.4);
+    EXPECT_LT(r1, 0.6);
+    EXPECT_EQ(0, t.remove_class(12));
+}
+
+TEST(FairThrottle, reserved_for_high_priority) {
+    photon::fair_throttle t(10 * 1024 * 1024, 2 * 1024 * 1024);
+    t.set_class(1, {0, -1UL, 1});
+    uint64_t max_latency = 0, n = 0;
+    auto deadline = photon::now + 1000 * 1000;
+    auto th = photon::thread_create11([&] {
+        while (photon::now < deadline) {
+            auto start = photon::now;
+            EXPECT_EQ(0, t.consume(2, 1024, photon::fair_throttle::Priority::High));
+            max_latency = std::max(max_latency, photon::now - start);
+            n++;
+            photon::thread_usleep(1000);
+        }
+    });
+    auto jh = photon::thread_enable_join(th);
+    auto got = run_fair(t, {1}, 256 * 1024, 1000 * 1000, 4);
+    photon::thread_join(jh);
+    LOG_INFO(VALUE(got[0]), VALUE(n), VALUE(max_latency));
+    EXPECT_LT(max_latency, 20 * 1000UL);
+    // normal traffic still borrows most of the idle reserve
+    EXPECT_GT(got[0], 8UL * 1024 * 1024);
+}
+
+TEST(FairThrottle, timeout_and_try_consume) {
+    photon::fair_throttle t(1024 * 1024);
+    EXPECT_EQ(0, t.try_consume(7, 64 * 1024));
+    EXPECT_EQ(-1, t.try_consume(7, 64 * 1024));
+    EXPECT_EQ(EAGAIN, errno);
+    EXPECT_EQ(-1, t.consume(7, 1024 * 1024, photon::fair_throttle::Priority::Normal, 10 * 1000));
+    EXPECT_EQ(ETIMEDOUT, errno);
+    auto start = photon::now;
+    EXPECT_EQ(0, t.consume(7, 1024));
+    EXPECT_GT(photon::now - start, 30 * 1000UL);
+    // unknown classes are charged to the default class
+    photon::fair_throttle::Stats stats;
+    EXPECT_EQ(0, t.get_stats(0, &stats));
+    EXPECT_EQ(2UL, stats.requests);
+}
+
 int main(int argc, char** argv) {
     int ret = photon::init(photon::INIT_EVENT_DEFAULT, photon::INIT_IO_NONE);
     if (ret) return -1;
@@ -0,0 +1,53 @@
+/*
+Copyright 2022 The Photon Authors
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "thread-slots.h"
+
+#include <utility>
+
+// the indexes held by current thread, released when it exits
+struct HeldSlots {
+    std::vector<std::pair<ThreadSlots*, int>> slots;
+    ~HeldSlots() {
+        for (auto& x : slots) x.first->release(x.second);
+    }
+};
+
+static thread_local HeldSlots held;
+
+int ThreadSlots::get() {
+    for (auto& x : held.slots)
+        if (x.first == this) return x.second;
+    auto i = acquire();
+    held.slots.emplace_back(this, i);
+    return i;
+}
+
+int ThreadSlots::acquire() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_free.empty()) {
+        auto i = m_free.back();
+        m_free.pop_back();
+        return i;
+    }
+    return (m_next < m_capacity) ? m_next++ : m_capacity;
+}
+
+void ThreadSlots::release(int i) {
+    if (i >= m_capacity) return;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_free.push_back(i);
+}
@@ -0,0 +1,54 @@
+/*
+Copyright 2022 The Photon Authors
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+#include <mutex>
+#include <vector>
+
+/**
+ * Indexes in [0, capacity) for OS threads (vCPUs), to address per-thread data
+ * such as the shards of a counter, or caches of free buffers.
+ *
+ * An index is recycled when its thread exits, so that short-lived threads do
+ * not exhaust them, and the data it addresses is inherited by the next thread
+ * that gets it. Threads beyond `capacity` all get `capacity`, so the data
+ * should have an extra entry, shared by them.
+ *
+ * As threads may exit after static destruction, a ThreadSlots is meant to be
+ * created with `new` and never destructed.
+ */
+class ThreadSlots {
+public:
+    explicit ThreadSlots(int capacity) : m_capacity(capacity) { }
+    ThreadSlots(const ThreadSlots&) = delete;
+    ThreadSlots& operator=(const ThreadSlots&) = delete;
+
+    int capacity() const { return m_capacity; }
+
+    // the index of current thread, acquired on its first call; callers
+    // on hot paths are expected to cache it in a thread_local
+    int get();
+
+protected:
+    std::mutex m_mutex;
+    std::vector<int> m_free;
+    int m_next = 0;
+    const int m_capacity;
+
+    int acquire();
+    void release(int i);
+    friend struct HeldSlots;
+};
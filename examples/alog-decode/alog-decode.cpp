@@ -0,0 +1,46 @@
+/*
+Copyright 2022 The Photon Authors
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Turn a log file written by new_binary_log_output_file() into text.
+// usage: alog-decode <binary log> [text log]
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <photon/common/alog.h>
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <binary log> [text log]\n", argv[0]);
+        return 1;
+    }
+    // keep stdout for the decoded lines
+    set_log_output(log_output_stderr);
+    int fd = open(argv[1], O_RDONLY);
+    if (fd < 0) LOG_ERRNO_RETURN(0, 1, "failed to open ", argv[1]);
+    DEFER(close(fd));
+    auto output = log_output_stdout;
+    if (argc > 2) {
+        output = new_log_output_file(argv[2]);
+        if (!output) return 1;
+    } else if (!isatty(1)) {
+        output->clear_color();
+    }
+    DEFER(output->destruct());
+    auto ret = decode_binary_log(fd, output);
+    if (ret < 0) return 1;
+    LOG_INFO("` lines decoded from `", ret, argv[1]);
+    return 0;
+}
@@ -0,0 +1,192 @@
+/*
+Copyright 2022 The Photon Authors
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Memory per connection of an echo server, with every connection idle in
+// recv(): stackless coroutines (photon/io/coro20.h) versus photon threads.
+// Clients are plain blocking sockets of a std::thread, in the same process.
+//
+//     c++20coro-echo-memory --conns=10000 --stackless=true
+//     c++20coro-echo-memory --conns=10000 --stackless=false
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <gflags/gflags.h>
+#include <photon/photon.h>
+#include <photon/io/coro20.h>
+#include <photon/net/socket.h>
+#include <photon/thread/thread11.h>
+#include <photon/common/alog.h>
+
+DEFINE_uint64(conns, 10000, "number of connections");
+DEFINE_bool(stackless, true, "stackless coroutines, or photon threads");
+DEFINE_uint64(msg_size, 64, "bytes echoed on each connection");
+DEFINE_uint64(engine, photon::INIT_EVENT_EPOLL, "master event engine, 1 for epoll, 2 for io_uring");
+
+static const size_t BUF_SIZE = 4096;
+
+struct Memory {
+    uint64_t vsz = 0, rss = 0;  // in bytes
+};
+
+static Memory memory_usage() {
+    Memory m;
+    auto f = fopen("/proc/self/statm", "r");
+    if (!f) return m;
+    DEFER(fclose(f));
+    unsigned long pages, resident;
+    if (fscanf(f, "%lu %lu", &pages, &resident) == 2) {
+        m.vsz = pages * getpagesize();
+        m.rss = resident * getpagesize();
+    }
+    return m;
+}
+
+static photon::coro::Task<> echo(int fd) {
+    char buf[BUF_SIZE];
+    ssize_t n;
+    while ((n = co_await photon::coro::recv(fd, buf, sizeof(buf))) > 0) {
+        if (co_await photon::coro::send(fd, buf, n) != n) break;
+    }
+    ::close(fd);
+}
+
+static photon::coro::Task<> serve(photon::coro::Scheduler* sched, int listener,
+                                  photon::coro::CancelToken* token) {
+    for (;;) {
+        int fd = co_await photon::coro::accept(listener, nullptr, nullptr, {}, token);
+        if (fd < 0) {
+            if (errno != ECANCELED) LOG_ERROR("failed to accept ", ERRNO());
+            co_return;
+        }
+        sched->spawn(echo(fd));
+    }
+}
+
+static int echo_handler(void*, photon::net::ISocketStream* s) {
+    char buf[BUF_SIZE];
+    ssize_t n;
+    while ((n = s->recv(buf, sizeof(buf))) > 0) {
+        if (s->write(buf, n) != n) break;
+    }
+    return 0;
+}
+
+// connects all the clients, and makes a round trip on each of them
+static void run_clients(uint16_t port, std::vector<int>* fds, std::atomic<int>* state) {
+    DEFER(*state = 1);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    std::vector<char> msg(FLAGS_msg_size, 'x'), buf(FLAGS_msg_size);
+    for (uint64_t i = 0; i < FLAGS_conns; i++) {
+        int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) LOG_ERRNO_RETURN(0, , "failed to create client `", i);
+        if (::connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+            ::close(fd);
+            LOG_ERRNO_RETURN(0, , "failed to connect client `", i);
+        }
+        fds->push_back(fd);
+    }
+    for (auto fd : *fds) {
+        if (::write(fd, msg.data(), msg.size()) != (ssize_t)msg.size() ||
+            ::recv(fd, buf.data(), buf.size(), MSG_WAITALL) != (ssize_t)buf.size())
+            LOG_ERRNO_RETURN(0, , "failed to echo");
+    }
+}
+
+static void raise_fd_limit() {
+    rlimit r;
+    if (getrlimit(RLIMIT_NOFILE, &r) < 0) return;
+    r.rlim_cur = r.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &r);
+    if (r.rlim_cur < FLAGS_conns * 2 + 64)
+        LOG_WARN("fd limit ` may be too low for ` connections", r.rlim_cur, FLAGS_conns);
+}
+
+int main(int argc, char** argv) {
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+    set_log_output_level(ALOG_INFO);
+    raise_fd_limit();
+    if (photon::init(FLAGS_engine, photon::INIT_IO_NONE))
+        return -1;
+    DEFER(photon::fini());
+
+    photon::coro::Scheduler sched;
+    photon::coro::CancelToken token;
+    photon::net::ISocketServer* server = nullptr;
+    DEFER(delete server);
+    int listener = -1;
+    photon::join_handle* runner = nullptr;
+    uint16_t port;
+    if (FLAGS_stackless) {
+        listener = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        if (::bind(listener, (sockaddr*)&addr, len) < 0 || ::listen(listener, 4096) < 0 ||
+            ::getsockname(listener, (sockaddr*)&addr, &len) < 0)
+            LOG_ERRNO_RETURN(0, -1, "failed to listen");
+        port = ntohs(addr.sin_port);
+        sched.spawn(serve(&sched, listener, &token));
+        runner = photon::thread_enable_join(
+            photon::thread_create11([&] { sched.run(); }));
+    } else {
+        server = photon::net::new_tcp_socket_server();
+        if (server->bind_v4localhost() < 0 || server->listen(4096) < 0)
+            LOG_ERRNO_RETURN(0, -1, "failed to listen");
+        port = server->getsockname().port;
+        server->set_handler({nullptr, &echo_handler});
+        server->start_loop();
+    }
+
+    auto before = memory_usage();
+    std::vector<int> fds;
+    std::atomic<int> state{0};
+    fds.reserve(FLAGS_conns);
+    std::thread clients(&run_clients, port, &fds, &state);
+    while (!state) photon::thread_usleep(1000);
+    photon::thread_usleep(100 * 1000);  // for the servers to settle
+    auto after = memory_usage();
+    clients.join();
+
+    auto n = fds.size() ? fds.size() : 1;
+    LOG_INFO("` server, ` connections: ` KB RSS and ` KB virtual memory per connection",
+             FLAGS_stackless ? "stackless coroutine" : "photon thread", fds.size(),
+             FP((after.rss - before.rss) / 1024.0 / n).precision(2),
+             FP((after.vsz - before.vsz) / 1024.0 / n).precision(2));
+
+    for (auto fd : fds) ::close(fd);
+    if (FLAGS_stackless) {
+        token.cancel();     // and the sessions finish as their clients close
+        photon::thread_join(runner);
+        ::close(listener);
+    } else {
+        photon::thread_usleep(1000 * 1000);
+        server->terminate();
+    }
+    return 0;
+}
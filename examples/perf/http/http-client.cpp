@@ -18,6 +18,7 @@ limitations under the License.
 #include <cstddef>
 #include <cstring>
 #include <string>
+#include <vector>
 
 #include <gflags/gflags.h>
 
@@ -35,6 +36,9 @@ DEFINE_uint64(port, 19876, "port");
 DEFINE_uint64(count, -1UL, "request count per thread, -1 for endless loop");
 DEFINE_uint64(threads, 4, "num threads");
 DEFINE_uint64(body_size, 4096, "http body size");
+DEFINE_string(path, "", "target path, e.g. /static-file.test for a server with --serve_file");
+DEFINE_uint64(range_size, 0, "request ranges of this size at random offsets of the body, 0 for the whole body");
+DEFINE_uint64(pipeline, 1, "requests sent in a batch with HTTP pipelining, 1 for no pipelining");
 
 class StringStream {
     std::string s;
@@ -83,25 +87,38 @@ inline uint64_t GetSteadyTimeUs() {
 void client_thread_entry(result *res, net::http::Client *client, int idx) {
     std::string body_buf;
     body_buf.resize(FLAGS_body_size);
-    std::string target = "http://" + FLAGS_ip + ":" + std::to_string(FLAGS_port);
-    for (uint64_t i = 0; i < FLAGS_count; i++) {
+    std::string target = "http://" + FLAGS_ip + ":" + std::to_string(FLAGS_port) + FLAGS_path;
+    uint64_t size = FLAGS_range_size ? FLAGS_range_size : FLAGS_body_size;
+    std::vector<net::http::Client::Operation*> ops;
+    for (uint64_t j = 0; j < FLAGS_pipeline; j++)
+        ops.push_back(client->new_operation(net::http::Verb::GET, target, 8 * 1024));
+    DEFER(for (auto op : ops) client->destroy_operation(op));
+    for (uint64_t i = 0; i < FLAGS_count; i += ops.size()) {
         auto t_begin = GetSteadyTimeUs();
-        net::http::Client::OperationOnStack<8 * 1024> operation(client, net::http::Verb::GET, target);
-        auto op = &operation;
-        client->call(op);
-        if (op->resp.headers.content_length() != FLAGS_body_size) {
-            LOG_ERROR(VALUE(op->resp.headers.content_length()), VALUE(errno), VALUE(i), VALUE(FLAGS_body_size));
-            res->failed = true;
+        for (auto op : ops) {
+            op->req.reset(net::http::Verb::GET, target);
+            if (FLAGS_range_size) {
+                auto offset = rand() % (FLAGS_body_size - FLAGS_range_size + 1);
+                op->req.headers.range(offset, offset + FLAGS_range_size - 1);
+            }
         }
-        auto ret = op->resp.read((void*)body_buf.data(), FLAGS_body_size);
-        if (ret != (ssize_t)FLAGS_body_size) {
-            LOG_ERROR(VALUE(ret), VALUE(errno), VALUE(i), VALUE(FLAGS_body_size));
-            res->failed = true;
+        if (ops.size() == 1) client->call(ops[0]);
+        else client->call_pipelined(ops.data(), ops.size());
+        for (auto op : ops) {
+            if (op->resp.headers.content_length() != size) {
+                LOG_ERROR(VALUE(op->resp.headers.content_length()), VALUE(errno), VALUE(i), VALUE(size));
+                res->failed = true;
+            }
+            auto ret = op->resp.read((void*)body_buf.data(), size);
+            if (ret != (ssize_t)size) {
+                LOG_ERROR(VALUE(ret), VALUE(errno), VALUE(i), VALUE(size));
+                res->failed = true;
+            }
         }
         auto t_end = GetSteadyTimeUs();
-        res->sum_throuput += FLAGS_body_size;
-        res->sum_latency += t_end - t_begin;
-        res->cnt++;
+        res->sum_throuput += size * ops.size();
+        res->sum_latency += (t_end - t_begin) * ops.size();
+        res->cnt += ops.size();
     }
 }
 void test_client(result &res) {
@@ -122,6 +139,10 @@ void test_client(result &res) {
 int main(int argc, char** argv) {
     gflags::ParseCommandLineFlags(&argc, &argv, true);
     set_log_output_level(ALOG_INFO);
+    if (FLAGS_pipeline == 0)
+        LOG_ERROR_RETURN(EINVAL, -1, "pipeline should be at least 1");
+    if (FLAGS_range_size > FLAGS_body_size)
+        LOG_ERROR_RETURN(EINVAL, -1, "range_size ` exceeds body_size `", FLAGS_range_size, FLAGS_body_size);
     if (photon::init(photon::INIT_EVENT_DEFAULT, photon::INIT_IO_NONE))
         return -1;
     DEFER(photon::fini());
@@ -132,9 +153,11 @@ int main(int argc, char** argv) {
     DEFER(net::et_poller_fini());
 #endif
     test_client(res_client);
-    if (res_client.cnt != 0) LOG_INFO("http_client latency = `us , throughput = `MB/s, failed = `, read_size = `, threads = `",
+    if (res_client.cnt != 0) LOG_INFO("http_client latency = `us , throughput = `MB/s, requests = `/s, failed = `, read_size = `, threads = `, pipeline = `",
                 res_client.sum_latency / res_client.cnt,
                 res_client.sum_throuput * 1000 * 1000 / (res_client.t_end - res_client.t_begin) / 1024 / 1024,
-                res_client.failed, FLAGS_body_size, FLAGS_threads);
+                res_client.cnt * 1000 * 1000 / (res_client.t_end - res_client.t_begin),
+                res_client.failed, FLAGS_range_size ? FLAGS_range_size : FLAGS_body_size, FLAGS_threads,
+                FLAGS_pipeline);
     return 0;
 }
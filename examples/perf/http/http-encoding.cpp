@@ -0,0 +1,149 @@
+/*
+Copyright 2022 The Photon Authors
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Throughput and bytes on the wire of HTTP responses with a JSON-like body,
+// in each of the content encodings, negotiated by Accept-Encoding. The server
+// and the clients run in the same process; the bytes on the wire are those
+// acknowledged on the server side of the connections (headers included).
+//
+//     http-encoding --body_size=262144 --requests=2000 --encodings=identity,gzip,deflate
+
+#include <linux/tcp.h>
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <gflags/gflags.h>
+#include <photon/photon.h>
+#include <photon/net/socket.h>
+#include <photon/net/http/client.h>
+#include <photon/net/http/server.h>
+#include <photon/thread/thread11.h>
+#include <photon/common/alog-stdstring.h>
+#include <photon/common/estring.h>
+
+using namespace photon::net;
+
+DEFINE_uint64(body_size, 256 * 1024, "size of the response body before encoding");
+DEFINE_uint64(requests, 2000, "number of requests for each encoding");
+DEFINE_uint64(threads, 4, "concurrent clients");
+DEFINE_string(encodings, "identity,gzip,deflate", "encodings to run, e.g. identity,gzip,deflate,zstd");
+DEFINE_int32(level, -1, "compression level, -1 for default");
+
+static std::string body;
+// bytes acknowledged on each connection before the current run, as the
+// connections in the pool of the client may be reused across runs
+static std::map<ISocketStream*, uint64_t> connections;
+
+static uint64_t bytes_acked(ISocketStream* s) {
+    struct tcp_info info = {};
+    socklen_t len = sizeof(info);
+    if (s->getsockopt(IPPROTO_TCP, TCP_INFO, &info, &len) < 0)
+        return 0;
+    return info.tcpi_bytes_acked;
+}
+
+static int json_handler(void*, http::Request& req, http::Response& resp, std::string_view) {
+    auto s = req.get_socket_stream();
+    if (!connections.count(s))
+        connections[s] = bytes_acked(s);
+    resp.set_result(200);
+    resp.headers.insert("Content-Type", "application/json");
+    auto encoding = http::select_encoding(req.headers["Accept-Encoding"]);
+    if (encoding.empty()) {
+        resp.headers.content_length(body.size());
+    } else if (resp.encode_body(encoding, FLAGS_level) < 0) {
+        LOG_ERRNO_RETURN(0, -1, "failed to encode body in `", encoding);
+    }
+    // in pieces, as produced by a serializer
+    for (size_t i = 0; i < body.size(); i += 4096) {
+        auto size = std::min(body.size() - i, (size_t)4096);
+        if (resp.write(body.data() + i, size) != (ssize_t)size)
+            LOG_ERRNO_RETURN(0, -1, "failed to send body");
+    }
+    return 0;
+}
+
+static int run(uint16_t port, std::string_view encoding) {
+    connections.clear();
+    auto client = http::new_http_client();
+    DEFER(delete client);
+    auto url = "http://127.0.0.1:" + std::to_string(port) + "/data.json";
+    uint64_t done = 0, failed = 0;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<photon::join_handle*> jhs;
+    for (uint64_t t = 0; t < FLAGS_threads; t++) {
+        jhs.push_back(photon::thread_enable_join(photon::thread_create11([&] {
+            std::vector<char> buf(FLAGS_body_size + 1);
+            while (done + failed < FLAGS_requests) {
+                auto op = client->new_operation(http::Verb::GET, url);
+                DEFER(client->destroy_operation(op));
+                op->req.headers.insert("Accept-Encoding", encoding);
+                if (op->call() < 0 || op->resp.status_code() != 200 ||
+                    op->resp.read(buf.data(), buf.size()) != (ssize_t)body.size()) {
+                    failed++;
+                    continue;
+                }
+                done++;
+            }
+        })));
+    }
+    for (auto jh : jhs) photon::thread_join(jh);
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start).count();
+    photon::thread_usleep(10 * 1000);   // for the last acknowledgements
+    uint64_t wire = 0;
+    for (auto& c : connections) wire += bytes_acked(c.first) - c.second;
+    if (failed)
+        LOG_ERROR("` requests failed", failed);
+    auto n = done ? done : 1;
+    LOG_INFO("`: ` requests/s, ` MB/s of body decoded, ` bytes on the wire per response (`% of the body)",
+             encoding, done * 1000000 / us, FP(done * body.size() / (double)us).precision(1),
+             wire / n, FP(wire * 100.0 / n / body.size()).precision(1));
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+    set_log_output_level(ALOG_INFO);
+    if (photon::init(photon::INIT_EVENT_DEFAULT, photon::INIT_IO_NONE))
+        return -1;
+    DEFER(photon::fini());
+
+    for (uint64_t i = 0; body.size() < FLAGS_body_size; i++) {
+        body += "{\"id\": " + std::to_string(i) + ", \"name\": \"user" + std::to_string(i % 97) +
+                "\", \"score\": " + std::to_string(i * 7919 % 1000) + ", \"active\": " +
+                (i % 3 ? "true" : "false") + "},\n";
+    }
+    body.resize(FLAGS_body_size);
+
+    auto server = new_tcp_socket_server();
+    DEFER(delete server);
+    auto http_server = http::new_http_server();
+    DEFER(delete http_server);
+    http_server->add_handler({nullptr, &json_handler});
+    if (server->bind_v4localhost() < 0 || server->listen() < 0)
+        LOG_ERRNO_RETURN(0, -1, "failed to listen");
+    server->set_handler(http_server->get_connection_handler());
+    server->start_loop();
+
+    for (auto encoding : estring_view(FLAGS_encodings).split(","))
+        run(server->getsockname().port, encoding);
+    server->terminate();
+    return 0;
+}
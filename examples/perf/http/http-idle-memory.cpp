@@ -0,0 +1,148 @@
+/*
+Copyright 2022 The Photon Authors
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Memory per idle keep-alive connection of an HTTP server, with the idle
+// connections parked in a cascading engine, or each of them kept by a thread.
+// Clients are plain blocking sockets of a std::thread, in the same process.
+//
+//     http-idle-memory --conns=10000 --park=true
+//     http-idle-memory --conns=10000 --park=false
+
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gflags/gflags.h>
+#include <photon/photon.h>
+#include <photon/net/socket.h>
+#include <photon/net/http/server.h>
+#include <photon/thread/thread11.h>
+#include <photon/common/alog.h>
+
+using namespace photon::net;
+
+DEFINE_uint64(conns, 10000, "number of connections");
+DEFINE_bool(park, true, "park idle connections, or keep a thread for each of them");
+DEFINE_uint64(engine, photon::INIT_EVENT_EPOLL, "master event engine, 1 for epoll, 2 for io_uring");
+
+struct Memory {
+    uint64_t vsz = 0, rss = 0;  // in bytes
+};
+
+static Memory memory_usage() {
+    Memory m;
+    auto f = fopen("/proc/self/statm", "r");
+    if (!f) return m;
+    DEFER(fclose(f));
+    unsigned long pages, resident;
+    if (fscanf(f, "%lu %lu", &pages, &resident) == 2) {
+        m.vsz = pages * getpagesize();
+        m.rss = resident * getpagesize();
+    }
+    return m;
+}
+
+static int hello_handler(void*, http::Request&, http::Response& resp, std::string_view) {
+    resp.set_result(200);
+    resp.headers.content_length(5);
+    resp.write("hello", 5);
+    return 0;
+}
+
+// connects all the clients, and makes a request on each of them
+static void run_clients(uint16_t port, std::vector<int>* fds, std::atomic<int>* state) {
+    DEFER(*state = 1);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    for (uint64_t i = 0; i < FLAGS_conns; i++) {
+        int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) LOG_ERRNO_RETURN(0, , "failed to create client `", i);
+        if (::connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+            ::close(fd);
+            LOG_ERRNO_RETURN(0, , "failed to connect client `", i);
+        }
+        fds->push_back(fd);
+    }
+    std::string req = "GET /hello HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    char buf[4096];
+    for (auto fd : *fds) {
+        if (::write(fd, req.data(), req.size()) != (ssize_t)req.size())
+            LOG_ERRNO_RETURN(0, , "failed to send request");
+        // the response is small enough to come in one piece
+        auto n = ::recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0 || std::string(buf, n).find("hello") == std::string::npos)
+            LOG_ERRNO_RETURN(0, , "failed to receive response");
+    }
+}
+
+static void raise_fd_limit() {
+    rlimit r;
+    if (getrlimit(RLIMIT_NOFILE, &r) < 0) return;
+    r.rlim_cur = r.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &r);
+    if (r.rlim_cur < FLAGS_conns * 2 + 64)
+        LOG_WARN("fd limit ` may be too low for ` connections", r.rlim_cur, FLAGS_conns);
+}
+
+int main(int argc, char** argv) {
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+    set_log_output_level(ALOG_INFO);
+    raise_fd_limit();
+    if (photon::init(FLAGS_engine, photon::INIT_IO_NONE))
+        return -1;
+    DEFER(photon::fini());
+
+    auto server = new_tcp_socket_server();
+    DEFER(delete server);
+    auto http_server = http::new_http_server();
+    DEFER(delete http_server);
+    http_server->set_idle_parking(FLAGS_park);
+    http_server->add_handler({nullptr, &hello_handler});
+    if (server->bind_v4localhost() < 0 || server->listen(4096) < 0)
+        LOG_ERRNO_RETURN(0, -1, "failed to listen");
+    server->set_handler(http_server->get_connection_handler());
+    server->start_loop();
+
+    auto before = memory_usage();
+    std::vector<int> fds;
+    std::atomic<int> state{0};
+    fds.reserve(FLAGS_conns);
+    std::thread clients(&run_clients, server->getsockname().port, &fds, &state);
+    while (!state) photon::thread_usleep(1000);
+    photon::thread_usleep(100 * 1000);  // for the server to settle
+    auto after = memory_usage();
+    clients.join();
+
+    auto n = fds.size() ? fds.size() : 1;
+    LOG_INFO("` idle connections, `: ` KB RSS and ` KB virtual memory per connection",
+             fds.size(), FLAGS_park ? "parked" : "with threads",
+             FP((after.rss - before.rss) / 1024.0 / n).precision(2),
+             FP((after.vsz - before.vsz) / 1024.0 / n).precision(2));
+
+    for (auto fd : fds) ::close(fd);
+    photon::thread_usleep(1000 * 1000);
+    server->terminate();
+    return 0;
+}
@@ -30,6 +30,9 @@ using namespace photon;
 DEFINE_int32(port, 19876, "port");
 DEFINE_int32(body_size, 4096, "http body size");
 DEFINE_bool(serve_file, false, "serve static file");
+DEFINE_bool(sendfile, true, "serve static file with sendfile, or by copying in user space");
+DEFINE_string(proxy, "", "act as a reverse proxy to this upstream, e.g. 127.0.0.1:19877");
+DEFINE_bool(splice, true, "relay proxied bodies with splice, or by copying in user space");
 
 static bool stop_flag = false;
 static std::string data_str;
@@ -46,6 +49,23 @@ static void show_qps_loop() {
     }
 }
 
+static int proxy_director(void*, net::http::Request& src, net::http::Request& dst) {
+    dst.reset(src.verb(), "http://" + FLAGS_proxy + std::string(src.target()));
+    for (auto kv = src.headers.begin(); kv != src.headers.end(); kv++) {
+        if (kv.first() != "Host") dst.headers.insert(kv.first(), kv.second());
+    }
+    return 0;
+}
+
+static int proxy_modifier(void*, net::http::Response& src, net::http::Response& dst) {
+    dst.set_result(src.status_code());
+    for (auto kv : src.headers) {
+        dst.headers.insert(kv.first, kv.second);
+    }
+    qps++;
+    return 0;
+}
+
 class SimpleHandler : public net::http::HTTPHandler {
 public:
     int handle_request(net::http::Request& req, net::http::Response& resp, std::string_view) {
@@ -96,12 +116,17 @@ int main(int argc, char** argv) {
         LOG_ERRNO_RETURN(0, -1, "error file");
     }
     DEFER(delete file);
-    for (int i = 0; i < FLAGS_body_size; ++i) {
-        file->write("1", 1);
+    if (file->write(data_str.data(), data_str.size()) != (ssize_t) data_str.size()) {
+        LOG_ERRNO_RETURN(0, -1, "error write file");
     }
-    auto fs_handler = net::http::new_fs_handler(fs);
+    auto fs_handler = net::http::new_fs_handler(fs, FLAGS_sendfile);
     DEFER(delete fs_handler);
-    if (FLAGS_serve_file) {
+    auto proxy_handler = net::http::new_proxy_handler({nullptr, &proxy_director},
+        {nullptr, &proxy_modifier}, nullptr, false, FLAGS_splice);
+    DEFER(delete proxy_handler);
+    if (!FLAGS_proxy.empty()) {
+        http_srv->add_handler(proxy_handler);
+    } else if (FLAGS_serve_file) {
         http_srv->add_handler(fs_handler);
     } else {
         http_srv->add_handler(&handler);
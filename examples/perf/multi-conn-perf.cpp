@@ -15,9 +15,18 @@ limitations under the License.
 */
 
 // This is a performance test for multiple connections and OS threads
+//
+// With --reuseport, the server is a single-port reuseport server, whose
+// vCPUs (of a WorkPool) each listen with a SO_REUSEPORT socket of their own.
+// Adding --scaling in standalone mode measures how it scales over vCPUs:
+//
+//     multi-conn-perf --reuseport --scaling --server_thread_num=8 --seconds=5
 
 #include <atomic>
+#include <memory>
+#include <string>
 #include <thread>
+#include <vector>
 #include <gflags/gflags.h>
 
 #include <photon/photon.h>
@@ -26,6 +35,8 @@ limitations under the License.
 #include <photon/common/alog.h>
 #include <photon/net/socket.h>
 #include <photon/net/basic_socket.h>
+#include <photon/net/reuseport_server.h>
+#include <photon/thread/workerpool.h>
 #include <photon/common/utility.h>
 
 DEFINE_uint64(client_thread_num, 8, "client thread number");
@@ -35,6 +46,11 @@ DEFINE_uint64(port, 20000, "port");
 DEFINE_uint64(buf_size, 512, "buffer size");
 DEFINE_bool(cascading_engine, false, "Use cascading engine instead of master engine");
 DEFINE_uint64(mode, 0, "0: standalone, 1: client, 2: server");
+DEFINE_bool(reuseport, false, "serve on a single port, with a SO_REUSEPORT listener on each of server_thread_num vCPUs");
+DEFINE_bool(incoming_cpu, false, "set SO_INCOMING_CPU of the listeners, with --reuseport");
+DEFINE_uint64(rebalance_ms, 1000, "rebalance connections among vCPUs at most this often, with --reuseport, 0 to disable");
+DEFINE_bool(scaling, false, "measure the qps of 1, 2, 4 ... server_thread_num vCPUs, with --reuseport in standalone mode");
+DEFINE_uint64(seconds, 5, "seconds to run for each step of --scaling");
 
 enum class Mode {
     Standalone,
@@ -43,27 +59,41 @@ enum class Mode {
 };
 
 static std::atomic<uint64_t> qps{0};
+static std::atomic<bool> stop_clients{false};
 
-static void run_qps_loop() {
+static void show_connections(photon::net::IReusePortSocketServer* server) {
+    std::vector<uint64_t> counts(FLAGS_server_thread_num);
+    auto n = server->connections(counts.data(), counts.size());
+    std::string s;
+    for (size_t i = 0; i < n; i++)
+        s += std::to_string(counts[i]) + " ";
+    LOG_INFO("connections per vCPU: `(` migrated)", s.c_str(), server->migrations());
+}
+
+static void run_qps_loop(photon::net::IReusePortSocketServer* server) {
     while (true) {
         photon::thread_sleep(1);
         LOG_INFO("qps: `", qps.load());
         qps = 0;
+        if (server) show_connections(server);
     }
 }
 
 static void do_write(int server_index) {
-    photon::net::EndPoint ep(FLAGS_ip.c_str(), FLAGS_port + server_index);
+    photon::net::EndPoint ep(FLAGS_ip.c_str(), FLAGS_port + (FLAGS_reuseport ? 0 : server_index));
     auto cli = photon::net::new_tcp_socket_client();
+    DEFER(delete cli);
     auto conn = cli->connect(ep);
     if (!conn) {
         LOG_ERROR("connect failed");
         exit(1);
     }
 
-    LOG_INFO("Client `, Server `", conn->getsockname(), conn->getpeername());
+    DEFER(delete conn);
+
+    LOG_DEBUG("Client `, Server `", conn->getsockname(), conn->getpeername());
     char buf[FLAGS_buf_size];
-    while (true) {
+    while (!stop_clients) {
         ssize_t ret = conn->write(buf, FLAGS_buf_size);
         if (ret != (ssize_t) FLAGS_buf_size)
             exit(1);
@@ -76,11 +106,58 @@ static int client(int client_index) {
     pthread_setname_np(pthread_self(), name.c_str());
 
     photon::init(photon::INIT_EVENT_DEFAULT, photon::INIT_IO_NONE);
+    DEFER(photon::fini());
 
+    std::vector<photon::join_handle*> writers;
     for (auto i: xrange(FLAGS_server_thread_num)) {
-        photon::thread_create11(do_write, i);
+        writers.push_back(photon::thread_enable_join(photon::thread_create11(do_write, i)));
+    }
+    for (auto jh : writers) {
+        photon::thread_join(jh);
+    }
+    return 0;
+}
+
+static int reuseport_handler(void*, photon::net::ISocketStream* sock) {
+    char buf[FLAGS_buf_size];
+    while (sock->read(buf, sizeof(buf)) == (ssize_t)sizeof(buf))
+        qps++;
+    return 0;
+}
+
+static photon::net::IReusePortSocketServer* reuseport_server(photon::WorkPool* pool) {
+    auto server = photon::net::new_reuseport_tcp_server(pool, FLAGS_incoming_cpu,
+                                                        FLAGS_rebalance_ms * 1000);
+    server->set_handler({nullptr, &reuseport_handler});
+    if (server->bind_v4any(FLAGS_port) < 0 || server->listen() < 0) {
+        LOG_ERRNO_RETURN(0, nullptr, "failed to listen on port `", FLAGS_port);
+    }
+    server->start_loop();
+    return server;
+}
+
+// The same load on servers of 1, 2, 4 ... server_thread_num vCPUs
+static int reuseport_scaling() {
+    for (uint64_t n = 1; n <= FLAGS_server_thread_num; n *= 2) {
+        photon::WorkPool pool(n, photon::INIT_EVENT_DEFAULT, photon::INIT_IO_NONE, -1);
+        std::unique_ptr<photon::net::IReusePortSocketServer> server(reuseport_server(&pool));
+        if (!server) return -1;
+        stop_clients = false;
+        std::vector<std::thread> clients;
+        for (auto i: xrange(FLAGS_client_thread_num)) {
+            clients.emplace_back(client, i);
+        }
+        photon::thread_sleep(1);    // warm up
+        qps = 0;
+        photon::thread_sleep(FLAGS_seconds);
+        LOG_INFO("` vCPUs: qps `", n, qps.load() / FLAGS_seconds);
+        show_connections(server.get());
+        stop_clients = true;
+        for (auto& th : clients) {
+            th.join();
+        }
+        photon::thread_usleep(100 * 1000);  // for the handlers to see the close
     }
-    photon::thread_sleep(-1);
     return 0;
 }
 
@@ -160,10 +237,22 @@ int main(int argc, char** arg) {
     }
     DEFER(photon::fini());
 
+    if (FLAGS_reuseport && FLAGS_scaling && Mode(FLAGS_mode) == Mode::Standalone) {
+        return reuseport_scaling();
+    }
+
     if (Mode(FLAGS_mode) == Mode::Standalone || Mode(FLAGS_mode) == Mode::Server) {
-        photon::thread_create11(run_qps_loop);
-        for (auto i: xrange(FLAGS_server_thread_num)) {
-            std::thread(server, i).detach();
+        if (FLAGS_reuseport) {
+            auto pool = new photon::WorkPool(FLAGS_server_thread_num, photon::INIT_EVENT_DEFAULT,
+                                             photon::INIT_IO_NONE, -1);
+            auto server = reuseport_server(pool);
+            if (!server) return -1;
+            photon::thread_create11(run_qps_loop, server);
+        } else {
+            photon::thread_create11(run_qps_loop, nullptr);
+            for (auto i: xrange(FLAGS_server_thread_num)) {
+                std::thread(server, i).detach();
+            }
         }
     }
 
@@ -16,11 +16,13 @@ limitations under the License.
 
 #include <fcntl.h>
 #include <chrono>
+#include <vector>
 
 #include <gflags/gflags.h>
 
 #include <photon/photon.h>
 #include <photon/io/signal.h>
+#include <photon/io/fd-events.h>
 #include <photon/thread/thread11.h>
 #include <photon/thread/workerpool.h>
 #include <photon/common/alog.h>
@@ -38,10 +40,12 @@ DEFINE_uint64(port, 9527, "port");
 DEFINE_uint64(buf_size, 512, "buffer size");
 DEFINE_uint64(vcpu_num, 1, "vCPU number for both client and server");
 DEFINE_string(socket_type, "tcp", "Support tcp/rsocket/io_uring");
+DEFINE_bool(epoll_et, false, "register sockets to epoll once, edge-triggered, rather than per wait");
 
 static bool stop_test = false;
 static std::atomic<uint64_t> qps = {};
 static std::atomic<uint64_t> time_cost = {};
+static std::atomic<uint64_t> syscalls = {};
 
 // Use WorkPool to enable multi vCPU for client
 static photon::WorkPool* work_pool = nullptr;
@@ -52,10 +56,25 @@ static void handle_signal(int sig) {
     stop_test = true;
 }
 
+// Adds up the syscalls made by the master engine of current vCPU, for
+// waiting for events. The I/O syscalls (a send and a recv at least) are
+// not counted, as they are the same for all engines.
+static void count_engine_syscalls() {
+    photon::EventEngineStats last = {}, stats;
+    while (!stop_test && photon::event_engine_stats(&stats) == 0) {
+        syscalls += (stats.waits + stats.ctls) - (last.waits + last.ctls);
+        last = stats;
+        photon::thread_sleep(FLAGS_show_statistics_interval);
+    }
+}
+
 static void run_statistics_loop(bool show_latency) {
     while (!stop_test) {
         photon::thread_sleep(FLAGS_show_statistics_interval);
         uint64_t qps_val = qps.load();
+        uint64_t syscalls_val = syscalls.exchange(0);
+        if (qps_val)
+            LOG_INFO("engine syscalls per request: `", (double)syscalls_val / qps_val);
         if (show_latency) {
             uint64_t lat = (qps_val != 0) ? (time_cost.load() / qps_val) : 0;
             LOG_INFO("qps: `, bw: ` MB/s, latency: ` us", qps_val / FLAGS_show_statistics_interval,
@@ -73,6 +92,10 @@ static void run_statistics_loop(bool show_latency) {
 static int ping_pong_client() {
     if (FLAGS_vcpu_num > 1) {
         work_pool = new photon::WorkPool(FLAGS_vcpu_num, event_engine, photon::INIT_IO_NONE);
+        for (size_t i = 0; i < FLAGS_vcpu_num; i++)
+            work_pool->thread_migrate(photon::thread_create11(count_engine_syscalls), i);
+    } else {
+        photon::thread_create11(count_engine_syscalls);
     }
     DEFER(delete work_pool);
 
@@ -261,6 +284,7 @@ static int echo_server() {
             }
             DEFER(delete server);
             socket_server_arr[i] = server;
+            photon::thread_create11(count_engine_syscalls);
 
             server->set_handler(handler);
             server->setsockopt<int>(SOL_SOCKET, SO_REUSEPORT, 1);
@@ -308,6 +332,9 @@ int main(int argc, char** arg) {
     // We encourage you to upgrade to the latest kernel so that you could enjoy the extraordinary performance.
     if (FLAGS_socket_type == "iouring") {
         event_engine = photon::INIT_EVENT_IOURING;
+    } else if (FLAGS_epoll_et) {
+        event_engine = (photon::INIT_EVENT_DEFAULT & ~photon::INIT_EVENT_IOURING) |
+                       photon::INIT_EVENT_EPOLL_ET;
     }
     int ret = photon::init(event_engine, photon::INIT_IO_NONE);
     if (ret < 0) {
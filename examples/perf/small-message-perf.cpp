@@ -0,0 +1,136 @@
+/*
+Copyright 2022 The Photon Authors
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Round trips of a length-prefixed protocol with small messages over
+// loopback, where each message is read as a header then a body, as RPC
+// and most binary protocols do. The streams of both sides are read either
+// directly, or through a buffered socket stream that gets a header and its
+// body (or several pipelined messages) in one recv.
+//
+//     small-message-perf --size=64 --pipeline=1 --threads=4 --seconds=5 --busy_poll_us=0
+
+#include <chrono>
+#include <vector>
+
+#include <gflags/gflags.h>
+#include <photon/photon.h>
+#include <photon/net/socket.h>
+#include <photon/net/buffered_socket.h>
+#include <photon/io/fd-events.h>
+#include <photon/thread/thread11.h>
+#include <photon/common/alog.h>
+
+using namespace photon::net;
+
+DEFINE_uint64(size, 64, "size of the message body");
+DEFINE_uint64(pipeline, 1, "requests sent before reading their responses");
+DEFINE_uint64(threads, 4, "concurrent connections");
+DEFINE_uint64(seconds, 5, "seconds to run for each mode");
+DEFINE_uint64(busy_poll_us, 0, "spin for events for up to this long before sleeping, 0 to disable");
+
+static bool buffered_mode;
+static bool running;
+
+static ISocketStream* wrap(ISocketStream* s) {
+    return buffered_mode ? new_buffered_socket_stream(s) : s;
+}
+
+static ssize_t read_message(ISocketStream* s, char* body) {
+    uint32_t len;
+    if (s->read(&len, sizeof(len)) != sizeof(len))
+        return -1;
+    if (s->read(body, len) != (ssize_t)len)
+        return -1;
+    return len;
+}
+
+static ssize_t write_message(ISocketStream* s, char* body, uint32_t len) {
+    iovec iov[2] = {{&len, sizeof(len)}, {body, len}};
+    return s->writev(iov, 2);
+}
+
+static int echo_handler(void*, ISocketStream* sock) {
+    auto s = wrap(sock);
+    DEFER(if (s != sock) delete s);
+    std::vector<char> body(FLAGS_size);
+    while (true) {
+        auto len = read_message(s, body.data());
+        if (len < 0 || write_message(s, body.data(), len) < 0)
+            break;
+    }
+    return 0;
+}
+
+static void run(const EndPoint& ep) {
+    auto client = new_tcp_socket_client();
+    DEFER(delete client);
+    uint64_t count = 0;
+    running = true;
+    std::vector<photon::join_handle*> jhs;
+    for (uint64_t i = 0; i < FLAGS_threads; i++) {
+        jhs.push_back(photon::thread_enable_join(photon::thread_create11([&] {
+            auto sock = client->connect(ep);
+            if (!sock) LOG_ERRNO_RETURN(0, , "failed to connect");
+            auto s = wrap(sock);
+            DEFER(if (s != sock) delete s; delete sock);
+            std::vector<char> body(FLAGS_size, 'x');
+            while (running) {
+                for (uint64_t j = 0; j < FLAGS_pipeline; j++)
+                    if (write_message(s, body.data(), body.size()) < 0)
+                        LOG_ERRNO_RETURN(0, , "failed to send");
+                for (uint64_t j = 0; j < FLAGS_pipeline; j++)
+                    if (read_message(s, body.data()) != (ssize_t)body.size())
+                        LOG_ERRNO_RETURN(0, , "failed to recv");
+                count += FLAGS_pipeline;
+            }
+        })));
+    }
+    auto start = std::chrono::steady_clock::now();
+    photon::thread_sleep(FLAGS_seconds);
+    running = false;
+    for (auto jh : jhs) photon::thread_join(jh);
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start).count();
+    LOG_INFO("`: ` round trips/s", buffered_mode ? "buffered" : "direct", count * 1000000 / us);
+    photon::BusyPollStats stats;
+    if (FLAGS_busy_poll_us && photon::busy_poll_stats(&stats) == 0)
+        LOG_INFO("busy-poll: ` hits, ` misses, ` sleeps, ` us spun in total",
+                 stats.hits, stats.misses, stats.sleeps, stats.spin_us);
+}
+
+int main(int argc, char** argv) {
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+    set_log_output_level(ALOG_INFO);
+    photon::PhotonOptions opt;
+    opt.busy_poll_us = FLAGS_busy_poll_us;
+    if (photon::init(photon::INIT_EVENT_DEFAULT, photon::INIT_IO_NONE, opt))
+        return -1;
+    DEFER(photon::fini());
+
+    auto server = new_tcp_socket_server();
+    DEFER(delete server);
+    if (server->bind_v4localhost() < 0 || server->listen() < 0)
+        LOG_ERRNO_RETURN(0, -1, "failed to listen");
+    server->set_handler({nullptr, &echo_handler});
+    server->start_loop();
+
+    for (auto mode : {false, true}) {
+        buffered_mode = mode;
+        run(server->getsockname());
+    }
+    server->terminate();
+    return 0;
+}
@@ -105,6 +105,9 @@ public:
     }
 };
 
+// `allocator` allocates the buffers of refills, nullptr for malloc(); a
+// SlabAllocator (common/slab-alloc.h) is recommended for caches served by
+// many vCPUs, as refill sizes are rounded to its 4KB steps up to 64KB
 extern "C" {
 ICachedFileSystem *new_cached_fs(IFileSystem *src, ICachePool *pool, uint64_t pageSize,
                                  IOAlloc *allocator, CacheFnTransFunc fn_trans_func = nullptr);
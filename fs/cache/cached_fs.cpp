@@ -18,6 +18,7 @@ limitations under the License.
 #include <photon/common/alog.h>
 #include <photon/common/io-alloc.h>
 #include <photon/common/iovector.h>
+#include <photon/common/metric-meter/histogram.h>
 #include <photon/common/string_view.h>
 #include <photon/fs/filesystem.h>
 #include <photon/fs/range-split.h>
@@ -26,6 +27,21 @@ limitations under the License.
 namespace photon {
 namespace fs {
 
+struct CacheMetrics {
+    Metric::LatencyHistogram* read;
+    Metric::LatencyHistogram* write;
+    CacheMetrics() {
+        auto& r = Metric::default_registry();
+        const char* help = "Latency of I/O on cached files";
+        read = r.histogram("photon_cached_file_io_duration_us", "op=\"read\"", help);
+        write = r.histogram("photon_cached_file_io_duration_us", "op=\"write\"", help);
+    }
+    static CacheMetrics& get() {
+        static CacheMetrics m;
+        return m;
+    }
+};
+
 class CachedFs : public ICachedFileSystem, public IFileSystemXAttr {
 public:
     CachedFs(IFileSystem *srcFs, ICachePool *fileCachePool,
@@ -215,6 +231,7 @@ public:
     }
 
     ssize_t preadv2(const struct iovec *iov, int iovcnt, off_t offset, int flags) override {
+        SCOPE_LATENCY(*CacheMetrics::get().read);
         return cache_store_->preadv2(iov, iovcnt, offset, flags);
     }
 
@@ -229,6 +246,7 @@ public:
     }
 
     ssize_t pwritev2(const struct iovec *iov, int iovcnt, off_t offset, int flags) override {
+        SCOPE_LATENCY(*CacheMetrics::get().write);
         return cache_store_->pwritev2(iov, iovcnt, offset, flags);
     }
 
@@ -54,6 +54,8 @@ enum ResizeType : int {
 
 namespace photon
 {
+class fair_throttle;
+
 namespace fs
 {
     // `CacheFnTransFunc` use to transform the filename in the cached store.
@@ -143,6 +145,14 @@ namespace fs
             return -1;
         }
 
+        // charge the refills (downloads from source) of all stores to class `tenant`
+        // of a shared throttle, unless a store has its own, see common/fair_throttle.h
+        void set_refill_throttle(photon::fair_throttle* throttle, uint32_t tenant = 0)
+        {
+            m_refill_throttle = throttle;
+            m_refill_tenant = tenant;
+        }
+
     protected:
         virtual ICacheStore* do_open(std::string_view filename, int flags, mode_t mode) = 0;
 
@@ -154,6 +164,8 @@ namespace fs
         const uint32_t m_max_refilling = 128;
         const uint32_t m_refilling_threshold = -1U;
         bool m_pin_write = false;
+        photon::fair_throttle* m_refill_throttle = nullptr;
+        uint32_t m_refill_tenant = 0;
         friend class ICacheStore;
     };
 
@@ -242,6 +254,13 @@ namespace fs
         void set_page_size(size_t page_size) { page_size_ = page_size; }
         IOAlloc* get_allocator() { return allocator_; }
         void set_allocator(IOAlloc* allocator) { allocator_ = allocator; }
+        void set_refill_throttle(photon::fair_throttle* throttle, uint32_t tenant) {
+            refill_throttle_ = throttle;
+            refill_tenant_ = tenant;
+        }
+        // have the CRC32C of every range downloaded from the source computed,
+        // in the same pass that copies it to the reader, and checked by check_refill()
+        void set_refill_crc(bool enable) { refill_crc_ = enable; }
 
         struct try_preadv_result
         {
@@ -269,6 +288,10 @@ namespace fs
     protected:
         int open_src_file(photon::fs::IFile** src_file, int flags = O_RDONLY);
         int tryget_size();
+        int throttle_refill(size_t count);
+        // called with the CRC32C of a downloaded range if set_refill_crc(true),
+        // returns -1 to reject the data, which is then neither cached nor returned
+        virtual int check_refill(off_t offset, size_t count, uint32_t crc) { return 0; }
         ssize_t do_prefetch(size_t count, off_t offset, int flags, uint64_t batch_size = 32 * 1024 * 1024UL);
 
         std::string src_name_;
@@ -284,6 +307,9 @@ namespace fs
         photon::fs::IFileSystem* src_fs_ = nullptr;
         size_t page_size_ = 4096;
         IOAlloc* allocator_ = nullptr;
+        photon::fair_throttle* refill_throttle_ = nullptr;
+        uint32_t refill_tenant_ = 0;
+        bool refill_crc_ = false;
         RangeLock range_lock_;
         photon::mutex open_lock_;
         photon::spinlock mt_;
@@ -21,7 +21,9 @@ limitations under the License.
 #include <photon/common/alog-audit.h>
 #include <photon/common/io-alloc.h>
 #include <photon/common/iovector.h>
+#include <photon/common/checksum/crc32c.h>
 #include <photon/common/expirecontainer.h>
+#include <photon/common/fair_throttle.h>
 #include <photon/thread/thread-pool.h>
 
 
@@ -197,6 +199,27 @@ void* ICacheStore::async_refill(void* args) {
     return nullptr;
 }
 
+int ICacheStore::throttle_refill(size_t count) {
+    auto throttle = refill_throttle_;
+    auto tenant = refill_tenant_;
+    if (!throttle && pool_) {
+        throttle = pool_->m_refill_throttle;
+        tenant = pool_->m_refill_tenant;
+    }
+    return throttle ? throttle->consume(tenant, count) : 0;
+}
+
+// extends `crc` over [begin, end) of `buf`
+static uint32_t crc32c_range(const IOVector& buf, size_t begin, size_t end, uint32_t crc) {
+    size_t pos = 0;
+    for (auto& v : buf) {
+        auto b = std::max(begin, pos), e = std::min(end, pos + v.iov_len);
+        if (b < e) crc = crc32c_extend((char*)v.iov_base + (b - pos), e - b, crc);
+        pos += v.iov_len;
+    }
+    return crc;
+}
+
 ssize_t ICacheStore::do_refill_range(uint64_t refill_off, uint64_t refill_size, size_t count, off_t actual_size, IOVector* input, off_t offset, int flags) {
     ssize_t ret = 0;
     if (!(open_flags_&O_WRITE_BACK) && input && !(flags&(RW_V2_WRITE_BACK|RW_V2_SYNC_MODE)) && pool_ &&
@@ -214,6 +237,8 @@ ssize_t ICacheStore::do_refill_range(uint64_t refill_off, uint64_t refill_size,
         uint32_t refilling = max_refilling;
         DEFER({ if (refilling >= max_refilling) range_lock_.unlock(refill_off, refill_size); });
         if (actual_size != actual_size_) return -EAGAIN;
+        if (throttle_refill(refill_size) < 0)
+            LOG_ERRNO_RETURN(0, -1, "refill throttle interrupted, offset : `, size : `", refill_off, refill_size);
         IOVector buffer(*allocator_);
         void* pin_wresult = nullptr;
         int pinRet = -1;
@@ -245,22 +270,42 @@ ssize_t ICacheStore::do_refill_range(uint64_t refill_off, uint64_t refill_size,
 
         // buffer need async refill
         IOVector refill_buf(buffer.iovec(), buffer.iovcnt());
+        // the checksum of the part copied to the reader is computed while copying
+        uint32_t crc = 0;
+        size_t copied_at = 0, crc_end = 0;
+        auto copy = [&](const iovector_view* dst, size_t n) {
+            if (!refill_crc_) return refill_buf.memcpy_to(dst, n);
+            crc = crc32c_range(buffer, 0, copied_at, crc);
+            n = refill_buf.memcpy_to_with_crc(dst, n, &crc);
+            crc_end = copied_at + n;
+            return n;
+        };
         if ((open_flags_&O_WRITE_BACK) || !input) {
             ret = 0;
         } else if ((off_t)refill_off <= offset) {
             auto view = input->view();
-            refill_buf.extract_front(offset - refill_off);
-            ret = refill_buf.memcpy_to(&view, count);
+            copied_at = offset - refill_off;
+            refill_buf.extract_front(copied_at);
+            ret = copy(&view, count);
             input->extract_front(ret);
             offset += ret;
         } else if (refill_off + refill_size >= offset + count) {
             iovector_view tail_iov;
             tail_iov.iovcnt = 0;
             input->slice(count - (refill_off- offset), refill_off- offset, &tail_iov);
-            ret = refill_buf.memcpy_to(&tail_iov);
+            ret = copy(&tail_iov, SIZE_MAX);
             input->extract_back(ret);
         } else ret = 0;
 
+        if (refill_crc_) {
+            crc = crc32c_range(buffer, crc_end, refill_size, crc);
+            if (check_refill(refill_off, refill_size, crc) < 0) {
+                if (pinRet == 0) (void)static_cast<IMemCacheStore*>(this)->unpin_wbuf(pin_wresult, -1, flags);
+                LOG_ERROR_RETURN(EIO, -1, "refill check failed, offset : `, size : `, crc32c : `",
+                    refill_off, refill_size, crc);
+            }
+        }
+
         if (!(open_flags_&O_WRITE_BACK) && input && ret != 0 && !(flags&(RW_V2_WRITE_BACK|RW_V2_SYNC_MODE)) && pool_ &&
             pool_->m_thread_pool && (refilling=pool_->m_refilling.load(std::memory_order_relaxed)) < pool_->m_max_refilling) {
             pool_->m_refilling.fetch_add(1, std::memory_order_relaxed);
@@ -25,6 +25,8 @@ limitations under the License.
 #include <cstring>
 #include <algorithm>
 #include <set>
+#include <string>
+#include <vector>
 
 #include <photon/common/utility.h>
 #include <photon/photon.h>
@@ -33,6 +35,8 @@ limitations under the License.
 #include <photon/fs/aligned-file.h>
 #include <photon/thread/thread.h>
 #include <photon/common/io-alloc.h>
+#include <photon/common/iovector.h>
+#include <photon/common/checksum/crc32c.h>
 #include <photon/fs/cache/cache.h>
 
 #include "../full_file_cache/cache_pool.h"
@@ -1067,6 +1071,133 @@ TEST(CachePool, DISABLED_test_mem_usage) {
   LOG_INFO("Physical memory usage diff: ` KiB.", diff);
 }
 
+// an in-memory store of 4KB pages that checks every refill with check_refill()
+class CrcCheckedStore : public ICacheStore {
+public:
+  static const size_t kPage = 4096;
+  std::string data_;
+  std::vector<bool> cached_;
+  int check_ret_ = 0;
+  std::vector<std::string> checked_;   // the ranges passed to check_refill()
+  size_t written_ = 0;
+
+  int set_quota(size_t) override { return 0; }
+  int stat(CacheStat*) override { return 0; }
+  int evict(off_t, size_t, int) override { return 0; }
+  int fstat(struct stat* buf) override {
+    buf->st_size = 0;
+    return 0;
+  }
+  std::pair<off_t, size_t> queryRefillRange(off_t offset, size_t size) override {
+    // from the first page missing to the last one
+    off_t begin = -1, end = 0;
+    for (off_t p = offset / kPage * kPage; p < (off_t)(offset + size); p += kPage) {
+      if (p / kPage < (off_t)cached_.size() && cached_[p / kPage]) continue;
+      if (begin < 0) begin = p;
+      end = p + kPage;
+    }
+    if (begin < 0) return {offset, 0};
+    return {begin, end - begin};
+  }
+  ssize_t do_preadv2(const struct iovec* iov, int iovcnt, off_t offset, int) override {
+    iovector_view view((struct iovec*)iov, iovcnt);
+    return view.memcpy_from(&data_[offset], std::min(view.sum(), data_.size() - offset));
+  }
+  ssize_t do_pwritev2(const struct iovec* iov, int iovcnt, off_t offset, int) override {
+    iovector_view view((struct iovec*)iov, iovcnt);
+    auto size = view.sum();
+    if (data_.size() < offset + size) data_.resize(offset + size);
+    view.memcpy_to(&data_[offset], size);
+    if (cached_.size() * kPage < offset + size)
+      cached_.resize((offset + size + kPage - 1) / kPage);
+    for (off_t p = offset; p < (off_t)(offset + size); p += kPage)
+      cached_[p / kPage] = true;
+    written_ += size;
+    return size;
+  }
+
+protected:
+  int check_refill(off_t offset, size_t count, uint32_t crc) override {
+    auto src = ::open(src_path_.c_str(), O_RDONLY);
+    DEFER(::close(src));
+    std::string buf(count, 0);
+    EXPECT_EQ((ssize_t)count, ::pread(src, &buf[0], count, offset));
+    EXPECT_EQ(crc32c(buf.data(), count), crc);
+    checked_.push_back(std::to_string(offset) + "+" + std::to_string(count));
+    return check_ret_;
+  }
+
+public:
+  std::string src_path_;
+};
+
+class CrcCheckedPool : public ICachePool {
+public:
+  CrcCheckedStore* store_ = nullptr;
+  CrcCheckedPool() : ICachePool(0) {}
+  int set_quota(std::string_view, size_t) override { return 0; }
+  int stat(CacheStat*, std::string_view) override { return 0; }
+  int evict(std::string_view) override { return 0; }
+  int evict(size_t) override { return 0; }
+  int rename(std::string_view, std::string_view) override { return 0; }
+
+protected:
+  ICacheStore* do_open(std::string_view, int, mode_t) override {
+    return store_ = new CrcCheckedStore;
+  }
+};
+
+TEST(CacheStore, refill_crc) {
+  std::string srcRoot("/tmp/ease/cache/crc_src/");
+  SetupTestDir(srcRoot);
+  auto srcFs = new_localfs_adaptor(srcRoot.c_str(), ioengine_psync);
+  DEFER(delete srcFs);
+  // not a multiple of the page size, so the last refill is a short one
+  std::string data(3 * 4096 + 100, 0);
+  UniformCharRandomGen gen(0, 255);
+  for (auto& c : data) c = gen.next();
+  {
+    auto f = srcFs->open("/file", O_RDWR | O_CREAT | O_TRUNC, 0644);
+    ASSERT_NE(nullptr, f);
+    DEFER(delete f);
+    ASSERT_EQ((ssize_t)data.size(), f->pwrite(data.data(), data.size(), 0));
+  }
+
+  IOAlloc alloc;
+  auto pool = new CrcCheckedPool;
+  auto cachedFs = new_cached_fs(srcFs, pool, 4096, &alloc);
+  DEFER(delete cachedFs);
+  auto file = static_cast<ICachedFile*>(cachedFs->open("/file", O_RDONLY, 0644));
+  ASSERT_NE(nullptr, file);
+  DEFER(delete file);
+  auto store = pool->store_;
+  store->src_path_ = srcRoot + "file";
+  store->set_refill_crc(true);
+
+  // a rejected refill is an error, and nothing is cached
+  store->check_ret_ = -1;
+  char buf[3 * 4096 + 100];
+  errno = 0;
+  EXPECT_EQ(-1, file->pread(buf, 100, 4096 + 10));
+  EXPECT_EQ(EIO, errno);
+  EXPECT_EQ(0UL, store->written_);
+  EXPECT_EQ(1UL, store->checked_.size());
+
+  // the checksum covers the whole refilled range, not only the part read,
+  // whether the read starts in it, or ends in it, or covers it
+  store->check_ret_ = 0;
+  store->checked_.clear();
+  EXPECT_EQ(100, file->pread(buf, 100, 4096 + 10));
+  EXPECT_EQ(0, memcmp(buf, &data[4096 + 10], 100));
+  EXPECT_EQ(4096, file->pread(buf, 4096, 2048));
+  EXPECT_EQ(0, memcmp(buf, &data[2048], 4096));
+  EXPECT_EQ((ssize_t)data.size(), file->pread(buf, sizeof(buf), 0));
+  EXPECT_EQ(0, memcmp(buf, data.data(), data.size()));
+  EXPECT_EQ(0, memcmp(store->data_.data(), data.data(), data.size()));
+  std::vector<std::string> expected{"4096+4096", "0+4096", "8192+4196"};
+  EXPECT_EQ(expected, store->checked_);
+}
+
 }
 }
 int main(int argc, char** argv) {
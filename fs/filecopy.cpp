@@ -17,11 +17,22 @@ limitations under the License.
 #include "filecopy.h"
 
 #include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <algorithm>
 #include <stddef.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <sys/stat.h>
 
 #include <photon/common/alog.h>
+#include <photon/common/utility.h>
+#include <photon/thread/thread11.h>
+#include <photon/thread/awaiter.h>
 #include "filesystem.h"
+#include "fiemap.h"
 
 namespace photon {
 namespace fs {
@@ -74,5 +85,317 @@ ssize_t filecopy(IFile* infile, IFile* outfile, size_t bs, int retry_limit) {
     return offset;
 }
 
+namespace {
+
+struct Extent {
+    off_t offset;
+    size_t length;
+};
+
+// collect the data extents of `file` within [0, size), or a single extent
+// covering the whole file if extent map is not available; the extents are
+// widened to ALIGNMENT, so that the padding of a block never reaches into
+// another one, except the last block whose padding goes beyond EOF
+static void collect_extents(IFile* file, off_t size, bool skip_holes,
+                            std::vector<Extent>& extents) {
+    extents.clear();
+    if (size <= 0) return;
+    if (skip_holes) {
+        off_t start = 0;
+        while (start < size) {
+            fiemap_t<64> fm(start, size - start);
+            fm.fm_flags = FIEMAP_FLAG_SYNC;
+            if (file->fiemap(&fm) < 0) goto whole_file;
+            if (fm.fm_mapped_extents == 0) return;
+            for (__u32 i = 0; i < fm.fm_mapped_extents; ++i) {
+                auto& e = fm.fm_extents[i];
+                off_t begin = std::max((off_t)e.fe_logical, start);
+                off_t end = std::min((off_t)e.fe_logical_end(), size);
+                if (end <= begin) continue;
+                start = end;
+                // preallocated but unwritten extents read as zeros
+                if (e.fe_flags & FIEMAP_EXTENT_UNWRITTEN) continue;
+                begin = align_down(begin, ALIGNMENT);
+                end = std::min((off_t)align_up(end, ALIGNMENT), size);
+                if (!extents.empty() && extents.back().offset +
+                        (off_t)extents.back().length >= begin) {
+                    extents.back().length = end - extents.back().offset;
+                } else {
+                    extents.push_back({begin, (size_t)(end - begin)});
+                }
+            }
+            if (fm.fm_extents[fm.fm_mapped_extents - 1].fe_flags & FIEMAP_EXTENT_LAST)
+                return;
+        }
+        return;
+    }
+whole_file:
+    extents.clear();
+    extents.push_back({0, (size_t)size});
+}
+
+static uint64_t hole_bytes(const std::vector<Extent>& extents, off_t size) {
+    uint64_t data = 0;
+    for (auto& e : extents) data += e.length;
+    return size - data;
+}
+
+#ifdef __linux__
+// get the real fd behind a local file, or -1
+static int local_fd_of(IFile* file) {
+    auto obj = file->get_underlay_object(0);
+    if (!obj) return -1;
+    auto fd = (int)(uint64_t)obj;
+    if ((uint64_t)fd != (uint64_t)obj) return -1;  // not a fd
+    struct stat st1, st2;
+    if (::fstat(fd, &st1) < 0 || file->fstat(&st2) < 0) return -1;
+    if (st1.st_dev != st2.st_dev || st1.st_ino != st2.st_ino) return -1;
+    return fd;
+}
+
+static ssize_t splice_range(int fd_in, int fd_out, int* pipefd,
+                            off_t offset, size_t count) {
+    if (pipefd[0] < 0 && ::pipe(pipefd) < 0) return -1;
+    off_t off_in = offset, off_out = offset;
+    auto n = ::splice(fd_in, &off_in, pipefd[1], nullptr, count, SPLICE_F_MOVE);
+    if (n <= 0) return n;
+    for (ssize_t left = n; left > 0;) {
+        auto m = ::splice(pipefd[0], nullptr, fd_out, &off_out, left, SPLICE_F_MOVE);
+        if (m <= 0) return -1;
+        left -= m;
+    }
+    return n;
+}
+
+// copy the extents in kernel, without bringing data to user space;
+// return 0 if succeeded, or -1 to fall back to user space copy
+static int kernel_copy(int fd_in, int fd_out, const std::vector<Extent>& extents,
+                       off_t size, size_t chunk, FileCopyStats& stats) {
+    bool use_splice = false;
+    int pipefd[2] = {-1, -1};
+    DEFER({ if (pipefd[0] >= 0) { ::close(pipefd[0]); ::close(pipefd[1]); } });
+    for (auto& e : extents) {
+        off_t offset = e.offset, end = e.offset + e.length;
+        while (offset < end) {
+            size_t count = std::min((size_t)(end - offset), chunk);
+            ssize_t n;
+            if (!use_splice) {
+                off_t off_in = offset, off_out = offset;
+                n = ::copy_file_range(fd_in, &off_in, fd_out, &off_out, count, 0);
+                if (n < 0 && (errno == EXDEV || errno == ENOSYS ||
+                              errno == EINVAL || errno == EOPNOTSUPP)) {
+                    if (stats.bytes_copied != 0) return -1;
+                    use_splice = true;
+                    continue;
+                }
+            } else {
+                n = splice_range(fd_in, fd_out, pipefd, offset, count);
+            }
+            if (n < 0) {
+                LOG_DEBUG("kernel copy failed at ", VALUE(offset), VALUE(count),
+                          ERRNO(), " fall back to user space copy");
+                return -1;
+            }
+            if (n == 0) break;      // file shrunk
+            offset += n;
+            stats.bytes_copied += n;
+            stats.blocks++;
+        }
+    }
+    if (::ftruncate(fd_out, size) < 0) return -1;
+    stats.kernel_copy = true;
+    return 0;
+}
+
+// copy_file_range() and splice() block, so run kernel_copy() in a kernel
+// thread of its own, leaving the vCPU to the other photon threads
+static int kernel_copy_offloaded(int fd_in, int fd_out, const std::vector<Extent>& extents,
+                                 off_t size, size_t chunk, FileCopyStats& stats) {
+    int ret = -1, err = 0;
+    Awaiter<PhotonContext> done;
+    std::thread th([&] {
+        ret = kernel_copy(fd_in, fd_out, extents, size, chunk, stats);
+        err = errno;
+        done.resume();
+    });
+    done.suspend();
+    th.join();
+    errno = err;
+    return ret;
+}
+#endif
+
+class PipelinedCopier {
+public:
+    PipelinedCopier(IFile* infile, IFile* outfile, const FileCopyOptions& opts,
+                    const std::vector<Extent>& extents, FileCopyStats& stats)
+        : m_infile(infile), m_outfile(outfile), m_opts(opts),
+          m_extents(extents), m_stats(stats), m_readers(opts.max_readers) {
+        if (!m_extents.empty()) m_cursor = m_extents[0].offset;
+    }
+
+    int run() {
+        auto n = std::max(m_opts.max_inflight, 1);
+        std::vector<join_handle*> jhs;
+        jhs.reserve(n);
+        for (int i = 0; i < n; ++i) {
+            auto th = thread_create11(&PipelinedCopier::worker, this);
+            jhs.push_back(thread_enable_join(th));
+        }
+        for (auto jh : jhs)
+            thread_join(jh);
+        if (m_errno) {
+            errno = m_errno;
+            return -1;
+        }
+        return 0;
+    }
+
+protected:
+    IFile* m_infile;
+    IFile* m_outfile;
+    const FileCopyOptions& m_opts;
+    const std::vector<Extent>& m_extents;
+    FileCopyStats& m_stats;
+    semaphore m_readers;
+    size_t m_index = 0;
+    off_t m_cursor = 0;
+    int m_errno = 0;
+
+    // all the workers run in the same vCPU, so no need of locking
+    bool next_block(off_t& offset, size_t& count) {
+        while (m_index < m_extents.size()) {
+            auto& e = m_extents[m_index];
+            off_t end = e.offset + e.length;
+            if (m_cursor < end) {
+                offset = m_cursor;
+                count = std::min((size_t)(end - m_cursor), m_opts.block_size);
+                m_cursor += count;
+                return true;
+            }
+            if (++m_index < m_extents.size())
+                m_cursor = m_extents[m_index].offset;
+        }
+        return false;
+    }
+
+    void worker() {
+        auto bs = m_opts.block_size;
+        void* buff = nullptr;
+        int err = ::posix_memalign(&buff, ALIGNMENT, bs);
+        if (err) {
+            m_errno = ENOMEM;
+            LOG_ERROR("Fail to allocate buffer with ", VALUE(bs), VALUE(err));
+            return;
+        }
+        DEFER(free(buff));
+        off_t offset;
+        size_t count;
+        while (!m_errno && next_block(offset, count)) {
+            auto rlen = read_block(buff, count, offset);
+            if (rlen < 0) break;
+            if (write_block(buff, rlen, offset) < 0) break;
+            m_stats.bytes_copied += rlen;
+            m_stats.blocks++;
+        }
+    }
+
+    ssize_t read_block(void* buff, size_t count, off_t offset) {
+        m_readers.wait(1);
+        DEFER(m_readers.signal(1));
+        for (int retry = m_opts.retry_limit; retry > 0; --retry) {
+            if (m_errno) return -1;
+            auto rlen = m_infile->pread(buff, count, offset);
+            if (rlen >= 0) return rlen;
+            LOG_DEBUG("Fail to read at ", VALUE(offset), VALUE(count), " retry...");
+            m_stats.retries++;
+        }
+        m_errno = EIO;
+        LOG_ERROR_RETURN(EIO, -1, "Fail to read at ", VALUE(offset), VALUE(count));
+    }
+
+    ssize_t write_block(void* buff, ssize_t rlen, off_t offset) {
+        // cause it might write into file with O_DIRECT,
+        // keep write length aligned, and truncate later
+        auto wcount = align_up((size_t)rlen, ALIGNMENT);
+        memset((char*)buff + rlen, 0, wcount - rlen);
+        for (int retry = m_opts.retry_limit; retry > 0; --retry) {
+            if (m_errno) return -1;
+            auto wlen = m_outfile->pwrite(buff, wcount, offset);
+            // once write lenth larger than read length treats as OK
+            if (wlen >= rlen) return wlen;
+            LOG_DEBUG("Fail to write at ", VALUE(offset), VALUE(rlen), " retry...");
+            m_stats.retries++;
+        }
+        m_errno = EIO;
+        LOG_ERROR_RETURN(EIO, -1, "Fail to write at ", VALUE(offset), VALUE(rlen));
+    }
+};
+
+}  // namespace
+
+ssize_t filecopy(IFile* infile, IFile* outfile, const FileCopyOptions& opts,
+                 FileCopyStats* stats) {
+    if (opts.block_size == 0 || opts.block_size % ALIGNMENT)
+        LOG_ERROR_RETURN(EINVAL, -1, "block_size should be non-zero and 4K aligned ",
+                         VALUE(opts.block_size));
+    if (opts.max_readers <= 0)
+        LOG_ERROR_RETURN(EINVAL, -1, "max_readers should be positive ",
+                         VALUE(opts.max_readers));
+    FileCopyStats _stats;
+    if (!stats) stats = &_stats;
+    *stats = {};
+    auto t0 = std::chrono::steady_clock::now();
+    DEFER(stats->elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(
+              std::chrono::steady_clock::now() - t0).count());
+
+    struct stat st;
+    if (infile->fstat(&st) < 0) {
+        LOG_DEBUG("Fail to get file size, fall back to sequential copy");
+        auto ret = filecopy(infile, outfile, opts.block_size, opts.retry_limit);
+        if (ret > 0) stats->file_size = stats->bytes_copied = ret;
+        return ret;
+    }
+    off_t size = st.st_size;
+    stats->file_size = size;
+    std::vector<Extent> extents;
+    collect_extents(infile, size, opts.skip_holes, extents);
+    stats->bytes_skipped = hole_bytes(extents, size);
+    if (stats->bytes_skipped) {
+        // holes are not written, so clear the old content of outfile
+        if (outfile->ftruncate(0) < 0 || outfile->ftruncate(size) < 0) {
+            LOG_DEBUG("Fail to truncate output file, copy the holes as well ", ERRNO());
+            collect_extents(infile, size, false, extents);
+            stats->bytes_skipped = 0;
+        }
+    }
+
+#ifdef __linux__
+    if (opts.kernel_copy) {
+        int fd_in = local_fd_of(infile), fd_out = local_fd_of(outfile);
+        if (fd_in >= 0 && fd_out >= 0) {
+            auto chunk = opts.block_size * std::max(opts.max_inflight, 1);
+            if (kernel_copy_offloaded(fd_in, fd_out, extents, size, chunk, *stats) == 0)
+                goto done;
+            stats->bytes_copied = stats->blocks = 0;
+        }
+    }
+#endif
+
+    {
+        PipelinedCopier copier(infile, outfile, opts, extents, *stats);
+        if (copier.run() < 0) return -1;
+    }
+    // truncate after write, for O_DIRECT and trailing holes
+    if (outfile->ftruncate(size) < 0)
+        LOG_ERRNO_RETURN(0, -1, "Fail to truncate output file to ", VALUE(size));
+
+done:
+    LOG_DEBUG("file copied ", VALUE(size), VALUE(stats->bytes_copied),
+              VALUE(stats->bytes_skipped), VALUE(stats->blocks),
+              VALUE(stats->retries), VALUE(stats->kernel_copy));
+    return size;
+}
+
 }  // namespace fs
 }
@@ -15,6 +15,7 @@ limitations under the License.
 */
 
 #include <cstdio>
+#include <cstdint>
 
 namespace photon {
 namespace fs {
@@ -24,5 +25,36 @@ class IFile;
 // or return file size
 ssize_t filecopy(IFile* infile, IFile* outfile, size_t bs = 65536, int retry_limit=5);
 
+struct FileCopyOptions {
+    size_t block_size = 65536;  // size of each block read / written
+    int retry_limit = 5;        // retries for each block
+    int max_inflight = 16;      // max number of blocks buffered in memory,
+                                // i.e. the depth of the read-write pipeline
+    int max_readers = 4;        // max number of concurrent (range) reads
+    bool skip_holes = true;     // skip sparse regions of infile via fiemap
+    bool kernel_copy = true;    // use copy_file_range / splice when both
+                                // files are local files with real fds,
+                                // in a kernel thread of its own
+};
+
+struct FileCopyStats {
+    uint64_t file_size = 0;     // size of infile
+    uint64_t bytes_copied = 0;  // bytes actually read and written
+    uint64_t bytes_skipped = 0; // bytes in holes, not copied
+    uint64_t blocks = 0;        // number of blocks copied
+    uint64_t retries = 0;       // number of retried reads / writes
+    uint64_t elapsed_us = 0;
+    bool kernel_copy = false;   // whether the kernel fast path was taken
+    double throughput() const { // MB/s of file size, holes included
+        return elapsed_us ? (double)file_size / elapsed_us : 0;
+    }
+};
+
+// copy file with a pipeline of concurrent range reads and writes,
+// return file size, or -1 when failed with errno set;
+// `stats` is optional, and filled even when failed
+ssize_t filecopy(IFile* infile, IFile* outfile, const FileCopyOptions& opts,
+                 FileCopyStats* stats = nullptr);
+
 }  // namespace FileSystem
 }
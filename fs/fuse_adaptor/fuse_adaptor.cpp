@@ -90,6 +90,8 @@ struct user_config {
     int threads;
     int force_splice_read;
     char *looptype;
+    int vcpus;
+    int uring_receive;
 };
 
 uint64_t find_looptype(const char *name) {
@@ -105,6 +107,9 @@ uint64_t find_looptype(const char *name) {
     if (!strncmp(name, "io_uring", 8))
         return FUSE_SESSION_LOOP_IOURING;
 
+    if (!strncmp(name, "multi_vcpu", 10))
+        return FUSE_SESSION_LOOP_MULTI_VCPU;
+
     return FUSE_SESSION_LOOP_EPOLL;
 }
 
@@ -112,6 +117,8 @@ uint64_t find_looptype(const char *name) {
 struct fuse_opt user_opts[] = { USER_OPT("threads=%d",  threads, 0),
                                 USER_OPT("force_splice_read=%d", force_splice_read, 0),
                                 USER_OPT("looptype=%s", looptype, 0),
+                                USER_OPT("vcpus=%d", vcpus, 0),
+                                USER_OPT("uring_receive=%d", uring_receive, 0),
                                 FUSE_OPT_END };
 struct fuse_handle {
     struct fuse *fuse = NULL;
@@ -121,6 +128,8 @@ struct fuse_handle {
     int multithreaded = 1;
     int threads = 4;
     int force_splice_read = 0;
+    int vcpus = 0;
+    int uring_receive = 0;
     void *userdata = NULL;
 
     int setup(
@@ -131,9 +140,12 @@ struct fuse_handle {
         struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
         DEFER(fuse_opt_free_args(&args));
 
-        struct user_config cfg{ .threads = 4, .force_splice_read = 0, .looptype = NULL};
+        struct user_config cfg{ .threads = 4, .force_splice_read = 0, .looptype = NULL,
+                                .vcpus = 0, .uring_receive = 0};
         fuse_opt_parse(&args, &cfg, user_opts, NULL);
         threads = cfg.threads;
+        vcpus = cfg.vcpus;
+        uring_receive = cfg.uring_receive;
         if (cfg.looptype)
             looptype = find_looptype(cfg.looptype);
 #if FUSE_USE_VERSION < FUSE_MAKE_VERSION(3, 13)
@@ -240,6 +252,11 @@ static int fuse_session_loop_mpt(struct fuse_session *se,
     loop_args args;
     args.looptype = fh.looptype;
     args.force_splice_read = fh.force_splice_read;
+    if (fh.looptype == FUSE_SESSION_LOOP_MULTI_VCPU) {
+        args.max_threads = fh.threads;
+        args.vcpu_num = fh.vcpus;
+        args.uring_receive = fh.uring_receive;
+    }
     auto loop = new_session_loop(se, args);
     loop->run();
     delete loop;
@@ -261,13 +278,24 @@ static int _run_fuse(int argc, char *argv[],
         set_sync_custom_io(se);
     } else if (fh.looptype == FUSE_SESSION_LOOP_IOURING_CASCADING) {
         set_iouring_custom_io(se);
+    } else if (fh.looptype == FUSE_SESSION_LOOP_MULTI_VCPU) {
+        set_multi_vcpu_custom_io(se);
     }
 #endif
 
-    if (fh.multithreaded) {
-        if (fh.threads < 1) fh.threads = 1;
-        if (fh.threads > 64) fh.threads = 64;
-
+    if (fh.threads < 1) fh.threads = 1;
+    if (fh.threads > 64) fh.threads = 64;
+
+    if (fh.looptype == FUSE_SESSION_LOOP_MULTI_VCPU) {
+        // the loop itself spreads over vCPUs, and `threads` means
+        // workers per vCPU
+        std::thread([&]() {
+            init(INIT_EVENT_EPOLL, INIT_IO_NONE);
+            DEFER(fini());
+            if (fuse_session_loop_mpt(se, fh) != 0) ret = -1;
+        }).join();
+        fuse_session_reset(se);
+    } else if (fh.multithreaded) {
         std::vector<std::thread> ths;
         for (int i = 0; i < fh.threads; ++i) {
           ths.emplace_back(std::thread([&]() {
@@ -27,7 +27,10 @@ limitations under the License.
 #endif
 
 #include <vector>
+#include <algorithm>
 #include <tuple>
+#include <memory>
+#include <thread>
 #include <unordered_set>
 
 #ifndef _GNU_SOURCE
@@ -44,6 +47,8 @@ limitations under the License.
 #include <photon/thread/thread11.h>
 #include <photon/thread/thread-local.h>
 #include <photon/thread/thread-pool.h>
+#include <photon/thread/workerpool.h>
+#include <photon/photon.h>
 #include <photon/common/event-loop.h>
 #include <photon/io/iouring-wrapper.h>
 
@@ -871,6 +876,270 @@ int set_iouring_custom_io(struct fuse_session *se) {
     return IouringSessionLoop::set_custom_io(se);
 }
 
+#if FUSE_USE_VERSION >= FUSE_MAKE_VERSION(3, 13)
+// The cloned /dev/fuse fd of current vCPU. Requests are received, processed
+// and replied on the same vCPU, as kernel requires replies to be written to
+// the very fd where the requests are read from.
+static thread_local int vcpu_fuse_fd = -1;
+
+static ssize_t custom_vcpu_writev(int fd, struct iovec *iov, int count, void *userdata)
+{
+    (void)userdata;
+    return writev(vcpu_fuse_fd, iov, count);
+}
+
+static ssize_t custom_vcpu_read(int fd, void *buf, size_t len, void *userdata)
+{
+    (void)userdata;
+    return read(vcpu_fuse_fd, buf, len);
+}
+
+static ssize_t custom_vcpu_splice_receive(
+    int fdin, off_t *offin,
+    int fdout, off_t *offout, size_t len,
+    unsigned int flags, void *userdata)
+{
+    return splice(vcpu_fuse_fd, offin, fdout, offout, len, flags);
+}
+
+// zero-copy reply, moving payload from the pipe filled by libfuse
+static ssize_t custom_vcpu_splice_send(
+    int fdin, off_t *offin,
+    int fdout, off_t *offout, size_t len,
+    unsigned int flags, void *userdata)
+{
+    return splice(fdin, offin, vcpu_fuse_fd, offout, len, flags);
+}
+
+static int clone_fuse_fd(uint32_t masterfd, bool nonblock) {
+    int clonefd = open("/dev/fuse", O_RDWR | O_CLOEXEC);
+    if (clonefd == -1)
+        LOG_ERRNO_RETURN(0, -1, "failed to open /dev/fuse");
+    if (ioctl(clonefd, FUSE_DEV_IOC_CLONE, &masterfd) == -1) {
+        close(clonefd);
+        LOG_ERRNO_RETURN(0, -1, "failed to clone fuse fd ", VALUE(masterfd));
+    }
+    if (nonblock) {
+        int flags = fcntl(clonefd, F_GETFL, 0);
+        fcntl(clonefd, F_SETFL, flags | O_NONBLOCK);
+    }
+    return clonefd;
+}
+
+// Run a receive loop in each vCPU of a WorkPool, with a cloned fuse fd
+// per vCPU, so that requests are received and dispatched in parallel
+class MultiVCPUSessionLoop : public FuseSessionLoop {
+public:
+    explicit MultiVCPUSessionLoop(struct fuse_session *se) : se_(se) {}
+
+    int init(const loop_args &args) {
+        args_ = args;
+        nworkers_ = args_.max_threads > 0 ? std::min(args_.max_threads, 64) : 32;
+        pool_ = args_.workpool;
+        if (!pool_) {
+            int n = args_.vcpu_num > 0 ? args_.vcpu_num :
+                    (int)std::thread::hardware_concurrency();
+            owned_pool_.reset(new WorkPool(n, INIT_EVENT_EPOLL, INIT_IO_NONE));
+            pool_ = owned_pool_.get();
+        }
+        nvcpus_ = pool_->get_vcpu_num();
+        return 0;
+    }
+
+    void run() {
+        photon::semaphore done;
+        for (int i = 0; i < nvcpus_; ++i) {
+            auto th = photon::thread_create11(
+                &MultiVCPUSessionLoop::vcpu_loop, this, &done);
+            pool_->thread_migrate(th, i);
+        }
+        done.wait(nvcpus_);
+    }
+
+    ~MultiVCPUSessionLoop() {
+        if (se_) fuse_session_exit(se_);
+    }
+
+    static int set_custom_io(struct fuse_session *se) {
+        const struct fuse_custom_io custom_io = {
+            .writev = photon::fs::custom_vcpu_writev,
+            .read = photon::fs::custom_vcpu_read,
+            .splice_receive = photon::fs::custom_vcpu_splice_receive,
+            .splice_send = photon::fs::custom_vcpu_splice_send,
+#if FUSE_USE_VERSION >= FUSE_MAKE_VERSION(3, 17)
+            .clone_fd = NULL,
+#endif
+        };
+#if FUSE_USE_VERSION >= FUSE_MAKE_VERSION(3, 17)
+        return fuse_session_custom_io(se, &custom_io,
+                                      sizeof(struct fuse_custom_io),
+                                      fuse_session_fd(se));
+#else
+        return fuse_session_custom_io(se, &custom_io, fuse_session_fd(se));
+#endif
+    }
+
+private:
+    struct vcpu_ctx {
+        int fd;
+        CascadingEventEngine *engine = nullptr;
+        photon::mutex recv_lock;
+        int running = 0;
+    };
+
+    loop_args args_;
+    struct fuse_session *se_;
+    WorkPool *pool_ = nullptr;
+    std::unique_ptr<WorkPool> owned_pool_;
+    int nvcpus_ = 0;
+    int nworkers_ = 32;
+
+    void *vcpu_loop(photon::semaphore *done) {
+        DEFER(done->signal(1));
+        int fd = clone_fuse_fd(fuse_session_fd(se_), !args_.uring_receive);
+        if (fd < 0) {
+            fuse_session_exit(se_);
+            return nullptr;
+        }
+        DEFER(close(fd));
+        vcpu_fuse_fd = fd;
+
+        vcpu_ctx ctx{fd};
+        photon::thread *poller = nullptr;
+        if (args_.uring_receive) {
+            iouring_args args;
+            args.eager_submit = true;
+            ctx.engine = new_iouring_cascading_engine(args);
+            if (!ctx.engine) {
+                LOG_ERROR("failed to create io_uring engine");
+                fuse_session_exit(se_);
+                return nullptr;
+            }
+        }
+        DEFER(delete ctx.engine);
+
+        std::vector<photon::thread *> workers;
+        for (int i = 0; i < nworkers_; ++i) {
+            auto th = photon::thread_create11(
+                &MultiVCPUSessionLoop::fuse_do_work, this, &ctx);
+            photon::thread_enable_join(th);
+            workers.push_back(th);
+        }
+        if (ctx.engine) {
+            poller = photon::thread_create11(
+                &MultiVCPUSessionLoop::fuse_do_poll, this, &ctx, &workers);
+            photon::thread_enable_join(poller);
+        }
+        for (auto th : workers)
+            photon::thread_join((photon::join_handle *)th);
+        if (poller)
+            photon::thread_join((photon::join_handle *)poller);
+        return nullptr;
+    }
+
+    void *fuse_do_work(vcpu_ctx *ctx) {
+        struct fuse_buf fbuf;
+        memset(&fbuf, 0, sizeof(fbuf));
+        struct fuse_pipe pipe;
+        if (args_.force_splice_read && pipe.setup() < 0) {
+            LOG_ERROR("failed to setup pipe for splice read: `", strerror(errno));
+            return nullptr;
+        }
+        ctx->running++;
+        DEFER({
+            ctx->running--;
+            pipe.setdown();
+            free(fbuf.mem);
+        });
+        while (!fuse_session_exited(se_)) {
+            int res = ctx->engine ? receive_uring(ctx, &fbuf, &pipe) :
+                                    receive_epoll(ctx, &fbuf, &pipe);
+            if (res == 0 || res == -EINTR || res == -EAGAIN)
+                continue;
+            if (res < 0) {
+                fuse_session_exit(se_);
+                break;
+            }
+            fuse_session_process_buf(se_, &fbuf);
+        }
+        return nullptr;
+    }
+
+    // only one worker of a vCPU waits for the fd at a time,
+    // and it gives way to others as soon as it gets a request
+    int receive_epoll(vcpu_ctx *ctx, struct fuse_buf *fbuf, struct fuse_pipe *pipe) {
+        SCOPED_LOCK(ctx->recv_lock);
+        while (!fuse_session_exited(se_)) {
+            int res;
+            if (args_.force_splice_read) {
+                res = fuse_session_receive_splice(se_, fbuf, pipe, ctx->fd);
+            } else {
+                res = fuse_session_receive_fd(se_, fbuf, ctx->fd);
+                if (res > 0) {
+                    fbuf->size = res;
+                    fbuf->flags = (enum fuse_buf_flags)0;
+                }
+            }
+            if (res > 0 || (res < 0 && res != -EAGAIN && res != -EINTR))
+                return res;
+            // wake up periodically to check whether session has exited
+            photon::wait_for_fd_readable(ctx->fd, 100UL * 1000);
+        }
+        return 0;
+    }
+
+    int receive_uring(vcpu_ctx *ctx, struct fuse_buf *fbuf, struct fuse_pipe *pipe) {
+        if (args_.force_splice_read)
+            return fuse_session_receive_uring_splice(se_, fbuf, ctx->fd, pipe, ctx->engine);
+        size_t bufsize = getpagesize() * (256 + 1);
+        if (!fbuf->mem) {
+            fbuf->mem = malloc(bufsize);
+            if (!fbuf->mem) return -ENOMEM;
+        }
+        uint64_t flags = ((uint64_t)IOSQE_ASYNC) << 32;
+        ssize_t res = iouring_pread(ctx->fd, fbuf->mem, bufsize, -1, flags, -1, ctx->engine);
+        int err = errno;
+        if (fuse_session_exited(se_))
+            return 0;
+        if (res < 0) {
+            if (err == ENOENT)  // interrupted request, safe to restart
+                return -EINTR;
+            if (err == ENODEV) {
+                fuse_session_exit(se_);
+                return 0;
+            }
+            return -err;
+        }
+        fbuf->size = res;
+        fbuf->flags = (enum fuse_buf_flags)0;
+        return res;
+    }
+
+    void *fuse_do_poll(vcpu_ctx *ctx, std::vector<photon::thread *> *workers) {
+        bool interrupted = false;
+        photon::thread_yield();     // let workers start
+        while (ctx->running > 0) {
+            ctx->engine->wait_for_events(nullptr, 0, 100UL * 1000);
+            if (fuse_session_exited(se_) && !interrupted) {
+                // workers may still be waiting for requests
+                for (auto th : *workers)
+                    photon::thread_interrupt(th, EINTR);
+                interrupted = true;
+            }
+        }
+        return nullptr;
+    }
+};
+
+FuseSessionLoop *new_multi_vcpu_session_loop(struct fuse_session *se, loop_args args) {
+    return NewObj<MultiVCPUSessionLoop>(se)->init(args);
+}
+
+int set_multi_vcpu_custom_io(struct fuse_session *se) {
+    return MultiVCPUSessionLoop::set_custom_io(se);
+}
+#endif
+
 #endif
 
 }  // namespace fs
@@ -29,6 +29,8 @@ limitations under the License.
 #include <liburing.h>
 
 namespace photon {
+class WorkPool;
+
 namespace fs {
 
 #define SHIFT(n) (1 << n)
@@ -37,6 +39,7 @@ const uint64_t FUSE_SESSION_LOOP_EPOLL = SHIFT(0);
 const uint64_t FUSE_SESSION_LOOP_SYNC = SHIFT(1);
 const uint64_t FUSE_SESSION_LOOP_IOURING_CASCADING = SHIFT(2);
 const uint64_t FUSE_SESSION_LOOP_IOURING = SHIFT(3);
+const uint64_t FUSE_SESSION_LOOP_MULTI_VCPU = SHIFT(4);
 
 const uint64_t FUSE_SESSION_LOOP_DEFAULT = FUSE_SESSION_LOOP_EPOLL |
                                            FUSE_SESSION_LOOP_SYNC  |
@@ -47,7 +50,13 @@ const uint64_t FUSE_SESSION_LOOP_DEFAULT = FUSE_SESSION_LOOP_EPOLL |
 struct loop_args {
     uint64_t looptype = FUSE_SESSION_LOOP_EPOLL;
     bool force_splice_read = false;
-    int max_threads = 32;
+    int max_threads = 32;       // workers per vCPU for multi-vCPU loop, 1..64
+
+    // for FUSE_SESSION_LOOP_MULTI_VCPU only
+    int vcpu_num = 0;           // 0 for number of CPUs
+    bool uring_receive = false; // receive requests with io_uring instead of epoll
+    WorkPool* workpool = nullptr;   // run the loops in a shared workpool,
+                                    // or create one of `vcpu_num` vCPUs
 };
 
 class FuseSessionLoop {
@@ -59,6 +68,7 @@ public:
 
 int set_sync_custom_io(struct fuse_session *);
 int set_iouring_custom_io(struct fuse_session *);
+int set_multi_vcpu_custom_io(struct fuse_session *);
 
 #define DECLARE_SESSION_LOOP(name)  \
 FuseSessionLoop *new_##name##_session_loop(struct fuse_session *, loop_args = {})
@@ -67,6 +77,7 @@ DECLARE_SESSION_LOOP(epoll);
 #if FUSE_USE_VERSION >= FUSE_MAKE_VERSION(3, 13)
 DECLARE_SESSION_LOOP(sync);
 DECLARE_SESSION_LOOP(iouring);
+DECLARE_SESSION_LOOP(multi_vcpu);
 #endif
 
 inline FuseSessionLoop *
@@ -78,6 +89,8 @@ new_session_loop(struct fuse_session *se, loop_args args = {}) {
             return new_sync_session_loop(se, args);
         case FUSE_SESSION_LOOP_IOURING_CASCADING:
             return new_iouring_session_loop(se, args);
+        case FUSE_SESSION_LOOP_MULTI_VCPU:
+            return new_multi_vcpu_session_loop(se, args);
 #endif
         case FUSE_SESSION_LOOP_EPOLL:
         default:
@@ -37,6 +37,26 @@ enum HTTPFileFlags {
     HTTP_HEADER = 0xF01,  // (const char*, const char*) ... for header
     HTTP_URL_PARAM =
         0xF02,  // const char* ... for url param (concat by '?' in url)
+    HTTP_READ_OPTIONS =
+        0xF03,  // const HttpReadOptions* ... for read options (httpfile_v2 only)
+};
+
+// Read strategies of httpfile_v2, all of them are disabled by default
+struct HttpReadOptions {
+    // reads larger than `split_size` are split into range GETs of
+    // `split_size`, issued in parallel over pooled connections;
+    // 0 to disable
+    size_t split_size = 0;
+    // max number of concurrent range GETs issued by a single read
+    int max_parallel = 4;
+    // max size of the per-file readahead window for sequential reads,
+    // the window starts from `readahead_min` and doubles on each
+    // sequential miss; 0 to disable
+    size_t readahead_max = 0;
+    size_t readahead_min = 128 * 1024;
+    // small concurrent reads of adjacent ranges are merged into a single
+    // range GET, up to `merge_max` bytes in total; 0 to disable
+    size_t merge_max = 0;
 };
 
 using FileOpenCallback = Delegate<void, const char*, IFile*>;
@@ -72,11 +92,18 @@ IFile* new_httpfile(const char* url, IFileSystem* httpfs = nullptr,
                     uint64_t conn_timeout = -1UL, uint64_t stat_expire = -1UL,
                     FileOpenCallback open_cb = {});
 
+/**
+ * @brief create httpfs object, based on photon http client
+ *
+ * @param read_opts default read options of the files opened, can be
+ * overridden by ioctl(HTTP_READ_OPTIONS, ...) on each file
+ */
 IFileSystem* new_httpfs_v2(bool default_https = false,
                            uint64_t conn_timeout = -1UL,
                            uint64_t stat_expire = -1UL,
                            net::http::Client* client = nullptr,
-                           bool client_ownership = false);
+                           bool client_ownership = false,
+                           const HttpReadOptions* read_opts = nullptr);
 
 IFile* new_httpfile_v2(const char* url, IFileSystem* httpfs = nullptr,
                        uint64_t conn_timeout = -1UL,
@@ -27,6 +27,7 @@ limitations under the License.
 #include <photon/net/http/url.h>
 #include <photon/common/alog-stdstring.h>
 #include <photon/thread/thread.h>
+#include <photon/thread/thread11.h>
 #include <photon/common/string-keyed.h>
 #include <photon/common/string_view.h>
 #include <photon/common/estring.h>
@@ -46,12 +47,15 @@ protected:
 
     net::http::Client *m_client;
     bool m_client_ownership;
+    HttpReadOptions m_read_opts;
 
 public:
     HttpFs_v2(bool default_https, uint64_t conn_timeout, uint64_t stat_timeout,
-              net::http::Client* client, bool client_ownership)
+              net::http::Client* client, bool client_ownership,
+              const HttpReadOptions* read_opts)
         : m_default_https(default_https), m_conn_timeout(conn_timeout),
           m_stat_timeout(stat_timeout) {
+        if (read_opts) m_read_opts = *read_opts;
         if (client == nullptr) {
             m_client = net::http::new_http_client();
             m_client_ownership = true;
@@ -65,6 +69,7 @@ public:
             delete m_client;
     }
     net::http::Client* get_client() { return m_client; }
+    const HttpReadOptions& read_options() { return m_read_opts; }
     IFile* open(const char* pathname, int flags) override;
     IFile* open(const char* pathname, int flags, mode_t) override {
         return open(pathname, flags);
@@ -116,12 +121,27 @@ public:
 
     std::string m_url_param;
 
+    HttpReadOptions m_read_opts;
+
+    // readahead state of sequential reads
+    photon::mutex m_ra_mutex;
+    std::vector<char> m_ra_buf;
+    off_t m_ra_offset = 0;
+    off_t m_ra_last_end = 0;   // reading from the beginning is sequential
+    size_t m_ra_window = 0;
+
+    // small reads of adjacent ranges, waiting to be merged
+    struct ReadBatch;
+    ReadBatch* m_batch = nullptr;
+
     HttpFile_v2(const char* url, HttpFs_v2* httpfs, uint64_t conn_timeout,
              uint64_t stat_timeout)
         : m_url(url),
           m_fs((HttpFs_v2*)httpfs),
           m_conn_timeout(conn_timeout),
-          m_stat_timeout(stat_timeout) {}
+          m_stat_timeout(stat_timeout) {
+        if (m_fs) m_read_opts = m_fs->read_options();
+    }
 
     HttpFile_v2(std::string&& url, HttpFs_v2* httpfs, uint64_t conn_timeout,
              uint64_t stat_timeout, const std::string_view& param)
@@ -129,7 +149,9 @@ public:
           m_fs((HttpFs_v2*)httpfs),
           m_conn_timeout(conn_timeout),
           m_stat_timeout(stat_timeout),
-          m_url_param(param) {}
+          m_url_param(param) {
+        if (m_fs) m_read_opts = m_fs->read_options();
+    }
 
     int update_stat_from_resp(const net::http::Client::Operation* op) {
         auto ret = op->status_code;
@@ -188,6 +210,19 @@ public:
         iovector_view view((struct iovec*)iovec, iovcnt);
         auto count = std::min(view.sum(), (size_t)(s.st_size - offset));
         if (count == 0) return 0;
+        auto& opts = m_read_opts;
+        if (opts.readahead_max && count < opts.readahead_max)
+            return readahead_read(view, offset, count, s.st_size, tmo);
+        if (opts.split_size && count > opts.split_size && opts.max_parallel > 1)
+            return parallel_read(view, offset, count, tmo);
+        if (opts.merge_max && count < opts.merge_max)
+            return merged_read(view, offset, count, tmo);
+        return range_read(iovec, iovcnt, offset, count, tmo);
+    }
+
+    // issue a single range GET, and read the body into iovec
+    ssize_t range_read(const struct iovec* iovec, int iovcnt, off_t offset,
+                       size_t count, Timeout tmo) {
         HTTP_OP op;
         send_read_request(op, offset, count, tmo);
         if (op.status_code < 0) return -1;
@@ -212,6 +247,171 @@ public:
         return ret;
     }
 
+    ssize_t range_read(void* buf, size_t count, off_t offset, Timeout tmo) {
+        struct iovec v{buf, count};
+        return range_read(&v, 1, offset, count, tmo);
+    }
+
+    // get iovecs of [offset, offset + count) within `view`
+    static void slice_iovec(iovector_view view, size_t offset, size_t count,
+                            std::vector<struct iovec>& out) {
+        out.clear();
+        for (auto& v : view) {
+            if (count == 0) break;
+            if (offset >= v.iov_len) {
+                offset -= v.iov_len;
+                continue;
+            }
+            auto len = std::min(v.iov_len - offset, count);
+            out.push_back({(char*)v.iov_base + offset, len});
+            count -= len;
+            offset = 0;
+        }
+    }
+
+    // split a large read into pieces of `split_size`, and issue range
+    // GETs of them in parallel, each with a connection from the pool
+    ssize_t parallel_read(iovector_view view, off_t offset, size_t count,
+                          Timeout tmo) {
+        auto piece = m_read_opts.split_size;
+        auto npieces = (count + piece - 1) / piece;
+        auto nworkers = std::min((size_t)m_read_opts.max_parallel, npieces);
+        size_t next = 0;
+        int err = 0;
+        auto worker = [&]() {
+            std::vector<struct iovec> iov;
+            while (!err && next < npieces) {
+                auto i = next++;
+                auto pos = i * piece;
+                auto len = std::min(piece, count - pos);
+                slice_iovec(view, pos, len, iov);
+                auto ret = range_read(iov.data(), (int)iov.size(),
+                                      offset + pos, len, tmo);
+                if (ret != (ssize_t)len) {
+                    if (!err) err = (ret < 0) ? errno : EIO;
+                    LOG_ERROR("HttpFs: parallel range read failed ",
+                              VALUE(m_url), VALUE(offset + pos), VALUE(len), VALUE(ret));
+                }
+            }
+        };
+        std::vector<join_handle*> jhs;
+        for (size_t i = 1; i < nworkers; ++i)
+            jhs.push_back(thread_enable_join(thread_create11(worker)));
+        worker();
+        for (auto jh : jhs)
+            thread_join(jh);
+        if (err) {
+            errno = err;
+            return -1;
+        }
+        return count;
+    }
+
+    // sequential small reads are served from a per-file readahead buffer,
+    // whose window grows exponentially up to `readahead_max`, as long as
+    // the access pattern remains sequential
+    ssize_t readahead_read(iovector_view view, off_t offset, size_t count,
+                           off_t file_size, Timeout tmo) {
+        m_ra_mutex.lock();
+        auto ra_end = m_ra_offset + (off_t)m_ra_buf.size();
+        if (offset >= m_ra_offset && offset + (off_t)count <= ra_end) {
+            view.memcpy_from(&m_ra_buf[offset - m_ra_offset], count);
+            m_ra_last_end = offset + count;
+            m_ra_mutex.unlock();
+            return count;
+        }
+        bool sequential = (offset == m_ra_last_end) ||
+                          (offset >= m_ra_offset && offset < ra_end);
+        m_ra_last_end = offset + count;
+        if (!sequential) {
+            m_ra_window = 0;
+            m_ra_mutex.unlock();
+            if (m_read_opts.merge_max && count < m_read_opts.merge_max)
+                return merged_read(view, offset, count, tmo);
+            return range_read(view.iov, view.iovcnt, offset, count, tmo);
+        }
+        DEFER(m_ra_mutex.unlock());
+        auto& opts = m_read_opts;
+        m_ra_window = m_ra_window ? std::min(m_ra_window * 2, opts.readahead_max)
+                                  : std::min(opts.readahead_min, opts.readahead_max);
+        auto len = std::min(std::max(m_ra_window, count), (size_t)(file_size - offset));
+        m_ra_buf.resize(len);
+        auto ret = range_read(&m_ra_buf[0], len, offset, tmo);
+        if (ret < (ssize_t)count) {
+            m_ra_buf.clear();
+            if (ret < 0) return ret;
+            LOG_ERROR_RETURN(EIO, -1, "HttpFs: readahead got short body ",
+                             VALUE(m_url), VALUE(offset), VALUE(len), VALUE(ret));
+        }
+        m_ra_buf.resize(ret);
+        m_ra_offset = offset;
+        view.memcpy_from(&m_ra_buf[0], count);
+        return count;
+    }
+
+    struct ReadRequest {
+        iovector_view view;
+        off_t offset;
+        size_t count;
+        ssize_t ret = -1;
+        int err = 0;
+        photon::semaphore done;
+        ReadRequest(iovector_view view, off_t offset, size_t count)
+            : view(view), offset(offset), count(count) {}
+    };
+
+    struct ReadBatch {
+        off_t begin, end;
+        std::vector<ReadRequest*> reqs;
+    };
+
+    // concurrent small reads of adjacent ranges join the batch that is
+    // collecting, and the leader of the batch issues a single range GET
+    // for all of them after yielding once
+    ssize_t merged_read(iovector_view view, off_t offset, size_t count,
+                        Timeout tmo) {
+        ReadRequest req(view, offset, count);
+        off_t end = offset + count;
+        auto batch = m_batch;
+        if (batch && (size_t)(batch->end - batch->begin) + count <= m_read_opts.merge_max &&
+                (offset == batch->end || end == batch->begin)) {
+            if (offset == batch->end) batch->end = end;
+            else batch->begin = offset;
+            batch->reqs.push_back(&req);
+            req.done.wait(1);
+            errno = req.err;
+            return req.ret;
+        }
+        if (batch)  // not mergeable with the collecting batch
+            return range_read(view.iov, view.iovcnt, offset, count, tmo);
+
+        ReadBatch this_batch{offset, end, {&req}};
+        m_batch = &this_batch;
+        photon::thread_yield();
+        m_batch = nullptr;
+        if (this_batch.reqs.size() == 1)
+            return range_read(view.iov, view.iovcnt, offset, count, tmo);
+
+        auto len = this_batch.end - this_batch.begin;
+        std::vector<char> buf(len);
+        auto ret = range_read(&buf[0], len, this_batch.begin, tmo);
+        auto err = errno;
+        for (auto r : this_batch.reqs) {
+            if (ret < 0) {
+                r->ret = -1;
+                r->err = err;
+            } else {
+                auto pos = r->offset - this_batch.begin;
+                auto n = std::max(std::min((ssize_t)r->count, ret - pos), (ssize_t)0);
+                r->view.memcpy_from(&buf[pos], n);
+                r->ret = n;
+            }
+            if (r != &req) r->done.signal(1);
+        }
+        errno = req.err;
+        return req.ret;
+    }
+
     int fstat(struct stat* buf) override {
         m_etimeout = false;
         if (!m_stat_gettime || photon::now - m_stat_gettime >= m_stat_timeout ||
@@ -240,6 +440,16 @@ public:
 
     void add_url_param(va_list args) { m_url_param = va_arg(args, const char*); }
 
+    int set_read_options(va_list args) {
+        auto opts = va_arg(args, const HttpReadOptions*);
+        if (!opts) LOG_ERROR_RETURN(EINVAL, -1, "read options should not be NULL");
+        if (opts->split_size && opts->max_parallel <= 0)
+            LOG_ERROR_RETURN(EINVAL, -1, "max_parallel should be positive ",
+                             VALUE(opts->max_parallel));
+        m_read_opts = *opts;
+        return 0;
+    }
+
     int vioctl(int request, va_list args) override {
         switch (request) {
             case HTTP_HEADER:
@@ -248,10 +458,13 @@ public:
             case HTTP_URL_PARAM:
                 add_url_param(args);
                 break;
+            case HTTP_READ_OPTIONS:
+                return set_read_options(args);
             default:
                 LOG_ERROR_RETURN(EINVAL, -1,
-                                 "Unknow ioctl request, supports ` and ` only",
-                                 VALUE(HTTP_HEADER), VALUE(HTTP_URL_PARAM));
+                                 "Unknow ioctl request, supports `, ` and ` only",
+                                 VALUE(HTTP_HEADER), VALUE(HTTP_URL_PARAM),
+                                 VALUE(HTTP_READ_OPTIONS));
         }
         return 0;
     }
@@ -278,9 +491,9 @@ inline IFile* HttpFs_v2::open(const char* pathname, int flags) {
 
 IFileSystem* new_httpfs_v2(bool default_https, uint64_t conn_timeout,
                            uint64_t stat_timeout, net::http::Client* client,
-                           bool client_ownership) {
+                           bool client_ownership, const HttpReadOptions* read_opts) {
     return new HttpFs_v2(default_https, conn_timeout, stat_timeout,
-                         client, client_ownership);
+                         client, client_ownership, read_opts);
 }
 
 IFile* new_httpfile_v2(const char* url, IFileSystem* httpfs, uint64_t conn_timeout,
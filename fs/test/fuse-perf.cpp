@@ -0,0 +1,166 @@
+/*
+Copyright 2022 The Photon Authors
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// A fio-like harness for the fuse session loops. It mounts a localfs rooted
+// in a memory-backed directory (/dev/shm by default), then hammers a file
+// through the mountpoint from several std::threads, e.g.
+//
+//   fuse-perf --mnt=/tmp/fmnt --looptype=multi_vcpu --vcpus=4 --jobs=16
+//   fuse-perf --mnt=/tmp/fmnt --looptype=mpt --rw=randwrite --bs=131072
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef FUSE_USE_VERSION
+#define FUSE_USE_VERSION 317
+#endif
+
+#include <gflags/gflags.h>
+#include <photon/common/alog-stdstring.h>
+#include <photon/photon.h>
+#include "../fuse_adaptor/fuse_adaptor.h"
+#include "../localfs.h"
+
+DEFINE_string(src, "/dev/shm/fuse-perf-src", "memory-backed source folder");
+DEFINE_string(mnt, "/tmp/fuse-perf-mnt", "mountpoint");
+DEFINE_string(looptype, "multi_vcpu", "fuse session loop: sync, epoll, mpt, iouring, multi_vcpu");
+DEFINE_uint32(vcpus, 4, "vCPUs of the multi_vcpu loop");
+DEFINE_uint32(threads, 16, "fuse worker threads (per vCPU for multi_vcpu)");
+DEFINE_bool(uring_receive, false, "receive fuse requests via io_uring (multi_vcpu)");
+DEFINE_bool(splice, false, "enable splice_read/splice_write/splice_move");
+DEFINE_bool(direct_io, true, "bypass the kernel page cache of the mountpoint");
+DEFINE_string(rw, "randread", "read, randread, write or randwrite");
+DEFINE_uint32(bs, 4096, "block size");
+DEFINE_uint64(size, 1UL << 30, "file size");
+DEFINE_uint32(jobs, 8, "client std::threads");
+DEFINE_uint32(runtime, 10, "seconds to run");
+
+using namespace photon;
+
+static std::atomic<uint64_t> ops{0}, lat_ns{0};
+static std::atomic<bool> stop{false};
+
+static std::string fuse_options() {
+    std::string o = "looptype=" + FLAGS_looptype +
+                    ",threads=" + std::to_string(FLAGS_threads) +
+                    ",vcpus=" + std::to_string(FLAGS_vcpus) +
+                    ",uring_receive=" + std::to_string((int)FLAGS_uring_receive);
+    if (FLAGS_splice) o += ",splice_read,splice_write,splice_move";
+    if (FLAGS_direct_io) o += ",direct_io";
+    return o;
+}
+
+static void run_fuse_thread() {
+    photon::init(INIT_EVENT_EPOLL, INIT_IO_NONE);
+    DEFER(photon::fini());
+    auto fs = fs::new_localfs_adaptor(FLAGS_src.c_str(), fs::ioengine_psync);
+    DEFER(delete fs);
+    auto opts = fuse_options();
+    const char* argv[] = {"fuse-perf", FLAGS_mnt.c_str(), "-f", "-o", opts.c_str()};
+    LOG_INFO("mount ` on ` with `", FLAGS_src, FLAGS_mnt, opts);
+    fuser_go(fs, 5, (char**)argv);
+}
+
+static void job(int fd, uint32_t seed) {
+    bool write = FLAGS_rw.find("write") != std::string::npos;
+    bool random = FLAGS_rw.compare(0, 4, "rand") == 0;
+    uint64_t nblocks = FLAGS_size / FLAGS_bs;
+    std::mt19937_64 rng(seed);
+    void* buf = nullptr;
+    if (posix_memalign(&buf, 4096, FLAGS_bs)) return;
+    DEFER(free(buf));
+    memset(buf, seed, FLAGS_bs);
+    uint64_t blk = seed % nblocks, n = 0, ns = 0;
+    while (!stop.load(std::memory_order_relaxed)) {
+        blk = random ? rng() % nblocks : (blk + 1) % nblocks;
+        auto t0 = std::chrono::steady_clock::now();
+        auto ret = write ? pwrite(fd, buf, FLAGS_bs, blk * FLAGS_bs)
+                         : pread(fd, buf, FLAGS_bs, blk * FLAGS_bs);
+        auto t1 = std::chrono::steady_clock::now();
+        if (ret != (ssize_t)FLAGS_bs) {
+            LOG_ERRNO_RETURN(0, , "I/O failed at block `", blk);
+        }
+        ns += std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+        n++;
+    }
+    ops += n;
+    lat_ns += ns;
+}
+
+int main(int argc, char** argv) {
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+    set_log_output_level(ALOG_INFO);
+    if (FLAGS_bs == 0 || FLAGS_size < FLAGS_bs)
+        LOG_ERROR_RETURN(EINVAL, -1, "invalid bs ` or size `", FLAGS_bs, FLAGS_size);
+
+    mkdir(FLAGS_src.c_str(), 0755);
+    mkdir(FLAGS_mnt.c_str(), 0755);
+    auto data = FLAGS_src + "/data";
+    int sfd = open(data.c_str(), O_RDWR | O_CREAT, 0644);
+    if (sfd < 0) LOG_ERRNO_RETURN(0, -1, "failed to create `", data);
+    if (ftruncate(sfd, FLAGS_size) < 0) LOG_ERRNO_RETURN(0, -1, "failed to truncate `", data);
+    close(sfd);
+
+    std::thread fuse_th(&run_fuse_thread);
+    // wait until the mountpoint serves the data file
+    auto path = FLAGS_mnt + "/data";
+    struct stat st;
+    for (int i = 0; stat(path.c_str(), &st) < 0 || (uint64_t)st.st_size != FLAGS_size; i++) {
+        if (i == 500) {
+            LOG_ERROR("mount ` does not come up", FLAGS_mnt);
+            fuse_th.detach();
+            return -1;
+        }
+        usleep(10 * 1000);
+    }
+
+    std::vector<int> fds;
+    std::vector<std::thread> jobs;
+    for (uint32_t i = 0; i < FLAGS_jobs; i++) {
+        int fd = open(path.c_str(), O_RDWR);
+        if (fd < 0) { LOG_ERRNO_RETURN(0, -1, "failed to open `", path); }
+        fds.push_back(fd);
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < FLAGS_jobs; i++)
+        jobs.emplace_back(&job, fds[i], i + 1);
+    sleep(FLAGS_runtime);
+    stop = true;
+    for (auto& th : jobs) th.join();
+    auto elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    for (auto fd : fds) close(fd);
+
+    uint64_t n = ops.load();
+    LOG_INFO("` bs=` jobs=` looptype=` vcpus=` threads=`: IOPS `, BW ` MB/s, avg lat ` us",
+             FLAGS_rw, FLAGS_bs, FLAGS_jobs, FLAGS_looptype, FLAGS_vcpus, FLAGS_threads,
+             n * 1000000 / elapsed_us, n * FLAGS_bs / elapsed_us,
+             n ? lat_ns.load() / n / 1000 : 0);
+
+    auto cmd = "fusermount3 -u " + FLAGS_mnt + " 2>/dev/null || fusermount -u " + FLAGS_mnt;
+    if (system(cmd.c_str()) != 0) LOG_WARN("failed to unmount `", FLAGS_mnt);
+    fuse_th.join();
+    unlink(data.c_str());
+    return 0;
+}
@@ -16,6 +16,7 @@ limitations under the License.
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <fcntl.h>
 #include <sys/wait.h>
 #include <photon/fs/filecopy.h>
@@ -58,6 +59,84 @@ TEST(filecopy, libaio_localfile_copy) {
 }
 #endif
 
+TEST(filecopy, parallel_localfile_copy) {
+    auto fs = fs::new_localfs_adaptor("/tmp");
+    DEFER(delete fs);
+    for (bool kernel_copy : {true, false}) {
+        auto f1 = fs->open("test_filecopy_src", O_RDONLY);
+        auto f2 = fs->open("test_filecopy_dst3", O_RDWR | O_CREAT | O_TRUNC, 0644);
+        fs::FileCopyOptions opts;
+        opts.block_size = 16 * 1024;
+        opts.kernel_copy = kernel_copy;
+        fs::FileCopyStats stats;
+        auto ret = fs::filecopy(f1, f2, opts, &stats);
+        delete f2;
+        delete f1;
+        EXPECT_EQ(500 * 4100, ret);
+        EXPECT_EQ(500 * 4100, (ssize_t)stats.file_size);
+        EXPECT_EQ(kernel_copy, stats.kernel_copy);
+        EXPECT_EQ(stats.file_size, stats.bytes_copied + stats.bytes_skipped);
+        LOG_INFO(VALUE(kernel_copy), VALUE(stats.blocks), VALUE(stats.elapsed_us),
+                 " throughput: ", stats.throughput(), "MB/s");
+        ret = system("diff -b /tmp/test_filecopy_src /tmp/test_filecopy_dst3");
+        EXPECT_EQ(0, WEXITSTATUS(ret));
+    }
+}
+
+TEST(filecopy, parallel_sparse_file_copy) {
+    auto fs = fs::new_localfs_adaptor("/tmp");
+    DEFER(delete fs);
+    auto f1 = fs->open("test_filecopy_sparse", O_RDWR | O_CREAT | O_TRUNC, 0644);
+    char buf[4096];
+    memset(buf, 'x', sizeof(buf));
+    f1->pwrite(buf, sizeof(buf), 0);
+    f1->pwrite(buf, sizeof(buf), 64 * 1024 * 1024);
+    f1->ftruncate(128 * 1024 * 1024);
+    f1->fsync();
+    auto f2 = fs->open("test_filecopy_sparse_dst", O_RDWR | O_CREAT | O_TRUNC, 0644);
+    fs::FileCopyOptions opts;
+    opts.kernel_copy = false;
+    fs::FileCopyStats stats;
+    auto ret = fs::filecopy(f1, f2, opts, &stats);
+    delete f2;
+    delete f1;
+    EXPECT_EQ(128 * 1024 * 1024, ret);
+    EXPECT_EQ(stats.file_size, stats.bytes_copied + stats.bytes_skipped);
+    LOG_INFO("sparse copy ", VALUE(stats.bytes_copied), VALUE(stats.bytes_skipped));
+    ret = system("cmp /tmp/test_filecopy_sparse /tmp/test_filecopy_sparse_dst");
+    EXPECT_EQ(0, WEXITSTATUS(ret));
+}
+
+TEST(filecopy, sparse_file_copy_overwrite) {
+    auto fs = fs::new_localfs_adaptor("/tmp");
+    DEFER(delete fs);
+    auto f1 = fs->open("test_filecopy_sparse2", O_RDWR | O_CREAT | O_TRUNC, 0644);
+    char buf[4096];
+    memset(buf, 'x', sizeof(buf));
+    f1->pwrite(buf, sizeof(buf), 0);
+    f1->pwrite(buf, 1000, 4 * 1024 * 1024 + 100);
+    f1->ftruncate(8 * 1024 * 1024);
+    f1->fsync();
+    DEFER(delete f1);
+    memset(buf, 'y', sizeof(buf));
+    for (bool kernel_copy : {true, false}) {
+        // the holes of the source must not leave the old content of the
+        // destination behind
+        auto f2 = fs->open("test_filecopy_sparse2_dst", O_RDWR | O_CREAT, 0644);
+        for (off_t off = 0; off < 10 * 1024 * 1024; off += sizeof(buf))
+            f2->pwrite(buf, sizeof(buf), off);
+        fs::FileCopyOptions opts;
+        opts.kernel_copy = kernel_copy;
+        fs::FileCopyStats stats;
+        auto ret = fs::filecopy(f1, f2, opts, &stats);
+        delete f2;
+        EXPECT_EQ(8 * 1024 * 1024, ret);
+        EXPECT_GT(stats.bytes_skipped, 0);
+        ret = system("cmp /tmp/test_filecopy_sparse2 /tmp/test_filecopy_sparse2_dst");
+        EXPECT_EQ(0, WEXITSTATUS(ret));
+    }
+}
+
 int main(int argc, char **argv) {
     if (photon::init(photon::INIT_EVENT_DEFAULT, photon::INIT_IO_NONE))
         return -1;
@@ -0,0 +1,124 @@
+/*
+Copyright 2022 The Photon Authors
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef FUSE_USE_VERSION
+#define FUSE_USE_VERSION 317
+#endif
+
+#include <photon/photon.h>
+#include <photon/common/alog.h>
+#include <photon/common/alog-stdstring.h>
+#include "../fuse_adaptor/fuse_adaptor.h"
+#include "../localfs.h"
+#include "../../test/gtest.h"
+
+using namespace photon;
+
+static std::string src_dir, mnt_dir;
+
+// mount a localfs of `src_dir` on `mnt_dir` with the multi-vCPU loop,
+// run `f` on it, then unmount; returns false if it could not be mounted
+template<typename F>
+static bool with_mount(const char* options, const F& f) {
+    std::thread fuse_th([&] {
+        photon::init(INIT_EVENT_EPOLL, INIT_IO_NONE);
+        DEFER(photon::fini());
+        auto fs = fs::new_localfs_adaptor(src_dir.c_str(), fs::ioengine_psync);
+        DEFER(delete fs);
+        const char* argv[] = {"test-fuse-multi-vcpu", mnt_dir.c_str(), "-f", "-o", options};
+        fuser_go(fs, 5, (char**)argv);
+    });
+    auto probe = mnt_dir + "/probe";
+    struct stat st;
+    int i = 0;
+    while (stat(probe.c_str(), &st) < 0 && ++i < 300)
+        usleep(10 * 1000);
+    if (i < 300) f();
+    auto cmd = "fusermount3 -u " + mnt_dir + " 2>/dev/null || fusermount -u " + mnt_dir;
+    if (system(cmd.c_str()) != 0 && i < 300)
+        LOG_WARN("failed to unmount `", mnt_dir);
+    if (i < 300) fuse_th.join();
+    else fuse_th.detach();
+    return i < 300;
+}
+
+static void read_write(int jobs) {
+    std::vector<std::thread> ths;
+    for (int j = 0; j < jobs; j++) {
+        ths.emplace_back([j] {
+            auto path = mnt_dir + "/file" + std::to_string(j);
+            int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+            ASSERT_GE(fd, 0);
+            char buf[4096], rbuf[4096];
+            memset(buf, 'a' + j, sizeof(buf));
+            for (int i = 0; i < 64; i++)
+                ASSERT_EQ((ssize_t)sizeof(buf), pwrite(fd, buf, sizeof(buf), i * sizeof(buf)));
+            for (int i = 0; i < 64; i++) {
+                ASSERT_EQ((ssize_t)sizeof(rbuf), pread(fd, rbuf, sizeof(rbuf), i * sizeof(rbuf)));
+                ASSERT_EQ(0, memcmp(buf, rbuf, sizeof(buf)));
+            }
+            close(fd);
+            // it went through to the source folder
+            struct stat st;
+            auto src = src_dir + "/file" + std::to_string(j);
+            ASSERT_EQ(0, stat(src.c_str(), &st));
+            EXPECT_EQ(64 * 4096, st.st_size);
+        });
+    }
+    for (auto& th : ths) th.join();
+}
+
+TEST(fuse, multi_vcpu) {
+    bool mounted = with_mount("looptype=multi_vcpu,vcpus=2,threads=4,direct_io",
+                              [] { read_write(8); });
+    if (!mounted) LOG_WARN("fuse is not mountable here, skipped");
+}
+
+TEST(fuse, multi_vcpu_threads_clamped) {
+    // out of 1..64, which used to start that many workers per vCPU
+    bool mounted = with_mount("looptype=multi_vcpu,vcpus=2,threads=100000,direct_io",
+                              [] { read_write(2); });
+    if (!mounted) LOG_WARN("fuse is not mountable here, skipped");
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    if (access("/dev/fuse", R_OK | W_OK) < 0) {
+        LOG_WARN("/dev/fuse is not available, skipped");
+        return 0;
+    }
+    char src[] = "/tmp/test-fuse-src-XXXXXX", mnt[] = "/tmp/test-fuse-mnt-XXXXXX";
+    if (!mkdtemp(src) || !mkdtemp(mnt))
+        LOG_ERRNO_RETURN(0, -1, "failed to create temporary folders");
+    src_dir = src;
+    mnt_dir = mnt;
+    auto probe = src_dir + "/probe";
+    close(open(probe.c_str(), O_CREAT | O_WRONLY, 0644));
+    auto ret = RUN_ALL_TESTS();
+    auto cmd = "rm -rf " + src_dir + " " + mnt_dir;
+    if (system(cmd.c_str()) != 0)
+        LOG_WARN("failed to remove `", cmd);
+    return ret;
+}
@@ -0,0 +1,191 @@
+/*
+Copyright 2022 The Photon Authors
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <vector>
+#include <chrono>
+#include <photon/photon.h>
+#include <photon/fs/httpfs/httpfs.h>
+#include <photon/fs/localfs.h>
+#include <photon/net/http/server.h>
+#include <photon/net/socket.h>
+#include <photon/thread/thread11.h>
+#include <photon/common/alog.h>
+#include <photon/common/estring.h>
+#include "../../test/gtest.h"
+
+using namespace photon;
+
+static constexpr size_t FILE_SIZE = 4 * 1024 * 1024;
+static std::vector<char> file_data;
+
+// delegates to the fs handler, with injected latency,
+// counting the requests received
+class LatencyHandler : public net::http::HTTPHandler {
+public:
+    net::http::HTTPHandler* m_handler;
+    uint64_t m_latency_us;
+    uint64_t m_requests = 0;
+    LatencyHandler(net::http::HTTPHandler* handler, uint64_t latency_us)
+        : m_handler(handler), m_latency_us(latency_us) {}
+    int handle_request(net::http::Request& req, net::http::Response& resp,
+                       std::string_view prefix) override {
+        m_requests++;
+        photon::thread_usleep(m_latency_us);
+        return m_handler->handle_request(req, resp, prefix);
+    }
+};
+
+class HttpFsTest : public ::testing::Test {
+protected:
+    net::ISocketServer* tcpserver = nullptr;
+    net::http::HTTPServer* server = nullptr;
+    fs::IFileSystem* localfs = nullptr;
+    net::http::HTTPHandler* fs_handler = nullptr;
+    LatencyHandler* handler = nullptr;
+    fs::IFileSystem* httpfs = nullptr;
+    estring url;
+
+    void SetUp() override {
+        localfs = fs::new_localfs_adaptor("/tmp");
+        fs_handler = net::http::new_fs_handler(localfs);
+        handler = new LatencyHandler(fs_handler, 2000);
+        server = net::http::new_http_server();
+        server->add_handler(handler);
+        tcpserver = net::new_tcp_socket_server();
+        tcpserver->bind_v4localhost();
+        tcpserver->listen();
+        tcpserver->set_handler(server->get_connection_handler());
+        tcpserver->start_loop();
+        httpfs = fs::new_httpfs_v2();
+        url.appends("http://localhost:", tcpserver->getsockname().port,
+                    "/test_httpfs_data");
+    }
+    void TearDown() override {
+        delete httpfs;
+        delete tcpserver;
+        delete server;
+        delete handler;
+        delete fs_handler;
+        delete localfs;
+    }
+    fs::IFile* open(const fs::HttpReadOptions& opts) {
+        auto file = httpfs->open(url.c_str(), O_RDONLY);
+        if (file) {
+            EXPECT_EQ(0, file->ioctl(fs::HTTP_READ_OPTIONS, &opts));
+        }
+        return file;
+    }
+};
+
+TEST_F(HttpFsTest, parallel_range_read) {
+    std::vector<char> buf(FILE_SIZE);
+    uint64_t elapsed[2];
+    for (int i = 0; i < 2; ++i) {
+        fs::HttpReadOptions opts;
+        opts.split_size = i ? 256 * 1024 : 0;
+        opts.max_parallel = 8;
+        auto file = open(opts);
+        ASSERT_NE(nullptr, file);
+        DEFER(delete file);
+        struct stat st;
+        ASSERT_EQ(0, file->fstat(&st));
+        ASSERT_EQ((off_t)FILE_SIZE, st.st_size);
+        memset(buf.data(), 0, FILE_SIZE);
+        auto requests = handler->m_requests;
+        auto t0 = std::chrono::steady_clock::now();
+        // read with 2 iovecs, to check the slicing of iovecs
+        struct iovec iov[2] = {{&buf[0], 1000}, {&buf[1000], FILE_SIZE - 1000}};
+        ASSERT_EQ((ssize_t)FILE_SIZE, file->preadv(iov, 2, 0));
+        elapsed[i] = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - t0).count();
+        EXPECT_EQ(0, memcmp(buf.data(), file_data.data(), FILE_SIZE));
+        EXPECT_EQ(i ? FILE_SIZE / opts.split_size : 1, handler->m_requests - requests);
+    }
+    LOG_INFO("single range GET: ` us, parallel range GETs: ` us", elapsed[0], elapsed[1]);
+}
+
+TEST_F(HttpFsTest, sequential_readahead) {
+    fs::HttpReadOptions opts;
+    opts.readahead_min = 64 * 1024;
+    opts.readahead_max = 1024 * 1024;
+    auto file = open(opts);
+    ASSERT_NE(nullptr, file);
+    DEFER(delete file);
+    file->fstat(nullptr);
+    auto requests = handler->m_requests;
+    char buf[4096];
+    for (size_t off = 0; off < FILE_SIZE; off += sizeof(buf)) {
+        ASSERT_EQ((ssize_t)sizeof(buf), file->pread(buf, sizeof(buf), off));
+        ASSERT_EQ(0, memcmp(buf, &file_data[off], sizeof(buf)));
+    }
+    auto n = handler->m_requests - requests;
+    LOG_INFO("` sequential reads served by ` range GETs", FILE_SIZE / sizeof(buf), n);
+    // 64K + 128K + 256K + 512K + 1M * 3 + 64K
+    EXPECT_EQ(8UL, n);
+
+    // random reads don't trigger readahead
+    requests = handler->m_requests;
+    for (off_t off : {3 * 1024 * 1024, 16 * 1024, 2 * 1024 * 1024}) {
+        ASSERT_EQ((ssize_t)sizeof(buf), file->pread(buf, sizeof(buf), off));
+        ASSERT_EQ(0, memcmp(buf, &file_data[off], sizeof(buf)));
+    }
+    EXPECT_EQ(3UL, handler->m_requests - requests);
+}
+
+TEST_F(HttpFsTest, merge_concurrent_reads) {
+    fs::HttpReadOptions opts;
+    opts.merge_max = 1024 * 1024;
+    auto file = open(opts);
+    ASSERT_NE(nullptr, file);
+    DEFER(delete file);
+    file->fstat(nullptr);
+    const int N = 16;
+    const size_t BS = 8192;
+    std::vector<char> buf(N * BS);
+    auto requests = handler->m_requests;
+    std::vector<join_handle*> jhs;
+    for (int i = 0; i < N; ++i) {
+        auto th = thread_create11([&, i]() {
+            auto off = 1024 * 1024 + i * BS;
+            EXPECT_EQ((ssize_t)BS, file->pread(&buf[i * BS], BS, off));
+        });
+        jhs.push_back(thread_enable_join(th));
+    }
+    for (auto jh : jhs)
+        thread_join(jh);
+    EXPECT_EQ(0, memcmp(buf.data(), &file_data[1024 * 1024], N * BS));
+    EXPECT_EQ(1UL, handler->m_requests - requests);
+}
+
+int main(int argc, char** argv) {
+    if (photon::init(photon::INIT_EVENT_DEFAULT, photon::INIT_IO_NONE))
+        return -1;
+    DEFER(photon::fini());
+    set_log_output_level(ALOG_INFO);
+    file_data.resize(FILE_SIZE);
+    for (size_t i = 0; i < FILE_SIZE; ++i)
+        file_data[i] = rand();
+    auto fs = fs::new_localfs_adaptor("/tmp");
+    auto file = fs->open("test_httpfs_data", O_RDWR | O_CREAT | O_TRUNC, 0644);
+    file->pwrite(file_data.data(), FILE_SIZE, 0);
+    delete file;
+    delete fs;
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
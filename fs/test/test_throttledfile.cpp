@@ -31,6 +31,7 @@ limitations under the License.
 #include <photon/thread/thread11.h>
 #include <photon/thread/thread.h>
 #include <photon/fs/localfs.h>
+#include <photon/common/fair_throttle.h>
 #include "../../test/ci-tools.h"
 #include "../../test/gtest.h"
 #include "mock.h"
@@ -428,6 +429,43 @@ TEST(ThrottledFs, concurrent){
     delete fs;
 }
 
+TEST(FairThrottledFile, shared_by_tenants) {
+    using namespace testing;
+    photon::vcpu_init();
+    DEFER(photon::vcpu_fini());
+    photon::fair_throttle iops(1000), throughput(-1UL);
+    iops.set_class(1, {0, -1UL, 1});
+    iops.set_class(2, {0, -1UL, 3});
+    PMock::MockNullFile mock;
+    EXPECT_CALL(mock, pread(_, _, _)).WillRepeatedly(ReturnArg<1>());
+    EXPECT_CALL(mock, pwritev(_, _, _)).WillRepeatedly(WithArgs<0, 1>(Invoke(count_iov_size)));
+    FairThrottleAttach a1{&iops, &throughput, 1}, a2{&iops, &throughput, 2};
+    IFile* f1 = new_fair_throttled_file(&mock, a1);
+    IFile* f2 = new_fair_throttled_file(&mock, a2);
+    DEFER({ delete f1; delete f2; });
+
+    uint64_t n1 = 0, n2 = 0;
+    auto deadline = photon::now + 500 * 1000;
+    auto th = photon::thread_create11([&] {
+        char buf[4096];
+        while (photon::now < deadline) { f1->pread(buf, 4096, 0); n1++; }
+    });
+    auto jh = photon::thread_enable_join(th);
+    iovec iov[2] = {{nullptr, 4000}, {nullptr, 96}};
+    while (photon::now < deadline) { f2->pwritev(iov, 2, 0); n2++; }
+    photon::thread_join(jh);
+    LOG_INFO(VALUE(n1), VALUE(n2));
+    EXPECT_LT(n1 + n2, 600UL);
+    EXPECT_GT(n2, n1 * 2);
+
+    photon::fair_throttle::Stats stats;
+    // tenants unknown to the throttle are charged to the default class
+    EXPECT_EQ(-1, throughput.get_stats(2, &stats));
+    EXPECT_EQ(ENOENT, errno);
+    EXPECT_EQ(0, throughput.get_stats(0, &stats));
+    EXPECT_EQ((n1 + n2) * 4096, stats.granted);
+}
+
 int main(int argc, char **argv)
 {
     if (!photon::is_using_default_engine()) return 0;
@@ -22,6 +22,7 @@ limitations under the License.
 #include <photon/common/iovector.h>
 #include <photon/common/utility.h>
 #include <photon/common/alog.h>
+#include <photon/common/fair_throttle.h>
 
 using namespace std;
 
@@ -469,6 +470,123 @@ namespace fs
         }
     };
 
+    class FairThrottledFile : public ForwardFile_Ownership
+    {
+    public:
+        FairThrottleAttach m_attach;
+
+        FairThrottledFile(IFile *file, const FairThrottleAttach &attach, bool ownership = false)
+            : ForwardFile_Ownership(file, ownership), m_attach(attach) {}
+
+        int throttle(size_t count, bool read)
+        {
+            auto prio = (read && m_attach.realtime_read) ?
+                photon::fair_throttle::Priority::High : photon::fair_throttle::Priority::Normal;
+            if (m_attach.iops && m_attach.iops->consume(m_attach.tenant, 1, prio) < 0)
+                return -1;
+            if (m_attach.throughput && m_attach.throughput->consume(m_attach.tenant, count, prio) < 0)
+                return -1;
+            return 0;
+        }
+        static size_t sum(const struct iovec *iov, int iovcnt)
+        {
+            return iovector_view((iovec*)iov, iovcnt).sum();
+        }
+
+#define FAIR_THROTTLED(count, read, call) \
+        return (throttle(count, read) < 0) ? -1 : m_file->call
+
+        virtual ssize_t pread(void *buf, size_t count, off_t offset) override
+        {
+            FAIR_THROTTLED(count, true, pread(buf, count, offset));
+        }
+        virtual ssize_t preadv(const struct iovec *iov, int iovcnt, off_t offset) override
+        {
+            FAIR_THROTTLED(sum(iov, iovcnt), true, preadv(iov, iovcnt, offset));
+        }
+        virtual ssize_t preadv_mutable(struct iovec *iov, int iovcnt, off_t offset) override
+        {
+            FAIR_THROTTLED(sum(iov, iovcnt), true, preadv_mutable(iov, iovcnt, offset));
+        }
+        virtual ssize_t preadv2(const struct iovec *iov, int iovcnt, off_t offset, int flags) override
+        {
+            FAIR_THROTTLED(sum(iov, iovcnt), true, preadv2(iov, iovcnt, offset, flags));
+        }
+        virtual ssize_t preadv2_mutable(struct iovec *iov, int iovcnt, off_t offset, int flags) override
+        {
+            FAIR_THROTTLED(sum(iov, iovcnt), true, preadv2_mutable(iov, iovcnt, offset, flags));
+        }
+        virtual ssize_t read(void *buf, size_t count) override
+        {
+            FAIR_THROTTLED(count, true, read(buf, count));
+        }
+        virtual ssize_t readv(const struct iovec *iov, int iovcnt) override
+        {
+            FAIR_THROTTLED(sum(iov, iovcnt), true, readv(iov, iovcnt));
+        }
+        virtual ssize_t readv_mutable(struct iovec *iov, int iovcnt) override
+        {
+            FAIR_THROTTLED(sum(iov, iovcnt), true, readv_mutable(iov, iovcnt));
+        }
+        virtual ssize_t pwrite(const void *buf, size_t count, off_t offset) override
+        {
+            FAIR_THROTTLED(count, false, pwrite(buf, count, offset));
+        }
+        virtual ssize_t pwritev(const struct iovec *iov, int iovcnt, off_t offset) override
+        {
+            FAIR_THROTTLED(sum(iov, iovcnt), false, pwritev(iov, iovcnt, offset));
+        }
+        virtual ssize_t pwritev_mutable(struct iovec *iov, int iovcnt, off_t offset) override
+        {
+            FAIR_THROTTLED(sum(iov, iovcnt), false, pwritev_mutable(iov, iovcnt, offset));
+        }
+        virtual ssize_t pwritev2(const struct iovec *iov, int iovcnt, off_t offset, int flags) override
+        {
+            FAIR_THROTTLED(sum(iov, iovcnt), false, pwritev2(iov, iovcnt, offset, flags));
+        }
+        virtual ssize_t pwritev2_mutable(struct iovec *iov, int iovcnt, off_t offset, int flags) override
+        {
+            FAIR_THROTTLED(sum(iov, iovcnt), false, pwritev2_mutable(iov, iovcnt, offset, flags));
+        }
+        virtual ssize_t write(const void *buf, size_t count) override
+        {
+            FAIR_THROTTLED(count, false, write(buf, count));
+        }
+        virtual ssize_t writev(const struct iovec *iov, int iovcnt) override
+        {
+            FAIR_THROTTLED(sum(iov, iovcnt), false, writev(iov, iovcnt));
+        }
+        virtual ssize_t writev_mutable(struct iovec *iov, int iovcnt) override
+        {
+            FAIR_THROTTLED(sum(iov, iovcnt), false, writev_mutable(iov, iovcnt));
+        }
+#undef FAIR_THROTTLED
+    };
+
+    class FairThrottledFs : public ForwardFS_Ownership {
+    public:
+        FairThrottleAttach m_attach;
+        FairThrottledFs(IFileSystem *fs, const FairThrottleAttach &attach,
+                        bool ownership = false)
+            : ForwardFS_Ownership(fs, ownership), m_attach(attach) {}
+
+        virtual IFile *open(const char *pathname, int flags) override {
+            auto file = m_fs->open(pathname, flags);
+            if(file == nullptr) return nullptr;
+            return new FairThrottledFile(file, m_attach, true);
+        }
+        virtual IFile *open(const char *pathname, int flags, mode_t mode) override {
+            auto file = m_fs->open(pathname, flags, mode);
+            if(file == nullptr) return nullptr;
+            return new FairThrottledFile(file, m_attach, true);
+        }
+        virtual IFile *creat(const char *pathname, mode_t mode) override {
+            auto file = m_fs->creat(pathname, mode);
+            if(file == nullptr) return nullptr;
+            return new FairThrottledFile(file, m_attach, true);
+        }
+    };
+
     IFile *new_throttled_file(IFile *file, const ThrottleLimits &limits, bool ownership) {
         if (file == nullptr)
             LOG_ERROR_RETURN(EINVAL, nullptr, "cannot open file");
@@ -480,5 +598,17 @@ namespace fs
                                   bool ownership) {
         return new ThrottledFs(fs, limits, ownership);
     }
+
+    IFile *new_fair_throttled_file(IFile *file, const FairThrottleAttach &attach,
+                                   bool ownership) {
+        if (file == nullptr)
+            LOG_ERROR_RETURN(EINVAL, nullptr, "cannot open file");
+        return new FairThrottledFile(file, attach, ownership);
+    }
+
+    IFileSystem *new_fair_throttled_fs(IFileSystem *fs, const FairThrottleAttach &attach,
+                                       bool ownership) {
+        return new FairThrottledFs(fs, attach, ownership);
+    }
 }
 }
@@ -18,6 +18,9 @@ limitations under the License.
 #include <cinttypes>
 
 namespace photon {
+
+class fair_throttle;
+
 namespace fs
 {
     struct ThrottleLimits
@@ -46,5 +49,24 @@ namespace fs
     extern "C" IFileSystem *new_throttled_fs(IFileSystem *fs,
                                              const ThrottleLimits &limits,
                                              bool ownership = false);
+
+    // attaches files to the tenant class of shared `photon::fair_throttle`s,
+    // see common/fair_throttle.h
+    struct FairThrottleAttach
+    {
+        photon::fair_throttle *iops = nullptr;       // charged 1 per I/O, if any
+        photon::fair_throttle *throughput = nullptr; // charged in bytes, if any
+        uint32_t tenant = 0;
+        // reads are latency-sensitive, and may use the reserved capacity
+        bool realtime_read = false;
+    };
+
+    extern "C" IFile *new_fair_throttled_file(IFile *file,
+                                              const FairThrottleAttach &attach,
+                                              bool ownership = false);
+
+    extern "C" IFileSystem *new_fair_throttled_fs(IFileSystem *fs,
+                                                  const FairThrottleAttach &attach,
+                                                  bool ownership = false);
 }
 }
@@ -0,0 +1 @@
+../../../common/fair_throttle.h
\ No newline at end of file
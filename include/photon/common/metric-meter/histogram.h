@@ -0,0 +1 @@
+../../../../common/metric-meter/histogram.h
\ No newline at end of file
@@ -0,0 +1 @@
+../../../common/slab-alloc.h
\ No newline at end of file
@@ -0,0 +1 @@
+../../../common/thread-slots.h
\ No newline at end of file
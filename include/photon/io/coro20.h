@@ -0,0 +1 @@
+../../../io/coro20.h
\ No newline at end of file
@@ -0,0 +1 @@
+../../../net/buffered_socket.h
\ No newline at end of file
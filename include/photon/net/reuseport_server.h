@@ -0,0 +1 @@
+../../../net/reuseport_server.h
\ No newline at end of file
@@ -0,0 +1,129 @@
+/*
+Copyright 2022 The Photon Authors
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <photon/io/fd-events.h>
+#include <photon/common/alog.h>
+#include <photon/common/utility.h>
+
+#ifndef EPIOCSPARAMS    // since Linux 6.9 and glibc 2.40
+struct epoll_params {
+    uint32_t busy_poll_usecs;
+    uint16_t busy_poll_budget;
+    uint8_t prefer_busy_poll;
+    uint8_t __pad;
+};
+#define EPIOCSPARAMS _IOW(0x8A, 0x01, struct epoll_params)
+#endif
+
+namespace photon {
+
+// let epoll_wait() of `epfd` busy-poll the sockets (of NAPI devices) for
+// `usecs` before sleeping, 0 to disable
+inline int set_epoll_busy_poll(int epfd, uint32_t usecs) {
+    struct epoll_params params = {};
+    params.busy_poll_usecs = usecs;
+    params.busy_poll_budget = usecs ? 8 : 0;    // the kernel's default budget
+    if (ioctl(epfd, EPIOCSPARAMS, &params) < 0)
+        LOG_ERRNO_RETURN(0, -1, "failed to set busy-poll params of epoll fd ", epfd);
+    return 0;
+}
+
+// The spin phase of a master engine, see BusyPollParams. An engine owns one
+// of these, and routes its wait_and_fire_events() through wait().
+class BusyPoller {
+public:
+    // the CPU budget is accounted in periods of this length
+    static constexpr uint64_t PERIOD_US = 100 * 1000;
+
+    BusyPollParams params;
+    BusyPollStats stats = {};
+    uint64_t gap = 0;               // average idle time until an event, in us
+    uint64_t period_start = 0;
+    uint64_t period_spin = 0;
+
+    bool enabled() const {
+        return params.max_spin_us;
+    }
+
+    void set(const BusyPollParams& p) {
+        params = p;
+        params.cpu_percent = std::min(params.cpu_percent, 100u);
+        stats.window_us = params.max_spin_us;
+        gap = 0;
+    }
+
+    // `fire(timeout)` waits for events for at most `timeout`, fires them
+    // and returns # of them, counting a wakeup by cancel_wait() as one, or
+    // the spin would go on and the sleep after it miss the wakeup; it's
+    // invoked with 0 repeatedly while spinning, so it must be cheap when
+    // there's nothing to fire
+    template<typename Fire>
+    ssize_t wait(uint64_t timeout, const Fire& fire) {
+        if (!timeout || !enabled())
+            return fire(timeout);
+        // events are often ready already, so look before reading the clock;
+        // such hits are not learned from, as any window would catch them
+        auto n = fire(0);
+        if (n != 0) {
+            if (n > 0) stats.hits++;
+            return n;
+        }
+        auto start = __update_now();
+        if (start - period_start >= PERIOD_US) {
+            period_start = start;
+            period_spin = 0;
+        }
+        auto budget = sat_sub(PERIOD_US * params.cpu_percent / 100, period_spin);
+        auto window = std::min(std::min(stats.window_us, timeout), budget);
+        auto t = start;
+        if (window) {
+            do {
+                n = fire(0);
+                t = __update_now();
+            } while (n == 0 && t - start < window);
+            period_spin += t - start;
+            stats.spin_us += t - start;
+            if (n > 0) {
+                stats.hits++;
+                learn(t - start);
+                return n;
+            }
+            stats.misses++;
+        }
+        stats.sleeps++;
+        n = fire(sat_sub(timeout, t - start));
+        if (n > 0)
+            learn(__update_now() - start);
+        return n;
+    }
+
+protected:
+    // Spin for twice the average idle time, if that's within the limit.
+    // Otherwise events are too sparse to be worth spinning for, but the
+    // idle time is still learned from sleeps, so spinning resumes when
+    // they become frequent again.
+    void learn(uint64_t idle) {
+        gap = gap ? (gap * 7 + idle) / 8 : idle;
+        stats.window_us = (gap * 2 <= params.max_spin_us) ? std::max(gap * 2, (uint64_t)1) : 0;
+    }
+};
+
+}  // namespace photon
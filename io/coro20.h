@@ -0,0 +1,539 @@
+/*
+Copyright 2022 The Photon Authors
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <map>
+#include <optional>
+#include <utility>
+
+#include <photon/common/alog.h>
+#include <photon/common/callback.h>
+#include <photon/common/timeout.h>
+#include <photon/io/fd-events.h>
+#include <photon/thread/thread.h>
+
+/**
+ * Stackless (C++20) coroutines, with co_await-able socket and file I/O.
+ *
+ * Unlike photon threads and the wrappers in photon/thread/coro20.h, they
+ * have no stack: a coroutine awaiting I/O costs only its frame, so that
+ * millions of operations may be in flight. They are run by a Scheduler in
+ * a single photon thread of the vCPU, and resumed by the completions fired
+ * by the master event engine (see AsyncIO in photon/io/fd-events.h):
+ *  - with io_uring, the operations themselves are submitted to the ring;
+ *  - with epoll, sockets are tried first, and polled for when they would
+ *    block; files are read and written synchronously, as in psync mode.
+ *
+ * Sockets must be non-blocking. Every operation may have a timeout, and a
+ * CancelToken, failing with ETIMEDOUT or ECANCELED respectively.
+ *
+ *     photon::coro::Task<> echo(int fd) {
+ *         char buf[4096];
+ *         ssize_t n;
+ *         while ((n = co_await photon::coro::recv(fd, buf, sizeof(buf))) > 0)
+ *             if (co_await photon::coro::send(fd, buf, n) != n) break;
+ *         ::close(fd);
+ *     }
+ *
+ *     photon::coro::Scheduler sched;
+ *     sched.spawn(echo(fd));
+ *     sched.run();
+ */
+
+namespace photon {
+namespace coro {
+
+class Scheduler;
+
+template <typename T = void>
+class Task;
+
+namespace detail {
+
+class TaskPromiseBase {
+public:
+    static std::suspend_always initial_suspend() noexcept { return {}; }
+
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+        template <typename P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept;
+        void await_resume() noexcept {}
+    };
+    FinalAwaiter final_suspend() noexcept { return {}; }
+
+    void unhandled_exception() { m_exception = std::current_exception(); }
+
+protected:
+    template <typename T> friend class photon::coro::Task;
+    friend class photon::coro::Scheduler;
+    std::coroutine_handle<> m_continuation;
+    Scheduler* m_scheduler = nullptr;   // of a detached (spawned) task
+    std::exception_ptr m_exception;
+
+    void rethrow() {
+        if (m_exception) std::rethrow_exception(m_exception);
+    }
+};
+
+template <typename T>
+class TaskPromise : public TaskPromiseBase {
+public:
+    Task<T> get_return_object();
+    template <typename U>
+    void return_value(U&& value) { m_value.emplace(std::forward<U>(value)); }
+    T result() {
+        rethrow();
+        return std::move(*m_value);
+    }
+
+protected:
+    std::optional<T> m_value;
+};
+
+template <>
+class TaskPromise<void> : public TaskPromiseBase {
+public:
+    Task<void> get_return_object();
+    void return_void() {}
+    void result() { rethrow(); }
+};
+
+}  // namespace detail
+
+// A lazily started stackless coroutine, that runs when it is awaited by
+// another one, or spawned to a Scheduler.
+template <typename T>
+class Task {
+public:
+    using promise_type = detail::TaskPromise<T>;
+    using handle_type = std::coroutine_handle<promise_type>;
+
+    Task() = default;
+    explicit Task(handle_type h) : m_handle(h) {}
+    Task(Task&& rhs) noexcept : m_handle(rhs.m_handle) { rhs.m_handle = {}; }
+    Task& operator=(Task&& rhs) noexcept {
+        if (this != &rhs) {
+            if (m_handle) m_handle.destroy();
+            m_handle = rhs.m_handle;
+            rhs.m_handle = {};
+        }
+        return *this;
+    }
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    ~Task() {
+        if (m_handle) m_handle.destroy();
+    }
+
+    bool done() const { return !m_handle || m_handle.done(); }
+
+    bool await_ready() const noexcept { return done(); }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        m_handle.promise().m_continuation = awaiting;
+        return m_handle;
+    }
+    T await_resume() { return m_handle.promise().result(); }
+
+protected:
+    friend class Scheduler;
+    handle_type m_handle;
+
+    handle_type release() {
+        auto h = m_handle;
+        m_handle = {};
+        return h;
+    }
+};
+
+namespace detail {
+template <typename T>
+inline Task<T> TaskPromise<T>::get_return_object() {
+    return Task<T>(Task<T>::handle_type::from_promise(*this));
+}
+inline Task<void> TaskPromise<void>::get_return_object() {
+    return Task<void>(Task<void>::handle_type::from_promise(*this));
+}
+}  // namespace detail
+
+// Runs stackless coroutines of the current vCPU, in the photon thread that
+// calls run(). Coroutines may only be resumed, and awaited for, in there.
+class Scheduler {
+public:
+    Scheduler() = default;
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+    // the coroutines that are not finished are leaked, as the engine may
+    // still refer to their operations
+    ~Scheduler() {
+        if (m_tasks)
+            LOG_WARN("` coroutine(s) left unfinished in the scheduler", m_tasks);
+    }
+
+    // Starts `task` detached, within run(); it is destroyed once finished.
+    // Exceptions that escape from it are ignored.
+    template <typename T>
+    void spawn(Task<T>&& task) {
+        auto h = task.release();
+        if (!h) return;
+        h.promise().m_scheduler = this;
+        m_tasks++;
+        post({h.address(), &resume_handle});
+    }
+
+    // Runs the coroutines, until all the spawned ones have finished, or
+    // stop() is called. Returns 0, or -1 if another scheduler is running.
+    int run() {
+        if (_current())
+            LOG_ERROR_RETURN(EBUSY, -1, "a coroutine scheduler is already running");
+        _current() = this;
+        m_runner = photon::CURRENT;
+        m_stop = false;
+        DEFER({ _current() = nullptr; m_runner = nullptr; });
+        while (!m_stop && (m_tasks || !m_ready.empty())) {
+            // run the ready ones, but not the ones they make ready, so that
+            // other threads and events get a chance
+            for (auto n = m_ready.size(); n && !m_stop; n--) {
+                auto fn = m_ready.front();
+                m_ready.pop_front();
+                fn();
+            }
+            fire_timers();
+            if (!m_ready.empty()) {
+                photon::thread_yield();
+            } else if (!m_stop && m_tasks) {
+                Timeout timeout;
+                if (!m_timers.empty()) timeout.expiration(m_timers.begin()->first);
+                m_sleeping = true;
+                photon::thread_usleep(timeout);
+                m_sleeping = false;
+            }
+        }
+        return 0;
+    }
+
+    // Makes run() return, leaving the coroutines where they are.
+    void stop() {
+        m_stop = true;
+        wakeup();
+    }
+
+    // the number of spawned tasks that have not finished
+    size_t tasks() const { return m_tasks; }
+
+    // the scheduler in run() on the current vCPU, if any
+    static Scheduler* current() { return _current(); }
+
+    // Makes `fn` be called in run(). It may be called by engines in firing
+    // events, on the same vCPU.
+    void post(Delegate<void> fn) {
+        m_ready.push_back(fn);
+        wakeup();
+    }
+
+    using Timers = std::multimap<uint64_t, Delegate<void>>;
+    Timers::iterator add_timer(uint64_t expiration, Delegate<void> fn) {
+        auto it = m_timers.emplace(expiration, fn);
+        if (it == m_timers.begin()) wakeup();
+        return it;
+    }
+    void remove_timer(Timers::iterator it) { m_timers.erase(it); }
+    Timers::iterator no_timer() { return m_timers.end(); }
+
+protected:
+    friend class detail::TaskPromiseBase;
+    friend class IOAwaitable;
+    std::deque<Delegate<void>> m_ready;
+    Timers m_timers;
+    size_t m_tasks = 0;
+    photon::thread* m_runner = nullptr;
+    bool m_sleeping = false;
+    bool m_stop = false;
+    bool m_poll_only = false;   // the engine performs no I/O but polling
+
+    static Scheduler*& _current() {
+        thread_local Scheduler* current = nullptr;
+        return current;
+    }
+    static void resume_handle(void* address) {
+        std::coroutine_handle<>::from_address(address).resume();
+    }
+    void wakeup() {
+        if (m_sleeping) photon::thread_interrupt(m_runner, EOK);
+    }
+    void fire_timers() {
+        while (!m_timers.empty() && m_timers.begin()->first <= photon::now) {
+            auto fn = m_timers.begin()->second;
+            m_timers.erase(m_timers.begin());
+            fn();
+        }
+    }
+    void finished() { m_tasks--; }
+};
+
+template <typename P>
+inline std::coroutine_handle<>
+detail::TaskPromiseBase::FinalAwaiter::await_suspend(std::coroutine_handle<P> h) noexcept {
+    auto& p = h.promise();
+    if (p.m_continuation) return p.m_continuation;
+    if (auto sched = p.m_scheduler) {
+        h.destroy();
+        sched->finished();
+    }
+    return std::noop_coroutine();
+}
+
+class IOAwaitable;
+
+// Cancels the operations awaited with it, which fail with ECANCELED, as do
+// those awaited with it afterwards. It is bound to the vCPU.
+class CancelToken {
+public:
+    CancelToken() = default;
+    CancelToken(const CancelToken&) = delete;
+    CancelToken& operator=(const CancelToken&) = delete;
+
+    inline void cancel();
+    bool cancelled() const { return m_cancelled; }
+
+protected:
+    friend class IOAwaitable;
+    IOAwaitable* m_ops = nullptr;   // the ones in flight
+    bool m_cancelled = false;
+};
+
+// An I/O operation of a coroutine. It is resumed with the result of the
+// operation, or -1 with errno for failure.
+class IOAwaitable {
+public:
+    IOAwaitable(AsyncIO::Opcode opcode, int fd, void* buf, size_t count,
+                off_t offset, uint32_t flags, Timeout timeout,
+                CancelToken* token, socklen_t* addrlen = nullptr)
+        : m_timeout(timeout), m_token(token) {
+        m_io.opcode = opcode;
+        m_io.fd = fd;
+        m_io.buf = buf;
+        m_io.count = count;
+        m_io.offset = offset;
+        m_io.flags = flags;
+        m_io.addrlen = addrlen;
+        m_io.done = {this, &IOAwaitable::on_done};
+    }
+    IOAwaitable(const IOAwaitable&) = delete;
+    IOAwaitable& operator=(const IOAwaitable&) = delete;
+
+    bool await_ready() {
+        if (m_token && m_token->cancelled())
+            return complete(-ECANCELED);
+        if (is_socket() && try_syscall()) return true;
+        if (m_timeout.expired())
+            return complete(-ETIMEDOUT);
+        return false;
+    }
+
+    bool await_suspend(std::coroutine_handle<> h) {
+        m_sched = Scheduler::current();
+        if (!m_sched) {
+            LOG_ERROR("coroutine I/O is awaited out of Scheduler::run()");
+            return !complete(-EINVAL);
+        }
+        if (submit() < 0) return !complete(-errno);
+        if (m_done) return false;   // performed synchronously
+        m_handle = h;
+        m_timer = m_sched->no_timer();
+        if (m_timeout.expiration() != -1UL)
+            m_timer = m_sched->add_timer(m_timeout.expiration(),
+                                         {this, &IOAwaitable::on_timeout});
+        if (m_token) {
+            m_next = m_token->m_ops;
+            if (m_next) m_next->m_prev = this;
+            m_token->m_ops = this;
+        }
+        return true;
+    }
+
+    ssize_t await_resume() {
+        if (m_res < 0) {
+            errno = (int)-m_res;
+            return -1;
+        }
+        return m_res;
+    }
+
+protected:
+    friend class CancelToken;
+    AsyncIO m_io;
+    AsyncIO m_poll;         // for engines that can only poll sockets
+    Timeout m_timeout;
+    CancelToken* m_token;
+    IOAwaitable *m_prev = nullptr, *m_next = nullptr;   // in m_token
+    Scheduler* m_sched = nullptr;
+    Scheduler::Timers::iterator m_timer;
+    std::coroutine_handle<> m_handle;
+    int64_t m_res = 0;
+    int m_aborted = 0;      // ETIMEDOUT or ECANCELED
+    bool m_polling = false;
+    bool m_fired = false;   // by the engine, or as if by it
+    bool m_done = false;
+
+    bool is_socket() const {
+        auto op = m_io.opcode;
+        return op == AsyncIO::RECV || op == AsyncIO::SEND || op == AsyncIO::ACCEPT;
+    }
+
+    // performs the operation right away, unless it would block
+    bool try_syscall() {
+        ssize_t ret;
+        switch (m_io.opcode) {
+            case AsyncIO::RECV:
+                ret = ::recv(m_io.fd, m_io.buf, m_io.count, m_io.flags | MSG_DONTWAIT);
+                break;
+            case AsyncIO::SEND:
+                ret = ::send(m_io.fd, m_io.buf, m_io.count, m_io.flags | MSG_DONTWAIT);
+                break;
+            case AsyncIO::ACCEPT:
+                ret = ::accept4(m_io.fd, (sockaddr*)m_io.buf, m_io.addrlen, m_io.flags);
+                break;
+            case AsyncIO::PREAD:
+                ret = ::pread(m_io.fd, m_io.buf, m_io.count, m_io.offset);
+                break;
+            case AsyncIO::PWRITE:
+                ret = ::pwrite(m_io.fd, m_io.buf, m_io.count, m_io.offset);
+                break;
+            default:
+                ret = -1;
+                errno = EINVAL;
+        }
+        if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return false;
+        return complete(ret < 0 ? -errno : ret);
+    }
+
+    bool complete(int64_t res) {
+        m_res = res;
+        return m_done = true;
+    }
+
+    static MasterEventEngine* engine() { return get_vcpu()->master_event_engine; }
+
+    AsyncIO* submitted() { return m_polling ? &m_poll : &m_io; }
+
+    int submit() {
+        if (!m_polling) {
+            if (!m_sched->m_poll_only) {
+                if (engine()->async_io(&m_io) == 0) return 0;
+                if (errno != ENOSYS) return -1;
+                m_sched->m_poll_only = true;
+            }
+            // files are always "ready" for polling
+            if (!is_socket()) return try_syscall(), 0;
+            m_polling = true;
+            m_poll.fd = m_io.fd;
+            m_poll.flags = (m_io.opcode == AsyncIO::SEND) ? EVENT_WRITE : EVENT_READ;
+            m_poll.done = {this, &IOAwaitable::on_done};
+        }
+        return engine()->async_io(&m_poll);
+    }
+
+    // by the engine, in firing events
+    void on_done(AsyncIO*) {
+        m_fired = true;
+        m_sched->post({this, &IOAwaitable::step});
+    }
+
+    void step() {
+        auto res = submitted()->res;
+        if (m_aborted && (m_polling || res == -ECANCELED))
+            return finish(-m_aborted);
+        if (!m_polling || res < 0)
+            return finish(res);
+        if (try_syscall()) return finish(m_res);
+        m_fired = false;    // woken up spuriously
+        if (submit() < 0) finish(-errno);
+    }
+
+    void on_timeout() {
+        m_timer = m_sched->no_timer();
+        abort(ETIMEDOUT);
+    }
+
+    void abort(int err) {
+        if (m_aborted || m_fired) return;
+        m_aborted = err;
+        auto io = submitted();
+        auto ret = engine()->async_cancel(io);
+        if (ret == 0) {
+            io->res = -ECANCELED;
+            on_done(io);
+        } else if (ret < 0) {
+            LOG_WARN("failed to cancel coroutine I/O, waiting for its completion ", ERRNO());
+        }
+    }
+
+    void finish(int64_t res) {
+        if (m_timer != m_sched->no_timer())
+            m_sched->remove_timer(m_timer);
+        if (m_token) {
+            if (m_prev) m_prev->m_next = m_next;
+            else m_token->m_ops = m_next;
+            if (m_next) m_next->m_prev = m_prev;
+        }
+        complete(res);
+        m_handle.resume();
+    }
+};
+
+inline void CancelToken::cancel() {
+    m_cancelled = true;
+    for (auto op = m_ops; op; op = op->m_next)
+        op->abort(ECANCELED);
+}
+
+inline IOAwaitable recv(int fd, void* buf, size_t count, Timeout timeout = {},
+                        CancelToken* token = nullptr) {
+    return {AsyncIO::RECV, fd, buf, count, 0, 0, timeout, token};
+}
+
+inline IOAwaitable send(int fd, const void* buf, size_t count, Timeout timeout = {},
+                        CancelToken* token = nullptr) {
+    return {AsyncIO::SEND, fd, (void*)buf, count, 0, MSG_NOSIGNAL, timeout, token};
+}
+
+// the accepted socket is non-blocking, and close-on-exec
+inline IOAwaitable accept(int fd, sockaddr* addr = nullptr, socklen_t* addrlen = nullptr,
+                          Timeout timeout = {}, CancelToken* token = nullptr) {
+    return {AsyncIO::ACCEPT, fd, addr, 0, 0, SOCK_NONBLOCK | SOCK_CLOEXEC,
+            timeout, token, addrlen};
+}
+
+inline IOAwaitable pread(int fd, void* buf, size_t count, off_t offset,
+                         Timeout timeout = {}, CancelToken* token = nullptr) {
+    return {AsyncIO::PREAD, fd, buf, count, offset, 0, timeout, token};
+}
+
+inline IOAwaitable pwrite(int fd, const void* buf, size_t count, off_t offset,
+                          Timeout timeout = {}, CancelToken* token = nullptr) {
+    return {AsyncIO::PWRITE, fd, (void*)buf, count, offset, 0, timeout, token};
+}
+
+}  // namespace coro
+}  // namespace photon
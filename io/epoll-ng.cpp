@@ -27,6 +27,7 @@ limitations under the License.
 #include <vector>
 
 #include "reset_handle.h"
+#include "busy-poll.h"
 
 namespace photon {
 #ifndef EPOLLRDHUP
@@ -173,7 +174,11 @@ public:
     }
     int reset() override {
         fini();
-        return init();
+        if (init() < 0)
+            return -1;
+        if (busy_poller.params.kernel_us)
+            set_epoll_busy_poll(engine.epfd, busy_poller.params.kernel_us);
+        return 0;
     }
     virtual ~EventEngineEPollNG() override {
         fini();
@@ -217,18 +222,22 @@ public:
         return ret;
     }
 
+    // returns 1 if woken up by cancel_wait(), or 0
     template <typename DataCB, typename FDCB>
-    void wait_for_events(uint64_t timeout, const DataCB& datacb,
-                         const FDCB& fdcb) {
-        int fired = 0;
-        int turn;
-        do {
-            turn = rpoller.notify_one(datacb, fdcb) +
-                   wpoller.notify_one(datacb, fdcb) +
-                   epoller.notify_one(datacb, fdcb);
-            fired += turn;
-        } while (turn);
-        if (!fired) {
+    int wait_for_events(uint64_t timeout, const DataCB& datacb,
+                        const FDCB& fdcb) {
+        int woken = 0;
+        auto notify_sub_pollers = [&]() __INLINE__ {
+            int fired = 0, turn;
+            do {
+                turn = rpoller.notify_one(datacb, fdcb) +
+                       wpoller.notify_one(datacb, fdcb) +
+                       epoller.notify_one(datacb, fdcb);
+                fired += turn;
+            } while (turn);
+            return fired;
+        };
+        if (!notify_sub_pollers()) {
             // no events ready
             eventfd_t value;
             engine.reap(timeout);
@@ -242,6 +251,7 @@ public:
                             return;
                         case (uint64_t)POLLERTYPE::EVENT:
                             eventfd_read(evfd, &value);
+                            woken = 1;
                             return;
                         default:
                             LOG_ERROR_RETURN(EINVAL, ,
@@ -250,7 +260,10 @@ public:
                     }
                 },
                 [&]() __INLINE__ { return true; });
+            // fire the events just reaped, rather than in the next call
+            notify_sub_pollers();
         }
+        return woken;
     }
     virtual ssize_t wait_for_events(void** data, size_t count,
                                     Timeout timeout) override {
@@ -271,9 +284,28 @@ public:
         }
         return ptr - data;
     }
+    BusyPoller busy_poller;
     virtual ssize_t wait_and_fire_events(uint64_t timeout) override {
+        return busy_poller.wait(timeout, [&](uint64_t t) __INLINE__ {
+            return fire_events(t);
+        });
+    }
+    int busy_poll(const BusyPollParams& params) override {
+        if (params.kernel_us != busy_poller.params.kernel_us &&
+            set_epoll_busy_poll(engine.epfd, params.kernel_us) < 0)
+            return -1;
+        busy_poller.set(params);
+        return 0;
+    }
+    int busy_poll_stats(BusyPollStats* stats) override {
+        *stats = busy_poller.stats;
+        return 0;
+    }
+    // returns # of events fired, counting a wakeup by cancel_wait() as one,
+    // so that a spinning BusyPoller stops to look at the standby queue
+    ssize_t fire_events(uint64_t timeout) {
         ssize_t n = 0;
-        wait_for_events(
+        int woken = wait_for_events(
             timeout,
             [&](epoll_data_t data) __INLINE__ {
                 assert(data.ptr);
@@ -283,7 +315,7 @@ public:
                 n++;
             },
             [&]() __INLINE__ { return true; });
-        return n;
+        return n + woken;
     }
     virtual int cancel_wait() override { return eventfd_write(evfd, 1); }
 
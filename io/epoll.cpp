@@ -19,6 +19,9 @@ limitations under the License.
 #include <sys/eventfd.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
+#include <mutex>
 #include <vector>
 
 #include <photon/common/alog.h>
@@ -27,6 +30,7 @@ limitations under the License.
 #include <photon/io/fd-events.h>
 #include "events_map.h"
 #include "reset_handle.h"
+#include "busy-poll.h"
 
 namespace photon {
 #ifndef EPOLLRDHUP
@@ -42,8 +46,11 @@ constexpr static uint32_t READBITS =
 constexpr static uint32_t WRITEBITS =
     EVMAP::UNDERLAY_EVENT_WRITE | ERRBIT | EPOLLHUP;
 
+// An fd is either armed ONE_SHOT per wait, or registered persistently
+// (EDGE_TRIGGERED in `interests`, in ET mode), with its readiness that has
+// been reported by edges, but not yet consumed, cached in `ready`.
 struct InFlightEvent {
-    uint32_t interests = 0, _;
+    uint32_t interests = 0, ready = 0;
     void* reader_data;
     void* writer_data;
     void* error_data;
@@ -51,10 +58,27 @@ struct InFlightEvent {
 
 const static uint32_t EVENT_RWEO = EVENT_RWE | ONE_SHOT;
 
+class EventEngineEPoll;
+
+// the engines in ET mode, to be told of fds closed on any vCPU; never
+// destructed, as vCPUs may finish after static destruction
+struct ETEngines {
+    std::mutex mutex;
+    std::vector<EventEngineEPoll*> engines;
+    std::atomic<int> count{0};
+};
+
+static ETEngines& et_engines() {
+    static auto x = new ETEngines;
+    return *x;
+}
+
 class EventEngineEPoll : public MasterEventEngine, public CascadingEventEngine, public ResetHandle {
 public:
     int _evfd = -1;
     int _engine_fd = -1;
+    bool _et_mode = false;
+    EventEngineStats _stats = {};
     int init() {
         int epfd = epoll_create(1);
         if (epfd < 0) LOG_ERRNO_RETURN(0, -1, "failed to epoll_create(1)");
@@ -78,11 +102,22 @@ public:
         if_close_fd(_engine_fd);    // close original fd
         if_close_fd(_evfd);
         _inflight_events.clear();   // reset members
+        _ready_ios.clear();
         _events_remain = 0;
-        return init();              // re-init
+        if (init() < 0)             // re-init
+            return -1;
+        if (_busy_poll.params.kernel_us)
+            set_epoll_busy_poll(_engine_fd, _busy_poll.params.kernel_us);
+        return 0;
     }
     virtual ~EventEngineEPoll() override {
         LOG_INFO("Finish event engine: epoll");
+        if (_et_mode) {
+            auto& x = et_engines();
+            std::lock_guard<std::mutex> lock(x.mutex);
+            x.engines.erase(std::find(x.engines.begin(), x.engines.end(), this));
+            x.count--;
+        }
         if_close_fd(_engine_fd);
         if_close_fd(_evfd);
     }
@@ -96,6 +131,7 @@ public:
         struct epoll_event ev;
         ev.events = events;  // EPOLLERR | EPOLLHUP always included
         ev.data.u64 = fd;
+        _stats.ctls++;
         int ret = epoll_ctl(_engine_fd, op, fd, &ev);
         if (ret < 0) {
             ERRNO err;
@@ -124,6 +160,8 @@ public:
             _inflight_events.resize(e.fd * 2);
 
         e.interests &= EVENT_RWEO;
+        if (unlikely(_et_mode && is_registered(e.fd)))
+            LOG_ERROR_RETURN(EALREADY, -1, "fd ` is registered persistently", e.fd);
         auto& entry = _inflight_events[e.fd];
         auto eint = entry.interests & EVENT_RWEO;
         int op;
@@ -173,6 +211,8 @@ ok:     entry.interests |= eint;
         if (e.fd < 0 || (size_t)e.fd >= _inflight_events.size())
             LOG_ERROR_RETURN(EINVAL, -1, "invalid file descriptor ", e.fd);
         if (unlikely(e.interests == 0)) return 0;
+        if (unlikely(_et_mode && is_registered(e.fd)))
+            return unregister(e.fd);
         auto& entry = _inflight_events[e.fd];
         auto eint = entry.interests & EVENT_RWEO;
         auto intersection = e.interests & eint;
@@ -209,6 +249,7 @@ ok:     entry.interests |= eint;
         timeout = (timeout && timeout < 1024) ? 1 : timeout / 1024;
         timeout &= 0x7fffffff;  // make sure less than INT32_MAX
         while (_engine_fd > 0) {
+            _stats.waits++;
             int ret = ::epoll_wait(_engine_fd, _events, LEN(_events), timeout);
             if (ret < 0) {
                 ERRNO err;
@@ -223,24 +264,31 @@ ok:     entry.interests |= eint;
         }
         return -1;
     }
+    // returns 1 if woken up by cancel_wait(), or 0
     template <typename DataCB, typename FDCB>
-    void wait_for_events(uint64_t timeout, const DataCB& datacb,
-                         const FDCB& fdcb) {
+    int wait_for_events(uint64_t timeout, const DataCB& datacb,
+                        const FDCB& fdcb) {
         if (!_events_remain) {
             int ret = do_epoll_wait(timeout);
-            if (ret < 0) return;
+            if (ret < 0) return 0;
         }
 
+        int woken = 0;
         while (_events_remain && fdcb()) {
             auto& e = _events[--_events_remain];
             if ((int)e.data.u64 == _evfd) {
                 uint64_t value;
                 eventfd_read(_evfd, &value);
+                woken = 1;
                 continue;
             }
             assert(e.data.u64 < _inflight_events.size());
             if (e.data.u64 >= _inflight_events.size()) continue;
             auto& entry = _inflight_events[e.data.u64];
+            if (entry.interests & EDGE_TRIGGERED) {
+                fire_registered(entry, e.events, datacb);
+                continue;
+            }
             uint32_t events = 0;
             if ((e.events & ERRBIT) && (entry.interests & EVENT_ERROR)) {
                 events |= EVENT_ERROR;
@@ -260,6 +308,7 @@ ok:     entry.interests |= eint;
                              .data = nullptr});
             }
         }
+        return woken;
     }
     virtual ssize_t wait_for_events(void** data, size_t count,
                                     Timeout timeout) override {
@@ -279,19 +328,82 @@ ok:     entry.interests |= eint;
         }
         return ptr - data;
     }
+    BusyPoller _busy_poll;
     virtual ssize_t wait_and_fire_events(uint64_t timeout) override {
+        return _busy_poll.wait(timeout, [&](uint64_t t) __INLINE__ {
+            return fire_events(t);
+        });
+    }
+    int busy_poll(const BusyPollParams& params) override {
+        if (params.kernel_us != _busy_poll.params.kernel_us &&
+            set_epoll_busy_poll(_engine_fd, params.kernel_us) < 0)
+            return -1;
+        _busy_poll.set(params);
+        return 0;
+    }
+    int busy_poll_stats(BusyPollStats* stats) override {
+        *stats = _busy_poll.stats;
+        return 0;
+    }
+    int stats(EventEngineStats* stats) override {
+        *stats = _stats;
+        return 0;
+    }
+    // returns # of events fired, counting a wakeup by cancel_wait() as one,
+    // so that a spinning BusyPoller stops to look at the standby queue
+    ssize_t fire_events(uint64_t timeout) {
         ssize_t n = 0;
-        wait_for_events(timeout,
-            [&](void* data) __INLINE__ {
-                assert(data);
+        auto fire = [&](void* data) __INLINE__ {
+            assert(data);
+            if ((uintptr_t)data & ASYNC_IO_TAG) {
+                auto io = (AsyncIO*)((uintptr_t)data ^ ASYNC_IO_TAG);
+                io->res = 0;
+                io->done(io);
+            } else {
                 thread_interrupt((thread*)data, EOK);
-                n++;
-            },
-            [&]() __INLINE__ { return true; });
-        return n;
+            }
+            n++;
+        };
+        if (unlikely(!_ready_ios.empty())) {
+            // the AsyncIOs polling for readiness that had been cached
+            auto ios = std::move(_ready_ios);
+            _ready_ios.clear();
+            for (auto data : ios) fire(data);
+            return n;
+        }
+        int woken = wait_for_events(timeout, fire, [&]() __INLINE__ { return true; });
+        return n + woken;
     }
     virtual int cancel_wait() override { return eventfd_write(_evfd, 1); }
 
+    // AsyncIOs share the slots of waiting threads, tagged by the lowest bit
+    const static uintptr_t ASYNC_IO_TAG = 1;
+    int async_io(AsyncIO* io) override {
+        if (io->opcode != AsyncIO::POLL) {
+            errno = ENOSYS;     // to be polled for, by the caller
+            return -1;
+        }
+        auto interest = io->flags & EVENT_RWE;
+        if (!interest || (interest & (interest-1)))
+            LOG_ERROR_RETURN(EINVAL, -1, "can not poll for multiple (or no) interests");
+        auto data = (void*)((uintptr_t)io | ASYNC_IO_TAG);
+        if (_et_mode && is_registered(io->fd))
+            return poll_registered(io->fd, interest, data);
+        return add_interest({io->fd, interest | ONE_SHOT, data});
+    }
+    int async_cancel(AsyncIO* io) override {
+        auto interest = io->flags & EVENT_RWE;
+        auto data = (void*)((uintptr_t)io | ASYNC_IO_TAG);
+        if (_et_mode && is_registered(io->fd)) {
+            auto& w = waiter(_inflight_events[io->fd], interest);
+            if (w == data) w = nullptr;
+            auto it = std::find(_ready_ios.begin(), _ready_ios.end(), data);
+            if (it != _ready_ios.end()) _ready_ios.erase(it);
+            return 0;
+        }
+        return rm_interest({io->fd, interest, nullptr});
+    }
+
     int wait_for_fd(int fd, uint32_t interest, Timeout timeout) override {
         if (fd < 0)
             LOG_ERROR_RETURN(EINVAL, -1, "invalid fd");
@@ -299,6 +411,8 @@ ok:     entry.interests |= eint;
             LOG_ERROR_RETURN(EINVAL, -1, "can not wait for multiple interests");
         if (unlikely(interest == 0))
             return rm_interest({fd, EVENT_RWE| ONE_SHOT, 0}); // remove fd from epoll
+        if (_et_mode && is_registered(fd))
+            return wait_registered(fd, interest, timeout, false);
         int ret = add_interest({fd, interest | ONE_SHOT, CURRENT});
         if (ret < 0) LOG_ERROR_RETURN(0, -1, "failed to add event interest");
         SCOPED_PAUSE_WORK_STEALING;
@@ -312,6 +426,140 @@ ok:     entry.interests |= eint;
                              err.no; // Interrupted by other thread
         return -1;
     }
+
+    // In ET mode, an fd is registered on its first EAGAIN, for all of
+    // EPOLLIN, EPOLLOUT and EPOLLET, and stays so until it's removed by
+    // wait_for_fd(fd, 0), usually right before it is closed. So a wait costs
+    // no epoll_ctl(), and one for an fd that has been reported ready since it
+    // was last waited for costs no syscall at all.
+    int wait_for_fd_again(int fd, uint32_t interest, Timeout timeout) override {
+        if (!_et_mode || fd < 0 || !interest || (interest & (interest-1)))
+            return wait_for_fd(fd, interest, timeout);
+        if (!is_registered(fd) && register_fd(fd) < 0)
+            return wait_for_fd(fd, interest, timeout);
+        return wait_registered(fd, interest, timeout, true);
+    }
+
+    bool is_registered(int fd) {
+        forget_closed();
+        return (size_t)fd < _inflight_events.size() &&
+               (_inflight_events[fd].interests & EDGE_TRIGGERED);
+    }
+
+    // fds closed on any vCPU, see forget_registered_fd(), which are to be
+    // forgotten before their numbers are looked up again, as they may have
+    // been reused by then
+    std::mutex _closed_mutex;
+    std::vector<int> _closed_fds;
+    std::atomic<bool> _closed{false};
+    void forget(int fd) {
+        std::lock_guard<std::mutex> lock(_closed_mutex);
+        _closed_fds.push_back(fd);
+        _closed.store(true, std::memory_order_release);
+    }
+    void forget_closed() {
+        if (likely(!_closed.load(std::memory_order_acquire)))
+            return;
+        std::vector<int> fds;
+        {
+            std::lock_guard<std::mutex> lock(_closed_mutex);
+            fds.swap(_closed_fds);
+            _closed.store(false, std::memory_order_relaxed);
+        }
+        // waiters, if any, are left to time out, as with unregister()
+        for (auto fd : fds)
+            if ((size_t)fd < _inflight_events.size() &&
+                (_inflight_events[fd].interests & EDGE_TRIGGERED))
+                _inflight_events[fd] = {};
+    }
+    int register_fd(int fd) {
+        if (unlikely((size_t)fd >= _inflight_events.size()))
+            _inflight_events.resize(fd * 2);
+        auto& entry = _inflight_events[fd];
+        if (entry.interests & EVENT_RWE)
+            return -1;  // being waited for, ONE_SHOT
+        auto events = EPOLLIN | EPOLLRDHUP | EPOLLOUT | EPOLLET;
+        // a fired ONE_SHOT fd stays (disabled) in epoll, until closed
+        int op = (entry.interests & ONE_SHOT) ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+        int ret = ctl(fd, op, events, ENOENT, EEXIST);
+        if (ret > 0)    // the fd was closed, or it's added by others
+            ret = ctl(fd, (op == EPOLL_CTL_ADD) ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, events);
+        if (ret < 0)
+            return -1;
+        entry = {};
+        entry.interests = EDGE_TRIGGERED;
+        return 0;
+    }
+    int unregister(int fd) {
+        // waiters, if any, are left to time out, as with ONE_SHOT
+        _inflight_events[fd] = {};
+        if (ctl(fd, EPOLL_CTL_DEL, 0, ENOENT) < 0)
+            LOG_ERROR_RETURN(0, -1, "failed to unregister fd ", fd);
+        return 0;
+    }
+    static void*& waiter(InFlightEvent& entry, uint32_t interest) {
+        return (interest == EVENT_READ)  ? entry.reader_data :
+               (interest == EVENT_WRITE) ? entry.writer_data :
+                                           entry.error_data;
+    }
+    // `again`: the fd has just failed with EAGAIN, so a cached readiness
+    // is stale, otherwise it is consumed by the wait
+    int wait_registered(int fd, uint32_t interest, Timeout timeout, bool again) {
+        auto& entry = _inflight_events[fd];
+        if (!again && (entry.ready & interest)) {
+            entry.ready &= ~interest;
+            _stats.cache_hits++;
+            return 0;
+        }
+        entry.ready &= ~interest;
+        auto& w = waiter(entry, interest);
+        if (w)
+            LOG_ERROR_RETURN(EALREADY, -1, "fd ` is being waited for", fd);
+        w = CURRENT;
+        SCOPED_PAUSE_WORK_STEALING;
+        int ret = thread_usleep(timeout);
+        ERRNO err;
+        // `_inflight_events` may have been resized while sleeping
+        auto& w2 = waiter(_inflight_events[fd], interest);
+        if (w2 == CURRENT) w2 = nullptr;
+        if (ret == -1 && err.no == EOK)
+            return 0;
+        errno = (ret == 0) ? ETIMEDOUT : err.no;
+        return -1;
+    }
+    // an AsyncIO polling a registered fd takes the place of a waiting
+    // thread; a cached readiness is consumed, as by wait_registered(), and
+    // fires it in the next round of events
+    int poll_registered(int fd, uint32_t interest, void* data) {
+        auto& entry = _inflight_events[fd];
+        if (entry.ready & interest) {
+            entry.ready &= ~interest;
+            _stats.cache_hits++;
+            _ready_ios.push_back(data);
+            return 0;
+        }
+        auto& w = waiter(entry, interest);
+        if (w)
+            LOG_ERROR_RETURN(EALREADY, -1, "fd ` is being waited for", fd);
+        w = data;
+        return 0;
+    }
+    std::vector<void*> _ready_ios;
+
+    template <typename DataCB>
+    void fire_registered(InFlightEvent& entry, uint32_t events, const DataCB& datacb) {
+        uint32_t ready = ((events & READBITS)  ? EVENT_READ  : 0) |
+                         ((events & WRITEBITS) ? EVENT_WRITE : 0) |
+                         ((events & ERRBIT)    ? EVENT_ERROR : 0) ;
+        entry.ready |= ready;
+        for (auto i : {EVENT_READ, EVENT_WRITE, EVENT_ERROR}) {
+            auto& w = waiter(entry, i);
+            if ((ready & i) && w) {
+                datacb(w);
+                w = nullptr;
+            }
+        }
+    }
 };
 
 __attribute__((noinline)) static
@@ -324,6 +572,26 @@ MasterEventEngine* new_epoll_master_engine() {
     return new_epoll_engine("master");
 }
 
+MasterEventEngine* new_epoll_et_master_engine() {
+    auto e = new_epoll_engine("master, edge-triggered");
+    if (!e) return nullptr;
+    e->_et_mode = true;
+    auto& x = et_engines();
+    std::lock_guard<std::mutex> lock(x.mutex);
+    x.engines.push_back(e);
+    x.count++;
+    return e;
+}
+
+void forget_registered_fd(int fd) {
+    auto& x = et_engines();
+    if (likely(x.count.load(std::memory_order_relaxed) == 0))
+        return;
+    std::lock_guard<std::mutex> lock(x.mutex);
+    for (auto e : x.engines)
+        e->forget(fd);
+}
+
 CascadingEventEngine* new_epoll_cascading_engine() {
     return new_epoll_engine("cascading");
 }
@@ -15,9 +15,12 @@ limitations under the License.
 */
 
 #pragma once
+#include <errno.h>
 #include <sys/types.h>
+#include <sys/socket.h>
 #include <photon/photon.h>
 #include <photon/thread/thread.h>
+#include <photon/common/callback.h>
 #include <photon/common/timeout.h>
 
 namespace photon {
@@ -31,6 +34,54 @@ const static uint32_t ONE_SHOT = 0x8000;
 
 const static int EOK = ENXIO;   // the Event of NeXt I/O
 
+// An operation whose completion is fired by the master engine itself, in
+// wait_and_fire_events(), by invoking `done`, rather than by interrupting
+// a waiting thread. It is for stackless coroutines (see photon/io/coro20.h),
+// which have no thread to interrupt. As the engine may be amid firing other
+// events, `done` should merely take note of the completion, and it must
+// neither block nor submit to the engine.
+struct AsyncIO {
+    enum Opcode : uint8_t { POLL, RECV, SEND, ACCEPT, PREAD, PWRITE };
+    Opcode opcode = POLL;
+    int fd = -1;
+    uint32_t flags = 0;     // EVENT_READ or EVENT_WRITE for POLL,
+                            // MSG_* for RECV and SEND, SOCK_* for ACCEPT
+    void* buf = nullptr;    // or the peer's sockaddr, for ACCEPT
+    size_t count = 0;
+    off_t offset = 0;
+    socklen_t* addrlen = nullptr;
+    int64_t res = 0;        // the result, or -errno for failure
+    Delegate<void, AsyncIO*> done;
+};
+
+// Busy-polling of a master engine: when its vCPU runs out of ready threads,
+// the engine polls for events without blocking for a while before it goes
+// to sleep, which saves the sleep/wakeup round trip through the kernel for
+// events that arrive shortly. The time spun is learned from recent idle
+// periods that ended with events, so it shrinks to 0 when events are sparse.
+struct BusyPollParams {
+    uint32_t max_spin_us = 0;       // the maximum time to spin, 0 to disable
+    uint32_t cpu_percent = 50;      // the maximum share of time spent spinning
+    uint32_t kernel_us = 0;         // busy-polling of sockets within epoll_wait()
+                                    // (EPIOCSPARAMS, Linux 6.9+), epoll engines only
+};
+
+struct BusyPollStats {
+    uint64_t hits;          // idle periods ended by events while spinning
+    uint64_t misses;        // spins that found nothing, before sleeping
+    uint64_t sleeps;        // idle periods that went to sleep
+    uint64_t spin_us;       // total time spent spinning
+    uint64_t window_us;     // the current time to spin, as learned
+};
+
+// Syscalls made by a master engine, to tell the cost of waiting for events
+struct EventEngineStats {
+    uint64_t waits;         // epoll_wait() or alike
+    uint64_t ctls;          // epoll_ctl() or alike, to (un)register interests
+    uint64_t cache_hits;    // waits found ready in the readiness cache,
+                            // without a syscall (see INIT_EVENT_EPOLL_ET)
+};
+
 // Event engine is the abstraction of substrates like epoll,
 // io-uring, kqueue, etc.
 // Master event engine is the default one used by global functions
@@ -71,6 +122,63 @@ public:
     virtual ssize_t wait_and_fire_events(uint64_t timeout) = 0;
 
     virtual int cancel_wait() = 0;
+
+    /**
+     * @brief Submit an AsyncIO, whose completion will be fired by `io->done`
+     * @return 0 for success, or -1 for failure, with errno ENOSYS if the
+     *         engine does not support the opcode (epoll supports POLL only)
+     */
+    virtual int async_io(AsyncIO* io) {
+        errno = ENOSYS;
+        return -1;
+    }
+
+    /**
+     * @brief Cancel an AsyncIO that is submitted and not yet fired
+     * @return 0 if it is cancelled, and will not be fired;
+     *         1 if it will still be fired, with either its result or -ECANCELED;
+     *         -1 for failure
+     */
+    virtual int async_cancel(AsyncIO* io) {
+        errno = ENOSYS;
+        return -1;
+    }
+
+    /**
+     * @brief Configure busy-polling of the engine, see BusyPollParams
+     * @return 0 for success, or -1 with errno ENOSYS if not supported
+     */
+    virtual int busy_poll(const BusyPollParams& params) {
+        errno = ENOSYS;
+        return -1;
+    }
+
+    virtual int busy_poll_stats(BusyPollStats* stats) {
+        errno = ENOSYS;
+        return -1;
+    }
+
+    /**
+     * @brief Wait for `fd` after an I/O on it failed with EAGAIN, i.e. wait
+     *        for a *new* readiness. Engines that keep fds registered (epoll
+     *        with INIT_EVENT_EPOLL_ET) register `fd` persistently on first
+     *        use, and then wait for it without any epoll_ctl(). Others wait
+     *        as wait_for_fd() does.
+     * @note  A registered fd is removed by wait_for_fd(fd, 0, ...) on the
+     *        vCPU where it was waited for, or by forget_registered_fd() on
+     *        any vCPU, which must be done before it is closed, as sockets
+     *        do, even if they are closed by other vCPUs (work stealing, or
+     *        thread_migrate()). An AsyncIO polling a registered fd takes the
+     *        place of a waiting thread, and shares its readiness cache.
+     */
+    virtual int wait_for_fd_again(int fd, uint32_t interest, Timeout timeout) {
+        return wait_for_fd(fd, interest, timeout);
+    }
+
+    virtual int stats(EventEngineStats* stats) {
+        errno = ENOSYS;
+        return -1;
+    }
 };
 
 inline int wait_for_fd_readable(int fd, Timeout timeout = {}) {
@@ -85,6 +193,19 @@ inline int wait_for_fd_error(int fd, Timeout timeout = {}) {
     return get_vcpu()->master_event_engine->wait_for_fd_error(fd, timeout);
 }
 
+// busy-polling of the master engine of current vCPU
+inline int busy_poll(const BusyPollParams& params) {
+    return get_vcpu()->master_event_engine->busy_poll(params);
+}
+
+inline int busy_poll_stats(BusyPollStats* stats) {
+    return get_vcpu()->master_event_engine->busy_poll_stats(stats);
+}
+
+inline int event_engine_stats(EventEngineStats* stats) {
+    return get_vcpu()->master_event_engine->stats(stats);
+}
+
 // Cascading event engine is used explicitly with a pointer, for complex
 // scenarios that the master engine cannot handle, e.g., waiting for multiple
 // events with a single invocation.
@@ -140,6 +261,14 @@ DECLARE_MASTER_AND_CASCADING_ENGINE(select);
 DECLARE_MASTER_AND_CASCADING_ENGINE(kqueue);
 DECLARE_MASTER_AND_CASCADING_ENGINE(epoll_ng);
 
+// the epoll master engine with persistent fd registration, see INIT_EVENT_EPOLL_ET
+MasterEventEngine* new_epoll_et_master_engine();
+
+// Tell the engines of all vCPUs that `fd` is about to be closed, so that
+// those which have registered it (see wait_for_fd_again()) forget it, before
+// its number is reused. It can be called on any vCPU, or any thread.
+void forget_registered_fd(int fd);
+
 struct iouring_args {
     bool is_master    = true;
     bool setup_sqpoll = false;
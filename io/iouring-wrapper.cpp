@@ -31,6 +31,7 @@ limitations under the License.
 #include <photon/io/fd-events.h>
 #include "events_map.h"
 #include "reset_handle.h"
+#include "busy-poll.h"
 
 #ifndef _GNU_SOURCE
 #define _GNU_SOURCE
@@ -293,6 +294,47 @@ public:
         }
         return 0;
     }
+    int async_io(AsyncIO* io) override {
+        if (io->opcode > AsyncIO::PWRITE)
+            LOG_ERROR_RETURN(ENOSYS, -1, "iouring: unknown AsyncIO opcode ", io->opcode);
+        auto* sqe = _get_sqe();
+        if (sqe == nullptr)
+            return -1;
+        switch (io->opcode) {
+            case AsyncIO::POLL:
+                io_uring_prep_poll_add(sqe, io->fd,
+                    evmap.translate_bitwisely(io->flags & EVENT_RWE));
+                break;
+            case AsyncIO::RECV:
+                io_uring_prep_recv(sqe, io->fd, io->buf, io->count, io->flags);
+                break;
+            case AsyncIO::SEND:
+                io_uring_prep_send(sqe, io->fd, io->buf, io->count, io->flags);
+                break;
+            case AsyncIO::ACCEPT:
+                io_uring_prep_accept(sqe, io->fd, (sockaddr*)io->buf, io->addrlen, io->flags);
+                break;
+            case AsyncIO::PREAD:
+                io_uring_prep_read(sqe, io->fd, io->buf, io->count, io->offset);
+                break;
+            case AsyncIO::PWRITE:
+                io_uring_prep_write(sqe, io->fd, io->buf, io->count, io->offset);
+                break;
+        }
+        io_uring_sqe_set_data(sqe, (void*)((uintptr_t)io | ASYNC_IO_TAG));
+        return try_submit();
+    }
+
+    int async_cancel(AsyncIO* io) override {
+        auto* sqe = _get_sqe();
+        if (sqe == nullptr)
+            return -1;
+        io_uring_prep_cancel(sqe, (void*)((uintptr_t)io | ASYNC_IO_TAG), 0);
+        io_uring_sqe_set_data(sqe, nullptr);
+        if (try_submit() < 0) return -1;
+        return 1;   // the AsyncIO is fired anyway
+    }
+
     int add_interest(Event e) override {
         auto* sqe = _get_sqe();
         if (sqe == nullptr)
@@ -357,6 +399,13 @@ public:
                 continue;
             }
 
+            if ((uintptr_t)ctx & ASYNC_IO_TAG) {
+                auto io = (AsyncIO*)((uintptr_t)ctx ^ ASYNC_IO_TAG);
+                io->res = cqe->res;
+                io->done(io);
+                continue;
+            }
+
             if (ctx == (ioCtx*) this) {
                 // Triggered by cancel_wait
                 eventfd_t val;
@@ -416,6 +465,33 @@ public:
     }
 
     ssize_t wait_and_fire_events(uint64_t timeout) override {
+        return m_busy_poller.wait(timeout, [&](uint64_t t) __INLINE__ {
+            return fire_events(t);
+        });
+    }
+
+    int busy_poll(const BusyPollParams& params) override {
+        // kernel_us is for epoll, as io_uring has no equivalent here
+        m_busy_poller.set(params);
+        return 0;
+    }
+
+    int busy_poll_stats(BusyPollStats* stats) override {
+        *stats = m_busy_poller.stats;
+        return 0;
+    }
+
+    // return # of completions reaped
+    ssize_t fire_events(uint64_t timeout) {
+        if (timeout == 0 && m_busy_poller.enabled() && !m_args.setup_iopoll) {
+            // spinning, peek at the completion queue without entering
+            // the kernel, unless there are SQEs to submit
+            if (io_uring_sq_ready(m_ring) && io_uring_submit(m_ring) < 0)
+                return -1;
+            ssize_t n = io_uring_cq_ready(m_ring);
+            if (n) reap_events();
+            return n;
+        }
         // Prepare own timeout
         if (timeout > (uint64_t) std::numeric_limits<int64_t>::max()) {
             timeout = std::numeric_limits<int64_t>::max();
@@ -426,8 +502,9 @@ public:
             return -1;
         }
 
+        ssize_t n = io_uring_cq_ready(m_ring);
         reap_events();
-        return 0;
+        return n;
     }
 
     int cancel_wait() override {
@@ -573,10 +650,13 @@ private:
         return {sec, nsec};
     }
 
+    // AsyncIOs are told from ioCtx by the lowest bit of user data
+    static const uintptr_t ASYNC_IO_TAG = 1;
     static const int QUEUE_DEPTH = 16384;
     static const int REGISTER_FILES_SPARSE_FD = -1;
     static const int REGISTER_FILES_MAX_NUM = 10000;
     iouring_args m_args;
+    BusyPoller m_busy_poller;
     io_uring* m_ring = nullptr;
     int m_eventfd = -1;
     std::unordered_map<fdInterest, eventCtx, fdInterestHasher> m_event_contexts;
@@ -0,0 +1,151 @@
+/*
+Copyright 2022 The Photon Authors
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <thread>
+#include <photon/photon.h>
+#include <photon/io/fd-events.h>
+#include <photon/thread/thread.h>
+#include <photon/common/alog.h>
+#include <photon/common/utility.h>
+#include "../../test/gtest.h"
+
+using namespace photon;
+
+class BusyPoll : public testing::TestWithParam<uint64_t> {
+protected:
+    int evfd = -1;
+    void SetUp() override {
+        GTEST_ASSERT_EQ(0, photon::init(GetParam(), INIT_IO_NONE));
+        evfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    }
+    void TearDown() override {
+        close(evfd);
+        photon::fini();
+    }
+
+    // another kernel thread signals the eventfd `n` times, every `gap_us`,
+    // each after the previous one is received
+    void ping(int n, uint64_t gap_us) {
+        volatile int received = 0;
+        std::thread th([&] {
+            for (int i = 0; i < n; i++) {
+                while (received < i) ::usleep(10);
+                ::usleep(gap_us);
+                eventfd_write(evfd, 1);
+            }
+        });
+        for (int i = 0; i < n; i++) {
+            ASSERT_EQ(0, wait_for_fd_readable(evfd, 1000 * 1000));
+            eventfd_t value;
+            eventfd_read(evfd, &value);
+            received = i + 1;
+        }
+        th.join();
+    }
+};
+
+TEST_P(BusyPoll, disabled) {
+    BusyPollStats stats;
+    ASSERT_EQ(0, busy_poll_stats(&stats));
+    ping(10, 100);
+    ASSERT_EQ(0, busy_poll_stats(&stats));
+    EXPECT_EQ(0, stats.hits + stats.misses + stats.sleeps + stats.spin_us);
+}
+
+TEST_P(BusyPoll, adaptive) {
+    BusyPollParams params;
+    params.max_spin_us = 2000;
+    params.cpu_percent = 100;
+    ASSERT_EQ(0, busy_poll(params));
+
+    // frequent events are spun for; whether a spin catches one depends on
+    // the pinging thread being scheduled meanwhile, so only the spinning,
+    // which starts with the full window, is asserted
+    ping(200, 50);
+    BusyPollStats stats;
+    ASSERT_EQ(0, busy_poll_stats(&stats));
+    LOG_INFO("frequent: ", VALUE(stats.hits), VALUE(stats.misses), VALUE(stats.sleeps),
+             VALUE(stats.spin_us), VALUE(stats.window_us));
+    EXPECT_GT(stats.hits + stats.misses, 0);
+    EXPECT_GT(stats.spin_us, 0);
+
+    // sparse events are slept for, as spinning wouldn't catch them
+    ping(30, 10 * 1000);
+    auto hits = stats.hits;
+    ASSERT_EQ(0, busy_poll_stats(&stats));
+    LOG_INFO("sparse: ", VALUE(stats.hits), VALUE(stats.misses), VALUE(stats.sleeps),
+             VALUE(stats.spin_us), VALUE(stats.window_us));
+    EXPECT_EQ(0, stats.window_us);
+    EXPECT_LE(stats.hits - hits, 1);
+}
+
+TEST_P(BusyPoll, cpu_budget) {
+    BusyPollParams params;
+    params.max_spin_us = 100 * 1000;
+    params.cpu_percent = 5;
+    ASSERT_EQ(0, busy_poll(params));
+    // sleep, while nothing arrives, for 500ms
+    auto start = __update_now();
+    for (int i = 0; i < 5; i++)
+        wait_for_fd_readable(evfd, 100 * 1000);
+    auto elapsed = __update_now() - start;
+    BusyPollStats stats;
+    ASSERT_EQ(0, busy_poll_stats(&stats));
+    LOG_INFO(VALUE(elapsed), VALUE(stats.spin_us), VALUE(stats.misses), VALUE(stats.sleeps));
+    EXPECT_GT(stats.spin_us, 0);
+    EXPECT_GE(stats.sleeps, 5);
+    // a spin takes the rest of the budget of its period (5ms), so there is
+    // at most one spin in each period, counting those cut by the ends of
+    // the test; the time spun is not asserted, as it includes preemptions
+    EXPECT_GE(stats.misses, 1);
+    EXPECT_LE(stats.misses, elapsed / (100 * 1000) + 2);
+    // far from spinning all the time, with the budget ignored
+    EXPECT_LT(stats.spin_us, elapsed / 2);
+}
+
+TEST_P(BusyPoll, cross_vcpu_wakeup) {
+    BusyPollParams params;
+    params.max_spin_us = 1000 * 1000;
+    params.cpu_percent = 100;
+    ASSERT_EQ(0, busy_poll(params));
+    // another vCPU wakes up current thread while its vCPU is spinning,
+    // as no events arrive, for up to the budget of a period (100ms)
+    auto th = CURRENT;
+    std::thread waker([&] {
+        photon::init(INIT_EVENT_DEFAULT, INIT_IO_NONE);
+        DEFER(photon::fini());
+        ::usleep(10 * 1000);
+        thread_interrupt(th);
+    });
+    DEFER(waker.join());
+    auto start = __update_now();
+    thread_usleep(-1);
+    auto elapsed = __update_now() - start;
+    BusyPollStats stats;
+    ASSERT_EQ(0, busy_poll_stats(&stats));
+    LOG_INFO(VALUE(elapsed), VALUE(stats.spin_us), VALUE(stats.hits), VALUE(stats.sleeps));
+    // rather than sleeping (for 10s) after the spin missed the wakeup
+    EXPECT_LT(elapsed, 1000 * 1000);
+}
+
+INSTANTIATE_TEST_CASE_P(engines, BusyPoll, testing::Values(INIT_EVENT_EPOLL, INIT_EVENT_EPOLL_NG));
+
+int main(int argc, char** arg) {
+    ::testing::InitGoogleTest(&argc, arg);
+    return RUN_ALL_TESTS();
+}
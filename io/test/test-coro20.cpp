@@ -0,0 +1,258 @@
+/*
+Copyright 2022 The Photon Authors
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <photon/photon.h>
+#include <photon/io/coro20.h>
+#include <photon/net/socket.h>
+#include <photon/thread/thread11.h>
+#include <photon/common/alog.h>
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../../test/gtest.h"
+
+using namespace photon;
+
+static uint64_t engine = INIT_EVENT_EPOLL;
+
+static int nonblocking_listener(net::EndPoint& ep) {
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (::bind(fd, (sockaddr*)&addr, len) < 0 || ::listen(fd, 1024) < 0 ||
+        ::getsockname(fd, (sockaddr*)&addr, &len) < 0) {
+        ::close(fd);
+        return -1;
+    }
+    ep = net::EndPoint(net::IPAddr("127.0.0.1"), ntohs(addr.sin_port));
+    return fd;
+}
+
+static void nonblocking_pair(int fds[2]) {
+    ASSERT_EQ(0, ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds));
+}
+
+static coro::Task<> echo(int fd, int* sessions) {
+    char buf[4096];
+    ssize_t n;
+    while ((n = co_await coro::recv(fd, buf, sizeof(buf))) > 0) {
+        if (co_await coro::send(fd, buf, n) != n) break;
+    }
+    ::close(fd);
+    (*sessions)++;
+}
+
+static coro::Task<> serve(coro::Scheduler* sched, int listener, int n, int* sessions) {
+    for (int i = 0; i < n; i++) {
+        sockaddr_in addr;
+        socklen_t len = sizeof(addr);
+        int fd = co_await coro::accept(listener, (sockaddr*)&addr, &len);
+        EXPECT_GE(fd, 0);
+        if (fd < 0) break;
+        EXPECT_EQ(AF_INET, addr.sin_family);
+        EXPECT_TRUE(::fcntl(fd, F_GETFL) & O_NONBLOCK);
+        sched->spawn(echo(fd, sessions));
+    }
+}
+
+TEST(coro20, echo) {
+    net::EndPoint ep;
+    int listener = nonblocking_listener(ep);
+    ASSERT_GE(listener, 0);
+    DEFER(::close(listener));
+
+    const int N = 10;
+    int sessions = 0, clients = 0;
+    coro::Scheduler sched;
+    sched.spawn(serve(&sched, listener, N, &sessions));
+    std::vector<join_handle*> jhs;
+    for (int i = 0; i < N; i++) {
+        jhs.push_back(thread_enable_join(thread_create11([&, i] {
+            auto cli = net::new_tcp_socket_client();
+            DEFER(delete cli);
+            auto s = cli->connect(ep);
+            ASSERT_NE(nullptr, s);
+            DEFER(delete s);
+            for (int j = 0; j < 100; j++) {
+                std::string msg = "hello " + std::to_string(i * 1000 + j);
+                char buf[64];
+                ASSERT_EQ((ssize_t)msg.size(), s->write(msg.data(), msg.size()));
+                ASSERT_EQ((ssize_t)msg.size(), s->read(buf, msg.size()));
+                ASSERT_EQ(msg, std::string(buf, msg.size()));
+            }
+            clients++;
+        })));
+    }
+    EXPECT_EQ(0, sched.run());
+    for (auto jh : jhs) thread_join(jh);
+    EXPECT_EQ(N, clients);
+    EXPECT_EQ(N, sessions);
+    EXPECT_EQ(0UL, sched.tasks());
+}
+
+TEST(coro20, timeout) {
+    int fds[2];
+    nonblocking_pair(fds);
+    DEFER({ ::close(fds[0]); ::close(fds[1]); });
+    coro::Scheduler sched;
+    sched.spawn([](int fd) -> coro::Task<> {
+        char buf[16];
+        auto start = photon::now;
+        EXPECT_EQ(-1, co_await coro::recv(fd, buf, sizeof(buf), 10 * 1000));
+        EXPECT_EQ(ETIMEDOUT, errno);
+        EXPECT_GE(photon::now - start, 9 * 1000UL);
+        // expired already
+        EXPECT_EQ(-1, co_await coro::recv(fd, buf, sizeof(buf), 0));
+        EXPECT_EQ(ETIMEDOUT, errno);
+        // ready right away, despite the timeout
+        EXPECT_EQ(3, co_await coro::send(fd, "abc", 3, 0));
+    }(fds[0]));
+    EXPECT_EQ(0, sched.run());
+    char buf[4];
+    EXPECT_EQ(3, ::read(fds[1], buf, sizeof(buf)));
+}
+
+TEST(coro20, cancel) {
+    int fds[2], fds2[2];
+    nonblocking_pair(fds);
+    nonblocking_pair(fds2);
+    DEFER({ ::close(fds[0]); ::close(fds[1]); ::close(fds2[0]); ::close(fds2[1]); });
+    coro::Scheduler sched;
+    coro::CancelToken token;
+    int cancelled = 0;
+    auto waiter = [&](int fd) -> coro::Task<> {
+        char buf[16];
+        EXPECT_EQ(-1, co_await coro::recv(fd, buf, sizeof(buf), {}, &token));
+        EXPECT_EQ(ECANCELED, errno);
+        cancelled++;
+    };
+    sched.spawn(waiter(fds[0]));
+    sched.spawn(waiter(fds2[0]));
+    auto th = thread_enable_join(thread_create11([&] {
+        thread_usleep(10 * 1000);
+        EXPECT_EQ(0, cancelled);
+        token.cancel();
+    }));
+    EXPECT_EQ(0, sched.run());
+    thread_join(th);
+    EXPECT_EQ(2, cancelled);
+
+    // the token cancels operations afterwards, even if ready
+    EXPECT_EQ(1, ::write(fds[1], "x", 1));
+    sched.spawn(waiter(fds[0]));
+    EXPECT_EQ(0, sched.run());
+    EXPECT_EQ(3, cancelled);
+}
+
+TEST(coro20, file) {
+    const char* path = "/tmp/test-coro20.dat";
+    int fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    ASSERT_GE(fd, 0);
+    DEFER({ ::close(fd); ::unlink(path); });
+    coro::Scheduler sched;
+    sched.spawn([](int fd) -> coro::Task<> {
+        std::string data(10000, 'x');
+        EXPECT_EQ(10000, co_await coro::pwrite(fd, data.data(), data.size(), 4096));
+        char buf[8192];
+        EXPECT_EQ(8192, co_await coro::pread(fd, buf, sizeof(buf), 0));
+        EXPECT_EQ(0, buf[0]);
+        EXPECT_EQ('x', buf[4096]);
+        EXPECT_EQ(6000, co_await coro::pread(fd, buf, sizeof(buf), 8096));
+        EXPECT_EQ(0, co_await coro::pread(fd, buf, sizeof(buf), 20000));
+        EXPECT_EQ(-1, co_await coro::pread(-1, buf, sizeof(buf), 0));
+        EXPECT_EQ(EBADF, errno);
+    }(fd));
+    EXPECT_EQ(0, sched.run());
+}
+
+static coro::Task<int> add(int a, int b) {
+    if (a < 0) throw std::invalid_argument("negative");
+    co_return a + b;
+}
+
+TEST(coro20, task) {
+    coro::Scheduler sched;
+    int result = 0;
+    auto body = [&]() -> coro::Task<> {
+        result = co_await add(1, 2);
+        result += co_await add(3, 4);
+        try {
+            co_await add(-1, 0);
+        } catch (const std::invalid_argument&) {
+            result += 100;
+        }
+    };
+    sched.spawn(body());
+    EXPECT_EQ(0, sched.run());
+    EXPECT_EQ(110, result);
+
+    // schedulers do not nest
+    sched.spawn([]() -> coro::Task<> {
+        coro::Scheduler another;
+        EXPECT_EQ(-1, another.run());
+        EXPECT_EQ(EBUSY, errno);
+        co_return;
+    }());
+    EXPECT_EQ(0, sched.run());
+}
+
+TEST(coro20, many_in_flight) {
+    const int N = 1000;
+    std::vector<int> fds(N * 2);
+    for (int i = 0; i < N; i++) nonblocking_pair(&fds[i * 2]);
+    DEFER(for (auto fd : fds) ::close(fd));
+    coro::Scheduler sched;
+    int done = 0;
+    auto pong = [&](int fd) -> coro::Task<> {
+        char c;
+        EXPECT_EQ(1, co_await coro::recv(fd, &c, 1));
+        EXPECT_EQ(1, co_await coro::send(fd, &c, 1));
+        done++;
+    };
+    for (int i = 0; i < N; i++) sched.spawn(pong(fds[i * 2]));
+    auto th = thread_enable_join(thread_create11([&] {
+        // let all of them be waiting
+        thread_usleep(10 * 1000);
+        EXPECT_EQ(0, done);
+        for (int i = 0; i < N; i++)
+            EXPECT_EQ(1, ::write(fds[i * 2 + 1], "x", 1));
+    }));
+    EXPECT_EQ(0, sched.run());
+    thread_join(th);
+    EXPECT_EQ(N, done);
+}
+
+int main(int argc, char** arg) {
+    ::testing::InitGoogleTest(&argc, arg);
+#ifdef PHOTON_URING
+    if (argc > 1 && std::string(arg[1]) == "iouring")
+        engine = INIT_EVENT_IOURING;
+#endif
+    if (photon::init(engine, photon::INIT_IO_NONE))
+        return -1;
+    DEFER(photon::fini());
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,216 @@
+/*
+Copyright 2022 The Photon Authors
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <thread>
+#include <photon/photon.h>
+#include <photon/io/fd-events.h>
+#include <photon/net/socket.h>
+#include <photon/thread/thread11.h>
+#include <photon/common/alog.h>
+#include <photon/common/utility.h>
+#include "../../test/gtest.h"
+
+using namespace photon;
+
+class EpollET : public testing::Test {
+protected:
+    int fds[2] = {-1, -1};
+    void SetUp() override {
+        GTEST_ASSERT_EQ(0, photon::init(INIT_EVENT_EPOLL | INIT_EVENT_EPOLL_ET, INIT_IO_NONE));
+        GTEST_ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds));
+    }
+    void TearDown() override {
+        for (auto fd : fds) {
+            get_vcpu()->master_event_engine->wait_for_fd(fd, 0, -1UL);
+            close(fd);
+        }
+        photon::fini();
+    }
+    static EventEngineStats stats() {
+        EventEngineStats s;
+        event_engine_stats(&s);
+        return s;
+    }
+    static int wait_again(int fd, uint32_t interest, Timeout timeout) {
+        return get_vcpu()->master_event_engine->wait_for_fd_again(fd, interest, timeout);
+    }
+};
+
+TEST_F(EpollET, readiness_cache) {
+    auto th = thread_enable_join(thread_create11([&] {
+        thread_usleep(10 * 1000);
+        ASSERT_EQ(4, write(fds[1], "ping", 4));
+    }));
+    char buf[16];
+    ASSERT_EQ(-1, read(fds[0], buf, sizeof(buf)));
+    ASSERT_EQ(0, wait_again(fds[0], EVENT_READ, 1000 * 1000));
+    thread_join(th);
+
+    // the edge is cached, so waiting for it again costs no syscall
+    auto s = stats();
+    EXPECT_EQ(0, wait_for_fd_readable(fds[0], 1000 * 1000));
+    auto t = stats();
+    EXPECT_EQ(s.cache_hits + 1, t.cache_hits);
+    EXPECT_EQ(s.waits, t.waits);
+    EXPECT_EQ(s.ctls, t.ctls);
+
+    // consumed by the wait, and no new edge since then
+    EXPECT_EQ(-1, wait_for_fd_readable(fds[0], 10 * 1000));
+    EXPECT_EQ(ETIMEDOUT, errno);
+    EXPECT_EQ(4, read(fds[0], buf, sizeof(buf)));
+
+    // so does writability, which is reported along with the edge
+    EXPECT_EQ(0, wait_for_fd_writable(fds[0], 1000 * 1000));
+    EXPECT_EQ(t.cache_hits + 1, stats().cache_hits);
+    EXPECT_EQ(t.ctls, stats().ctls);
+}
+
+TEST_F(EpollET, unregister) {
+    char buf[16];
+    ASSERT_EQ(-1, read(fds[0], buf, sizeof(buf)));
+    ASSERT_EQ(-1, wait_again(fds[0], EVENT_READ, 1000));
+    ASSERT_EQ(ETIMEDOUT, errno);
+    auto ctls = stats().ctls;
+    ASSERT_EQ(0, get_vcpu()->master_event_engine->wait_for_fd(fds[0], 0, -1UL));
+    EXPECT_EQ(ctls + 1, stats().ctls);
+
+    // it's ONE_SHOT again after removal
+    ASSERT_EQ(4, write(fds[1], "ping", 4));
+    EXPECT_EQ(0, wait_for_fd_readable(fds[0], 1000 * 1000));
+    EXPECT_EQ(ctls + 2, stats().ctls);
+    EXPECT_EQ(4, read(fds[0], buf, sizeof(buf)));
+}
+
+static int echo(void*, net::ISocketStream* s) {
+    char buf[64];
+    while (true) {
+        auto n = s->recv(buf, sizeof(buf));
+        if (n <= 0 || s->write(buf, n) != n) break;
+    }
+    return 0;
+}
+
+TEST_F(EpollET, socket_stream) {
+    auto server = net::new_tcp_socket_server();
+    DEFER(delete server);
+    ASSERT_EQ(0, server->bind_v4localhost());
+    ASSERT_EQ(0, server->listen());
+    server->set_handler({nullptr, &echo});
+    server->start_loop();
+    auto client = net::new_tcp_socket_client();
+    DEFER(delete client);
+
+    const int N = 1000;
+    uint64_t ctls = 0;
+    {
+        auto s = client->connect(server->getsockname());
+        ASSERT_NE(nullptr, s);
+        DEFER(delete s);
+        char buf[64] = "hello";
+        for (int i = 0; i < N; i++) {
+            ASSERT_EQ(64, s->write(buf, 64));
+            ASSERT_EQ(64, s->read(buf, 64));
+        }
+        ctls = stats().ctls;
+    }
+    thread_usleep(10 * 1000);   // for the server to see the close
+    // sockets are registered once, rather than armed per wait
+    LOG_INFO(VALUE(ctls));
+    EXPECT_LT(ctls, 16);
+}
+
+// closed by another vCPU, e.g. after a work stealing, before its number is reused
+TEST_F(EpollET, closed_on_other_vcpu) {
+    auto server = net::new_tcp_socket_server();
+    DEFER(delete server);
+    ASSERT_EQ(0, server->bind_v4localhost());
+    ASSERT_EQ(0, server->listen());
+    server->set_handler({nullptr, &echo});
+    server->start_loop();
+    auto client = net::new_tcp_socket_client();
+    DEFER(delete client);
+    auto s = client->connect(server->getsockname());
+    ASSERT_NE(nullptr, s);
+    int fd = (int)(uint64_t)s->get_underlay_object();
+    char buf[16];
+    s->timeout(1000);
+    ASSERT_EQ(-1, s->recv(buf, sizeof(buf)));   // registered here
+    std::thread([&] {
+        photon::init(INIT_EVENT_EPOLL | INIT_EVENT_EPOLL_ET, INIT_IO_NONE);
+        DEFER(photon::fini());
+        delete s;
+    }).join();
+
+    int reused[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, reused));
+    DEFER(for (auto x : reused) {
+        get_vcpu()->master_event_engine->wait_for_fd(x, 0, -1UL);
+        close(x);
+    });
+    LOG_INFO(VALUE(fd), VALUE(reused[0]));
+    ASSERT_EQ(4, write(reused[1], "ping", 4));
+    EXPECT_EQ(0, wait_for_fd_readable(reused[0], 1000 * 1000));
+    EXPECT_EQ(4, read(reused[0], buf, sizeof(buf)));
+}
+
+// an AsyncIO polling a registered fd, waiting for an edge, or found ready in the cache
+TEST_F(EpollET, async_poll) {
+    char buf[16];
+    ASSERT_EQ(-1, read(fds[0], buf, sizeof(buf)));
+    ASSERT_EQ(-1, wait_again(fds[0], EVENT_READ, 1000));
+    auto engine = get_vcpu()->master_event_engine;
+    int fired = 0;
+    auto on_done = [&](AsyncIO* io) {
+        EXPECT_EQ(0, io->res);
+        fired++;
+    };
+    AsyncIO rio, wio;
+    rio.fd = wio.fd = fds[0];
+    rio.flags = EVENT_READ;
+    wio.flags = EVENT_WRITE;
+    rio.done = wio.done = on_done;
+    ASSERT_EQ(0, engine->async_io(&rio));
+    thread_usleep(10 * 1000);
+    EXPECT_EQ(0, fired);
+    ASSERT_EQ(4, write(fds[1], "ping", 4));
+    for (int i = 0; i < 100 && fired < 1; i++) thread_usleep(1000);
+    EXPECT_EQ(1, fired);
+
+    // writability came with the edge
+    auto s = stats();
+    ASSERT_EQ(0, engine->async_io(&wio));
+    for (int i = 0; i < 100 && fired < 2; i++) thread_usleep(1000);
+    EXPECT_EQ(2, fired);
+    EXPECT_EQ(s.cache_hits + 1, stats().cache_hits);
+    EXPECT_EQ(s.ctls, stats().ctls);
+
+    // cancelled before an edge
+    ASSERT_EQ(4, read(fds[0], buf, sizeof(buf)));
+    ASSERT_EQ(0, engine->async_io(&rio));
+    ASSERT_EQ(0, engine->async_cancel(&rio));
+    ASSERT_EQ(4, write(fds[1], "ping", 4));
+    thread_usleep(10 * 1000);
+    EXPECT_EQ(2, fired);
+    EXPECT_EQ(0, wait_for_fd_readable(fds[0], 1000 * 1000));
+}
+
+int main(int argc, char** arg) {
+    ::testing::InitGoogleTest(&argc, arg);
+    return RUN_ALL_TESTS();
+}
@@ -27,7 +27,11 @@ limitations under the License.
 #include <sys/sendfile.h>
 #endif
 #include <sys/uio.h>
+#include <vector>
 #include <photon/io/fd-events.h>
+#ifdef PHOTON_URING
+#include <photon/io/iouring-wrapper.h>
+#endif
 #include <photon/net/socket.h>
 #include <photon/thread/thread.h>
 #include <photon/common/alog.h>
@@ -236,6 +240,115 @@ ssize_t sendfile_n(ISocketStream* out_stream,
     return doio_loop(func, BufStep(count));
 }
 
+#ifdef __linux__
+static const size_t SPLICE_PIPE_SIZE = 1024 * 1024;
+
+// empty pipes kept per vCPU, as creating and sizing one for each relay
+// costs more than relaying a small body
+class SplicePipes {
+public:
+    struct Pipe {
+        int fd[2] = {-1, -1};
+        size_t size = 0;
+    };
+    static SplicePipes& get() {
+        thread_local SplicePipes pipes;
+        return pipes;
+    }
+    Pipe take() {
+        Pipe p;
+        if (!m_pipes.empty()) {
+            p = m_pipes.back();
+            m_pipes.pop_back();
+            return p;
+        }
+        if (::pipe2(p.fd, O_NONBLOCK | O_CLOEXEC) < 0)
+            return Pipe();
+        auto size = ::fcntl(p.fd[0], F_SETPIPE_SZ, SPLICE_PIPE_SIZE);
+        p.size = size > 0 ? size : 64 * 1024;
+        return p;
+    }
+    void put(const Pipe& p, bool clean) {
+        if (p.fd[0] < 0) return;
+        if (clean && m_pipes.size() < MAX_PIPES)
+            return m_pipes.push_back(p);
+        ::close(p.fd[0]);
+        ::close(p.fd[1]);
+    }
+    ~SplicePipes() {
+        for (auto& p : m_pipes) {
+            ::close(p.fd[0]);
+            ::close(p.fd[1]);
+        }
+    }
+
+private:
+    static const size_t MAX_PIPES = 16;
+    std::vector<Pipe> m_pipes;
+};
+
+static ssize_t splice_once(int in_fd, int out_fd, size_t count, bool blocking, Timeout timeout) {
+#ifdef PHOTON_URING
+    if (blocking)
+        return photon::iouring_splice(in_fd, -1, out_fd, -1, count, 0, timeout);
+#endif
+    const unsigned flags = SPLICE_F_MOVE | SPLICE_F_NONBLOCK;
+    return DOIO_ONCE(::splice(in_fd, nullptr, out_fd, nullptr, count, flags),
+                     wait_for_fd_readable(in_fd, timeout));
+}
+
+// `more` to come, so the socket may hold a partial segment back
+static ssize_t splice_drain(int in_fd, int out_fd, size_t count, bool more,
+                            bool blocking, Timeout timeout) {
+    const unsigned flags = SPLICE_F_MOVE | SPLICE_F_NONBLOCK | (more ? SPLICE_F_MORE : 0);
+#ifdef PHOTON_URING
+    if (blocking)
+        return photon::iouring_splice(in_fd, -1, out_fd, -1, count, flags & SPLICE_F_MORE, timeout);
+#endif
+    return DOIO_ONCE(::splice(in_fd, nullptr, out_fd, nullptr, count, flags),
+                     wait_for_fd_writable(out_fd, timeout));
+}
+
+ssize_t splice_n(int in_fd, int out_fd, size_t count, Timeout timeout) {
+    bool in_blocking = !(::fcntl(in_fd, F_GETFL) & O_NONBLOCK);
+    bool out_blocking = !(::fcntl(out_fd, F_GETFL) & O_NONBLOCK);
+#ifndef PHOTON_URING
+    if (in_blocking || out_blocking)
+        LOG_ERROR_RETURN(ENOSYS, -1, "splice of blocking sockets is not supported");
+#endif
+    auto pipe = SplicePipes::get().take();
+    if (pipe.fd[0] < 0)
+        LOG_ERRNO_RETURN(0, -1, "failed to create pipe");
+    auto& pipefd = pipe.fd;
+    bool clean = false;     // to be reused only if drained
+    DEFER(SplicePipes::get().put(pipe, clean));
+    size_t chunk = pipe.size;
+    size_t moved = 0;
+    while (moved < count) {
+        ssize_t n = splice_once(in_fd, pipefd[1], std::min(count - moved, chunk),
+                                in_blocking, timeout);
+        if (n == 0)
+            LOG_ERROR_RETURN(ECONNRESET, -1, "socket ` closed after ` of ` bytes", in_fd, moved, count);
+        if (n < 0)
+            LOG_ERRNO_RETURN(0, -1, "failed to splice from socket `", in_fd);
+        for (ssize_t left = n; left > 0;) {
+            ssize_t m = splice_drain(pipefd[0], out_fd, left, moved + n < count,
+                                     out_blocking, timeout);
+            if (m <= 0)
+                LOG_ERRNO_RETURN(0, -1, "failed to splice to socket `", out_fd);
+            left -= m;
+        }
+        moved += n;
+    }
+    clean = true;
+    return moved;
+}
+#else
+ssize_t splice_n(int in_fd, int out_fd, size_t count, Timeout timeout) {
+    LOG_ERROR_RETURN(ENOSYS, -1, "splice is not supported");
+}
+#endif
+
 bool ISocketStream::skip_read(size_t count) {
     static char buf[1024];
     return DOIO_LOOP(read(buf, std::min(count, sizeof(buf))), BufStep(count));
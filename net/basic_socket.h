@@ -72,6 +72,20 @@ ssize_t sendfile_fallback(ISocketStream* out_stream, int in_fd, off_t offset, si
     return sendfile_n(out_stream, in_fd, offset, count, timeout);
 }
 
+// move `count` bytes from socket `in_fd` to socket `out_fd` in kernel, with
+// splice() through a pipe of its own; non-blocking sockets are waited for by
+// the master event engine, and blocking ones (of io_uring) are spliced by it;
+// return `count`, or -1 for failure, with some of the bytes possibly moved
+ssize_t splice_n(int in_fd, int out_fd, size_t count, Timeout timeout = {});
+
+// the fd of `stream` if it is a socket stream of the kernel, or -1 for
+// the others (TLS, rsocket, F-Stack, wrappers of streams, etc.)
+int kernel_socket_fd(ISocketStream* stream);
+
+// whether the handler of `stream` may keep it by returning STREAM_TAKEN,
+// i.e. it has been accepted by a kernel socket server, which honors that
+bool stream_takeable(ISocketStream* stream);
+
 int zerocopy_confirm(int fd, uint32_t num_calls, Timeout timeout = {});
 
 ssize_t sendv(int fd, const struct iovec *iov, int iovcnt, int flag, Timeout timeout = {});
@@ -0,0 +1,365 @@
+/*
+Copyright 2022 The Photon Authors
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "buffered_socket.h"
+
+#include <sys/socket.h>
+#include <string.h>
+#include <vector>
+
+#include <photon/common/alog.h>
+#include <photon/common/timeout.h>
+#include <photon/io/fd-events.h>
+
+#include "basic_socket.h"
+
+namespace photon {
+namespace net {
+
+// ForwardSocketStream is not an IBufferedSocketStream, so the forwarding
+// of names, options and timeout is repeated here
+class BufferedSocketStream : public IBufferedSocketStream {
+public:
+    static constexpr size_t MIN_CAPACITY = 4 * 1024;
+    // an empty buffer of a kernel socket is freed after the socket has had
+    // nothing to read for this long
+    static constexpr uint64_t IDLE_RELEASE_US = 10 * 1000;
+
+    ISocketStream* m_underlay;
+    bool m_ownership;
+    char* m_buf = nullptr;
+    size_t m_cap = MIN_CAPACITY;    // power of 2, kept when the buffer is freed
+    size_t m_max;
+    uint64_t m_head = 0, m_tail = 0;
+    int m_fd;                       // -1 for other than kernel sockets
+    bool m_grow = false;            // the last recv filled up the buffer
+    iovec m_view[2];
+
+    BufferedSocketStream(ISocketStream* stream, size_t max_buffer, bool ownership)
+            : m_underlay(stream), m_ownership(ownership) {
+        m_max = MIN_CAPACITY;
+        while (m_max < max_buffer) m_max *= 2;
+        m_fd = kernel_socket_fd(stream);
+    }
+
+    ~BufferedSocketStream() override {
+        free(m_buf);
+        if (m_ownership) delete m_underlay;
+    }
+
+    int getsockname(EndPoint& addr) override {
+        return m_underlay->getsockname(addr);
+    }
+    int getpeername(EndPoint& addr) override {
+        return m_underlay->getpeername(addr);
+    }
+    int getsockname(char* path, size_t count) override {
+        return m_underlay->getsockname(path, count);
+    }
+    int getpeername(char* path, size_t count) override {
+        return m_underlay->getpeername(path, count);
+    }
+    int setsockopt(int level, int option_name, const void* option_value, socklen_t option_len) override {
+        return m_underlay->setsockopt(level, option_name, option_value, option_len);
+    }
+    int getsockopt(int level, int option_name, void* option_value, socklen_t* option_len) override {
+        return m_underlay->getsockopt(level, option_name, option_value, option_len);
+    }
+    uint64_t timeout() const override { return m_underlay->timeout(); }
+    void timeout(uint64_t tm) override { m_underlay->timeout(tm); }
+    Object* get_underlay_object(uint64_t recursion = 0) override {
+        return (recursion == 0) ? m_underlay : m_underlay->get_underlay_object(recursion - 1);
+    }
+
+    size_t buffered() const override {
+        return m_tail - m_head;
+    }
+
+    size_t mask() const {
+        return m_cap - 1;
+    }
+
+    // (re)allocate the buffer with capacity `cap`, moving the buffered
+    // bytes to its beginning
+    int resize(size_t cap) {
+        assert(cap >= buffered());
+        auto buf = (char*)malloc(cap);
+        if (!buf)
+            LOG_ERROR_RETURN(ENOMEM, -1, "failed to allocate read buffer of ` bytes", cap);
+        iovec iov[2];
+        auto n = buffered();
+        auto p = buf;
+        for (int i = 0, cnt = data_iov(iov, n); i < cnt; i++) {
+            memcpy(p, iov[i].iov_base, iov[i].iov_len);
+            p += iov[i].iov_len;
+        }
+        free(m_buf);
+        m_buf = buf;
+        m_cap = cap;
+        m_head = 0;
+        m_tail = n;
+        m_grow = false;
+        return 0;
+    }
+
+    void release() {
+        assert(buffered() == 0);
+        free(m_buf);
+        m_buf = nullptr;
+        m_head = m_tail = 0;
+        if (m_cap > MIN_CAPACITY) m_cap /= 2;
+    }
+
+    // the first `n` buffered bytes, in 1 or 2 iovecs
+    int data_iov(iovec* iov, size_t n) {
+        auto pos = m_head & mask();
+        auto first = std::min(n, m_cap - pos);
+        iov[0] = {m_buf + pos, first};
+        if (n == first) return 1;
+        iov[1] = {m_buf, n - first};
+        return 2;
+    }
+
+    // the free space of the buffer, in 1 or 2 iovecs
+    int space_iov(iovec* iov) {
+        auto space = m_cap - buffered();
+        auto pos = m_tail & mask();
+        auto first = std::min(space, m_cap - pos);
+        iov[0] = {m_buf + pos, first};
+        if (space == first) return 1;
+        iov[1] = {m_buf, space - first};
+        return 2;
+    }
+
+    void advance(size_t n) {
+        m_head += n;
+        if (m_head == m_tail) m_head = m_tail = 0;
+    }
+
+    // copy buffered bytes into iov[], from iov[i] at `off`, moving i and off
+    size_t drain(const iovec* iov, int iovcnt, int& i, size_t& off) {
+        size_t done = 0;
+        while (buffered() && i < iovcnt) {
+            auto pos = m_head & mask();
+            auto n = std::min(std::min(buffered(), m_cap - pos), iov[i].iov_len - off);
+            memcpy((char*)iov[i].iov_base + off, m_buf + pos, n);
+            advance(n);
+            done += n;
+            off += n;
+            if (off == iov[i].iov_len) { i++; off = 0; }
+        }
+        return done;
+    }
+
+    int wait_again(Timeout timeout) {
+        return get_vcpu()->master_event_engine->wait_for_fd_again(m_fd, EVENT_READ, timeout);
+    }
+
+    ssize_t recv_fd(iovec* iov, int iovcnt) {
+        Timeout tmo(m_underlay->timeout());
+        while (true) {
+            struct msghdr msg = {};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = iovcnt;
+            auto ret = ::recvmsg(m_fd, &msg, MSG_DONTWAIT);
+            if (ret >= 0) return ret;
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) return -1;
+            if (buffered() == 0) {
+                auto idle = tmo;
+                idle.timeout_at_most(IDLE_RELEASE_US);
+                if (wait_again(idle) == 0) continue;
+                if (errno != ETIMEDOUT) return -1;
+                if (tmo.expired()) return -1;
+                // nothing to read for a while, give the buffer back until
+                // there is, so that idle connections hold no buffer
+                release();
+                if (wait_again(tmo) < 0) return -1;
+                if (resize(m_cap) < 0) return -1;
+                iovcnt = space_iov(iov);
+                continue;
+            }
+            if (wait_again(tmo) < 0) return -1;
+        }
+    }
+
+    // recv once into the free space of the buffer;
+    // return # of bytes received, 0 for EOF, or -1 for failure
+    ssize_t read_more() {
+        if (!m_buf || (m_grow && m_cap < m_max)) {
+            if (resize(m_buf ? m_cap * 2 : m_cap) < 0) return -1;
+        }
+        iovec iov[2];
+        int iovcnt = space_iov(iov);
+        assert(buffered() < m_cap);
+        auto ret = (m_fd >= 0) ? recv_fd(iov, iovcnt) : m_underlay->recv(iov, iovcnt);
+        if (ret > 0) {
+            m_tail += ret;
+            m_grow = buffered() == m_cap && (size_t)ret >= m_cap / 2;
+        }
+        return ret;
+    }
+
+    // buffer at least `n` bytes, growing the buffer as necessary;
+    // return # of bytes buffered, which is less than `n` only at EOF
+    ssize_t fill(size_t n) {
+        if (n > m_max)
+            LOG_ERROR_RETURN(ENOBUFS, -1, "` bytes exceed the read buffer limit of `", n, m_max);
+        if (n > m_cap) {
+            auto cap = m_cap;
+            while (cap < n) cap *= 2;
+            if (resize(cap) < 0) return -1;
+        }
+        while (buffered() < n) {
+            auto ret = read_more();
+            if (ret < 0) return -1;
+            if (ret == 0) break;
+        }
+        return buffered();
+    }
+
+    ssize_t peek(size_t n, iovector_view* view) override {
+        auto ret = fill(n);
+        if (ret < 0) return -1;
+        view->assign(m_view, ret ? data_iov(m_view, ret) : 0);
+        return ret;
+    }
+
+    ssize_t read_until(std::string_view delim, iovector_view* view, size_t max) override {
+        if (delim.empty())
+            LOG_ERROR_RETURN(EINVAL, -1, "empty delimiter");
+        max = std::min(max, m_max);
+        size_t scanned = 0;
+        while (true) {
+            auto n = buffered();
+            if (n >= delim.size()) {
+                if ((m_head & mask()) + n > m_cap && resize(m_cap) < 0)
+                    return -1;  // wrapped around, make it contiguous
+                auto p = m_buf + (m_head & mask());
+                auto from = scanned > delim.size() ? scanned - delim.size() + 1 : 0;
+                auto q = (const char*)memmem(p + from, n - from, delim.data(), delim.size());
+                if (q) {
+                    size_t len = q - p + delim.size();
+                    if (len > max)
+                        LOG_ERROR_RETURN(ENOBUFS, -1, "delimiter not found in ` bytes", max);
+                    m_view[0] = {p, len};
+                    view->assign(m_view, 1);
+                    return len;
+                }
+                scanned = n;
+            }
+            if (n >= max)
+                LOG_ERROR_RETURN(ENOBUFS, -1, "delimiter not found in ` bytes", max);
+            if (n == m_cap && resize(m_cap * 2) < 0)
+                return -1;
+            auto ret = read_more();
+            if (ret < 0) return -1;
+            if (ret == 0) return 0;
+        }
+    }
+
+    ssize_t consume(size_t n, iovector_view* view) override {
+        auto ret = fill(n);
+        if (ret < 0) return -1;
+        n = std::min(n, (size_t)ret);
+        if (view) view->assign(m_view, n ? data_iov(m_view, n) : 0);
+        advance(n);
+        return n;
+    }
+
+    ssize_t read(void* buf, size_t count) override {
+        iovec iov{buf, count};
+        return readv(&iov, 1);
+    }
+    ssize_t readv(const struct iovec* iov, int iovcnt) override {
+        int i = 0;
+        size_t off = 0, done = drain(iov, iovcnt, i, off);
+        while (i < iovcnt) {
+            size_t rest = 0;
+            for (int j = i; j < iovcnt; j++) rest += iov[j].iov_len;
+            rest -= off;
+            if (rest >= m_cap) {
+                // too large to be worth buffering, read in place
+                std::vector<iovec> v(iov + i, iov + iovcnt);
+                v[0].iov_base = (char*)v[0].iov_base + off;
+                v[0].iov_len -= off;
+                auto ret = m_underlay->readv_mutable(v.data(), v.size());
+                if (ret < 0) return -1;
+                return done + ret;
+            }
+            auto ret = read_more();
+            if (ret < 0) return -1;
+            if (ret == 0) break;
+            done += drain(iov, iovcnt, i, off);
+        }
+        return done;
+    }
+    ssize_t readv_mutable(struct iovec* iov, int iovcnt) override {
+        return readv(iov, iovcnt);
+    }
+    ssize_t recv(void* buf, size_t count, int flags = 0) override {
+        iovec iov{buf, count};
+        return recv(&iov, 1, flags);
+    }
+    ssize_t recv(const struct iovec* iov, int iovcnt, int flags = 0) override {
+        if (!buffered()) {
+            size_t count = 0;
+            for (int j = 0; j < iovcnt; j++) count += iov[j].iov_len;
+            if (count >= m_cap || flags)
+                return m_underlay->recv(iov, iovcnt, flags);
+            auto ret = read_more();
+            if (ret <= 0) return ret;
+        }
+        int i = 0;
+        size_t off = 0;
+        return drain(iov, iovcnt, i, off);
+    }
+
+    int close() override {
+        return m_underlay->close();
+    }
+    int shutdown(ShutdownHow how) override {
+        return m_underlay->shutdown(how);
+    }
+    ssize_t write(const void* buf, size_t count) override {
+        return m_underlay->write(buf, count);
+    }
+    ssize_t writev(const struct iovec* iov, int iovcnt) override {
+        return m_underlay->writev(iov, iovcnt);
+    }
+    ssize_t writev_mutable(struct iovec* iov, int iovcnt) override {
+        return m_underlay->writev_mutable(iov, iovcnt);
+    }
+    ssize_t send(const void* buf, size_t count, int flags = 0) override {
+        return m_underlay->send(buf, count, flags);
+    }
+    ssize_t send(const struct iovec* iov, int iovcnt, int flags = 0) override {
+        return m_underlay->send(iov, iovcnt, flags);
+    }
+    ssize_t sendfile(int in_fd, off_t offset, size_t count) override {
+        return m_underlay->sendfile(in_fd, offset, count);
+    }
+};
+
+extern "C" IBufferedSocketStream* new_buffered_socket_stream(ISocketStream* stream,
+                                    size_t max_buffer, bool ownership) {
+    if (!stream)
+        LOG_ERROR_RETURN(EINVAL, nullptr, "invalid stream");
+    return new BufferedSocketStream(stream, max_buffer, ownership);
+}
+
+}  // namespace net
+}  // namespace photon
@@ -0,0 +1,61 @@
+/*
+Copyright 2022 The Photon Authors
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <photon/net/socket.h>
+#include <photon/common/iovector.h>
+#include <photon/common/string_view.h>
+
+namespace photon {
+namespace net {
+
+// A socket stream that reads ahead into a ring buffer, so that a small
+// message (e.g. a header followed by a short body) costs one recv() rather
+// than one per read(). The buffer starts small, doubles as the peer keeps
+// filling it up to `max_buffer`, and is given back to the allocator when a
+// kernel socket stays idle. Writes go straight to the underlay.
+//
+// The views returned by peek(), read_until() and consume() point into the
+// buffer, and stay valid until the next operation that reads the stream.
+class IBufferedSocketStream : public ISocketStream {
+public:
+    // make sure at least `n` bytes are buffered (0 for no I/O), and return
+    // a view of all the buffered bytes, without consuming them;
+    // return # of bytes buffered, which is less than `n` only at EOF
+    virtual ssize_t peek(size_t n, iovector_view* view) = 0;
+
+    // buffer up to the first occurrence of `delim`, and return a contiguous
+    // view of the bytes up to and including it, without consuming them;
+    // return the length of the view, 0 for EOF before `delim`, or -1 with
+    // errno ENOBUFS if `delim` is not found in the first `max` bytes
+    virtual ssize_t read_until(std::string_view delim, iovector_view* view,
+                               size_t max = SIZE_MAX) = 0;
+
+    // consume `n` bytes, and return a view of them in the buffer, in
+    // 1 or 2 iovecs, so they can be parsed without copying;
+    // return # of bytes consumed, which is less than `n` only at EOF
+    virtual ssize_t consume(size_t n, iovector_view* view = nullptr) = 0;
+
+    // # of bytes buffered, which may be read without I/O
+    virtual size_t buffered() const = 0;
+};
+
+extern "C" IBufferedSocketStream* new_buffered_socket_stream(ISocketStream* stream,
+                        size_t max_buffer = 64 * 1024, bool ownership = false);
+
+}  // namespace net
+}  // namespace photon
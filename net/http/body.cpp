@@ -20,10 +20,15 @@ limitations under the License.
 #include <photon/common/string_view.h>
 #include <photon/fs/filesystem.h>
 #include <photon/net/socket.h>
+#include <photon/net/basic_socket.h>
 #include <photon/common/estring.h>
 #include <photon/common/stream.h>
 #include <tuple>
 #include <utility>
+#include <zlib.h>
+#ifdef PHOTON_ZSTD
+#include <zstd.h>
+#endif
 
 namespace photon {
 namespace net {
@@ -61,12 +66,25 @@ public:
     ~BodyReadStream() {
     }
     virtual int close() override {
+        if (m_partial_body_remain >= m_body_remain) {
+            // the rest of the body has been received along with the header
+            m_partial_body_buf += m_body_remain;
+            m_partial_body_remain -= m_body_remain;
+            m_body_remain = 0;
+            return 0;
+        }
         auto stream_remain = m_body_remain - m_partial_body_remain;
         if (stream_remain > SKIP_LIMIT) return -1;
         if (stream_remain && !m_stream->skip_read(stream_remain)) return -1;
+        m_body_remain = m_partial_body_remain = 0;
         return 0;
     }
 
+    virtual std::string_view overread() const {
+        if (m_partial_body_remain <= m_body_remain) return {};
+        return {m_partial_body_buf + m_body_remain, m_partial_body_remain - m_body_remain};
+    }
+
     virtual ssize_t read(void *buf, size_t count) override {
         ssize_t ret = 0;
         if (count > m_body_remain) count = m_body_remain;
@@ -104,6 +122,30 @@ public:
         return ret;
     }
 
+    ssize_t splice_to(net::ISocketStream *out, int in_fd, int out_fd) {
+        ssize_t ret = 0;
+        auto partial = std::min(m_partial_body_remain, m_body_remain);
+        if (partial > 0) {
+            if (out->write(m_partial_body_buf, partial) != (ssize_t)partial)
+                return -1;
+            m_body_remain -= partial;
+            m_partial_body_remain -= partial;
+            m_partial_body_buf += partial;
+            ret += partial;
+        }
+        if (m_body_remain > 0) {
+            auto n = net::splice_n(in_fd, out_fd, m_body_remain, m_stream->timeout());
+            if (n < 0) {
+                if (errno == ENOSYS) return ret;    // nothing spliced
+                m_body_remain = -1UL;   // position unknown, and not to be reused
+                return -1;
+            }
+            m_body_remain -= n;
+            ret += n;
+        }
+        return ret;
+    }
+
 protected:
     net::ISocketStream *m_stream;
     char* m_partial_body_buf;
@@ -133,11 +175,12 @@ public:
             return true;
         }
         m_finish = true;
-        auto body_remain = pos + p + 4 - m_line_size;
-        if (body_remain > 2) {
-            close();
+        auto end = pos + p + 4;     // of the CRLF after the last chunk
+        if (end < m_line_size) {
+            m_overread = {m_get_line_buf + end, m_line_size - end};
             return true;
         }
+        auto body_remain = end - m_line_size;
         if (body_remain > 0) {
             char tmp_buf[4];
             auto ret = m_stream->read(tmp_buf, body_remain);
@@ -229,10 +272,15 @@ public:
         return ret;
     }
 
+    std::string_view overread() const override {
+        return m_finish ? m_overread : std::string_view();
+    }
+
 protected:
     char *m_get_line_buf;
     size_t m_chunked_remain = 0, m_line_size = 0, m_cursor = 0;
     bool m_finish = false;
+    std::string_view m_overread;    // received beyond the last chunk
 };
 
 
@@ -320,6 +368,326 @@ protected:
 };
 
 
+// buffers of a coding stream, which bound its memory together with the
+// state of the codec (about 128KB for gzip / deflate encoding, 40KB for
+// decoding, and a window of 128KB for zstd encoding)
+static constexpr size_t CODING_BUFFER_SIZE = 16 * 1024;
+static constexpr int ZLIB_WINDOW_BITS = 14, ZLIB_MEM_LEVEL = 7;
+static constexpr int ZSTD_WINDOW_LOG = 17, ZSTD_WINDOW_LOG_MAX = 23;
+
+// the body read from `m_body`, decoded
+class DecodingReadStream : public ROStream {
+public:
+    explicit DecodingReadStream(IStream *body) : m_body(body) {}
+
+    virtual int close() override {
+        return m_body->close();
+    }
+
+    virtual ssize_t read(void *buf, size_t count) override {
+        auto out = (char*)buf;
+        auto out_size = count;
+        // fills up `buf` like the other body streams, unless at the end
+        while (out_size > 0 && !m_finish) {
+            if (m_in_size == 0 && !m_eof) {
+                auto r = m_body->read(m_in, sizeof(m_in));
+                if (r < 0) return r;
+                m_eof = (r == 0);
+                m_empty = m_empty && m_eof;
+                m_in_ptr = m_in;
+                m_in_size = r;
+            }
+            auto in_size = m_in_size, avail = out_size;
+            int ret = decode(m_in_ptr, m_in_size, out, out_size);
+            if (ret < 0)
+                LOG_ERROR_RETURN(EIO, -1, "failed to decode body");
+            m_finish = (ret == 1);
+            if (!m_finish && m_eof && in_size == 0 && out_size == avail) {
+                // e.g. a response to HEAD, or of status 204 / 304
+                if (m_empty) break;
+                LOG_ERROR_RETURN(EIO, -1, "encoded body truncated");
+            }
+        }
+        return count - out_size;
+    }
+
+    virtual ssize_t readv(const struct iovec *iov, int iovcnt) override {
+        ssize_t ret = 0;
+        for (int i = 0; i < iovcnt; i++) {
+            auto r = read(iov[i].iov_base, iov[i].iov_len);
+            if (r < 0) return r;
+            ret += r;
+            if ((size_t)r < iov[i].iov_len) break;
+        }
+        return ret;
+    }
+
+protected:
+    // decode from `in` to `out`, advancing both; return 1 at the end of
+    // the encoded data, 0 for more, or -1 for failure
+    virtual int decode(const char* &in, size_t &in_size, char* &out, size_t &out_size) = 0;
+
+    IStream *m_body;
+    const char *m_in_ptr = nullptr;
+    size_t m_in_size = 0;
+    bool m_eof = false, m_finish = false, m_empty = true;
+    char m_in[CODING_BUFFER_SIZE];
+};
+
+// the body encoded, and written to `m_body`
+class EncodingWriteStream : public WOStream {
+public:
+    explicit EncodingWriteStream(IStream *body) : m_body(body) {}
+
+    // finishes the encoded data
+    virtual int close() override {
+        if (m_finish) return 0;
+        const char *in = nullptr;
+        if (drive(in, 0, true) < 0) return -1;
+        m_finish = true;
+        return 0;
+    }
+
+    virtual ssize_t write(const void *buf, size_t count) override {
+        auto in = (const char*)buf;
+        if (m_finish)
+            LOG_ERROR_RETURN(EIO, -1, "encoded body finished");
+        return (drive(in, count, false) < 0) ? -1 : (ssize_t)count;
+    }
+
+    virtual ssize_t writev(const struct iovec *iov, int iovcnt) override {
+        ssize_t ret = 0;
+        for (int i = 0; i < iovcnt; i++) {
+            if (write(iov[i].iov_base, iov[i].iov_len) < 0) return -1;
+            ret += iov[i].iov_len;
+        }
+        return ret;
+    }
+
+protected:
+    // encode from `in` to `out`, advancing both; return 1 when all of
+    // the encoded data is out if `finish`, 0 for more, or -1 for failure
+    virtual int encode(const char* &in, size_t &in_size, char* &out, size_t &out_size,
+                       bool finish) = 0;
+
+    int drive(const char *in, size_t in_size, bool finish) {
+        while (true) {
+            auto out = m_out + m_out_size;
+            size_t out_size = sizeof(m_out) - m_out_size;
+            int ret = encode(in, in_size, out, out_size, finish);
+            if (ret < 0)
+                LOG_ERROR_RETURN(EIO, -1, "failed to encode body");
+            m_out_size = sizeof(m_out) - out_size;
+            bool done = finish ? (ret == 1) : (in_size == 0);
+            if (m_out_size == sizeof(m_out) || (finish && done)) {
+                if (m_out_size && m_body->write(m_out, m_out_size) != (ssize_t)m_out_size)
+                    LOG_ERRNO_RETURN(0, -1, "failed to write encoded body");
+                m_out_size = 0;
+            }
+            if (done) return 0;
+        }
+    }
+
+    IStream *m_body;
+    size_t m_out_size = 0;
+    bool m_finish = false;
+    char m_out[CODING_BUFFER_SIZE];
+};
+
+class ZlibDecodingStream : public DecodingReadStream {
+public:
+    using DecodingReadStream::DecodingReadStream;
+    ~ZlibDecodingStream() {
+        inflateEnd(&m_zs);
+    }
+    int init(bool deflate) {
+        // "deflate" is meant to be the zlib format, but some servers send
+        // raw deflate data instead, told apart by the header when it comes
+        if (deflate) return 0;
+        m_inited = true;
+        // gzip or zlib format, by the header
+        return (inflateInit2(&m_zs, MAX_WBITS + 32) == Z_OK) ? 0 : -1;
+    }
+
+protected:
+    z_stream m_zs = {};
+    bool m_inited = false;
+
+    // whether `in` begins with a zlib header (RFC 1950), which has a
+    // check sum in its 2nd byte
+    static bool zlib_header(const char* in, size_t in_size) {
+        auto cmf = (uint8_t)in[0];
+        if ((cmf & 0x0f) != Z_DEFLATED || (cmf >> 4) > 7) return false;
+        return in_size < 2 || (cmf * 256 + (uint8_t)in[1]) % 31 == 0;
+    }
+
+    int decode(const char* &in, size_t &in_size, char* &out, size_t &out_size) override {
+        if (!m_inited) {
+            if (in_size == 0) return 0;
+            int bits = zlib_header(in, in_size) ? MAX_WBITS : -MAX_WBITS;
+            if (inflateInit2(&m_zs, bits) != Z_OK)
+                LOG_ERROR_RETURN(0, -1, "inflateInit2() failed");
+            m_inited = true;
+        }
+        m_zs.next_in = (Bytef*)in;
+        m_zs.avail_in = in_size;
+        m_zs.next_out = (Bytef*)out;
+        m_zs.avail_out = std::min(out_size, (size_t)UINT32_MAX);
+        int ret = inflate(&m_zs, Z_NO_FLUSH);
+        in_size -= (const char*)m_zs.next_in - in;
+        in = (const char*)m_zs.next_in;
+        out_size -= (char*)m_zs.next_out - out;
+        out = (char*)m_zs.next_out;
+        if (ret == Z_STREAM_END) return 1;
+        if (ret == Z_OK || ret == Z_BUF_ERROR) return 0;
+        LOG_ERROR_RETURN(0, -1, "inflate() failed: `", m_zs.msg ? m_zs.msg : "");
+    }
+};
+
+class ZlibEncodingStream : public EncodingWriteStream {
+public:
+    using EncodingWriteStream::EncodingWriteStream;
+    ~ZlibEncodingStream() {
+        deflateEnd(&m_zs);
+    }
+    int init(bool gzip, int level) {
+        if (level < 0) level = Z_DEFAULT_COMPRESSION;
+        return (deflateInit2(&m_zs, level, Z_DEFLATED, ZLIB_WINDOW_BITS + (gzip ? 16 : 0),
+                             ZLIB_MEM_LEVEL, Z_DEFAULT_STRATEGY) == Z_OK) ? 0 : -1;
+    }
+
+protected:
+    z_stream m_zs = {};
+
+    int encode(const char* &in, size_t &in_size, char* &out, size_t &out_size,
+               bool finish) override {
+        m_zs.next_in = (Bytef*)in;
+        m_zs.avail_in = std::min(in_size, (size_t)UINT32_MAX);
+        m_zs.next_out = (Bytef*)out;
+        m_zs.avail_out = out_size;
+        int ret = deflate(&m_zs, finish ? Z_FINISH : Z_NO_FLUSH);
+        in_size -= (const char*)m_zs.next_in - in;
+        in = (const char*)m_zs.next_in;
+        out_size -= (char*)m_zs.next_out - out;
+        out = (char*)m_zs.next_out;
+        if (ret == Z_STREAM_END) return 1;
+        if (ret == Z_OK || ret == Z_BUF_ERROR) return 0;
+        LOG_ERROR_RETURN(0, -1, "deflate() failed: `", ret);
+    }
+};
+
+#ifdef PHOTON_ZSTD
+class ZstdDecodingStream : public DecodingReadStream {
+public:
+    using DecodingReadStream::DecodingReadStream;
+    ~ZstdDecodingStream() {
+        ZSTD_freeDStream(m_ds);
+    }
+    int init() {
+        m_ds = ZSTD_createDStream();
+        if (!m_ds) return -1;
+        return ZSTD_isError(ZSTD_DCtx_setParameter(m_ds, ZSTD_d_windowLogMax,
+                                                   ZSTD_WINDOW_LOG_MAX)) ? -1 : 0;
+    }
+
+protected:
+    ZSTD_DStream *m_ds = nullptr;
+
+    int decode(const char* &in, size_t &in_size, char* &out, size_t &out_size) override {
+        ZSTD_inBuffer ib = {in, in_size, 0};
+        ZSTD_outBuffer ob = {out, out_size, 0};
+        auto ret = ZSTD_decompressStream(m_ds, &ob, &ib);
+        if (ZSTD_isError(ret))
+            LOG_ERROR_RETURN(0, -1, "ZSTD_decompressStream() failed: `", ZSTD_getErrorName(ret));
+        in += ib.pos; in_size -= ib.pos;
+        out += ob.pos; out_size -= ob.pos;
+        return (ret == 0) ? 1 : 0;
+    }
+};
+
+class ZstdEncodingStream : public EncodingWriteStream {
+public:
+    using EncodingWriteStream::EncodingWriteStream;
+    ~ZstdEncodingStream() {
+        ZSTD_freeCCtx(m_cs);
+    }
+    int init(int level) {
+        m_cs = ZSTD_createCCtx();
+        if (!m_cs) return -1;
+        if (level >= 0 && ZSTD_isError(ZSTD_CCtx_setParameter(m_cs, ZSTD_c_compressionLevel, level)))
+            return -1;
+        return ZSTD_isError(ZSTD_CCtx_setParameter(m_cs, ZSTD_c_windowLog,
+                                                   ZSTD_WINDOW_LOG)) ? -1 : 0;
+    }
+
+protected:
+    ZSTD_CCtx *m_cs = nullptr;
+
+    int encode(const char* &in, size_t &in_size, char* &out, size_t &out_size,
+               bool finish) override {
+        ZSTD_inBuffer ib = {in, in_size, 0};
+        ZSTD_outBuffer ob = {out, out_size, 0};
+        auto ret = ZSTD_compressStream2(m_cs, &ob, &ib, finish ? ZSTD_e_end : ZSTD_e_continue);
+        if (ZSTD_isError(ret))
+            LOG_ERROR_RETURN(0, -1, "ZSTD_compressStream2() failed: `", ZSTD_getErrorName(ret));
+        in += ib.pos; in_size -= ib.pos;
+        out += ob.pos; out_size -= ob.pos;
+        return (finish && ret == 0) ? 1 : 0;
+    }
+};
+#endif
+
+ContentEncoding content_encoding_of(std::string_view name) {
+    estring_view n(name);
+    if (n.empty() || n.icmp("identity") == 0) return ContentEncoding::IDENTITY;
+    if (n.icmp("gzip") == 0 || n.icmp("x-gzip") == 0) return ContentEncoding::GZIP;
+    if (n.icmp("deflate") == 0) return ContentEncoding::DEFLATE;
+#ifdef PHOTON_ZSTD
+    if (n.icmp("zstd") == 0) return ContentEncoding::ZSTD;
+#endif
+    return ContentEncoding::UNSUPPORTED;
+}
+
+template<typename T, typename...Ts>
+static IStream* new_coding_stream(IStream *body, Ts...xs) {
+    auto s = new T(body);
+    if (s->init(xs...) < 0) {
+        delete s;
+        LOG_ERROR_RETURN(ENOMEM, nullptr, "failed to init codec");
+    }
+    return s;
+}
+
+IStream *new_decoding_read_stream(IStream *body, ContentEncoding encoding) {
+    switch (encoding) {
+        case ContentEncoding::GZIP:
+            return new_coding_stream<ZlibDecodingStream>(body, false);
+        case ContentEncoding::DEFLATE:
+            return new_coding_stream<ZlibDecodingStream>(body, true);
+#ifdef PHOTON_ZSTD
+        case ContentEncoding::ZSTD:
+            return new_coding_stream<ZstdDecodingStream>(body);
+#endif
+        default:
+            LOG_ERROR_RETURN(ENOTSUP, nullptr, "unsupported content encoding");
+    }
+}
+
+IStream *new_encoding_write_stream(IStream *body, ContentEncoding encoding, int level) {
+    switch (encoding) {
+        case ContentEncoding::GZIP:
+            return new_coding_stream<ZlibEncodingStream>(body, true, level);
+        case ContentEncoding::DEFLATE:
+            return new_coding_stream<ZlibEncodingStream>(body, false, level);
+#ifdef PHOTON_ZSTD
+        case ContentEncoding::ZSTD:
+            return new_coding_stream<ZstdEncodingStream>(body, level);
+#endif
+        default:
+            LOG_ERROR_RETURN(ENOTSUP, nullptr, "unsupported content encoding");
+    }
+}
+
 IStream *new_chunked_body_read_stream(net::ISocketStream *stream, std::string_view body) {
     return new ChunkedBodyReadStream(stream, body);
 }
@@ -328,6 +696,14 @@ IStream *new_body_read_stream(net::ISocketStream *stream, std::string_view body,
     return new BodyReadStream(stream, body, body_remain);
 }
 
+ssize_t splice_body(IStream *body, net::ISocketStream *out, int in_fd, int out_fd) {
+    return static_cast<BodyReadStream*>(body)->splice_to(out, in_fd, out_fd);
+}
+
+std::string_view body_overread(IStream *body) {
+    return static_cast<BodyReadStream*>(body)->overread();
+}
+
 IStream *new_body_write_stream(net::ISocketStream *stream, size_t size) {
     return new BodyWriteStream(stream, size);
 }
@@ -17,6 +17,7 @@ limitations under the License.
 
 #pragma once
 
+#include <sys/types.h>
 #include <photon/common/string_view.h>
 
 class IStream;
@@ -32,10 +33,39 @@ class ISocketStream;
 
 namespace http {
 
+enum class ContentEncoding {
+    IDENTITY,
+    GZIP,
+    DEFLATE,
+    ZSTD,           // if built with PHOTON_ENABLE_ZSTD
+    UNSUPPORTED,
+};
+
+ContentEncoding content_encoding_of(std::string_view name);
+
+// decodes `body` (not owned) as it is read
+IStream *new_decoding_read_stream(IStream *body, ContentEncoding encoding);
+
+// encodes the data written to it into `body` (not owned), which is
+// finished by close(); `level` is the compression level, -1 for default
+IStream *new_encoding_write_stream(IStream *body, ContentEncoding encoding, int level = -1);
+
 IStream *new_body_read_stream(ISocketStream *stream, std::string_view body, size_t body_remain);
 
 IStream *new_chunked_body_read_stream(ISocketStream *stream, std::string_view body);
 
+// move the rest of `body`, a stream from new_body_read_stream(), to `out`:
+// the part received along with the header is written, and the rest is
+// spliced in kernel from socket `in_fd` (under the body) to socket `out_fd`
+// (under `out`); return the number of bytes moved, or -1 for failure.
+// If the sockets can not be spliced, it stops after the received part,
+// leaving the rest to be read from `body`
+ssize_t splice_body(IStream *body, ISocketStream *out, int in_fd, int out_fd);
+
+// the bytes received beyond the end of `body`, a stream from
+// new_body_read_stream(), i.e. the beginning of the next pipelined message
+std::string_view body_overread(IStream *body);
+
 IStream *new_chunked_body_write_stream(ISocketStream *stream);
 
 IStream *new_body_write_stream(ISocketStream *stream, size_t size);
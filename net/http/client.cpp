@@ -140,6 +140,7 @@ constexpr static std::bitset<10>
     code_redirect_verb(code3xx(300, 301, 302, 307, 308));
 
 static constexpr size_t kMinimalHeadersSize = 8 * 1024 - 1;
+static constexpr size_t kMaxPipelined = 64;
 
 void Client::set_proxy(std::string_view proxy) {
     m_proxy_url.from_string(proxy);
@@ -208,20 +209,34 @@ public:
         return ROUNDTRIP_REDIRECT;
     }
 
+    ISocketStream* dial(Operation* op, Timeout tmo) {
+        if (op->enable_proxy && !op->proxy_url.empty())
+            return get_dialer().dial(op->proxy_url, tmo.timeout());
+        else if (op->enable_proxy && !m_proxy_url.empty())
+            return get_dialer().dial(m_proxy_url, tmo.timeout());
+        else if (!op->uds_path.empty())
+            return get_dialer().dial(op->uds_path, tmo.timeout());
+        else
+            return get_dialer().dial(op->req, tmo.timeout());
+    }
+
+    void reset_response(Operation* op, ISocketStream* s, bool stream_ownership) {
+        auto space = op->req.get_remain_space();
+        if (space.second > kMinimalHeadersSize) {
+            op->resp.reset(space.first, space.second, false, s, stream_ownership, op->req.verb());
+        } else {
+            auto buf = malloc(kMinimalHeadersSize);
+            op->resp.reset((char *)buf, kMinimalHeadersSize, true, s, stream_ownership, op->req.verb());
+        }
+        op->resp.reset_status(HEADER_SENT);
+    }
+
     int do_roundtrip(Operation* op, Timeout tmo) {
         op->status_code = -1;
         if (tmo.timeout() == 0)
             LOG_ERROR_RETURN(ETIMEDOUT, ROUNDTRIP_FAILED, "connection timedout");
         auto &req = op->req;
-        ISocketStream* s;
-        if (op->enable_proxy && !op->proxy_url.empty())
-            s = get_dialer().dial(op->proxy_url, tmo.timeout());
-        else if (op->enable_proxy && !m_proxy_url.empty())
-            s = get_dialer().dial(m_proxy_url, tmo.timeout());
-        else if (!op->uds_path.empty())
-            s = get_dialer().dial(op->uds_path, tmo.timeout());
-        else
-            s = get_dialer().dial(req, tmo.timeout());
+        ISocketStream* s = dial(op, tmo);
         if (!s) {
             if (errno == ECONNREFUSED || errno == ENOENT) {
                 LOG_ERROR_RETURN(0, ROUNDTRIP_FAST_RETRY, "connection refused")
@@ -267,16 +282,8 @@ public:
         }
 
         LOG_DEBUG("Request sent, wait for response ` `", req.verb(), req.target());
-        auto space = req.get_remain_space();
         auto &resp = op->resp;
-
-        if (space.second > kMinimalHeadersSize) {
-            resp.reset(space.first, space.second, false, sock.release(), true, req.verb());
-        } else {
-            auto buf = malloc(kMinimalHeadersSize);
-            resp.reset((char *)buf, kMinimalHeadersSize, true, sock.release(), true, req.verb());
-        }
-        resp.reset_status(HEADER_SENT);
+        reset_response(op, sock.release(), true);
         if (resp.receive_header(tmo.timeout()) != 0) {
             req.reset_status();
             resp.reset(nullptr, false);
@@ -292,7 +299,7 @@ public:
         return ROUNDTRIP_SUCCESS;
     }
 
-    int call(Operation* /*IN, OUT*/ op) override {
+    int prepare_headers(Operation* op) {
         auto content_length = op->req.headers.content_length();
         auto encoding = op->req.headers["Transfer-Encoding"];
         if ((content_length != 0) && (encoding == "chunked")) {
@@ -304,10 +311,22 @@ public:
         op->req.headers.insert("User-Agent", m_user_agent.empty() ? std::string_view(USERAGENT)
                                                                   : std::string_view(m_user_agent));
         op->req.headers.insert("Connection", "keep-alive");
+        if (op->accept_encoding)
+            op->req.headers.insert("Accept-Encoding", supported_encodings());
         if (op->enable_proxy && !m_proxy_auth.empty())
             op->req.headers.insert("Proxy-Authorization", m_proxy_auth);
         if (m_cookie_jar && m_cookie_jar->set_cookies_to_headers(&op->req) != 0)
             LOG_ERROR_RETURN(0, -1, "set_cookies_to_headers failed");
+        return 0;
+    }
+
+    int call(Operation* /*IN, OUT*/ op) override {
+        if (prepare_headers(op) != 0)
+            return -1;
+        return do_call(op);
+    }
+
+    int do_call(Operation* op) {
         Timeout tmo(std::min(op->timeout.timeout(), m_timeout));
         int retry = 0, followed = 0, ret = 0;
         uint64_t sleep_interval = 0;
@@ -336,9 +355,89 @@ public:
                 LOG_ERRNO_RETURN(0, -1,  "connection failed");
         }
         if (ret != ROUNDTRIP_SUCCESS) LOG_ERROR_RETURN(0, -1,"too many retry, roundtrip failed");
+        if (op->accept_encoding && op->resp.decode_body() < 0)
+            LOG_ERROR_RETURN(0, -1, "failed to decode response body");
         return 0;
     }
 
+    static bool pipelinable(Operation* op, Operation* first) {
+        auto& req = op->req;
+        return (req.verb() == Verb::GET || req.verb() == Verb::HEAD) &&
+               !op->body_buffer_size && !op->body_stream && !op->body_writer &&
+               !req.headers.content_length() && !req.headers.chunked() &&
+               !op->enable_proxy && op->uds_path == first->uds_path &&
+               req.secure() == first->req.secure() && req.port() == first->req.port() &&
+               req.host_no_port() == first->req.host_no_port();
+    }
+
+    // sends the requests of ops[0, n) in a single writev, and receives
+    // the responses in order; return the number of operations done
+    size_t roundtrip_pipelined(Operation** ops, size_t n) {
+        auto first = ops[0];
+        Timeout tmo(std::min(first->timeout.timeout(), m_timeout));
+        SocketStream_ptr sock(dial(first, tmo));
+        if (!sock)
+            LOG_ERRNO_RETURN(0, 0, "failed to connect for pipelined requests");
+        std::vector<struct iovec> iov(n);
+        for (size_t i = 0; i < n; i++) {
+            std::string_view header;
+            if (ops[i]->req.make_header(header) < 0)
+                return 0;
+            iov[i] = {(void*)header.data(), header.size()};
+        }
+        sock->timeout(tmo.timeout());
+        auto total = iovector_view(iov.data(), n).sum();
+        if (sock->writev(iov.data(), n) != (ssize_t)total) {
+            sock->close();
+            LOG_ERRNO_RETURN(0, 0, "failed to send pipelined requests");
+        }
+        for (size_t i = 0; i < n; i++) {
+            auto op = ops[i];
+            auto& resp = op->resp;
+            bool last = (i == n - 1);
+            op->status_code = -1;
+            reset_response(op, last ? sock.release() : sock.get(), last);
+            if ((i > 0 && ops[i - 1]->resp.pass_pipelined(resp) < 0) ||
+                resp.receive_header(tmo.timeout()) != 0 ||
+                (!last && resp.buffer_body() < 0) ||
+                (op->accept_encoding && resp.decode_body() < 0)) {
+                if (!last) sock->close();
+                resp.reset(nullptr, false);
+                LOG_ERROR_RETURN(0, i, "failed to receive pipelined response ", VALUE(i));
+            }
+            op->status_code = resp.status_code();
+            if (m_cookie_jar) m_cookie_jar->get_cookies_from_headers(op->req.host(), &resp);
+            if (last) break;
+            resp.m_stream = nullptr;    // the body is in the buffer
+            if (resp.headers["Connection"] == "close") {
+                sock->close();
+                return i + 1;
+            }
+        }
+        return n;
+    }
+
+    int call_pipelined(Operation** ops, size_t n) override {
+        int ret = 0;
+        std::vector<bool> ready(n);
+        for (size_t i = 0; i < n; i++) {
+            ready[i] = (prepare_headers(ops[i]) == 0);
+            if (!ready[i]) ret = -1;
+        }
+        for (size_t i = 0, k; i < n; i += k) {
+            k = 1;
+            if (!ready[i]) continue;
+            if (pipelinable(ops[i], ops[i]))
+                while (k < kMaxPipelined && i + k < n && ready[i + k] &&
+                       pipelinable(ops[i + k], ops[i])) k++;
+            size_t done = (k > 1) ? roundtrip_pipelined(ops + i, k) : 0;
+            // the rest are called one by one, with redirection and retry
+            for (size_t j = done; j < k; j++)
+                if (do_call(ops[i + j]) < 0) ret = -1;
+        }
+        return ret;
+    }
+
     ISocketStream* native_connect(std::string_view host, uint16_t port, bool secure, uint64_t timeout) override {
         return get_dialer().dial(host, port, secure, timeout);
     }
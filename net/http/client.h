@@ -62,6 +62,8 @@ public:
         Response resp;                            // response
         int status_code = -1;                     // status code in response
         bool enable_proxy = false;
+        bool accept_encoding = false;             // ask for a compressed response body, which
+                                                  // is decoded transparently as it is read
         std::string_view uds_path;                // If set, Unix Domain Socket will be used instead of TCP.
                                                   // URL should still be the format of http://localhost/xxx
 
@@ -157,6 +159,15 @@ public:
     };
 
     virtual int call(Operation* /*IN, OUT*/ op) = 0;
+    // Call the operations with HTTP/1.1 pipelining: consecutive GET / HEAD
+    // requests without body to the same server are sent over one connection
+    // in a single write, and their responses are received in order. The body
+    // of each response but the last one of a batch is received into the
+    // buffer of its operation, so it must have a Content-Length and fit there.
+    // Redirections are not followed in a batch. Operations that can not be
+    // pipelined, or are not done by a failed batch, are called one by one.
+    // Return 0 if all the operations succeeded, or -1 otherwise.
+    virtual int call_pipelined(Operation** ops, size_t n) = 0;
     // get common headers, to manipulate
     virtual Headers* common_headers() = 0;
 
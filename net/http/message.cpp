@@ -15,16 +15,23 @@ limitations under the License.
 */
 
 #include "message.h"
+#include <unistd.h>
 #include <photon/common/utility.h>
 #include <photon/common/alog-stdstring.h>
 #include <photon/common/stream.h>
+#include <photon/common/iovector.h>
 #include <photon/common/timeout.h>
 #include <photon/net/socket.h>
+#include <photon/net/basic_socket.h>
 #include "headers.h"
 #include "url.h"
 #include "parser.h"
 #include "body.h"
 
+#ifndef MSG_MORE
+# define MSG_MORE 0
+#endif
+
 namespace photon {
 namespace net {
 namespace http {
@@ -33,6 +40,7 @@ static ssize_t constexpr MAX_TRANSFER_BYTES = 4 * 1024;
 static ssize_t constexpr RESERVED_INDEX_SIZE = 1024;
 
 Message::~Message() {
+    m_body_codec.reset();
     if (m_stream_ownership && m_stream) {
         if (m_abandon || (m_body_stream && m_body_stream->close() < 0) ) {
             LOG_DEBUG("close sockstream");
@@ -51,7 +59,10 @@ void Message::reset() {
     }
     headers.reset();
     m_buf_size = 0;
+    m_body_codec.reset();
     m_body_stream.reset();
+    m_encoding = (int8_t)ContentEncoding::IDENTITY;
+    m_encoding_level = -1;
     m_stream = nullptr;
     m_stream_ownership = false;
     reset_status();
@@ -59,8 +70,16 @@ void Message::reset() {
 
 int Message::receive_header(uint64_t timeout) {
     auto tmo = Timeout(timeout);
-    int ret = 0;
-    while (1) {
+    int ret = 2;
+    if (m_pipelined) {
+        // received along with the previous message
+        auto size = m_pipelined;
+        m_pipelined = 0;
+        m_buf_size = 0;
+        ret = append_bytes(size);
+        if (ret < 0) return ret;
+    }
+    while (ret == 2) {
         m_stream->timeout(tmo.timeout());
         ret = receive_bytes(m_stream);
         if (ret < 0) {
@@ -69,12 +88,39 @@ int Message::receive_header(uint64_t timeout) {
         }
         if (ret == 1)
             return 1;
-        if (ret != 2)
-            break;
     }
     return prepare_body_read_stream();
 }
 
+int Message::pass_pipelined(Message& next) {
+    if (message_status != HEADER_PARSED || !m_body_stream)
+        return 0;
+    auto rest = body_overread(m_body_stream.get());
+    if (rest.empty())
+        return 0;
+    if (rest.size() >= next.m_buf_capacity)
+        LOG_ERROR_RETURN(ENOBUFS, -1, "no buffer for pipelined message");
+    memmove(next.m_buf, rest.data(), rest.size());
+    next.m_pipelined = rest.size();
+    return rest.size();
+}
+
+int Message::buffer_body() {
+    if (headers.chunked())
+        LOG_ERROR_RETURN(ENOTSUP, -1, "chunked body can not be buffered");
+    auto size = body_size();
+    if (m_body.length() >= size)
+        return 0;
+    auto rest = size - m_body.length();
+    if (rest > headers.space_remain())
+        LOG_ERROR_RETURN(ENOBUFS, -1, "no buffer for body ", VALUE(size));
+    if (m_stream->read(m_buf + m_buf_size, rest) != (ssize_t)rest)
+        LOG_ERRNO_RETURN(0, -1, "failed to receive body");
+    m_buf_size += rest;
+    m_body.length() += rest;
+    return prepare_body_read_stream();
+}
+
 
 int Message::receive_bytes(net::ISocketStream* stream) {
     if (m_buf_capacity - m_buf_size <= MAX_TRANSFER_BYTES + RESERVED_INDEX_SIZE)
@@ -130,9 +176,7 @@ int Message::append_bytes(uint16_t size) {
     return 0;
 }
 
-int Message::send_header(net::ISocketStream* stream) {
-    if (stream != nullptr) m_stream = stream; // update stream if needed
-
+int Message::make_header(std::string_view& header) {
     using SV = std::string_view;
     headers.insert("Connection", m_keep_alive ? SV("keep-alive") :
                                                 SV("close"));
@@ -140,43 +184,87 @@ int Message::send_header(net::ISocketStream* stream) {
         LOG_ERROR_RETURN(ENOBUFS, -1, "no buffer");
 
     memcpy(m_buf + m_buf_size + headers.size(), "\r\n", 2);
-    std::string_view sv = {m_buf, m_buf_size + headers.size() + 2UL};
+    header = {m_buf, m_buf_size + headers.size() + 2UL};
+    return 0;
+}
+
+int Message::send_header(net::ISocketStream* stream, int flags) {
+    if (stream != nullptr) m_stream = stream; // update stream if needed
+
+    std::string_view sv;
+    if (make_header(sv) < 0)
+        return -1;
 
-    ssize_t ret = m_stream->write(sv.data(), sv.size());
-    if (ret < (ssize_t)sv.size())
-        LOG_ERRNO_RETURN(0, -1, "send header failed ");
+    if (flags == 0) {
+        ssize_t ret = m_stream->write(sv.data(), sv.size());
+        if (ret < (ssize_t)sv.size())
+            LOG_ERRNO_RETURN(0, -1, "send header failed ");
+    } else while (!sv.empty()) {
+        ssize_t ret = m_stream->send(sv.data(), sv.size(), flags);
+        if (ret <= 0)
+            LOG_ERRNO_RETURN(0, -1, "send header failed ");
+        sv.remove_prefix(ret);
+    }
     message_status = HEADER_SENT;
     return prepare_body_write_stream();
 }
 
 ssize_t Message::read(void *buf, size_t count) {
-    if (!m_body_stream)
+    if (!body_stream())
         LOG_ERROR_RETURN(EIO, -1, "body not readable");
-    return m_body_stream->read(buf, count);
+    return body_stream()->read(buf, count);
 }
 
 ssize_t Message::readv(const struct iovec *iov, int iovcnt) {
-    if (!m_body_stream)
+    if (!body_stream())
         LOG_ERROR_RETURN(EIO, -1, "body not readable");
-    return m_body_stream->readv(iov, iovcnt);
+    return body_stream()->readv(iov, iovcnt);
 }
 
 ssize_t Message::write(const void *buf, size_t count) {
-    if (message_status < HEADER_SENT && send_header() < 0)
-        return -1;
+    if (message_status < HEADER_SENT) {
+        struct iovec iov = {(void*)buf, count};
+        return write_with_header(&iov, 1);
+    }
     message_status = BODY_SENT;
-    if (!m_body_stream)
+    if (!body_stream())
         LOG_ERROR_RETURN(EIO, -1, "body not writable");
-    return m_body_stream->write(buf, count);
+    return body_stream()->write(buf, count);
 }
 
 ssize_t Message::writev(const struct iovec *iov, int iovcnt) {
-    if (message_status < HEADER_SENT && send_header() < 0)
-        return -1;
+    if (message_status < HEADER_SENT)
+        return write_with_header(iov, iovcnt);
     message_status = BODY_SENT;
-    if (!m_body_stream)
+    if (!body_stream())
         LOG_ERROR_RETURN(EIO, -1, "body not writable");
-    return m_body_stream->writev(iov, iovcnt);
+    return body_stream()->writev(iov, iovcnt);
+}
+
+ssize_t Message::write_with_header(const struct iovec *iov, int iovcnt) {
+    const int MAX_IOV = 16;
+    auto count = iovector_view((struct iovec*)iov, iovcnt).sum();
+    auto size = body_size();
+    if (headers.chunked() || count > size || iovcnt >= MAX_IOV) {
+        // chunk framing and overflow are up to the body stream; the header
+        // goes with MSG_MORE, to be coalesced with the body by the kernel
+        if (send_header(nullptr, MSG_MORE) < 0)
+            return -1;
+        message_status = BODY_SENT;
+        return body_stream()->writev(iov, iovcnt);
+    }
+    std::string_view header;
+    if (make_header(header) < 0)
+        return -1;
+    struct iovec v[MAX_IOV];
+    v[0] = {(void*)header.data(), header.size()};
+    memcpy(&v[1], iov, iovcnt * sizeof(*iov));
+    ssize_t total = header.size() + count;
+    if (m_stream->writev(v, iovcnt + 1) != total)
+        LOG_ERRNO_RETURN(0, -1, "send header and body failed");
+    message_status = BODY_SENT;
+    m_body_stream.reset(new_body_write_stream(m_stream, size - count));
+    return count;
 }
 
 ssize_t Message::write_stream(IStream *input, size_t size_limit) {
@@ -206,6 +294,67 @@ ssize_t Message::write_stream(IStream *input, size_t size_limit) {
     return ret;
 }
 
+ssize_t Message::write_file(int fd, off_t offset, size_t count) {
+    if (message_status < HEADER_SENT && send_header(nullptr, count ? MSG_MORE : 0) < 0)
+        return -1;
+    message_status = BODY_SENT;
+    if (count == 0)
+        return 0;
+    if (!headers.chunked() && !m_body_codec) {
+        ssize_t ret = m_stream->sendfile(fd, offset, count);
+        if (ret >= 0 || errno != ENOSYS) {
+            if (ret != (ssize_t)count)
+                LOG_ERRNO_RETURN(0, -1, "sendfile body failed", VALUE(ret), VALUE(count));
+            return ret;
+        }
+    }
+    // chunked / encoded, or the stream does not implement sendfile
+    const size_t buf_size = 65536;
+    char seg_buf[buf_size + 4096];
+    char *aligned_buf = (char*) (((uint64_t)(&seg_buf[0]) + 4095) / 4096 * 4096);
+    size_t ret = 0;
+    while (ret < count) {
+        size_t n = std::min(count - ret, buf_size);
+        ssize_t rc = ::pread(fd, aligned_buf, n, offset + ret);
+        if (rc <= 0)
+            LOG_ERRNO_RETURN(0, -1, "read file failed", VALUE(fd), VALUE(rc));
+        ssize_t wc = write(aligned_buf, rc);
+        if (wc != rc)
+            LOG_ERRNO_RETURN(0, -1, "send body failed", VALUE(wc), VALUE(rc));
+        ret += wc;
+    }
+    return ret;
+}
+
+// the fd of a kernel socket stream, or of the one wrapped by `s` if `plain`
+static int kernel_fd_of(ISocketStream* s, bool plain) {
+    if (!s) return -1;
+    auto fd = kernel_socket_fd(s);
+    if (fd >= 0) return fd;
+    return plain ? s->get_underlay_fd() : -1;
+}
+
+ssize_t Message::relay_body(Message& src, bool plain_src, bool plain_dst) {
+    int in_fd = -1, out_fd = -1;
+    bool splice = src.m_body_stream && !src.m_body_codec && !m_encoding &&
+                  !src.headers.chunked() && !headers.chunked() &&
+                  src.body_size() == body_size() && body_size() > 0 &&
+                  (in_fd = kernel_fd_of(src.m_stream, plain_src)) >= 0 &&
+                  (out_fd = kernel_fd_of(m_stream, plain_dst)) >= 0;
+    if (!splice)
+        return write_stream(&src);
+    if (message_status < HEADER_SENT && send_header(nullptr, MSG_MORE) < 0)
+        return -1;
+    message_status = BODY_SENT;
+    ssize_t n = splice_body(src.m_body_stream.get(), m_stream, in_fd, out_fd);
+    if (n < 0)
+        LOG_ERRNO_RETURN(0, -1, "failed to splice body");
+    // the rest, if the sockets can not be spliced
+    ssize_t rest = write_stream(&src);
+    if (rest < 0) return -1;
+    return n + rest;
+}
+
 int Message::skip_remain() {
     if (m_body_stream && m_body_stream->close() == 0) {
         if (m_stream_ownership)
@@ -219,6 +368,9 @@ int Message::send() {
     if (message_status < HEADER_SENT && send_header() < 0) {
         LOG_ERROR_RETURN(0, -1, "send response header failed");
     }
+    if (m_body_codec && m_body_codec->close() < 0)
+        LOG_ERROR_RETURN(0, -1, "failed to finish encoded body");
+    m_body_codec.reset();
     m_body_stream.reset();
     return 0;
 }
@@ -242,9 +394,100 @@ int Message::prepare_body_write_stream() {
     } else {
         m_body_stream.reset(new_body_write_stream(m_stream, body_size()));
     }
+    if (m_encoding) {
+        m_body_codec.reset(new_encoding_write_stream(m_body_stream.get(),
+                            (ContentEncoding)m_encoding, m_encoding_level));
+        if (!m_body_codec) return -1;
+    }
     return 0;
 }
 
+int Message::encode_body(std::string_view encoding, int level) {
+    if (message_status != INIT)
+        LOG_ERROR_RETURN(EINVAL, -1, "header sent already");
+    auto e = content_encoding_of(encoding);
+    if (e == ContentEncoding::IDENTITY)
+        return 0;
+    if (e == ContentEncoding::UNSUPPORTED)
+        LOG_ERROR_RETURN(ENOTSUP, -1, "unsupported content encoding ", encoding);
+    if (headers.find("Content-Length") != headers.end())
+        LOG_ERROR_RETURN(EINVAL, -1, "encoded body can not have Content-Length");
+    if (!headers.chunked() && headers.insert("Transfer-Encoding", "chunked") < 0)
+        LOG_ERROR_RETURN(ENOBUFS, -1, "no buffer for header");
+    if (headers.insert("Content-Encoding", encoding) < 0)
+        LOG_ERROR_RETURN(0, -1, "failed to set Content-Encoding");
+    m_encoding = (int8_t)e;
+    m_encoding_level = level;
+    return 0;
+}
+
+int Message::decode_body() {
+    if (message_status != HEADER_PARSED || m_body_codec)
+        return 0;
+    auto e = content_encoding_of(headers["Content-Encoding"]);
+    if (e == ContentEncoding::IDENTITY)
+        return 0;
+    if (!m_body_stream)
+        LOG_ERROR_RETURN(EIO, -1, "body not readable");
+    m_body_codec.reset(new_decoding_read_stream(m_body_stream.get(), e));
+    return m_body_codec ? 0 : -1;
+}
+
+// supported encodings, by the order of preference
+static const struct {
+    ContentEncoding encoding;
+    std::string_view name;
+} supported[] = {
+#ifdef PHOTON_ZSTD
+    {ContentEncoding::ZSTD, "zstd"},
+#endif
+    {ContentEncoding::GZIP, "gzip"},
+    {ContentEncoding::DEFLATE, "deflate"},
+};
+
+std::string_view supported_encodings() {
+#ifdef PHOTON_ZSTD
+    return "zstd, gzip, deflate";
+#else
+    return "gzip, deflate";
+#endif
+}
+
+std::string_view select_encoding(std::string_view accept_encoding) {
+    const size_t N = sizeof(supported) / sizeof(supported[0]);
+    // the q-value of each supported encoding in thousandths, -1 if unlisted
+    int q[N], wildcard = -1;
+    for (auto& x : q) x = -1;
+    for (auto item : estring_view(accept_encoding).split(",")) {
+        auto params = estring_view(item).split(";");
+        auto it = params.begin();
+        if (it == params.end()) continue;
+        auto name = estring_view(*it).trim();
+        int qv = 1000;
+        for (++it; it != params.end(); ++it) {
+            auto p = estring_view(*it).trim();
+            if (p.size() > 2 && (p[0] == 'q' || p[0] == 'Q') && p[1] == '=')
+                qv = (int)(atof(std::string(p.substr(2)).c_str()) * 1000);
+        }
+        if (name == "*") {
+            wildcard = qv;
+            continue;
+        }
+        auto e = content_encoding_of(name);
+        for (size_t i = 0; i < N; i++)
+            if (supported[i].encoding == e) q[i] = qv;
+    }
+    int best = -1, best_q = 0;
+    for (size_t i = 0; i < N; i++) {
+        int qv = (q[i] < 0) ? wildcard : q[i];
+        if (qv > best_q) {
+            best = i;
+            best_q = qv;
+        }
+    }
+    return (best < 0) ? std::string_view() : supported[best].name;
+}
+
 ssize_t Message::resource_size() const {
     std::string_view ret;
     auto content_range = headers["Content-Range"];
@@ -326,6 +569,7 @@ int Request::reset(Verb v, std::string_view url, bool enable_proxy) {
     LOG_DEBUG("request reset ", VALUE(u.host()), VALUE(enable_proxy));
 
     Message::reset();
+    m_pipelined = 0;
     make_request_line(v, u, enable_proxy);
     headers.reset(m_buf + m_buf_size, m_buf_capacity - m_buf_size);
 
@@ -63,6 +63,7 @@ public:
         m_buf = (char*)buf;
         m_buf_capacity = buf_capacity;
         m_buf_ownership = buf_ownership;
+        m_pipelined = 0;
     }
     void reset(ISocketStream* s, bool stream_ownership = false) {
         reset();
@@ -90,8 +91,38 @@ public:
     ssize_t write(const void *buf, size_t count) override;
     ssize_t writev(const struct iovec *iov, int iovcnt) override;
     ssize_t write_stream(IStream *stream, size_t size_limit = -1);
+    // write `count` bytes of file `fd` from `offset` as the body, with
+    // ISocketStream::sendfile() if the body is not chunked, so that a
+    // kernel socket sends them without copying to user space; the header
+    // goes with MSG_MORE, to be coalesced with the beginning of the body
+    ssize_t write_file(int fd, off_t offset, size_t count);
+    // write the body of `src`, a received message, as the body of this one;
+    // if neither body is chunked and their sizes agree, the bytes are moved
+    // between the two sockets by splice(), without copying to user space,
+    // otherwise copied by write_stream(). A socket is spliced if the stream
+    // of the message is a kernel socket stream itself, or, if `plain_src` /
+    // `plain_dst`, a wrapper of one that does not transform data (e.g. a
+    // pooled plain connection, not a TLS one).
+    ssize_t relay_body(Message& src, bool plain_src = false, bool plain_dst = false);
     int close() override { return 0; }
 
+    // compress the body with Content-Encoding `encoding` ("gzip", "deflate",
+    // or "zstd" if built with PHOTON_ENABLE_ZSTD) as it is written, at
+    // compression `level` (-1 for default); to be called before anything
+    // is sent, without a Content-Length, as the body goes out chunked
+    int encode_body(std::string_view encoding, int level = -1);
+    // decompress the body by its Content-Encoding as it is read, after
+    // the header is received; no-op for an identity body
+    int decode_body();
+
+    // move the bytes received beyond the body of this message, i.e. the
+    // beginning of the next pipelined one, to the buffer of `next` (may be
+    // this message itself), for its receive_header() to parse before
+    // receiving more. Return the number of bytes moved, or -1 if they do
+    // not fit in the buffer
+    int pass_pipelined(Message& next);
+    uint16_t pipelined() const { return m_pipelined; }
+
     // Release ownership of socket stream and return it (like unique_ptr::release)
     // After this call, the Message no longer owns or references the socket
     net::ISocketStream* steal_socket_stream() {
@@ -122,7 +153,14 @@ protected:
     // return 1 if end of stream
     // return negative if an error occured
     int receive_header(uint64_t timeout = -1UL);
-    int send_header(net::ISocketStream* stream = nullptr);
+    int send_header(net::ISocketStream* stream = nullptr, int flags = 0);
+    // complete the header in the buffer, and point `header` to it
+    int make_header(std::string_view& header);
+    // send the header and the beginning of the body in a single writev
+    ssize_t write_with_header(const struct iovec *iov, int iovcnt);
+    // receive the rest of the body into the buffer, so that the body
+    // is read from memory (e.g. a pipelined response followed by others)
+    int buffer_body();
     // return 0 if whole header recvd
     // return 1 if end of stream
     // return 2 if partial header recvd
@@ -135,6 +173,10 @@ protected:
 
     int skip_remain();
 
+    IStream* body_stream() const {
+        return m_body_codec ? m_body_codec.get() : m_body_stream.get();
+    }
+
     std::string_view partial_body() const {
         return std::string_view{m_buf, m_buf_size} | m_body;
     }
@@ -145,16 +187,29 @@ protected:
     bool m_buf_ownership = false;
     rstring_view16 m_body, m_version;
     std::unique_ptr<IStream> m_body_stream;
+    // encoder / decoder over m_body_stream, for a Content-Encoding
+    std::unique_ptr<IStream> m_body_codec;
     net::ISocketStream* m_stream = nullptr;
     bool m_stream_ownership = false;
     bool m_abandon;
     bool m_keep_alive = true;
     Verb m_verb = Verb::UNKNOWN;
+    // bytes of this message at the beginning of the buffer, received
+    // along with the previous message on the stream
+    uint16_t m_pipelined = 0;
+    int8_t m_encoding = 0, m_encoding_level = -1;
 
     friend class HTTPServerImpl;
     friend class ClientImpl;
 };
 
+// the encoding preferred by the client among those supported, by its
+// Accept-Encoding; empty for identity
+std::string_view select_encoding(std::string_view accept_encoding);
+
+// the value of Accept-Encoding for all the supported encodings
+std::string_view supported_encodings();
+
 class URL;
 
 class Request : public Message {
@@ -20,13 +20,16 @@ limitations under the License.
 #include <vector>
 #include <sys/stat.h>
 #include <photon/net/socket.h>
+#include <photon/net/basic_socket.h>
 #include <photon/common/alog-stdstring.h>
 #include <photon/common/estring.h>
 #include <photon/fs/filesystem.h>
 #include <photon/fs/httpfs/httpfs.h>
 #include <photon/fs/range-split.h>
 #include <photon/common/intrusive_list.h>
+#include <photon/common/metric-meter/histogram.h>
 #include <photon/thread/thread11.h>
+#include <photon/io/fd-events.h>
 #include "url.h"
 #include "client.h"
 #include "message.h"
@@ -42,6 +45,23 @@ namespace photon {
 namespace net {
 namespace http {
 
+// looked up once, so that serving a request only updates per-thread shards
+struct ServerMetrics {
+    Metric::LatencyHistogram* latency;
+    Metric::Counter* connections;
+    ServerMetrics() {
+        auto& r = Metric::default_registry();
+        latency = r.histogram("photon_http_server_request_duration_us", {},
+                              "Time from request header received to response sent");
+        connections = r.gauge("photon_http_server_connections", {},
+                              "Connections being served");
+    }
+    static ServerMetrics& get() {
+        static ServerMetrics m;
+        return m;
+    }
+};
+
 class HTTPServerImpl : public HTTPServer {
 public:
     struct SockItem: public intrusive_list_node<SockItem> {
@@ -65,21 +85,56 @@ public:
         stopping = 2,
     } status = Status::running;
 
+    // an idle connection, waiting in a cascading engine with no thread
+    struct Parked: public intrusive_list_node<Parked> {
+        net::ISocketStream* sock;
+        int fd;
+        uint64_t deadline;
+    };
+
+    // parked connections of a vCPU, and the thread that watches them
+    struct Parking {
+        vcpu_base* vcpu;
+        CascadingEventEngine* engine = nullptr;
+        intrusive_list<Parked> list;
+        photon::thread* loop = nullptr;
+        uint64_t next_expiry = -1UL;
+        bool stopped = false;
+    };
+
+    const static int PARKED = 1;
+
     HandlerRecord m_default_handler = {"", nullptr, false, {this, &HTTPServerImpl::not_found_handler}};
     std::atomic<uint64_t> m_workers{0};
     intrusive_list<SockItem> m_connection_list;
     photon::spinlock m_connection_list_lock;
     std::vector<HandlerRecord> m_handlers;
+    bool m_parking = false;
+    uint64_t m_idle_timeout = -1UL;
+    std::vector<Parking*> m_parkings;
+    photon::spinlock m_parkings_lock;
 
     HTTPServerImpl() {}
     ~HTTPServerImpl() {
         status = Status::stopping;
-        for (const auto& it: m_connection_list) {
-            it->sock->shutdown(ShutdownHow::ReadWrite);
+        {
+            SCOPED_LOCK(m_parkings_lock);
+            for (auto p: m_parkings)
+                if (p->loop) thread_interrupt(p->loop, ECANCELED);
+        }
+        {
+            SCOPED_LOCK(m_connection_list_lock);
+            for (const auto& it: m_connection_list) {
+                it->sock->shutdown(ShutdownHow::ReadWrite);
+            }
         }
         while (m_workers != 0) {
             photon::thread_usleep(50 * 1000);
         }
+        for (auto p: m_parkings) {
+            delete p->engine;
+            delete p;
+        }
         for (const auto& it: m_handlers) {
             if (it.ownership) delete it.obj;
         }
@@ -87,6 +142,12 @@ public:
             delete m_default_handler.obj;
     }
 
+    int set_idle_parking(bool enable, uint64_t idle_timeout) override {
+        m_parking = enable;
+        m_idle_timeout = idle_timeout;
+        return 0;
+    }
+
     int not_found_handler(Request &req, Response &resp, std::string_view) {
         resp.set_result(404);
         resp.headers.content_length(0);
@@ -108,6 +169,17 @@ public:
     int handle_connection(net::ISocketStream* sock) override {
         m_workers++;
         DEFER(m_workers--);
+        auto& metrics = ServerMetrics::get();
+        metrics.connections->inc();
+        if (serve(sock) == PARKED)
+            return ISocketServer::STREAM_TAKEN;
+        metrics.connections->dec();
+        return 0;
+    }
+
+    // serves requests on @sock, until it is closed, or parked while idle
+    int serve(net::ISocketStream* sock) {
+        auto& metrics = ServerMetrics::get();
         SockItem sock_item(sock);
         {
             SCOPED_LOCK(m_connection_list_lock);
@@ -124,6 +196,8 @@ public:
         Response resp(resp_buf, 64*1024-1);
 
         while (status == Status::running) {
+            if (!req.pipelined() && try_park(sock))
+                return PARKED;
             req.reset(sock, false);
 
             auto rec_ret = req.receive_header();
@@ -140,13 +214,16 @@ public:
             resp.reset(sock, false);
             resp.keep_alive(req.keep_alive());
 
-            auto ret = mux_handler(req, resp);
-            if (ret < 0) {
-                LOG_ERROR_RETURN(0, -1, "handler error ",  VALUE(req.verb()), VALUE(req.target()));
-            }
+            {
+                SCOPE_LATENCY(*metrics.latency);
+                auto ret = mux_handler(req, resp);
+                if (ret < 0) {
+                    LOG_ERROR_RETURN(0, -1, "handler error ",  VALUE(req.verb()), VALUE(req.target()));
+                }
 
-            if (resp.send() < 0) {
-                LOG_ERROR_RETURN(0, -1, "failed to send");
+                if (resp.send() < 0) {
+                    LOG_ERROR_RETURN(0, -1, "failed to send");
+                }
             }
 
             if (!resp.keep_alive())
@@ -154,10 +231,126 @@ public:
 
             if (req.skip_remain() < 0)
                 break;
+
+            // the beginning of the next request, if pipelined
+            if (req.pass_pipelined(req) < 0)
+                break;
         }
         return 0;
     }
 
+    Parking* get_parking() {
+        auto vcpu = get_vcpu();
+        SCOPED_LOCK(m_parkings_lock);
+        for (auto p: m_parkings)
+            if (p->vcpu == vcpu) return p->stopped ? nullptr : p;
+        auto engine = new_default_cascading_engine();
+        if (!engine)
+            LOG_ERRNO_RETURN(0, nullptr, "failed to create cascading engine for parking");
+        auto p = new Parking;
+        p->vcpu = vcpu;
+        p->engine = engine;
+        m_parkings.push_back(p);
+        m_workers++;
+        p->loop = thread_create11(&HTTPServerImpl::parking_loop, this, p);
+        return p;
+    }
+
+    // parks @sock if there is no request on it yet; a new thread
+    // serves it later, when the next request arrives
+    bool try_park(net::ISocketStream* sock) {
+        if (!m_parking || !net::stream_takeable(sock)) return false;
+        int fd = net::kernel_socket_fd(sock);
+        if (fd < 0) return false;
+        char c;
+        if (::recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) >= 0 ||
+            (errno != EAGAIN && errno != EWOULDBLOCK))
+            return false;   // data, EOF or error, to be handled right now
+        auto p = get_parking();
+        if (!p) return false;
+        auto timeout = (m_idle_timeout != -1UL) ? m_idle_timeout : sock->timeout();
+        auto parked = new Parked;
+        parked->sock = sock;
+        parked->fd = fd;
+        parked->deadline = sat_add(photon::now, timeout);
+        if (p->engine->add_interest({fd, EVENT_READ, parked}) < 0) {
+            delete parked;
+            LOG_ERRNO_RETURN(0, false, "failed to park connection ", VALUE(fd));
+        }
+        p->list.push_back(parked);
+        if (parked->deadline < p->next_expiry) {
+            p->next_expiry = parked->deadline;
+            thread_interrupt(p->loop, EAGAIN);  // to wait with the new expiry
+        }
+        return true;
+    }
+
+    void unpark(Parking* p, Parked* parked) {
+        p->engine->rm_interest({parked->fd, EVENT_READ, parked});
+        p->list.erase(parked);
+    }
+
+    void close_parked(Parking* p, Parked* parked) {
+        unpark(p, parked);
+        delete parked->sock;
+        delete parked;
+        ServerMetrics::get().connections->dec();
+    }
+
+    void resume(net::ISocketStream* sock) {
+        DEFER(m_workers--);
+        if (serve(sock) == PARKED)
+            return;
+        ServerMetrics::get().connections->dec();
+        delete sock;
+    }
+
+    void parking_loop(Parking* p) {
+        DEFER(m_workers--);
+        // on any exit, no more connections are parked here
+        DEFER({
+            {
+                SCOPED_LOCK(m_parkings_lock);
+                p->stopped = true;
+                p->loop = nullptr;
+            }
+            while (!p->list.empty())
+                close_parked(p, p->list.front());
+        });
+        void* events[64];
+        while (status == Status::running) {
+            auto now = photon::now;
+            if (now >= p->next_expiry) {
+                p->next_expiry = -1UL;
+                std::vector<Parked*> expired;
+                for (auto parked: p->list) {
+                    if (parked->deadline <= now) {
+                        expired.push_back(parked);
+                    } else if (parked->deadline < p->next_expiry) {
+                        p->next_expiry = parked->deadline;
+                    }
+                }
+                for (auto parked: expired) {
+                    LOG_DEBUG("close idle connection ", VALUE(parked->fd));
+                    close_parked(p, parked);
+                }
+            }
+            auto timeout = (p->next_expiry == -1UL) ? -1UL : p->next_expiry - now;
+            auto n = p->engine->wait_for_events(events, LEN(events), timeout);
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EINTR || errno == ECANCELED) continue;
+                LOG_ERRNO_RETURN(0, , "failed to wait for parked connections");
+            }
+            for (ssize_t i = 0; i < n; i++) {
+                auto parked = (Parked*)events[i];
+                unpark(p, parked);
+                m_workers++;
+                thread_create11(&HTTPServerImpl::resume, this, parked->sock);
+                delete parked;
+            }
+        }
+    }
+
     void add_handler(DelegateHTTPHandler handler, std::string_view pattern) override {
         LOG_DEBUG("add handler, pattern=`", pattern);
         if (pattern == "") {
@@ -180,11 +373,24 @@ public:
 };
 
 
+// the real fd behind a local file, or -1
+static int local_fd_of(fs::IFile* file, const struct stat& st) {
+    auto obj = file->get_underlay_object(0);
+    if (!obj) return -1;
+    auto fd = (int)(uint64_t)obj;
+    if ((uint64_t)fd != (uint64_t)obj) return -1;  // not a fd
+    struct stat st_fd;
+    if (::fstat(fd, &st_fd) < 0 || !S_ISREG(st_fd.st_mode)) return -1;
+    if (st_fd.st_dev != st.st_dev || st_fd.st_ino != st.st_ino) return -1;
+    return fd;
+}
+
 class FsHandler : public HTTPHandler {
 public:
     fs::IFileSystem* m_fs;
+    bool m_sendfile;
 
-    FsHandler(fs::IFileSystem* fs): m_fs(fs) {}
+    FsHandler(fs::IFileSystem* fs, bool sendfile): m_fs(fs), m_sendfile(sendfile) {}
 
     void failed_resp(Response &resp, int result = 404) {
         resp.set_result(result);
@@ -246,6 +452,11 @@ public:
         resp.headers.content_length(req_size);
         if (req.verb() == Verb::HEAD)
             return 0;
+        if (m_sendfile) {
+            int fd = local_fd_of(file, buf);
+            if (fd >= 0)
+                return resp.write_file(fd, range.first, req_size) < 0 ? -1 : 0;
+        }
         file->lseek(range.first, SEEK_SET);
         return resp.write_stream(&*file, req_size);
     }
@@ -257,9 +468,21 @@ public:
     Modifier m_modifier;
     Client* m_client;
     bool m_client_ownership;
-    ProxyHandler(Director cb_director, Modifier cb_modifier, Client* client, bool client_ownership):
+    bool m_splice;
+    ProxyHandler(Director cb_director, Modifier cb_modifier, Client* client,
+                 bool client_ownership, bool splice = true):
         m_director(cb_director), m_modifier(cb_modifier),
-        m_client(client), m_client_ownership(client_ownership) {}
+        m_client(client), m_client_ownership(client_ownership), m_splice(splice) {}
+
+    struct RequestBody {
+        Request* src;
+        bool plain_upstream;
+    };
+
+    static ssize_t relay_request_body(void* body, Request* dst) {
+        auto b = (RequestBody*)body;
+        return dst->relay_body(*b->src, false, b->plain_upstream);
+    }
 
     ~ProxyHandler() {
         if (m_client_ownership)
@@ -275,7 +498,13 @@ public:
         ret = m_director(req, op.req);
         if (ret < 0) return ret;
 
-        op.body_stream = &req;
+        // the connection to upstream is a pooled plain one, unless secure
+        bool plain_upstream = !op.req.secure();
+        RequestBody body{&req, plain_upstream};
+        if (m_splice)
+            op.body_writer = {&body, &relay_request_body};
+        else
+            op.body_stream = &req;
         op.follow = 0;
         if (op.call() != 0) {
             resp.set_result(502);
@@ -287,7 +516,10 @@ public:
         ret = m_modifier(op.resp, resp);
         if (ret < 0) return ret;
 
-        resp.write_stream((IStream*)(&op.resp));
+        auto n = m_splice ? resp.relay_body(op.resp, plain_upstream)
+                          : resp.write_stream((IStream*)(&op.resp));
+        if (n < 0)
+            LOG_ERROR_RETURN(0, -1, "failed to relay response body of `", req.target());
 
         return 0;
     }
@@ -383,20 +615,43 @@ public:
 };
 
 
+class MetricsHandler : public HTTPHandler {
+public:
+    Metric::Registry* m_registry;
+    explicit MetricsHandler(Metric::Registry* registry) :
+        m_registry(registry ? registry : &Metric::default_registry()) {}
+
+    int handle_request(Request &req, Response &resp, std::string_view) override {
+        std::string body;
+        m_registry->expose(body);
+        resp.set_result(200);
+        resp.headers.insert("Content-Type", "text/plain; version=0.0.4");
+        resp.headers.content_length(body.size());
+        if (req.verb() == Verb::HEAD)
+            return 0;
+        return (resp.write(body.data(), body.size()) == (ssize_t)body.size()) ? 0 : -1;
+    }
+};
+
+HTTPHandler* new_metrics_handler(Metric::Registry* registry) {
+    return new MetricsHandler(registry);
+}
+
 HTTPServer* new_http_server() {
     return new HTTPServerImpl();
 }
 
-HTTPHandler* new_fs_handler(fs::IFileSystem* fs) {
-    return new FsHandler(fs);
+HTTPHandler* new_fs_handler(fs::IFileSystem* fs, bool sendfile) {
+    return new FsHandler(fs, sendfile);
 }
 
-HTTPHandler* new_proxy_handler(Director cb_director, Modifier cb_modifier, Client* client, bool client_ownership) {
+HTTPHandler* new_proxy_handler(Director cb_director, Modifier cb_modifier, Client* client,
+                               bool client_ownership, bool splice) {
     if (client == nullptr) {
         client = new_http_client();
         client_ownership = true;
     }
-    return new ProxyHandler(cb_director, cb_modifier, client, client_ownership);
+    return new ProxyHandler(cb_director, cb_modifier, client, client_ownership, splice);
 }
 
 HTTPHandler* new_default_forward_proxy_handler(uint64_t timeout) {
@@ -23,6 +23,10 @@ limitations under the License.
 #include <photon/net/socket.h>
 #include <photon/net/http/message.h>
 
+namespace Metric {
+    class Registry;
+}
+
 namespace photon {
 namespace fs {
     class IFileSystem;
@@ -55,6 +59,14 @@ public:
     // if no handler was set, return 404
     virtual void add_handler(DelegateHTTPHandler handler, std::string_view pattern = "") = 0;
     virtual void add_handler(HTTPHandler *handler, bool ownership = false, std::string_view pattern = "") = 0;
+
+    // Connections idle between requests are parked in a cascading event engine,
+    // holding neither a thread nor buffers, until the next request arrives, or
+    // until @idle_timeout (the timeout of the stream, if -1) is reached.
+    // Only the connections of kernel socket servers are parked, as they honor
+    // STREAM_TAKEN; the others (TLS, rsocket, streams passed to
+    // handle_connection() by users, etc.) are served by a thread all along.
+    virtual int set_idle_parking(bool enable, uint64_t idle_timeout = -1UL) = 0;
 };
 
 class Client;
@@ -63,14 +75,21 @@ class Client;
 using Director = Delegate<int, Request&, Request&>;
 using Modifier = Delegate<int, Response&, Response&>;
 
-// handler will ignore @ignore_prefix in target prefix
-HTTPHandler* new_fs_handler(fs::IFileSystem* fs);
+// handler will ignore @ignore_prefix in target prefix;
+// files that have a local fd behind are sent with sendfile(), if @sendfile
+HTTPHandler* new_fs_handler(fs::IFileSystem* fs, bool sendfile = true);
 
+// bodies between plain kernel sockets are relayed by splice(), if @splice
 HTTPHandler* new_proxy_handler(Director cb_Director, Modifier cb_Modifier,
-                               Client* client = nullptr, bool client_ownership = false);
+                               Client* client = nullptr, bool client_ownership = false,
+                               bool splice = true);
 
 HTTPHandler* new_default_forward_proxy_handler(uint64_t timeout = -1);
 
+// serves the metrics of @registry (the default registry if nullptr)
+// in Prometheus text format
+HTTPHandler* new_metrics_handler(Metric::Registry* registry = nullptr);
+
 HTTPServer* new_http_server();
 
 } // namespace http
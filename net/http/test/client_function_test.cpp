@@ -542,6 +542,72 @@ TEST(http_client, partial_body) {
 }
 
 
+// responds `size` bytes for target /`size`, and tells the port of the client
+static int sized_handler(void*, Request& req, Response& resp, std::string_view) {
+    auto size = estring_view(req.target().substr(1)).to_uint64();
+    EndPoint ep;
+    req.get_socket_stream()->getpeername(ep);
+    resp.set_result(200);
+    resp.headers.content_length(size);
+    resp.headers.insert("X-Peer-Port", std::to_string(ep.port));
+    std::string body(size, 0);
+    for (size_t i = 0; i < size; i++) body[i] = 'a' + i % 26;
+    return (resp.write(body.data(), size) == (ssize_t)size) ? 0 : -1;
+}
+
+TEST(http_client, pipelined) {
+    auto tcpserver = new_tcp_socket_server();
+    DEFER(delete tcpserver);
+    tcpserver->bind_v4localhost();
+    tcpserver->listen();
+    auto server = new_http_server();
+    DEFER(delete server);
+    server->add_handler({nullptr, &sized_handler});
+    tcpserver->set_handler(server->get_connection_handler());
+    tcpserver->start_loop();
+
+    auto client = new_http_client();
+    DEFER(delete client);
+    std::vector<size_t> sizes = {10, 0, 20000, 1, 4000, 7, 100000};
+    std::vector<Client::Operation*> ops;
+    for (auto size : sizes) {
+        auto op = client->new_operation(Verb::GET, to_url(tcpserver, "/" + std::to_string(size)));
+        ops.push_back(op);
+    }
+    DEFER(for (auto op : ops) client->destroy_operation(op));
+    // not pipelinable, splitting the batch
+    ops[3]->set_body("x");
+    ops[3]->req.redirect(Verb::POST, to_url(tcpserver, "/1"));
+
+    ASSERT_EQ(0, client->call_pipelined(ops.data(), ops.size()));
+    for (size_t i = 0; i < ops.size(); i++) {
+        auto& resp = ops[i]->resp;
+        EXPECT_EQ(200, ops[i]->status_code);
+        ASSERT_EQ(sizes[i], resp.headers.content_length());
+        std::string body(sizes[i], 0);
+        EXPECT_EQ((ssize_t)sizes[i], resp.read(&body[0], sizes[i]));
+        for (size_t j = 0; j < sizes[i]; j++)
+            if (body[j] != char('a' + j % 26)) { ADD_FAILURE() << "i=" << i << " j=" << j; break; }
+    }
+    auto port = [&](size_t i) { return ops[i]->resp.headers["X-Peer-Port"]; };
+    EXPECT_EQ(port(0), port(1));
+    EXPECT_EQ(port(0), port(2));
+    EXPECT_EQ(port(4), port(5));
+    EXPECT_EQ(port(4), port(6));
+
+    // a response too large for the buffer of a pipelined operation
+    auto big = client->new_operation(Verb::GET, to_url(tcpserver, "/100000"));
+    auto small = client->new_operation(Verb::GET, to_url(tcpserver, "/5"));
+    DEFER({ client->destroy_operation(big); client->destroy_operation(small); });
+    Client::Operation* batch[] = {big, small};
+    ASSERT_EQ(0, client->call_pipelined(batch, 2));
+    EXPECT_EQ(100000UL, big->resp.headers.content_length());
+    EXPECT_EQ(5UL, small->resp.headers.content_length());
+    std::string body(5, 0);
+    EXPECT_EQ(5, small->resp.read(&body[0], 5));
+    EXPECT_EQ("abcde", body);
+}
+
 TEST(http_client, vcpu) {
     system("mkdir -p /tmp/ease_ut/http_test/");
     system("echo \"this is a http_client request body text for socket stream\" > /tmp/ease_ut/http_test/ease-httpclient-gettestfile");
@@ -23,6 +23,7 @@ limitations under the License.
 #include <photon/io/fd-events.h>
 #include <photon/thread/thread11.h>
 #include <photon/common/alog-stdstring.h>
+#include <photon/common/metric-meter/histogram.h>
 #include <photon/fs/localfs.h>
 #include "../../../test/gtest.h"
 #include "../server.h"
@@ -197,6 +198,56 @@ TEST(http_server, fs_handler) {
     test_head_case(client, url, 5, 10, 10);
 }
 
+// a file larger than the socket buffers, by sendfile() and by user space copy
+TEST(http_server, fs_handler_large_file) {
+    const char* dir = "/tmp/ease_ut/http_server/";
+    system((std::string("mkdir -p ") + dir).c_str());
+    std::string content(3 * 1024 * 1024 + 123, 0);
+    for (size_t i = 0; i < content.size(); i++) content[i] = 'a' + (i * 7 + i / 4096) % 26;
+    auto fs = fs::new_localfs_adaptor(dir);
+    DEFER(delete fs);
+    {
+        auto file = fs->open("fs_handler_large", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        ASSERT_NE(nullptr, file);
+        DEFER(delete file);
+        ASSERT_EQ((ssize_t)content.size(), file->write(content.data(), content.size()));
+    }
+    for (bool sendfile : {true, false}) {
+        auto tcpserver = new_tcp_socket_server();
+        tcpserver->bind_v4localhost();
+        tcpserver->listen();
+        DEFER(delete tcpserver);
+        auto server = new_http_server();
+        DEFER(delete server);
+        auto fs_handler = new_fs_handler(fs, sendfile);
+        DEFER(delete fs_handler);
+        server->add_handler(fs_handler);
+        tcpserver->set_handler(server->get_connection_handler());
+        tcpserver->start_loop();
+        auto client = new_http_client();
+        DEFER(delete client);
+        auto url = to_url(tcpserver, "/fs_handler_large");
+        std::pair<off_t, size_t> ranges[] = {
+            {0, content.size()}, {1, 1024 * 1024}, {4095, 2 * 1024 * 1024 + 5},
+            {(off_t)content.size() - 100, 100},
+        };
+        // on the same connection, so that an over- or under-sent body shows up
+        for (auto& r : ranges) {
+            auto op = client->new_operation(Verb::GET, url);
+            DEFER(client->destroy_operation(op));
+            if (r.second != content.size())
+                op->req.headers.range(r.first, r.first + r.second - 1);
+            ASSERT_EQ(0, op->call());
+            EXPECT_EQ(r.second == content.size() ? 200 : 206, op->resp.status_code());
+            ASSERT_EQ(r.second, op->resp.headers.content_length());
+            std::string body(r.second, 0);
+            ASSERT_EQ((ssize_t)r.second, op->resp.read(&body[0], r.second));
+            EXPECT_TRUE(body == content.substr(r.first, r.second));
+        }
+    }
+    fs->unlink("fs_handler_large");
+}
+
 std::string std_data;
 const size_t std_data_size = 64 * 1024;
 constexpr char header_data[] = "HTTP/1.1 200 ok\r\n"
@@ -421,6 +472,65 @@ TEST(http_server, proxy_handler_post_forward) {
 }
 
 
+// responds with the request body, after receiving all of it
+int echo_body_handler(void*, Request &req, Response &resp, std::string_view) {
+    std::string body(req.headers.content_length(), 0);
+    if (req.read(&body[0], body.size()) != (ssize_t)body.size())
+        LOG_ERROR_RETURN(0, -1, "failed to read request body");
+    resp.set_result(200);
+    resp.headers.content_length(body.size());
+    resp.write(body.data(), body.size());
+    return 0;
+}
+
+// bodies larger than the socket buffers, relayed by splice() or copied
+TEST(http_server, proxy_handler_large_body) {
+    auto source_server = new_tcp_socket_server();
+    source_server->bind_v4localhost();
+    source_server->listen();
+    DEFER(delete source_server);
+    auto source_http_server = new_http_server();
+    DEFER(delete source_http_server);
+    source_http_server->add_handler({nullptr, &echo_body_handler});
+    source_server->set_handler(source_http_server->get_connection_handler());
+    source_server->start_loop();
+
+    std::string body(5 * 1024 * 1024 + 7, 0);
+    for (size_t i = 0; i < body.size(); i++) body[i] = 'a' + (i * 13 + i / 1000) % 26;
+    for (bool splice : {true, false}) {
+        auto tcpserver = new_tcp_socket_server();
+        tcpserver->bind_v4localhost();
+        tcpserver->listen();
+        DEFER(delete tcpserver);
+        auto proxy_server = new_http_server();
+        DEFER(delete proxy_server);
+        auto proxy_handler = new_proxy_handler({source_server, &test_director},
+                                               {nullptr, &test_modifier}, nullptr, false, splice);
+        DEFER(delete proxy_handler);
+        proxy_server->add_handler(proxy_handler);
+        tcpserver->set_handler(proxy_server->get_connection_handler());
+        tcpserver->start_loop();
+
+        auto client = new_http_client();
+        DEFER(delete client);
+        for (size_t size : {body.size(), (size_t)100, (size_t)1024 * 1024}) {
+            auto op = client->new_operation(Verb::POST, to_url(tcpserver, "/echo"));
+            DEFER(client->destroy_operation(op));
+            op->req.headers.content_length(size);
+            auto writer = [&](Request *req) -> ssize_t {
+                return req->write(body.data(), size);
+            };
+            op->body_writer = writer;
+            ASSERT_EQ(0, op->call());
+            EXPECT_EQ(200, op->resp.status_code());
+            ASSERT_EQ(size, op->resp.headers.content_length());
+            std::string echo(size, 0);
+            ASSERT_EQ((ssize_t)size, op->resp.read(&echo[0], size));
+            EXPECT_TRUE(echo == body.substr(0, size));
+        }
+    }
+}
+
 TEST(http_server, proxy_handler_failure) {
     //------------------------------------------
     auto client = new_http_client();
@@ -523,6 +633,457 @@ TEST(http_server, mux_handler) {
     EXPECT_EQ(404, op_default->resp.status_code());
 }
 
+TEST(http_server, metrics_handler) {
+    auto tcpserver = new_tcp_socket_server();
+    tcpserver->timeout(1000UL*1000);
+    tcpserver->bind_v4localhost();
+    tcpserver->listen();
+    DEFER(delete tcpserver);
+    auto server = new_http_server();
+    DEFER(delete server);
+    server->add_handler(new_metrics_handler(), true, "/metrics");
+    server->add_handler({nullptr, &idiot_handle});
+    tcpserver->set_handler(server->get_connection_handler());
+    tcpserver->start_loop();
+    Metric::default_registry().counter("test_metrics_handler_total")->add(42);
+    auto client = new_http_client();
+    DEFER(delete client);
+    auto op = client->new_operation(Verb::GET, to_url(tcpserver, "/test"));
+    DEFER(client->destroy_operation(op));
+    op->req.headers.range(0, 9);
+    EXPECT_EQ(0, op->call());
+    EXPECT_EQ(200, op->resp.status_code());
+
+    auto op_metrics = client->new_operation(Verb::GET, to_url(tcpserver, "/metrics"));
+    DEFER(client->destroy_operation(op_metrics));
+    EXPECT_EQ(0, op_metrics->call());
+    EXPECT_EQ(200, op_metrics->resp.status_code());
+    EXPECT_EQ(true, op_metrics->resp.headers["Content-Type"] == "text/plain; version=0.0.4");
+    std::string body;
+    body.resize(op_metrics->resp.headers.content_length());
+    auto ret = op_metrics->resp.read((void*)body.data(), body.size());
+    EXPECT_EQ((ssize_t)body.size(), ret);
+    LOG_INFO(body);
+    EXPECT_NE(std::string::npos, body.find("test_metrics_handler_total 42\n"));
+    EXPECT_NE(std::string::npos, body.find("# TYPE photon_http_server_request_duration_us histogram\n"));
+    EXPECT_NE(std::string::npos, body.find("photon_http_server_connections "));
+    // the request to /test has been recorded
+    auto h = Metric::default_registry().histogram("photon_http_server_request_duration_us");
+    EXPECT_GE(h->count(), 1UL);
+}
+
+// requests sent back to back, before their responses
+TEST(http_server, pipelined_requests) {
+    auto tcpserver = new_tcp_socket_server();
+    tcpserver->bind_v4localhost();
+    tcpserver->listen();
+    DEFER(delete tcpserver);
+    auto server = new_http_server();
+    DEFER(delete server);
+    server->add_handler({nullptr, &echo_body_handler});
+    tcpserver->set_handler(server->get_connection_handler());
+    tcpserver->start_loop();
+
+    auto cli = new_tcp_socket_client();
+    DEFER(delete cli);
+    auto s = cli->connect(tcpserver->getsockname());
+    ASSERT_NE(nullptr, s);
+    DEFER(delete s);
+    std::string reqs, expected;
+    for (int i = 0; i < 100; i++) {
+        auto body = std::string(i * 10, 'a' + i % 26);
+        reqs += "POST /echo HTTP/1.1\r\nHost: localhost\r\nContent-Length: " +
+                std::to_string(body.size()) + "\r\n\r\n" + body;
+        expected += body;
+    }
+    // also split at an arbitrary point
+    ASSERT_EQ(1000, s->write(reqs.data(), 1000));
+    photon::thread_usleep(10 * 1000);
+    ASSERT_EQ((ssize_t)reqs.size() - 1000, s->write(reqs.data() + 1000, reqs.size() - 1000));
+
+    // responses, in order
+    std::string data, bodies;
+    char buf[64 * 1024];
+    for (int i = 0; i < 100; i++) {
+        size_t pos, size = 0;
+        while ((pos = data.find("\r\n\r\n")) == std::string::npos ||
+               data.size() < pos + 4 + (size = estring_view(data.substr(
+                   data.find("Content-Length: ") + 16)).to_uint64())) {
+            auto n = s->recv(buf, sizeof(buf));
+            ASSERT_GT(n, 0) << "i=" << i;
+            data.append(buf, n);
+        }
+        EXPECT_EQ(0UL, data.find("HTTP/1.1 200"));
+        EXPECT_EQ((size_t)i * 10, size);
+        bodies += data.substr(pos + 4, size);
+        data.erase(0, pos + 4 + size);
+    }
+    EXPECT_TRUE(data.empty());
+    EXPECT_TRUE(bodies == expected);
+}
+
+int echo_chunked_handler(void*, Request &req, Response &resp, std::string_view) {
+    std::string body;
+    char buf[4096];
+    ssize_t n;
+    while ((n = req.read(buf, sizeof(buf))) > 0)
+        body.append(buf, n);
+    if (n < 0)
+        LOG_ERROR_RETURN(0, -1, "failed to read request body");
+    resp.set_result(200);
+    resp.headers.content_length(body.size());
+    resp.write(body.data(), body.size());
+    return 0;
+}
+
+// a request sent right after a chunked one, in the same segment
+TEST(http_server, pipelined_after_chunked) {
+    auto tcpserver = new_tcp_socket_server();
+    tcpserver->bind_v4localhost();
+    tcpserver->listen();
+    DEFER(delete tcpserver);
+    auto server = new_http_server();
+    DEFER(delete server);
+    server->add_handler({nullptr, &echo_chunked_handler});
+    tcpserver->set_handler(server->get_connection_handler());
+    tcpserver->start_loop();
+
+    auto cli = new_tcp_socket_client();
+    DEFER(delete cli);
+    auto s = cli->connect(tcpserver->getsockname());
+    ASSERT_NE(nullptr, s);
+    DEFER(delete s);
+    std::string reqs =
+        "POST /echo HTTP/1.1\r\nHost: localhost\r\nTransfer-Encoding: chunked\r\n\r\n"
+        "5\r\nhello\r\n6\r\n world\r\n0\r\n\r\n"
+        "POST /echo HTTP/1.1\r\nHost: localhost\r\nContent-Length: 4\r\n\r\nnext";
+    ASSERT_EQ((ssize_t)reqs.size(), s->write(reqs.data(), reqs.size()));
+
+    const char* expected[] = {"hello world", "next"};
+    std::string data;
+    char buf[4096];
+    for (auto body : expected) {
+        size_t pos, size = 0;
+        while ((pos = data.find("\r\n\r\n")) == std::string::npos ||
+               data.size() < pos + 4 + (size = estring_view(data.substr(
+                   data.find("Content-Length: ") + 16)).to_uint64())) {
+            auto n = s->recv(buf, sizeof(buf));
+            ASSERT_GT(n, 0) << body;
+            data.append(buf, n);
+        }
+        EXPECT_EQ(0UL, data.find("HTTP/1.1 200"));
+        EXPECT_EQ(body, data.substr(pos + 4, size));
+        data.erase(0, pos + 4 + size);
+    }
+    EXPECT_TRUE(data.empty());
+}
+
+// idle keep-alive connections parked without threads, and closed when idle for too long
+TEST(http_server, idle_parking) {
+    auto tcpserver = new_tcp_socket_server();
+    tcpserver->bind_v4localhost();
+    tcpserver->listen();
+    DEFER(delete tcpserver);
+    auto server = new_http_server();
+    DEFER(delete server);
+    ASSERT_EQ(0, server->set_idle_parking(true, 200 * 1000));
+    server->add_handler({nullptr, &echo_body_handler});
+    tcpserver->set_handler(server->get_connection_handler());
+    tcpserver->start_loop();
+    auto connections = Metric::default_registry().gauge("photon_http_server_connections");
+    auto base = connections->val();
+
+    auto cli = new_tcp_socket_client();
+    DEFER(delete cli);
+    const int N = 10;
+    std::vector<ISocketStream*> socks;
+    for (int i = 0; i < N; i++) {
+        auto s = cli->connect(tcpserver->getsockname());
+        ASSERT_NE(nullptr, s);
+        socks.push_back(s);
+    }
+    DEFER(for (auto s : socks) delete s);
+    auto round_trip = [](ISocketStream* s, int i) {
+        auto body = std::to_string(i);
+        auto req = "POST /echo HTTP/1.1\r\nHost: localhost\r\nContent-Length: " +
+                   std::to_string(body.size()) + "\r\n\r\n" + body;
+        ASSERT_EQ((ssize_t)req.size(), s->write(req.data(), req.size()));
+        char buf[4096];
+        std::string resp;
+        while (resp.size() < body.size() || resp.substr(resp.size() - body.size()) != body) {
+            auto n = s->recv(buf, sizeof(buf));
+            ASSERT_GT(n, 0);
+            resp.append(buf, n);
+        }
+        EXPECT_EQ(0UL, resp.find("HTTP/1.1 200"));
+    };
+    for (int j = 0; j < 5; j++) {
+        for (int i = 0; i < N; i++) round_trip(socks[i], i * 100 + j);
+        photon::thread_usleep(20 * 1000);
+        EXPECT_EQ(base + N, connections->val());
+    }
+
+    // the parked connections are closed by the engine after the idle timeout
+    photon::thread_usleep(400 * 1000);
+    EXPECT_EQ(base, connections->val());
+    char c;
+    for (auto s : socks) EXPECT_EQ(0, s->recv(&c, 1));
+}
+
+// a connection handed to handle_connection() by user code, which deletes
+// it afterwards, is not parked even when idle
+TEST(http_server, idle_parking_user_stream) {
+    auto tcpserver = new_tcp_socket_server();
+    tcpserver->bind_v4localhost();
+    tcpserver->listen();
+    DEFER(delete tcpserver);
+    auto server = new_http_server();
+    DEFER(delete server);
+    ASSERT_EQ(0, server->set_idle_parking(true, 200 * 1000));
+    server->add_handler({nullptr, &echo_body_handler});
+
+    auto cli = new_tcp_socket_client();
+    DEFER(delete cli);
+    auto s = cli->connect(tcpserver->getsockname());
+    ASSERT_NE(nullptr, s);
+    DEFER(delete s);
+    int ret = -2;
+    auto th = photon::thread_enable_join(photon::thread_create11([&] {
+        auto conn = tcpserver->accept();
+        ret = server->handle_connection(conn);
+        delete conn;
+    }));
+    for (int i = 0; i < 3; i++) {
+        // idle for a while before each request
+        photon::thread_usleep(20 * 1000);
+        auto req = std::string("POST /echo HTTP/1.1\r\nHost: localhost\r\n"
+                               "Content-Length: 1\r\n\r\n") + char('0' + i);
+        ASSERT_EQ((ssize_t)req.size(), s->write(req.data(), req.size()));
+        char buf[4096];
+        std::string resp;
+        while (resp.empty() || resp.back() != '0' + i) {
+            auto n = s->recv(buf, sizeof(buf));
+            ASSERT_GT(n, 0);
+            resp.append(buf, n);
+        }
+        EXPECT_EQ(0UL, resp.find("HTTP/1.1 200"));
+    }
+    s->shutdown(ShutdownHow::ReadWrite);
+    photon::thread_join(th);
+    EXPECT_EQ(0, ret);     // not STREAM_TAKEN
+}
+
+static std::string compressible_text(size_t size) {
+    std::string text;
+    for (int i = 0; text.size() < size; i++)
+        text += "{\"id\": " + std::to_string(i) + ", \"name\": \"item\", \"ok\": true}\n";
+    text.resize(size);
+    return text;
+}
+
+// decodes the request body, and echoes it in the encoding accepted by the client
+static int encoding_echo_handler(void*, Request &req, Response &resp, std::string_view) {
+    if (req.decode_body() < 0)
+        LOG_ERROR_RETURN(0, -1, "failed to decode request body");
+    std::string body;
+    char buf[4096];
+    ssize_t n;
+    while ((n = req.read(buf, sizeof(buf))) > 0) body.append(buf, n);
+    if (n < 0) LOG_ERROR_RETURN(0, -1, "failed to read request body");
+    resp.set_result(200);
+    auto encoding = select_encoding(req.headers["Accept-Encoding"]);
+    if (encoding.empty()) {
+        resp.headers.content_length(body.size());
+    } else if (resp.encode_body(encoding) < 0) {
+        LOG_ERROR_RETURN(0, -1, "failed to encode response body");
+    }
+    // in small pieces, as produced by a serializer
+    for (size_t i = 0; i < body.size(); i += 1000) {
+        auto size = std::min(body.size() - i, (size_t)1000);
+        if (resp.write(body.data() + i, size) != (ssize_t)size)
+            LOG_ERROR_RETURN(0, -1, "failed to write response body");
+    }
+    return 0;
+}
+
+TEST(http_server, select_encoding) {
+    EXPECT_EQ("", select_encoding(""));
+    EXPECT_EQ("", select_encoding("identity, br"));
+    EXPECT_EQ("gzip", select_encoding("gzip"));
+    EXPECT_EQ("deflate", select_encoding("br, deflate"));
+    EXPECT_EQ("gzip", select_encoding("deflate, gzip;q=1.0"));
+    EXPECT_EQ("deflate", select_encoding("gzip;q=0.5, deflate"));
+    EXPECT_EQ("deflate", select_encoding("gzip; q=0, *"));
+    EXPECT_EQ("", select_encoding("*;q=0"));
+    EXPECT_EQ("gzip", select_encoding("X-GZIP"));
+}
+
+TEST(http_server, content_encoding) {
+    auto tcpserver = new_tcp_socket_server();
+    tcpserver->bind_v4localhost();
+    tcpserver->listen();
+    DEFER(delete tcpserver);
+    auto server = new_http_server();
+    DEFER(delete server);
+    server->add_handler({nullptr, &encoding_echo_handler});
+    tcpserver->set_handler(server->get_connection_handler());
+    tcpserver->start_loop();
+    auto client = new_http_client();
+    DEFER(delete client);
+    auto text = compressible_text(1000 * 1000);
+    auto writer = [&](Request* req) -> ssize_t {
+        return req->write(text.data(), text.size());
+    };
+
+    for (auto request_encoding : {"", "gzip", "deflate"}) {
+        for (bool accept : {false, true}) {
+            auto op = client->new_operation(Verb::POST, to_url(tcpserver, "/echo"));
+            DEFER(client->destroy_operation(op));
+            op->accept_encoding = accept;
+            if (*request_encoding) {
+                ASSERT_EQ(0, op->req.encode_body(request_encoding));
+                op->body_writer = writer;
+            } else {
+                op->set_body(text);
+            }
+            ASSERT_EQ(0, op->call());
+            EXPECT_EQ(200, op->resp.status_code());
+            EXPECT_EQ(accept ? "gzip" : "", op->resp.headers["Content-Encoding"]);
+            std::string body(text.size() + 1, '\0');
+            EXPECT_EQ((ssize_t)text.size(), op->resp.read(&body[0], body.size()));
+            body.resize(text.size());
+            EXPECT_TRUE(body == text);
+        }
+    }
+
+    // a Content-Length conflicts with the encoding
+    auto op = client->new_operation(Verb::POST, to_url(tcpserver, "/echo"));
+    DEFER(client->destroy_operation(op));
+    op->req.headers.content_length(10);
+    EXPECT_EQ(-1, op->req.encode_body("gzip"));
+    EXPECT_EQ(EINVAL, errno);
+    EXPECT_EQ(-1, op->req.encode_body("br"));
+    EXPECT_EQ(ENOTSUP, errno);
+
+    // far fewer bytes on the wire, with bounded chunks
+    auto cli = new_tcp_socket_client();
+    DEFER(delete cli);
+    auto s = cli->connect(tcpserver->getsockname());
+    ASSERT_NE(nullptr, s);
+    DEFER(delete s);
+    auto req = "POST /echo HTTP/1.1\r\nHost: localhost\r\n"
+               "Accept-Encoding: deflate;q=0.5, gzip\r\nContent-Length: " +
+               std::to_string(text.size()) + "\r\n\r\n" + text;
+    ASSERT_EQ((ssize_t)req.size(), s->write(req.data(), req.size()));
+    std::string wire;
+    char buf[64 * 1024];
+    while (wire.size() < 5 || wire.substr(wire.size() - 5) != "0\r\n\r\n") {
+        auto n = s->recv(buf, sizeof(buf));
+        ASSERT_GT(n, 0);
+        wire.append(buf, n);
+    }
+    LOG_INFO("` bytes on the wire for a body of ` bytes", wire.size(), text.size());
+    EXPECT_NE(std::string::npos, wire.find("Content-Encoding: gzip\r\n"));
+    EXPECT_NE(std::string::npos, wire.find("Transfer-Encoding: chunked\r\n"));
+    EXPECT_LT(wire.size(), text.size() / 5);
+}
+
+struct StoredObject {
+    std::string data, encoding;
+};
+
+// serves an object stored already encoded, as it is
+static int stored_object_handler(void* obj_, Request&, Response &resp, std::string_view) {
+    auto obj = (StoredObject*)obj_;
+    resp.set_result(200);
+    resp.headers.insert("Content-Encoding", obj->encoding);
+    resp.headers.content_length(obj->data.size());
+    resp.write(obj->data.data(), obj->data.size());
+    return 0;
+}
+
+// bodies are decoded only for the clients that asked for it
+TEST(http_client, decode_only_if_accepted) {
+    auto tcpserver = new_tcp_socket_server();
+    tcpserver->bind_v4localhost();
+    tcpserver->listen();
+    DEFER(delete tcpserver);
+    auto server = new_http_server();
+    DEFER(delete server);
+    server->add_handler({nullptr, &encoding_echo_handler});
+    tcpserver->set_handler(server->get_connection_handler());
+    tcpserver->start_loop();
+    auto client = new_http_client();
+    DEFER(delete client);
+    auto text = compressible_text(100 * 1000);
+
+    // the body as encoded by the server, with the header set by hand
+    auto fetch_encoded = [&](const char* encoding) {
+        auto op = client->new_operation(Verb::POST, to_url(tcpserver, "/echo"));
+        DEFER(client->destroy_operation(op));
+        op->req.headers.insert("Accept-Encoding", encoding);
+        op->set_body(text);
+        std::string body;
+        EXPECT_EQ(0, op->call());
+        EXPECT_EQ(encoding, op->resp.headers["Content-Encoding"]);
+        char buf[4096];
+        ssize_t n;
+        while ((n = op->resp.read(buf, sizeof(buf))) > 0) body.append(buf, n);
+        EXPECT_EQ(0, n);
+        return body;
+    };
+    auto gzip = fetch_encoded("gzip"), zlib = fetch_encoded("deflate");
+    ASSERT_GT(gzip.size(), 18UL);
+    EXPECT_EQ("\x1f\x8b", gzip.substr(0, 2));
+    EXPECT_LT(zlib.size(), text.size());
+    // without the gzip header and trailer
+    auto raw = gzip.substr(10, gzip.size() - 18);
+
+    StoredObject obj;
+    auto source_server = new_tcp_socket_server();
+    source_server->bind_v4localhost();
+    source_server->listen();
+    DEFER(delete source_server);
+    auto source_http_server = new_http_server();
+    DEFER(delete source_http_server);
+    source_http_server->add_handler({&obj, &stored_object_handler});
+    source_server->set_handler(source_http_server->get_connection_handler());
+    source_server->start_loop();
+
+    auto proxy_tcpserver = new_tcp_socket_server();
+    proxy_tcpserver->bind_v4localhost();
+    proxy_tcpserver->listen();
+    DEFER(delete proxy_tcpserver);
+    auto proxy_server = new_http_server();
+    DEFER(delete proxy_server);
+    auto proxy_handler = new_proxy_handler({source_server, &test_director},
+                                           {nullptr, &test_modifier});
+    DEFER(delete proxy_handler);
+    proxy_server->add_handler(proxy_handler);
+    proxy_tcpserver->set_handler(proxy_server->get_connection_handler());
+    proxy_tcpserver->start_loop();
+
+    for (auto& x : {StoredObject{gzip, "gzip"}, StoredObject{zlib, "deflate"},
+                    StoredObject{raw, "deflate"}}) {
+        obj = x;
+        for (auto server : {source_server, proxy_tcpserver}) {
+            for (bool accept : {false, true}) {
+                auto op = client->new_operation(Verb::GET, to_url(server, "/object"));
+                DEFER(client->destroy_operation(op));
+                op->accept_encoding = accept;
+                ASSERT_EQ(0, op->call());
+                EXPECT_EQ(200, op->resp.status_code());
+                EXPECT_EQ(obj.encoding, op->resp.headers["Content-Encoding"]);
+                auto& expected = accept ? text : obj.data;
+                std::string body(expected.size() + 1, '\0');
+                EXPECT_EQ((ssize_t)expected.size(), op->resp.read(&body[0], body.size()));
+                body.resize(expected.size());
+                EXPECT_TRUE(body == expected) << obj.encoding << " accept=" << accept;
+            }
+        }
+    }
+}
+
 int main(int argc, char** arg) {
     if (photon::init(photon::INIT_EVENT_DEFAULT, photon::INIT_IO_NONE))
         return -1;
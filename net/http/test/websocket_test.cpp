@@ -26,6 +26,8 @@ limitations under the License.
 #include <photon/common/iovector.h>
 #include <cstring>
 #include <atomic>
+#include <chrono>
+#include <vector>
 #include "to_url.h"
 
 using namespace photon;
@@ -483,6 +485,164 @@ TEST(websocket, invalid_upgrade_request) {
     LOG_INFO("WebSocket invalid upgrade request test passed");
 }
 
+// Echo handler with a buffer for large frames
+int ws_large_echo_handler(void*, IWebSocketStream* ws) {
+    std::vector<char> buf(256 * 1024);
+    WebSocketOpcode opcode;
+    while (!ws->is_closed()) {
+        auto len = ws->recv_frame(buf.data(), buf.size(), &opcode);
+        if (len < 0 || opcode == WebSocketOpcode::Close) break;
+        if (opcode == WebSocketOpcode::Binary && ws->send_binary(buf.data(), len) != len)
+            break;
+    }
+    return 0;
+}
+
+// Pushes frames as asked by text commands "push <count> <size> <batch>",
+// where a batch of 1 sends them one by one, and counts the bytes of binary
+// frames received, replied to "count"
+int ws_push_handler(void*, IWebSocketStream* ws) {
+    std::vector<char> buf(2 * 1024 * 1024);
+    WebSocketOpcode opcode;
+    size_t received = 0;
+    while (!ws->is_closed()) {
+        auto len = ws->recv_frame(buf.data(), buf.size(), &opcode);
+        if (len < 0 || opcode == WebSocketOpcode::Close) break;
+        if (opcode == WebSocketOpcode::Binary) {
+            received += len;
+            continue;
+        }
+        if (opcode != WebSocketOpcode::Text) continue;
+        std::string cmd(buf.data(), len);
+        if (cmd == "count") {
+            ws->send_text(std::to_string(received));
+            received = 0;
+            continue;
+        }
+        size_t count, size, batch;
+        if (sscanf(cmd.c_str(), "push %zu %zu %zu", &count, &size, &batch) != 3) break;
+        std::string payload(size, 'p');
+        std::vector<WebSocketFrame> frames(batch, {WebSocketOpcode::Binary, payload.data(), size});
+        for (size_t i = 0; i < count; i += batch) {
+            auto n = std::min(batch, count - i);
+            auto ret = (n == 1) ? ws->send_binary(payload.data(), size)
+                                : ws->send_frames(frames.data(), n);
+            if (ret != (ssize_t)(n * size)) return -1;
+        }
+        ws->send_text("done");
+    }
+    return 0;
+}
+
+static IWebSocketStream* connect_ws(Client* client, ISocketServer* tcpserver) {
+    char url[64];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/ws", tcpserver->getsockname().port);
+    return client->websocket_connect(url, 10000000UL);
+}
+
+TEST(websocket, frame_sizes_and_batches) {
+    auto tcpserver = new_tcp_socket_server();
+    tcpserver->timeout(10000UL * 1000);
+    tcpserver->bind_v4localhost();
+    tcpserver->listen();
+    DEFER(delete tcpserver);
+    auto http_server = new_http_server();
+    DEFER(delete http_server);
+    auto ws_handler = new_websocket_handler({nullptr, &ws_large_echo_handler});
+    http_server->add_handler(ws_handler, true, "/ws");
+    tcpserver->set_handler(http_server->get_connection_handler());
+    tcpserver->start_loop();
+    auto client = new_http_client();
+    DEFER(delete client);
+    auto ws = connect_ws(client, tcpserver);
+    ASSERT_NE(ws, nullptr);
+    DEFER(delete ws);
+
+    std::string data(200 * 1024, 0);
+    for (size_t i = 0; i < data.size(); i++) data[i] = (char)(i * 131 + i / 7);
+    std::vector<char> buf(256 * 1024);
+    WebSocketOpcode opcode;
+
+    // all sizes around the vector widths, masked and sent by the client in
+    // a batch, so that several of them arrive in one recv at the server
+    std::vector<WebSocketFrame> frames;
+    size_t total = 0;
+    for (size_t size = 0; size <= 300; size++) {
+        frames.push_back({WebSocketOpcode::Binary, data.data() + size, size});
+        total += size;
+    }
+    ASSERT_EQ((ssize_t)total, ws->send_frames(frames.data(), frames.size()));
+    for (size_t size = 0; size <= 300; size++) {
+        ASSERT_EQ((ssize_t)size, ws->recv_frame(buf.data(), buf.size(), &opcode)) << "size=" << size;
+        EXPECT_EQ(WebSocketOpcode::Binary, opcode);
+        EXPECT_EQ(0, memcmp(buf.data(), data.data() + size, size)) << "size=" << size;
+    }
+
+    // large frames, from iovecs at odd offsets, across the read-ahead buffer
+    for (size_t size : {1000UL, 8191UL, 8193UL, 16385UL, 65536UL, 200000UL}) {
+        iovec iov[3] = {{&data[0], 3}, {&data[3], size / 3}, {&data[3 + size / 3], size - 3 - size / 3}};
+        ASSERT_EQ((ssize_t)size, ws->send_binary(iovector_view(iov, 3)));
+        ASSERT_EQ((ssize_t)size, ws->recv_frame(buf.data(), buf.size(), &opcode));
+        EXPECT_EQ(0, memcmp(buf.data(), data.data(), size)) << "size=" << size;
+    }
+    ws->close();
+}
+
+TEST(websocket, frames_per_second) {
+    auto tcpserver = new_tcp_socket_server();
+    tcpserver->timeout(30000UL * 1000);
+    tcpserver->bind_v4localhost();
+    tcpserver->listen();
+    DEFER(delete tcpserver);
+    auto http_server = new_http_server();
+    DEFER(delete http_server);
+    auto ws_handler = new_websocket_handler({nullptr, &ws_push_handler});
+    http_server->add_handler(ws_handler, true, "/ws");
+    tcpserver->set_handler(http_server->get_connection_handler());
+    tcpserver->start_loop();
+    auto client = new_http_client();
+    DEFER(delete client);
+    auto ws = connect_ws(client, tcpserver);
+    ASSERT_NE(ws, nullptr);
+    DEFER(delete ws);
+
+    char buf[4096];
+    WebSocketOpcode opcode;
+    const size_t N = 100000, SIZE = 64;
+    for (size_t batch : {1, 64}) {
+        auto cmd = "push " + std::to_string(N) + " " + std::to_string(SIZE) + " " + std::to_string(batch);
+        auto start = std::chrono::steady_clock::now();
+        ASSERT_EQ((ssize_t)cmd.size(), ws->send_text(cmd));
+        size_t frames = 0;
+        while (true) {
+            auto len = ws->recv_frame(buf, sizeof(buf), &opcode);
+            ASSERT_GE(len, 0);
+            if (opcode == WebSocketOpcode::Text) break;
+            ASSERT_EQ((ssize_t)SIZE, len);
+            frames++;
+        }
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - start).count() + 1;
+        EXPECT_EQ(N, frames);
+        LOG_INFO("server push of ` byte frames, batch `: ` frames/s", SIZE, batch, N * 1000000 / us);
+    }
+
+    // masking by the client, in large frames
+    std::string payload(1024 * 1024, 'm');
+    const size_t M = 64;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < M; i++)
+        ASSERT_EQ((ssize_t)payload.size(), ws->send_binary(payload.data(), payload.size()));
+    ASSERT_EQ(5, ws->send_text("count"));
+    auto len = ws->recv_frame(buf, sizeof(buf), &opcode);
+    ASSERT_GT(len, 0);
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start).count() + 1;
+    EXPECT_EQ(std::to_string(M * payload.size()), std::string(buf, len));
+    LOG_INFO("client send of ` MB frames: ` MB/s", payload.size() >> 20, M * payload.size() / us);
+    ws->close();
+}
+
 int main(int argc, char** argv) {
     if (photon::init()) {
         LOG_ERROR("Failed to initialize photon");
@@ -22,6 +22,13 @@ limitations under the License.
 #include <photon/net/utils.h>
 #include <random>
 #include <cstring>
+#include <memory>
+#include <vector>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 
 namespace photon {
 namespace net {
@@ -29,6 +36,12 @@ namespace http {
 
 static constexpr char SHA1_MAGIC[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
 static constexpr size_t MAX_HEADER_SIZE = 14;  // 2 + 8 (extended len) + 4 (mask)
+// read-ahead buffer of a stream, for several small frames per recv()
+static constexpr size_t RECV_BUFFER_SIZE = 16 * 1024;
+// frames sent by a single writev(), 2 iovecs each
+static constexpr size_t MAX_BATCH_FRAMES = 256;
+// masked payloads up to this size are assembled on stack
+static constexpr size_t STACK_SEND_BUFFER_SIZE = 4 * 1024;
 
 // ============================================================================
 // Frame encoding/decoding utilities
@@ -39,6 +52,60 @@ static uint32_t generate_masking_key() {
     return std::uniform_int_distribution<uint32_t>{}(gen);
 }
 
+// Vector kernels: XOR the leading whole vectors of `p` with `mask` repeated,
+// whose first byte goes with p[0]; return the number of bytes processed
+static size_t mask_vector_none(uint8_t*, size_t, uint32_t) {
+    return 0;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("avx2")))
+static size_t mask_vector_avx2(uint8_t* p, size_t len, uint32_t mask) {
+    auto m = _mm256_set1_epi32(mask);
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64) {
+        auto a = _mm256_loadu_si256(reinterpret_cast<__m256i*>(p + i));
+        auto b = _mm256_loadu_si256(reinterpret_cast<__m256i*>(p + i + 32));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(p + i), _mm256_xor_si256(a, m));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(p + i + 32), _mm256_xor_si256(b, m));
+    }
+    if (i + 32 <= len) {
+        auto a = _mm256_loadu_si256(reinterpret_cast<__m256i*>(p + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(p + i), _mm256_xor_si256(a, m));
+        i += 32;
+    }
+    return i;
+}
+#elif defined(__aarch64__)
+static size_t mask_vector_neon(uint8_t* p, size_t len, uint32_t mask) {
+    auto m = vreinterpretq_u8_u32(vdupq_n_u32(mask));
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        auto a = vld1q_u8(p + i);
+        auto b = vld1q_u8(p + i + 16);
+        vst1q_u8(p + i, veorq_u8(a, m));
+        vst1q_u8(p + i + 16, veorq_u8(b, m));
+    }
+    return i;
+}
+#endif
+
+using MaskVector = size_t (*)(uint8_t*, size_t, uint32_t);
+
+static MaskVector select_mask_vector() {
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return &mask_vector_avx2;
+#elif defined(__aarch64__)
+    return &mask_vector_neon;   // NEON is mandatory on aarch64
+#endif
+    return &mask_vector_none;
+}
+
+static const MaskVector mask_vector = select_mask_vector();
+static constexpr size_t MIN_VECTOR_MASK_SIZE = 32;
+
 // Core implementation: apply mask to a buffer with offset, returns new offset
 static size_t apply_mask_impl(void* data, size_t len, uint32_t mask, size_t offset) {
     if (len == 0) return offset;
@@ -47,6 +114,13 @@ static size_t apply_mask_impl(void* data, size_t len, uint32_t mask, size_t offs
     auto* k = reinterpret_cast<uint8_t*>(&mask);
     size_t idx = 0;
 
+    if (len >= MIN_VECTOR_MASK_SIZE) {
+        // vectors are multiples of 4 bytes, keeping the phase of the mask
+        size_t shift = (offset & 3) * 8;
+        uint32_t adjusted_mask = (shift == 0) ? mask : (mask >> shift) | (mask << (32 - shift));
+        idx = mask_vector(p, len, adjusted_mask);
+    }
+
     // Process until 8-byte memory aligned
     while (idx < len && (reinterpret_cast<uintptr_t>(p + idx) & 7) != 0) {
         p[idx] ^= k[(offset + idx) & 3];
@@ -112,36 +186,6 @@ static size_t build_frame_header(uint8_t* buf, WebSocketOpcode opcode,
     return idx;
 }
 
-static ssize_t parse_frame_header(ISocketStream* stream, WebSocketOpcode* opcode,
-                                   bool* masked, uint32_t* mask) {
-    uint8_t hdr[2];
-    if (stream->read(hdr, 2) != 2)
-        LOG_ERROR_RETURN(0, -1, "Failed to read frame header");
-    
-    *opcode = static_cast<WebSocketOpcode>(hdr[0] & 0x0F);
-    *masked = (hdr[1] >> 7) & 1;
-    size_t len = hdr[1] & 0x7F;
-    
-    if (len == 126) {
-        uint8_t ext[2];
-        if (stream->read(ext, 2) != 2)
-            LOG_ERROR_RETURN(0, -1, "Failed to read 16-bit length");
-        len = (ext[0] << 8) | ext[1];
-    } else if (len == 127) {
-        uint8_t ext[8];
-        if (stream->read(ext, 8) != 8)
-            LOG_ERROR_RETURN(0, -1, "Failed to read 64-bit length");
-        len = 0;
-        for (int i = 0; i < 8; i++)
-            len = (len << 8) | ext[i];
-    }
-    
-    if (*masked && stream->read(mask, 4) != 4)
-        LOG_ERROR_RETURN(0, -1, "Failed to read masking key");
-    
-    return len;
-}
-
 // ============================================================================
 // Handshake utilities
 // ============================================================================
@@ -174,6 +218,9 @@ class WebSocketStreamImpl : public IWebSocketStream {
     bool m_is_client;
     bool m_is_closed = false;
     bool m_owns_stream;
+    // read-ahead buffer, the bytes received but not parsed are in [m_rpos, m_rend)
+    std::unique_ptr<uint8_t[]> m_rbuf;
+    size_t m_rpos = 0, m_rend = 0;
 
 public:
     WebSocketStreamImpl(ISocketStream* stream, bool is_client, bool owns_stream)
@@ -196,6 +243,21 @@ public:
         return send_frame_iov(WebSocketOpcode::Binary, iov.iov, iov.iovcnt, timeout);
     }
 
+    ssize_t send_frames(const WebSocketFrame* frames, size_t n, uint64_t timeout) override {
+        if (!m_stream || m_is_closed) return -1;
+        Timeout tmo(timeout);
+        ssize_t total = 0;
+        for (size_t i = 0; i < n; i += MAX_BATCH_FRAMES) {
+            auto k = std::min(n - i, MAX_BATCH_FRAMES);
+            m_stream->timeout(tmo.timeout());
+            auto ret = m_is_client ? send_batch_masked(frames + i, k)
+                                   : send_batch(frames + i, k);
+            if (ret < 0) return -1;
+            total += ret;
+        }
+        return total;
+    }
+
     int ping(std::string_view data, uint64_t timeout) override {
         return send_frame(WebSocketOpcode::Ping, data.data(), data.size(), timeout) >= 0 ? 0 : -1;
     }
@@ -215,7 +277,7 @@ public:
         WebSocketOpcode op;
         bool masked;
         uint32_t mask = 0;
-        ssize_t payload_len = parse_frame_header(m_stream, &op, &masked, &mask);
+        ssize_t payload_len = parse_frame_header(&op, &masked, &mask);
         if (payload_len < 0) return -1;
         if (opcode) *opcode = op;
         
@@ -282,21 +344,30 @@ private:
         ssize_t expected = header_len + payload_len;
         ssize_t nwritten;
         
-        IOVector send_buf;
-        send_buf.push_back(header, header_len);
-        
         if (m_is_client && payload_len > 0) {
-            // Client must mask - copy and mask payload
-            send_buf.push_back(payload_len);
-            auto* masked = static_cast<uint8_t*>(send_buf.back().iov_base);
-            payload.memcpy_to(masked, payload_len);
-            apply_mask(masked, payload_len, mask);
-        } else {
+            // Client must mask - assemble header and masked payload in one buffer
+            uint8_t small[STACK_SEND_BUFFER_SIZE];
+            std::unique_ptr<uint8_t[]> large;
+            auto* buf = small;
+            if ((size_t)expected > sizeof(small))
+                buf = (large.reset(new uint8_t[expected]), large.get());
+            memcpy(buf, header, header_len);
+            payload.memcpy_to(buf + header_len, payload_len);
+            apply_mask(buf + header_len, payload_len, mask);
+            nwritten = m_stream->write(buf, expected);
+        } else if (iovcnt < 64) {
             // Server or empty payload - send directly
+            iovec v[64];
+            v[0] = {header, header_len};
+            memcpy(&v[1], iov, iovcnt * sizeof(*iov));
+            nwritten = m_stream->writev(v, iovcnt + 1);
+        } else {
+            IOVector send_buf;
+            send_buf.push_back(header, header_len);
             for (int i = 0; i < iovcnt; i++)
                 send_buf.push_back(iov[i]);
+            nwritten = m_stream->writev(send_buf.iovec(), send_buf.iovcnt());
         }
-        nwritten = m_stream->writev(send_buf.iovec(), send_buf.iovcnt());
         
         if (nwritten != expected)
             LOG_ERROR_RETURN(0, -1, "Failed to send frame");
@@ -307,6 +378,92 @@ private:
         return payload_len;
     }
 
+    // frames of the server, each with its header in one writev
+    ssize_t send_batch(const WebSocketFrame* frames, size_t n) {
+        uint8_t headers[MAX_BATCH_FRAMES][MAX_HEADER_SIZE];
+        iovec v[MAX_BATCH_FRAMES * 2];
+        ssize_t payload = 0, expected = 0;
+        int cnt = 0;
+        for (size_t i = 0; i < n; i++) {
+            auto len = build_frame_header(headers[i], frames[i].opcode, frames[i].size, false);
+            v[cnt++] = {headers[i], len};
+            if (frames[i].size)
+                v[cnt++] = {const_cast<void*>(frames[i].data), frames[i].size};
+            payload += frames[i].size;
+            expected += len + frames[i].size;
+        }
+        if (m_stream->writev(v, cnt) != expected)
+            LOG_ERROR_RETURN(0, -1, "Failed to send frames");
+        return payload;
+    }
+
+    // frames of the client, assembled with the masked payloads in one buffer
+    ssize_t send_batch_masked(const WebSocketFrame* frames, size_t n) {
+        size_t expected = 0;
+        for (size_t i = 0; i < n; i++)
+            expected += MAX_HEADER_SIZE + frames[i].size;
+        uint8_t small[STACK_SEND_BUFFER_SIZE];
+        std::unique_ptr<uint8_t[]> large;
+        auto* buf = small;
+        if (expected > sizeof(small))
+            buf = (large.reset(new uint8_t[expected]), large.get());
+        ssize_t payload = 0;
+        auto* p = buf;
+        for (size_t i = 0; i < n; i++) {
+            uint32_t mask;
+            p += build_frame_header(p, frames[i].opcode, frames[i].size, true, &mask);
+            memcpy(p, frames[i].data, frames[i].size);
+            apply_mask(p, frames[i].size, mask);
+            p += frames[i].size;
+            payload += frames[i].size;
+        }
+        if (m_stream->write(buf, p - buf) != p - buf)
+            LOG_ERROR_RETURN(0, -1, "Failed to send frames");
+        return payload;
+    }
+
+    // make sure that at least `n` (<= RECV_BUFFER_SIZE) bytes are buffered,
+    // receiving as many as available in the meantime
+    int fill(size_t n) {
+        if (m_rend - m_rpos >= n) return 0;
+        if (!m_rbuf) m_rbuf.reset(new uint8_t[RECV_BUFFER_SIZE]);
+        if (m_rpos + n > RECV_BUFFER_SIZE) {
+            memmove(m_rbuf.get(), m_rbuf.get() + m_rpos, m_rend - m_rpos);
+            m_rend -= m_rpos;
+            m_rpos = 0;
+        }
+        while (m_rend - m_rpos < n) {
+            auto ret = m_stream->recv(m_rbuf.get() + m_rend, RECV_BUFFER_SIZE - m_rend);
+            if (ret <= 0)
+                LOG_ERROR_RETURN(0, -1, "Failed to receive frame: ", ret ? "error" : "peer closed");
+            m_rend += ret;
+        }
+        return 0;
+    }
+
+    ssize_t parse_frame_header(WebSocketOpcode* opcode, bool* masked, uint32_t* mask) {
+        if (fill(2) < 0)
+            LOG_ERROR_RETURN(0, -1, "Failed to read frame header");
+        auto* hdr = m_rbuf.get() + m_rpos;
+        *opcode = static_cast<WebSocketOpcode>(hdr[0] & 0x0F);
+        *masked = (hdr[1] >> 7) & 1;
+        size_t len = hdr[1] & 0x7F;
+        size_t ext = (len == 126) ? 2 : (len == 127) ? 8 : 0;
+        size_t hdr_len = 2 + ext + (*masked ? 4 : 0);
+        if (fill(hdr_len) < 0)
+            LOG_ERROR_RETURN(0, -1, "Failed to read extended frame header");
+        hdr = m_rbuf.get() + m_rpos;
+        if (ext) {
+            len = 0;
+            for (size_t i = 0; i < ext; i++)
+                len = (len << 8) | hdr[2 + i];
+        }
+        if (*masked)
+            memcpy(mask, hdr + 2 + ext, 4);
+        m_rpos += hdr_len;
+        return len;
+    }
+
     ssize_t recv_frame_impl(iovec* iov, int iovcnt, WebSocketOpcode* opcode,
                             uint64_t timeout, bool header_parsed,
                             ssize_t payload_len = 0, bool masked = false, uint32_t mask = 0) {
@@ -317,7 +474,7 @@ private:
         
         WebSocketOpcode op;
         if (!header_parsed) {
-            payload_len = parse_frame_header(m_stream, &op, &masked, &mask);
+            payload_len = parse_frame_header(&op, &masked, &mask);
             if (payload_len < 0) return -1;
         } else {
             op = *opcode;
@@ -339,9 +496,27 @@ private:
     ssize_t read_payload_iov(iovector_view view, size_t len, bool masked, uint32_t mask) {
         // Shrink view to exact length needed
         view.shrink_to(len);
-        
-        if (m_stream->readv(view.iov, view.iovcnt) != static_cast<ssize_t>(len))
-            LOG_ERROR_RETURN(0, -1, "Failed to read payload");
+
+        // small payloads go through the buffer, receiving the following
+        // frames along with them; large ones are read in place
+        size_t buffered = m_rend - m_rpos;
+        if (buffered < len && len <= RECV_BUFFER_SIZE / 2) {
+            if (fill(len) < 0)
+                LOG_ERROR_RETURN(0, -1, "Failed to read payload");
+            buffered = len;
+        }
+        size_t n = std::min(buffered, len);
+        if (n) {
+            view.memcpy_from(m_rbuf.get() + m_rpos, n);
+            m_rpos += n;
+        }
+        if (n < len) {
+            std::vector<iovec> rest(view.iov, view.iov + view.iovcnt);
+            iovector_view rv(rest.data(), rest.size());
+            rv.extract_front(n);
+            if (m_stream->readv(rv.iov, rv.iovcnt) != static_cast<ssize_t>(len - n))
+                LOG_ERROR_RETURN(0, -1, "Failed to read payload");
+        }
         
         if (masked)
             apply_mask_iov(view.iov, view.iovcnt, mask);
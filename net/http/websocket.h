@@ -56,6 +56,15 @@ enum class WebSocketCloseCode : uint16_t {
     TLSHandshake = 1015
 };
 
+/**
+ * @brief A frame to send by IWebSocketStream::send_frames()
+ */
+struct WebSocketFrame {
+    WebSocketOpcode opcode;
+    const void* data;
+    size_t size;
+};
+
 /**
  * @brief WebSocket connection interface for both client and server sides
  */
@@ -87,6 +96,15 @@ public:
      * @return Number of bytes sent, or -1 on error
      */
     virtual ssize_t send_binary(iovector_view iov, uint64_t timeout = -1) = 0;
+
+    /**
+     * @brief Send several frames, with as few writes as possible
+     * @param frames Frames to send, in order
+     * @param n Number of frames
+     * @param timeout Timeout in microseconds (-1 for infinite)
+     * @return Total number of payload bytes sent, or -1 on error
+     */
+    virtual ssize_t send_frames(const WebSocketFrame* frames, size_t n, uint64_t timeout = -1) = 0;
     
     /**
      * @brief Send a ping frame
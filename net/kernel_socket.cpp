@@ -89,6 +89,7 @@ public:
     using ISocketStream::setsockopt;
     using ISocketStream::getsockopt;
     int fd = -1;
+    bool takeable = false;  // by its handler, see stream_takeable()
     explicit KernelSocketStream(int fd) : fd(fd) {}
     ~KernelSocketStream() override {
         if (fd < 0) return;
@@ -141,6 +142,10 @@ public:
     int close() final {
         if (fd < 0) return 0;
         get_vcpu()->master_event_engine->wait_for_fd(fd, 0, -1UL);
+#ifdef __linux__
+        // it may have been waited for on other vCPUs, too
+        forget_registered_fd(fd);
+#endif
         auto ret = ::close(fd);
         fd = -1;
         return ret;
@@ -168,17 +173,22 @@ public:
 protected:
     uint64_t m_timeout = -1;
 
+    // waits after EAGAIN, so that the master engine may serve them from
+    // its readiness cache, see MasterEventEngine::wait_for_fd_again()
+    static int wait_again(int sockfd, uint32_t interest, Timeout timeout) {
+        return get_vcpu()->master_event_engine->wait_for_fd_again(sockfd, interest, timeout);
+    }
     virtual ssize_t do_send(int sockfd, const void* buf, size_t count, int flags, Timeout timeout) {
-        return photon::net::send(sockfd, buf, count, flags, timeout);
+        return DOIO_ONCE(::send(sockfd, buf, count, flags), wait_again(sockfd, EVENT_WRITE, timeout));
     }
     virtual ssize_t do_sendmsg(int sockfd, const struct msghdr* message, int flags, Timeout timeout) {
-        return photon::net::sendmsg(sockfd, message, flags, timeout);
+        return DOIO_ONCE(::sendmsg(sockfd, message, flags), wait_again(sockfd, EVENT_WRITE, timeout));
     }
     virtual ssize_t do_recv(int sockfd, void* buf, size_t count, int flags, Timeout timeout) {
-        return photon::net::recv(sockfd, buf, count, flags, timeout);
+        return DOIO_ONCE(::recv(sockfd, buf, count, flags), wait_again(sockfd, EVENT_READ, timeout));
     }
     virtual ssize_t do_recvmsg(int sockfd, struct msghdr* message, int flags, Timeout timeout) {
-        return photon::net::recvmsg(sockfd, message, flags, timeout);
+        return DOIO_ONCE(::recvmsg(sockfd, message, flags), wait_again(sockfd, EVENT_READ, timeout));
     }
 
     struct tmp_msg_hdr : public ::msghdr {
@@ -451,8 +461,9 @@ protected:
     }
 
     static void handler(Handler m_handler, ISocketStream* sess) {
-        m_handler(sess);
-        delete sess;
+        static_cast<KernelSocketStream*>(sess)->takeable = true;
+        if (m_handler(sess) != STREAM_TAKEN)
+            delete sess;
     }
 };
 
@@ -1047,6 +1058,20 @@ extern "C" ISocketServer* new_fstack_dpdk_socket_server() {
 #endif // ENABLE_FSTACK_DPDK
 #endif // __linux__
 
+int kernel_socket_fd(ISocketStream* stream) {
+    auto s = dynamic_cast<KernelSocketStream*>(stream);
+    if (!s) return -1;
+#ifdef ENABLE_FSTACK_DPDK
+    if (dynamic_cast<FstackDpdkSocketStream*>(s)) return -1;
+#endif
+    return s->fd;
+}
+
+bool stream_takeable(ISocketStream* stream) {
+    auto s = dynamic_cast<KernelSocketStream*>(stream);
+    return s && s->takeable;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
 /* Implementations in socket.h */
@@ -0,0 +1,381 @@
+/*
+Copyright 2022 The Photon Authors
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "reuseport_server.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include <photon/common/alog.h>
+#include <photon/common/intrusive_list.h>
+#include <photon/io/fd-events.h>
+#include <photon/thread/thread11.h>
+#include <photon/thread/workerpool.h>
+
+#include "base_socket.h"
+
+#ifndef SO_INCOMING_CPU
+#define SO_INCOMING_CPU 49
+#endif
+
+namespace photon {
+namespace net {
+
+class ReusePortSocketServer : public IReusePortSocketServer {
+public:
+    // the load of a vCPU is sampled this often, and averaged
+    static constexpr uint64_t SAMPLE_US = 10 * 1000;
+    // loads are fixed-point, of 1/LOAD_ONE runnable threads
+    static constexpr uint64_t LOAD_ONE = 256;
+
+    struct Worker;
+
+    // A connection being served, which moves to vCPU `target` at the start
+    // of its next I/O, if the I/O is done by its handler thread `owner`.
+    // It's in the list of `worker`, which is touched on its vCPU only.
+    struct Connection : public ForwardSocketStream,
+                        public intrusive_list_node<Connection> {
+        Worker* worker;
+        photon::thread* owner = CURRENT;
+        std::atomic<Worker*> target{nullptr};
+        uint64_t ops = 0;           // since the last rebalancing
+
+        Connection(ISocketStream* s, Worker* w) : ForwardSocketStream(s, false), worker(w) {}
+
+        void balance();
+
+        // taken by the handler, it stays where it is, owning the stream
+        void take() {
+            owner = nullptr;
+            m_ownership = true;
+        }
+
+#define BALANCED_SOCK_ACT(action) \
+    balance(); return m_underlay->action
+
+        int close() override {
+            return m_underlay->close();
+        }
+        int shutdown(ShutdownHow how) override {
+            return m_underlay->shutdown(how);
+        }
+        ssize_t read(void* buf, size_t count) override {
+            BALANCED_SOCK_ACT(read(buf, count));
+        }
+        ssize_t write(const void* buf, size_t count) override {
+            BALANCED_SOCK_ACT(write(buf, count));
+        }
+        ssize_t readv(const struct iovec* iov, int iovcnt) override {
+            BALANCED_SOCK_ACT(readv(iov, iovcnt));
+        }
+        ssize_t readv_mutable(struct iovec* iov, int iovcnt) override {
+            BALANCED_SOCK_ACT(readv_mutable(iov, iovcnt));
+        }
+        ssize_t writev(const struct iovec* iov, int iovcnt) override {
+            BALANCED_SOCK_ACT(writev(iov, iovcnt));
+        }
+        ssize_t writev_mutable(struct iovec* iov, int iovcnt) override {
+            BALANCED_SOCK_ACT(writev_mutable(iov, iovcnt));
+        }
+        ssize_t recv(void* buf, size_t count, int flags = 0) override {
+            BALANCED_SOCK_ACT(recv(buf, count, flags));
+        }
+        ssize_t recv(const struct iovec* iov, int iovcnt, int flags = 0) override {
+            BALANCED_SOCK_ACT(recv(iov, iovcnt, flags));
+        }
+        ssize_t send(const void* buf, size_t count, int flags = 0) override {
+            BALANCED_SOCK_ACT(send(buf, count, flags));
+        }
+        ssize_t send(const struct iovec* iov, int iovcnt, int flags = 0) override {
+            BALANCED_SOCK_ACT(send(iov, iovcnt, flags));
+        }
+        ssize_t sendfile(int in_fd, off_t offset, size_t count) override {
+            BALANCED_SOCK_ACT(sendfile(in_fd, offset, count));
+        }
+
+#undef BALANCED_SOCK_ACT
+    };
+
+    struct Worker {
+        ReusePortSocketServer* server;
+        size_t index;
+        std::unique_ptr<ISocketServer> listener{new_tcp_socket_server()};
+        std::atomic<vcpu_base*> vcpu{nullptr};  // set once it runs there
+        std::atomic<uint64_t> load{0};
+        std::atomic<uint64_t> count{0};
+        intrusive_list<Connection> conns;
+
+        void add(Connection* c) {
+            c->worker = this;
+            conns.push_back(c);
+            count++;
+        }
+        void remove(Connection* c) {
+            conns.erase(c);
+            count--;
+        }
+
+        static void serve(Worker* w, ISocketStream* s) {
+            auto c = new Connection(s, w);
+            w->add(c);
+            auto ret = w->server->m_handler(c);
+            c->worker->remove(c);
+            if (ret == STREAM_TAKEN) {
+                c->take();
+            } else {
+                delete c;
+                delete s;
+            }
+        }
+
+        void accept_loop() {
+            while (!server->m_stopping) {
+                auto s = listener->accept();
+                if (!s) {
+                    if (server->m_stopping) break;
+                    LOG_WARN("failed to accept new connections on vCPU `: `", index, ERRNO());
+                    thread_usleep(1000);
+                    continue;
+                }
+                s->timeout(server->m_timeout);
+                thread_create11(&Worker::serve, this, s);
+            }
+        }
+
+        void monitor() {
+            auto last = photon::now;
+            while (!server->m_stopping) {
+                thread_usleep(SAMPLE_US);
+                // excluding the monitor itself
+                auto n = get_info(INFO_RUNNABLE_THREAD_NUM) - 1;
+                load = (load * 7 + n * LOAD_ONE) / 8;
+                auto interval = server->m_rebalance_interval;
+                if (interval && photon::now - last >= interval) {
+                    last = photon::now;
+                    server->rebalance(this);
+                }
+            }
+        }
+    };
+
+    WorkPool* m_pool;
+    bool m_incoming_cpu;
+    uint64_t m_rebalance_interval;
+    uint64_t m_timeout = -1;
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    Handler m_handler;
+    std::atomic<bool> m_stopping{false};
+    bool m_started = false;
+    bool m_block = false;
+    std::atomic<uint64_t> m_migrations{0};
+    photon::semaphore m_exited;
+
+    ReusePortSocketServer(WorkPool* pool, bool incoming_cpu, uint64_t rebalance_interval) :
+            m_pool(pool), m_incoming_cpu(incoming_cpu),
+            m_rebalance_interval(rebalance_interval) {
+        for (int i = 0; i < pool->get_vcpu_num(); i++) {
+            m_workers.emplace_back(new Worker);
+            m_workers.back()->server = this;
+            m_workers.back()->index = i;
+        }
+    }
+
+    ~ReusePortSocketServer() override {
+        terminate();
+    }
+
+    ISocketServer* front() {
+        return m_workers.front()->listener.get();
+    }
+
+    int bind(const EndPoint& ep) override {
+        auto addr = ep;
+        for (auto& w : m_workers) {
+            if (w->listener->setsockopt<int>(SOL_SOCKET, SO_REUSEPORT, 1) < 0 ||
+                w->listener->bind(addr) < 0)
+                LOG_ERROR_RETURN(0, -1, "failed to bind listener ` to `", w->index, addr);
+            if (addr.port == 0)     // the others bind to the port just chosen
+                addr = w->listener->getsockname();
+        }
+        return 0;
+    }
+    int bind(const char* path, size_t count) override {
+        LOG_ERROR_RETURN(ENOSYS, -1, "UNIX domain sockets are not supported");
+    }
+    int listen(int backlog = 1024) override {
+        for (auto& w : m_workers)
+            if (w->listener->listen(backlog) < 0)
+                LOG_ERRNO_RETURN(0, -1, "failed to listen on listener `", w->index);
+        return 0;
+    }
+    ISocketStream* accept(EndPoint* remote_endpoint = nullptr) override {
+        LOG_ERROR_RETURN(ENOSYS, nullptr, "connections are accepted by each vCPU, see start_loop()");
+    }
+
+    ISocketServer* set_handler(Handler handler) override {
+        m_handler = handler;
+        return this;
+    }
+
+    int start_loop(bool block = false) override {
+        if (m_started) LOG_ERROR_RETURN(EALREADY, -1, "Already listening");
+        m_started = true;
+        m_block = block;
+        m_stopping = false;
+        for (auto& w : m_workers) {
+            auto th = thread_create11(&ReusePortSocketServer::run, this, w.get());
+            if (m_pool->thread_migrate(th, w->index) < 0)
+                LOG_ERROR("failed to run listener ` on its vCPU", w->index);
+        }
+        if (block) m_exited.wait(m_workers.size());
+        return 0;
+    }
+
+    // on the vCPU of `w`
+    void run(Worker* w) {
+        w->vcpu = get_vcpu();
+        if (m_incoming_cpu) {
+            int cpu = pinned_cpu(w->index);
+            if (::setsockopt(w->listener->get_underlay_fd(), SOL_SOCKET,
+                             SO_INCOMING_CPU, &cpu, sizeof(cpu)) < 0)
+                LOG_WARN("failed to set SO_INCOMING_CPU of listener ` to `: `", w->index, cpu, ERRNO());
+        }
+        auto mon = thread_enable_join(thread_create11(&Worker::monitor, w));
+        w->accept_loop();
+        thread_join(mon);
+        m_exited.signal(1);
+    }
+
+    static int pinned_cpu(size_t index) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (pthread_getaffinity_np(pthread_self(), sizeof(set), &set) == 0 &&
+            CPU_COUNT(&set) == 1) {
+            for (int i = 0; i < CPU_SETSIZE; i++)
+                if (CPU_ISSET(i, &set)) return i;
+        }
+        return index;
+    }
+
+    void terminate() override {
+        if (!m_started || m_stopping) return;
+        m_stopping = true;
+        // wakes up the accept loops, on whichever state they are
+        for (auto& w : m_workers)
+            ::shutdown(w->listener->get_underlay_fd(), SHUT_RDWR);
+        if (!m_block) m_exited.wait(m_workers.size());
+        m_started = false;
+    }
+
+    // On the vCPU of `w`: moves its most active connections to the least
+    // loaded vCPU, if the load is skewed. They go at their next I/O.
+    void rebalance(Worker* w) {
+        Worker* least = nullptr;
+        for (auto& x : m_workers)
+            if (x->vcpu && (!least || x->load < least->load))
+                least = x.get();
+        uint64_t mine = w->load, min = least->load;
+        if (least == w || mine < min * 2 || mine - min < LOAD_ONE)
+            return;
+        int64_t n = w->count, diff = n - (int64_t)least->count;
+        auto k = std::min(std::max(diff / 2, (int64_t)1), n - 1);
+        std::vector<Connection*> active;
+        for (auto c : w->conns) {
+            if (c->ops) active.push_back(c);
+            c->ops = 0;
+        }
+        k = std::min(k, (int64_t)active.size());
+        if (k <= 0) return;
+        std::partial_sort(active.begin(), active.begin() + k, active.end(),
+            [](Connection* a, Connection* b) { return a->ops > b->ops; });
+        for (int64_t i = 0; i < k; i++)
+            active[i]->target = least;
+    }
+
+    // on the vCPU of `c`, by its owner
+    void migrate(Connection* c, Worker* to) {
+        c->target = nullptr;
+        auto from = c->worker;
+        if (CURRENT != c->owner || to == from) return;
+        // the fd may be registered to the engine of this vCPU
+        int fd = c->get_underlay_fd();
+        if (fd >= 0) get_vcpu()->master_event_engine->wait_for_fd(fd, 0, -1UL);
+        from->remove(c);
+        if (thread_migrate(CURRENT, to->vcpu) < 0) {
+            from->add(c);
+            return;
+        }
+        to->add(c);
+        m_migrations++;
+    }
+
+    size_t connections(uint64_t* counts, size_t n) override {
+        for (size_t i = 0; i < std::min(n, m_workers.size()); i++)
+            counts[i] = m_workers[i]->count;
+        return m_workers.size();
+    }
+    uint64_t migrations() override {
+        return m_migrations;
+    }
+
+    Object* get_underlay_object(uint64_t recursion = 0) override {
+        return front()->get_underlay_object(recursion);
+    }
+    int setsockopt(int level, int option_name, const void* option_value, socklen_t option_len) override {
+        for (auto& w : m_workers)
+            if (w->listener->setsockopt(level, option_name, option_value, option_len) < 0)
+                return -1;
+        return 0;
+    }
+    int getsockopt(int level, int option_name, void* option_value, socklen_t* option_len) override {
+        return front()->getsockopt(level, option_name, option_value, option_len);
+    }
+    int getsockname(EndPoint& addr) override {
+        return front()->getsockname(addr);
+    }
+    int getpeername(EndPoint& addr) override {
+        return front()->getpeername(addr);
+    }
+    int getsockname(char* path, size_t count) override {
+        return front()->getsockname(path, count);
+    }
+    int getpeername(char* path, size_t count) override {
+        return front()->getpeername(path, count);
+    }
+    uint64_t timeout() const override { return m_timeout; }
+    void timeout(uint64_t tm) override { m_timeout = tm; }
+};
+
+inline void ReusePortSocketServer::Connection::balance() {
+    auto t = target.load(std::memory_order_relaxed);
+    if (unlikely(t)) worker->server->migrate(this, t);
+    ops++;
+}
+
+extern "C" IReusePortSocketServer* new_reuseport_tcp_server(WorkPool* pool,
+        bool incoming_cpu, uint64_t rebalance_interval) {
+    if (!pool || pool->get_vcpu_num() <= 0)
+        LOG_ERROR_RETURN(EINVAL, nullptr, "invalid work pool");
+    return new ReusePortSocketServer(pool, incoming_cpu, rebalance_interval);
+}
+
+}  // namespace net
+}  // namespace photon
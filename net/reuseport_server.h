@@ -0,0 +1,56 @@
+/*
+Copyright 2022 The Photon Authors
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <photon/net/socket.h>
+
+namespace photon {
+
+class WorkPool;
+
+namespace net {
+
+// A TCP server that spreads its connections over the vCPUs of a WorkPool.
+// Each vCPU listens with a socket of its own, bound to the same address with
+// SO_REUSEPORT, so the kernel distributes incoming connections among them,
+// and a connection is served on the vCPU that accepted it.
+//
+// When the load of the vCPUs (their # of runnable threads, sampled) gets
+// skewed, the most active connections of a busy vCPU are moved, along with
+// their handler threads, to the least loaded one. A connection moves at the
+// start of its next I/O, so it must be used by its handler thread only. It is
+// not moved any more, and not counted, once the handler has taken it by
+// returning STREAM_TAKEN. The server must outlive the connections it serves.
+class IReusePortSocketServer : public ISocketServer {
+public:
+    // Fills `counts` with the # of connections being served by each vCPU of
+    // the pool, for `n` of them at most, and returns the # of vCPUs.
+    virtual size_t connections(uint64_t* counts, size_t n) = 0;
+
+    // # of connections moved for rebalancing so far
+    virtual uint64_t migrations() = 0;
+};
+
+// `incoming_cpu`: set SO_INCOMING_CPU of each listener to the CPU its vCPU is
+// pinned to (or to its index if not pinned), so that the kernel prefers to
+// hand a connection to the vCPU that runs on the CPU receiving its packets.
+// `rebalance_interval`: in us, 0 to disable rebalancing.
+extern "C" IReusePortSocketServer* new_reuseport_tcp_server(WorkPool* pool,
+        bool incoming_cpu = false, uint64_t rebalance_interval = 1000 * 1000);
+
+}  // namespace net
+}  // namespace photon
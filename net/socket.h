@@ -40,6 +40,9 @@ LogBuffer& operator << (LogBuffer& log, const in6_addr& iaddr);
 LogBuffer& operator << (LogBuffer& log, const sockaddr_in6& addr);
 
 namespace photon {
+
+class fair_throttle;
+
 namespace net {
 
     struct __attribute__ ((packed)) IPAddr {
@@ -283,6 +286,9 @@ namespace net {
         virtual ISocketStream* accept(EndPoint* remote_endpoint = nullptr) = 0;
 
         using Handler = Callback<ISocketStream*>;
+        // A handler returns STREAM_TAKEN to keep the stream after it returns, and
+        // deletes the stream by itself later. Only kernel socket servers honor it.
+        const static int STREAM_TAKEN = 0x7354414b;
         virtual ISocketServer* set_handler(Handler handler) = 0;
         virtual int start_loop(bool block = false) = 0;
         // Close the listening fd. It's the user's responsibility to close the active connections.
@@ -312,6 +318,11 @@ namespace net {
     extern "C" ISocketClient* new_fstack_dpdk_socket_client();
     extern "C" ISocketServer* new_fstack_dpdk_socket_server();
 
+    // charges the bytes transferred by `stream` to class `tenant` of a shared
+    // throttle, see common/fair_throttle.h
+    extern "C" ISocketStream* new_fair_throttled_stream(ISocketStream* stream, fair_throttle* throttle,
+                                                        uint32_t tenant, bool ownership = false);
+
 
     [[deprecated("deprecated since v0.8; use new_tcp_socket_client() instead;")]]
     inline ISocketClient* new_tcp_socket_client_ipv6() {
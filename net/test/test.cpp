@@ -17,6 +17,7 @@ limitations under the License.
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <photon/common/alog.h>
+#include <photon/common/fair_throttle.h>
 #include <photon/common/utility.h>
 #include <photon/io/fd-events.h>
 #include <photon/thread/thread11.h>
@@ -240,6 +241,39 @@ TEST(Socket, timeout) {
     EXPECT_GE(photon::now - now, 1000 * 1000UL);
 }
 
+TEST(Socket, fair_throttled_debt) {
+    auto cli = new_tcp_socket_client();
+    auto serv = new_tcp_socket_server();
+    DEFER({
+        delete cli;
+        delete serv;
+    });
+    serv->bind_v4localhost();
+    serv->listen(100);
+    auto sock = cli->connect(serv->getsockname());
+    ASSERT_NE(nullptr, sock);
+    auto peer = serv->accept();
+    ASSERT_NE(nullptr, peer);
+    DEFER(delete peer);
+    // 1000 bytes per second, granted in full but leaving a 1-second debt
+    photon::fair_throttle throttle(1000);
+    auto ts = new_fair_throttled_stream(sock, &throttle, 0, true);
+    DEFER(delete ts);
+    ts->timeout(100 * 1000);
+    char buf[1000] = {};
+    EXPECT_EQ(1000, ts->write(buf, 1000));
+    // sent, although the throttle timed out; the bytes are kept as debt
+    EXPECT_EQ(10, ts->write(buf, 10));
+    // nothing is sent until the debt is paid
+    errno = 0;
+    EXPECT_EQ(-1, ts->write(buf, 10));
+    EXPECT_EQ(ETIMEDOUT, errno);
+    ts->timeout(-1UL);
+    EXPECT_EQ(10, ts->write(buf, 10));
+    char rbuf[2048];
+    EXPECT_EQ(1020, peer->read(rbuf, 1020));
+}
+
 void prepare(char* snd, char* recv, struct iovec& siov, struct iovec& riov,
              size_t len = 128) {
     memset(recv, 0, len);
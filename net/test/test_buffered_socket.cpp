@@ -0,0 +1,190 @@
+#include <string>
+#include <vector>
+
+#include <photon/common/alog.h>
+#include <photon/common/utility.h>
+#include <photon/net/buffered_socket.h>
+#include <photon/photon.h>
+#include <photon/thread/thread11.h>
+#include "../../test/gtest.h"
+#include "../base_socket.h"
+
+using namespace photon::net;
+
+// a connected pair of kernel sockets: `server` is written by the tests,
+// `client` is read through the buffered stream
+struct Connection {
+    ISocketServer* server_sock = new_tcp_socket_server();
+    ISocketClient* client_sock = new_tcp_socket_client();
+    ISocketStream* server = nullptr;
+    ISocketStream* client = nullptr;
+    photon::semaphore done;
+
+    Connection() {
+        server_sock->bind_v4localhost();
+        server_sock->listen();
+        server_sock->set_handler({this, &Connection::handle});
+        server_sock->start_loop();
+        client = client_sock->connect(server_sock->getsockname());
+        while (!server) photon::thread_yield();
+    }
+    int handle(ISocketStream* stream) {
+        server = stream;
+        done.wait(1);
+        return 0;
+    }
+    ~Connection() {
+        delete client;
+        done.signal(1);
+        photon::thread_yield();
+        delete server_sock;
+        delete client_sock;
+    }
+};
+
+static std::string to_string(const iovector_view& view) {
+    std::string s;
+    for (auto& v : view)
+        s.append((const char*)v.iov_base, v.iov_len);
+    return s;
+}
+
+TEST(BufferedSocket, peek_read_until_consume) {
+    Connection conn;
+    auto bs = new_buffered_socket_stream(conn.client);
+    DEFER(delete bs);
+    conn.server->write("hello\r\nworld\r\n12345", 19);
+
+    iovector_view view;
+    EXPECT_GE(bs->peek(5, &view), 5);
+    EXPECT_EQ(0, to_string(view).find("hello"));
+    EXPECT_EQ(7, bs->read_until("\r\n", &view));
+    EXPECT_EQ("hello\r\n", to_string(view));
+    EXPECT_EQ(7, bs->consume(7, &view));
+    EXPECT_EQ("hello\r\n", to_string(view));
+    char buf[8] = {};
+    EXPECT_EQ(5, bs->read(buf, 5));
+    EXPECT_EQ("world", std::string(buf, 5));
+    EXPECT_EQ(2, bs->recv(buf, 2));
+    EXPECT_EQ(5, bs->buffered());
+    EXPECT_EQ(5, bs->recv(buf, sizeof(buf)));
+    EXPECT_EQ("12345", std::string(buf, 5));
+    EXPECT_EQ(0, bs->buffered());
+
+    conn.server->shutdown(ShutdownHow::Write);
+    EXPECT_EQ(0, bs->read_until("\n", &view));
+    EXPECT_EQ(0, bs->consume(1, &view));
+}
+
+static void lines_through(ISocketStream* server, IBufferedSocketStream* bs) {
+    std::vector<std::string> lines;
+    for (size_t i = 0; i < 500; i++)
+        lines.emplace_back(std::string((i * 7919) % 10000 + 1, 'a' + i % 26) + "\n");
+    auto th = photon::thread_enable_join(photon::thread_create11([&] {
+        for (auto& l : lines)
+            server->write(l.data(), l.size());
+    }));
+    for (auto& l : lines) {
+        iovector_view view;
+        auto len = bs->read_until("\n", &view);
+        ASSERT_EQ((ssize_t)l.size(), len);
+        EXPECT_EQ(l, to_string(view));
+        EXPECT_EQ(len, bs->consume(len, &view));
+        EXPECT_EQ(l, to_string(view));
+    }
+    photon::thread_join(th);
+}
+
+TEST(BufferedSocket, wrap_and_growth) {
+    Connection conn;
+    auto bs = new_buffered_socket_stream(conn.client);
+    DEFER(delete bs);
+    lines_through(conn.server, bs);
+
+    std::string large(1024 * 1024, 'x');
+    for (size_t i = 0; i < large.size(); i += 4096) large[i] = 'y';
+    auto th = photon::thread_enable_join(photon::thread_create11([&] {
+        conn.server->write("head", 4);
+        conn.server->write(large.data(), large.size());
+    }));
+    std::string buf(4 + large.size(), '\0');
+    EXPECT_EQ((ssize_t)buf.size(), bs->read(&buf[0], buf.size()));
+    EXPECT_EQ("head" + large, buf);
+    photon::thread_join(th);
+
+    std::string line(80 * 1024, 'z');
+    conn.server->write(line.data(), line.size());
+    iovector_view view;
+    EXPECT_EQ(-1, bs->read_until("\n", &view));
+    EXPECT_EQ(ENOBUFS, errno);
+    EXPECT_EQ(-1, bs->consume(line.size(), &view));
+    EXPECT_EQ(ENOBUFS, errno);
+}
+
+TEST(BufferedSocket, wrapped_stream) {
+    // the inner buffered stream is not a kernel socket, so the outer one
+    // reads through its recv()
+    Connection conn;
+    auto inner = new_buffered_socket_stream(conn.client);
+    auto bs = new_buffered_socket_stream(inner, 64 * 1024, true);
+    DEFER(delete bs);
+    lines_through(conn.server, bs);
+}
+
+// a stream of another kind, such as rsocket, whose underlay object is a
+// number that is also the fd of an unrelated kernel socket
+class NumberedStream : public ForwardSocketStream {
+public:
+    uint64_t m_number;
+    NumberedStream(ISocketStream* s, int number) :
+        ForwardSocketStream(s, false), m_number(number) { }
+    Object* get_underlay_object(uint64_t) override { return (Object*)m_number; }
+    int close() override { return m_underlay->close(); }
+    int shutdown(ShutdownHow how) override { return m_underlay->shutdown(how); }
+    ssize_t read(void* buf, size_t count) override { return m_underlay->read(buf, count); }
+    ssize_t readv(const iovec* iov, int iovcnt) override { return m_underlay->readv(iov, iovcnt); }
+    ssize_t write(const void* buf, size_t count) override { return m_underlay->write(buf, count); }
+    ssize_t writev(const iovec* iov, int iovcnt) override { return m_underlay->writev(iov, iovcnt); }
+    ssize_t recv(void* buf, size_t count, int flags) override { return m_underlay->recv(buf, count, flags); }
+    ssize_t recv(const iovec* iov, int iovcnt, int flags) override { return m_underlay->recv(iov, iovcnt, flags); }
+    ssize_t send(const void* buf, size_t count, int flags) override { return m_underlay->send(buf, count, flags); }
+    ssize_t send(const iovec* iov, int iovcnt, int flags) override { return m_underlay->send(iov, iovcnt, flags); }
+    ssize_t sendfile(int in_fd, off_t offset, size_t count) override { return m_underlay->sendfile(in_fd, offset, count); }
+};
+
+TEST(BufferedSocket, numbered_stream) {
+    // it is read through its recv(), not as a kernel socket of that number
+    Connection conn, other;
+    other.server->write("wrong\n", 6);
+    auto stream = new NumberedStream(conn.client, other.client->get_underlay_fd());
+    auto bs = new_buffered_socket_stream(stream, 64 * 1024, true);
+    DEFER(delete bs);
+    lines_through(conn.server, bs);
+}
+
+TEST(BufferedSocket, idle) {
+    Connection conn;
+    auto bs = new_buffered_socket_stream(conn.client);
+    DEFER(delete bs);
+    char buf[16];
+    for (int i = 0; i < 3; i++) {
+        auto th = photon::thread_enable_join(photon::thread_create11([&] {
+            // longer than the idle time after which the buffer is freed
+            photon::thread_usleep(50 * 1000);
+            conn.server->write("ping", 4);
+        }));
+        EXPECT_EQ(4, bs->recv(buf, sizeof(buf)));
+        EXPECT_EQ("ping", std::string(buf, 4));
+        photon::thread_join(th);
+    }
+    bs->timeout(30 * 1000);
+    EXPECT_EQ(-1, bs->recv(buf, sizeof(buf)));
+    EXPECT_EQ(ETIMEDOUT, errno);
+}
+
+int main(int argc, char** arg) {
+    photon::init();
+    DEFER(photon::fini());
+    ::testing::InitGoogleTest(&argc, arg);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,114 @@
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include <photon/common/alog.h>
+#include <photon/common/utility.h>
+#include <photon/net/reuseport_server.h>
+#include <photon/photon.h>
+#include <photon/thread/thread11.h>
+#include <photon/thread/workerpool.h>
+#include "../../test/gtest.h"
+
+using namespace photon::net;
+
+static int echo(void*, ISocketStream* s) {
+    char buf[64];
+    while (true) {
+        auto n = s->recv(buf, sizeof(buf));
+        if (n <= 0 || s->write(buf, n) != n) break;
+    }
+    return 0;
+}
+
+struct Server {
+    photon::WorkPool pool{2, photon::INIT_EVENT_DEFAULT, photon::INIT_IO_NONE, -1};
+    std::unique_ptr<IReusePortSocketServer> server;
+    std::unique_ptr<ISocketClient> client{new_tcp_socket_client()};
+    std::vector<std::unique_ptr<ISocketStream>> conns;
+
+    explicit Server(uint64_t rebalance_interval) :
+            server(new_reuseport_tcp_server(&pool, false, rebalance_interval)) {
+        server->set_handler({nullptr, &echo});
+        server->bind_v4localhost();
+        server->listen();
+        server->start_loop();
+    }
+    ~Server() {
+        conns.clear();
+        // for the handlers to see the close
+        photon::thread_usleep(50 * 1000);
+        server->terminate();
+    }
+    void connect(int n) {
+        for (int i = 0; i < n; i++) {
+            conns.emplace_back(client->connect(server->getsockname()));
+            ASSERT_NE(nullptr, conns.back());
+        }
+    }
+    void ping() {
+        for (auto& c : conns) {
+            char buf[16] = "ping";
+            ASSERT_EQ(16, c->write(buf, 16));
+            ASSERT_EQ(16, c->read(buf, 16));
+            EXPECT_EQ("ping", std::string(buf));
+        }
+    }
+    std::vector<uint64_t> counts() {
+        std::vector<uint64_t> v(2);
+        EXPECT_EQ(2, server->connections(v.data(), v.size()));
+        return v;
+    }
+};
+
+TEST(ReusePortServer, spread) {
+    Server s(0);
+    EXPECT_NE(0, s.server->getsockname().port);
+    s.connect(32);
+    s.ping();
+    auto v = s.counts();
+    LOG_INFO("connections: `, `", v[0], v[1]);
+    EXPECT_EQ(32, v[0] + v[1]);
+    // hashed over the listeners by the kernel
+    EXPECT_GT(v[0], 0);
+    EXPECT_GT(v[1], 0);
+    EXPECT_EQ(0, s.server->migrations());
+    EXPECT_EQ(nullptr, s.server->accept());
+}
+
+TEST(ReusePortServer, rebalance) {
+    Server s(100 * 1000);
+    s.connect(16);
+    s.ping();   // so they are all being served
+    // keep vCPU 0 busy, so its active connections move to vCPU 1
+    std::atomic<bool> running{true};
+    std::vector<photon::join_handle*> busy;
+    for (int i = 0; i < 4; i++) {
+        auto th = photon::thread_create11([&] {
+            while (running) photon::thread_yield();
+        });
+        busy.push_back(photon::thread_enable_join(th));
+        s.pool.thread_migrate(th, 0);
+    }
+    auto before = s.counts();
+    for (int i = 0; i < 100 && s.server->migrations() == 0; i++) {
+        s.ping();
+        photon::thread_usleep(10 * 1000);
+    }
+    s.ping();
+    running = false;
+    for (auto jh : busy) photon::thread_join(jh);
+    auto after = s.counts();
+    LOG_INFO("connections: ` ` -> ` `, ` migrated", before[0], before[1],
+             after[0], after[1], s.server->migrations());
+    EXPECT_GT(s.server->migrations(), 0);
+    EXPECT_LT(after[0], before[0]);
+    EXPECT_EQ(16, after[0] + after[1]);
+}
+
+int main(int argc, char** arg) {
+    photon::init(photon::INIT_EVENT_DEFAULT, photon::INIT_IO_NONE);
+    DEFER(photon::fini());
+    ::testing::InitGoogleTest(&argc, arg);
+    return RUN_ALL_TESTS();
+}
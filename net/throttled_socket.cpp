@@ -0,0 +1,116 @@
+/*
+Copyright 2022 The Photon Authors
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "socket.h"
+
+#include <photon/common/alog.h>
+#include <photon/common/fair_throttle.h>
+#include <photon/common/iovector.h>
+
+#include "base_socket.h"
+
+namespace photon {
+namespace net {
+
+// The amount of a socket transfer is not known until it is done, so bytes
+// are charged afterwards: the call returns once the throttle grants them,
+// which paces the stream. If the wait fails (timed out or interrupted), the
+// transfer has happened anyway and its result is returned, while the bytes
+// are kept as a debt that the next call pays before transferring anything.
+class FairThrottledSocketStream : public ForwardSocketStream {
+public:
+    fair_throttle* m_throttle;
+    uint32_t m_tenant;
+    uint64_t m_debt = 0;
+
+    FairThrottledSocketStream(ISocketStream* stream, fair_throttle* throttle,
+                              uint32_t tenant, bool ownership)
+            : ForwardSocketStream(stream, ownership), m_throttle(throttle), m_tenant(tenant) {}
+
+    int pay_debt() {
+        if (m_debt == 0) return 0;
+        if (m_throttle->consume(m_tenant, m_debt, fair_throttle::Priority::Normal,
+                                m_underlay->timeout()) < 0)
+            LOG_ERRNO_RETURN(0, -1, "failed to pay a throttle debt of ` bytes", m_debt);
+        m_debt = 0;
+        return 0;
+    }
+
+    ssize_t charge(ssize_t ret) {
+        if (ret > 0 && m_throttle->consume(m_tenant, ret, fair_throttle::Priority::Normal,
+                                           m_underlay->timeout()) < 0) {
+            LOG_DEBUG("failed to charge ` bytes, kept as debt ", ret, ERRNO());
+            m_debt += ret;
+        }
+        return ret;
+    }
+
+#define THROTTLED_SOCK_ACT(action)      \
+    if (pay_debt() < 0) return -1;      \
+    return charge(m_underlay->action)
+
+    int close() override {
+        return m_underlay->close();
+    }
+    int shutdown(ShutdownHow how) override {
+        return m_underlay->shutdown(how);
+    }
+    ssize_t read(void* buf, size_t count) override {
+        THROTTLED_SOCK_ACT(read(buf, count));
+    }
+    ssize_t write(const void* buf, size_t count) override {
+        THROTTLED_SOCK_ACT(write(buf, count));
+    }
+    ssize_t readv(const struct iovec* iov, int iovcnt) override {
+        THROTTLED_SOCK_ACT(readv(iov, iovcnt));
+    }
+    ssize_t readv_mutable(struct iovec* iov, int iovcnt) override {
+        THROTTLED_SOCK_ACT(readv_mutable(iov, iovcnt));
+    }
+    ssize_t writev(const struct iovec* iov, int iovcnt) override {
+        THROTTLED_SOCK_ACT(writev(iov, iovcnt));
+    }
+    ssize_t writev_mutable(struct iovec* iov, int iovcnt) override {
+        THROTTLED_SOCK_ACT(writev_mutable(iov, iovcnt));
+    }
+    ssize_t recv(void* buf, size_t count, int flags = 0) override {
+        THROTTLED_SOCK_ACT(recv(buf, count, flags));
+    }
+    ssize_t recv(const struct iovec* iov, int iovcnt, int flags = 0) override {
+        THROTTLED_SOCK_ACT(recv(iov, iovcnt, flags));
+    }
+    ssize_t send(const void* buf, size_t count, int flags = 0) override {
+        THROTTLED_SOCK_ACT(send(buf, count, flags));
+    }
+    ssize_t send(const struct iovec* iov, int iovcnt, int flags = 0) override {
+        THROTTLED_SOCK_ACT(send(iov, iovcnt, flags));
+    }
+    ssize_t sendfile(int in_fd, off_t offset, size_t count) override {
+        THROTTLED_SOCK_ACT(sendfile(in_fd, offset, count));
+    }
+
+#undef THROTTLED_SOCK_ACT
+};
+
+extern "C" ISocketStream* new_fair_throttled_stream(ISocketStream* stream, fair_throttle* throttle,
+                                                    uint32_t tenant, bool ownership) {
+    if (!stream || !throttle)
+        LOG_ERROR_RETURN(EINVAL, nullptr, "invalid stream or throttle");
+    return new FairThrottledSocketStream(stream, throttle, tenant, ownership);
+}
+
+}  // namespace net
+}  // namespace photon
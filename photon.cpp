@@ -72,14 +72,27 @@ inline iouring_args mkargs(uint64_t flags, const PhotonOptions& opt) {
     .sq_thread_idle_ms  = opt.iouring_sq_thread_idle_ms,
 };   }
 
-static int init_event_engine(uint64_t engine, uint64_t flags, const PhotonOptions& opt) {
+static MasterEventEngine* new_engine(uint64_t engine, uint64_t flags, const PhotonOptions& opt) {
 #ifdef PHOTON_URING
-    auto mee = (engine != INIT_EVENT_IOURING) ?
-        new_master_event_engine(engine) :
-        new_iouring_master_engine(mkargs(flags, opt));
-#else
-    auto mee = new_master_event_engine(engine);
+    if (engine == INIT_EVENT_IOURING)
+        return new_iouring_master_engine(mkargs(flags, opt));
+#endif
+#ifdef __linux__
+    if (engine == INIT_EVENT_EPOLL && (flags & INIT_EVENT_EPOLL_ET))
+        return new_epoll_et_master_engine();
 #endif
+    return new_master_event_engine(engine);
+}
+
+static int init_event_engine(uint64_t engine, uint64_t flags, const PhotonOptions& opt) {
+    auto mee = new_engine(engine, flags, opt);
+    if (mee && opt.busy_poll_us) {
+        BusyPollParams params;
+        params.max_spin_us = opt.busy_poll_us;
+        params.cpu_percent = opt.busy_poll_cpu_percent;
+        if (mee->busy_poll(params) < 0)
+            LOG_WARN("busy-polling is not supported by the master engine ", ERRNO());
+    }
     return fd_events_init(mee);
 }
 
@@ -33,6 +33,9 @@ const uint64_t INIT_EVENT_EPOLL_NG = SHIFT(5);
 const uint64_t INIT_EVENT_IOURING_SQPOLL = SHIFT(6);
 const uint64_t INIT_EVENT_IOURING_SQ_AFF = SHIFT(7);
 const uint64_t INIT_EVENT_IOURING_IOPOLL = SHIFT(8);
+// with INIT_EVENT_EPOLL, sockets are registered once (edge-triggered) and
+// their readiness is cached, rather than re-armed by epoll_ctl() per wait
+const uint64_t INIT_EVENT_EPOLL_ET = SHIFT(9);
 const uint64_t INIT_EVENT_SIGNAL = SHIFT(10);
 
 const uint64_t INIT_IO_NONE = 0;
@@ -60,6 +63,11 @@ struct PhotonOptions {
     uint32_t iouring_sq_thread_idle_ms = 1000;     // by default polls for 1s
     bool use_pooled_stack_allocator = false;
     bool bypass_threadpool = false;
+    // spin for events for up to `busy_poll_us` (learned from recent idle
+    // periods) before the vCPU sleeps, using at most `busy_poll_cpu_percent`
+    // of its time; see BusyPollParams in photon/io/fd-events.h
+    uint32_t busy_poll_us = 0;                  // 0 to disable
+    uint32_t busy_poll_cpu_percent = 50;
 };
 
 /**
@@ -25,7 +25,9 @@ limitations under the License.
 #include <photon/common/alog.h>
 #include <photon/common/timeout.h>
 #include <photon/common/expirecontainer.h>
+#include <photon/common/metric-meter/histogram.h>
 #include <photon/net/socket.h>
+#include <photon/net/buffered_socket.h>
 #include <photon/net/security-context/tls-stream.h>
 
 using namespace std;
@@ -33,6 +35,28 @@ using namespace std;
 namespace photon {
 namespace rpc {
 
+    struct RpcMetrics
+    {
+        Metric::LatencyHistogram* call;
+        Metric::Counter* call_errors;
+        Metric::LatencyHistogram* serve;
+        RpcMetrics()
+        {
+            auto& r = Metric::default_registry();
+            call = r.histogram("photon_rpc_stub_call_duration_us", {},
+                               "Round-trip time of RPC calls");
+            call_errors = r.counter("photon_rpc_stub_call_errors_total", {},
+                                    "RPC calls that failed");
+            serve = r.histogram("photon_rpc_skeleton_serve_duration_us", {},
+                                "Time spent serving RPC requests");
+        }
+        static RpcMetrics& get()
+        {
+            static RpcMetrics m;
+            return m;
+        }
+    };
+
     class StubImpl : public Stub
     {
     public:
@@ -158,6 +182,10 @@ namespace rpc {
 
         int do_call(FunctionID function, iovector* request, iovector* response, Timeout tmo) override {
             scoped_rwlock rl(m_rwlock, photon::RLOCK);
+            auto& metrics = RpcMetrics::get();
+            SCOPE_LATENCY(*metrics.call);
+            bool ok = false;
+            DEFER(if (!ok) metrics.call_errors->inc());
             if (tmo.expiration() < photon::now) {
                 LOG_ERROR_RETURN(ETIMEDOUT, -1, "Timed out before rpc start", VALUE(tmo.timeout()));
             }
@@ -179,6 +207,7 @@ namespace rpc {
             }
 
             ooo_result_collected(args);
+            ok = true;
             return ret;
         }
     };
@@ -288,7 +317,11 @@ namespace rpc {
             {
                 sk->m_serving_count++;
                 ResponseSender sender(this, &Context::response_sender);
-                int ret = func(&request, sender, stream);
+                int ret;
+                {
+                    SCOPE_LATENCY(*RpcMetrics::get().serve);
+                    ret = func(&request, sender, stream);
+                }
                 sk->m_serving_count--;
                 sk->m_cond_served.notify_all();
                 return ret;
@@ -341,6 +374,11 @@ namespace rpc {
             m_list.push_back(&node);
 #pragma GCC diagnostic pop
             DEFER(m_list.erase(&node));
+            // read header and body of small requests in one recv, it's
+            // declared first to outlive the requests being served
+            std::unique_ptr<net::IBufferedSocketStream> buffered;
+            if (auto sock = dynamic_cast<net::ISocketStream*>(stream))
+                buffered.reset(net::new_buffered_socket_stream(sock));
             // stream serve refcount
             int stream_serv_count = 0;
             photon::mutex w_lock;
@@ -352,9 +390,10 @@ namespace rpc {
             });
             if (stream_accept_notify) stream_accept_notify(stream);
             DEFER(if (stream_close_notify) stream_close_notify(stream));
+            IStream* s = buffered ? buffered.get() : stream;
 
             while(likely(m_running)) {
-                Context context(this, stream);
+                Context context(this, s);
                 context.stream_serv_count = &stream_serv_count;
                 context.stream_cv = &stream_cv;
                 context.w_lock = &w_lock;
@@ -363,7 +402,7 @@ namespace rpc {
                     // should only shutdown read, for other threads
                     // might still writing
                     ERRNO e;
-                    stream->shutdown(ShutdownHow::ReadWrite);
+                    s->shutdown(ShutdownHow::ReadWrite);
                     if (e.no == ECANCELED || e.no == EAGAIN || e.no == EINTR || e.no == ENXIO) {
                         return -1;
                     } else {
@@ -449,7 +488,7 @@ namespace rpc {
                 if (socket == nullptr) {
                     return nullptr;
                 }
-                return rpc::new_rpc_stub(socket, true);
+                return rpc::new_rpc_stub(net::new_buffered_socket_stream(socket, 64 * 1024, true), true);
             };
             return m_pool->acquire(endpoint, stub_ctor);
         }
@@ -510,7 +549,7 @@ namespace rpc {
                 }
                 // stub socket always set timeout for single action
                 sock->timeout(-1UL);
-                return new_rpc_stub(sock, true);
+                return new_rpc_stub(net::new_buffered_socket_stream(sock, 64 * 1024, true), true);
             });
         }
 
@@ -183,7 +183,8 @@ namespace rpc
         }
 
         // set the allocator to allocate memory for recving responses
-        // the default allocator is defined in iovector.h/cpp
+        // the default allocator is defined in iovector.h/cpp,
+        // SlabAllocator::get_io_alloc() is recommended for servers on many vCPUs
         virtual void set_allocator(IOAlloc allocation) = 0;
 
         /**
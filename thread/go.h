@@ -24,6 +24,8 @@ limitations under the License.
 
 #include <atomic>
 #include <cerrno>
+#include <cstdlib>
+#include <new>
 #include <type_traits>
 #include <utility>
 
@@ -524,6 +526,350 @@ inline channel<T> make_channel(size_t capacity = 0) {
     return channel<T>(capacity);
 }
 
+// =============================================================================
+// inline_channel<T> - buffered channel with inline storage
+// =============================================================================
+
+// inline_channel<T> is a buffered channel that stores elements in place, in
+// a ring of cache-line padded slots, so that sending and receiving never
+// touch the heap. Blocked receivers and senders park themselves in a small
+// lock-free registry; a sender that finds the ring empty and a receiver
+// parked hands the value over directly into the receiver's stack, and
+// wakes it up, without going through the ring or taking any lock.
+//
+// The capacity is rounded up to a power of 2, and must be at least 1
+// (use channel<T> for unbuffered rendezvous). Elements sent by the same
+// thread are received in order.
+//
+// Usage:
+//   inline_channel<Msg> ch(1024);
+//   ch.send(msg);                      // blocking send
+//   ch.recv(msg);                      // blocking receive
+//   ch.send_batch(msgs, n);            // returns # of elements sent
+//   auto k = ch.recv_batch(buf, n);    // blocks for at least 1 element
+template<typename T>
+class inline_channel {
+public:
+    explicit inline_channel(size_t capacity) {
+        size_t n = 1;
+        while (n < capacity) n <<= 1;
+        m_mask = n - 1;
+        void* ptr = nullptr;
+        if (posix_memalign(&ptr, alignof(Slot), sizeof(Slot) * n) != 0)
+            throw std::bad_alloc();
+        m_slots = (Slot*)ptr;
+        for (size_t i = 0; i < n; ++i)
+            new (&m_slots[i].seq) std::atomic<size_t>(i);
+        for (auto& x : m_parked)
+            for (auto& w : x) w.store(nullptr, std::memory_order_relaxed);
+    }
+
+    ~inline_channel() {
+        close();
+        auto tail = m_tail.load(std::memory_order_acquire);
+        for (auto pos = m_head.load(std::memory_order_acquire); pos < tail; ++pos)
+            m_slots[pos & m_mask].value()->~T();
+        free(m_slots);
+    }
+
+    inline_channel(const inline_channel&) = delete;
+    inline_channel& operator=(const inline_channel&) = delete;
+
+    // Close the channel: senders fail with ESHUTDOWN, and receivers fail
+    // once the remaining elements are drained.
+    void close() {
+        if (m_closed.exchange(true, std::memory_order_seq_cst)) return;
+        for (int d = 0; d < 2; ++d)
+            for (auto& x : m_parked[d]) {
+                auto w = x.load(std::memory_order_acquire);
+                if (w && x.compare_exchange_strong(w, nullptr)) {
+                    m_nparked[d].fetch_sub(1, std::memory_order_relaxed);
+                    wake(w, Waiter::WOKEN);
+                }
+            }
+    }
+
+    bool is_closed() const { return m_closed.load(std::memory_order_acquire); }
+    size_t capacity() const { return m_mask + 1; }
+    size_t size() const {
+        auto tail = m_tail.load(std::memory_order_acquire);
+        auto head = m_head.load(std::memory_order_acquire);
+        return tail > head ? tail - head : 0;
+    }
+    bool empty() const { return size() == 0; }
+
+    bool send(const T& value, Timeout timeout = {}) {
+        return do_send(value, timeout);
+    }
+
+    bool send(T&& value, Timeout timeout = {}) {
+        return do_send(std::move(value), timeout);
+    }
+
+    bool recv(T& value, Timeout timeout = {}) {
+        while (true) {
+            if (try_recv(value)) return true;
+            if (is_closed()) {
+                if (try_recv(value)) return true;
+                errno = ESHUTDOWN;
+                return false;
+            }
+            if (timeout.expired()) {
+                errno = ETIMEDOUT;
+                return false;
+            }
+            Waiter w;
+            park(RECV, &w, timeout);
+            if (w.state.load(std::memory_order_acquire) == Waiter::FILLED) {
+                auto ptr = w.value();
+                value = std::move(*ptr);
+                ptr->~T();
+                return true;
+            }
+        }
+    }
+
+    std::pair<T, bool> recv(Timeout timeout = {}) {
+        T value{};
+        bool ok = recv(value, timeout);
+        return {std::move(value), ok};
+    }
+
+    bool try_send(const T& value) { return do_try_send(value); }
+    bool try_send(T&& value) { return do_try_send(std::move(value)); }
+
+    bool try_recv(T& value) {
+        if (!try_pop(value)) return false;
+        wake_parked(SEND, 1);
+        return true;
+    }
+
+    // Send `n` elements, blocking while the channel is full. Returns the
+    // number of elements sent, which is less than `n` only if the channel
+    // is closed (errno ESHUTDOWN) or the timeout expired (errno ETIMEDOUT).
+    size_t send_batch(const T* values, size_t n, Timeout timeout = {}) {
+        size_t i = 0;
+        while (i < n) {
+            if (is_closed()) { errno = ESHUTDOWN; break; }
+            if (handoff(values[i])) { ++i; continue; }
+            size_t k = 0;
+            while (i < n && try_push(values[i])) { ++i; ++k; }
+            if (k) { wake_parked(RECV, k); continue; }
+            if (timeout.expired()) { errno = ETIMEDOUT; break; }
+            Waiter w;
+            park(SEND, &w, timeout);
+        }
+        return i;
+    }
+
+    // Receive up to `n` elements, blocking until at least 1 is available.
+    // Returns 0 if the channel is closed and drained (errno ESHUTDOWN),
+    // or the timeout expired (errno ETIMEDOUT).
+    size_t recv_batch(T* values, size_t n, Timeout timeout = {}) {
+        if (n == 0 || !recv(values[0], timeout)) return 0;
+        size_t k = 1;
+        while (k < n && try_pop(values[k])) ++k;
+        if (k > 1) wake_parked(SEND, k - 1);
+        return k;
+    }
+
+    inline_channel& operator<<(const T& value) { send(value); return *this; }
+    inline_channel& operator<<(T&& value) { send(std::move(value)); return *this; }
+    inline_channel& operator>>(T& value) { recv(value); return *this; }
+
+private:
+    enum { RECV = 0, SEND = 1, PARK_SLOTS = 32, CACHE_LINE = 64 };
+
+    struct alignas(CACHE_LINE) Slot {
+        std::atomic<size_t> seq;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type data;
+        T* value() { return (T*)&data; }
+    };
+
+    // lives on the stack of a parked thread, until its state is final
+    struct Waiter {
+        enum { WAITING, WOKEN, FILLED };
+        thread* th = CURRENT;
+        std::atomic<int> state{WAITING};
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type data;
+        T* value() { return (T*)&data; }
+    };
+
+    template<typename U>
+    bool try_push(U&& value) {
+        auto pos = m_tail.load(std::memory_order_relaxed);
+        while (true) {
+            auto& slot = m_slots[pos & m_mask];
+            auto seq = slot.seq.load(std::memory_order_acquire);
+            auto diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    new (slot.value()) T(std::forward<U>(value));
+                    slot.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool try_pop(T& value) {
+        auto pos = m_head.load(std::memory_order_relaxed);
+        while (true) {
+            auto& slot = m_slots[pos & m_mask];
+            auto seq = slot.seq.load(std::memory_order_acquire);
+            auto diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (m_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    value = std::move(*slot.value());
+                    slot.value()->~T();
+                    slot.seq.store(pos + m_mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = m_head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // the ring is checked to be empty before handing over, so that
+    // elements from the same sender are never reordered
+    template<typename U>
+    bool handoff(U&& value) {
+        if (m_nparked[RECV].load(std::memory_order_acquire) == 0 || !empty())
+            return false;
+        auto w = claim(RECV);
+        if (!w) return false;
+        new (w->value()) T(std::forward<U>(value));
+        wake(w, Waiter::FILLED);
+        return true;
+    }
+
+    template<typename U>
+    bool do_try_send(U&& value) {
+        if (is_closed()) {
+            errno = ESHUTDOWN;
+            return false;
+        }
+        if (handoff(std::forward<U>(value))) return true;
+        if (!try_push(std::forward<U>(value))) return false;
+        wake_parked(RECV, 1);
+        return true;
+    }
+
+    template<typename U>
+    bool do_send(U&& value, Timeout timeout) {
+        while (true) {
+            if (is_closed()) {
+                errno = ESHUTDOWN;
+                return false;
+            }
+            if (handoff(std::forward<U>(value))) return true;
+            if (try_push(std::forward<U>(value))) {
+                wake_parked(RECV, 1);
+                return true;
+            }
+            if (timeout.expired()) {
+                errno = ETIMEDOUT;
+                return false;
+            }
+            Waiter w;
+            park(SEND, &w, timeout);
+        }
+    }
+
+    Waiter* claim(int d) {
+        for (auto& x : m_parked[d]) {
+            auto w = x.load(std::memory_order_acquire);
+            if (w && x.compare_exchange_strong(w, nullptr)) {
+                m_nparked[d].fetch_sub(1, std::memory_order_relaxed);
+                return w;
+            }
+        }
+        return nullptr;
+    }
+
+    void wake_parked(int d, size_t n) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        while (n-- && m_nparked[d].load(std::memory_order_relaxed) > 0) {
+            auto w = claim(d);
+            if (!w) break;
+            wake(w, Waiter::WOKEN);
+        }
+    }
+
+    // the waiter must not be touched after its state is set
+    static void wake(Waiter* w, int state) {
+        thread_interrupt(w->th, 0);
+        w->state.store(state, std::memory_order_release);
+    }
+
+    bool ready(int d) {
+        if (is_closed()) return true;
+        return d == RECV ? !empty() : size() <= m_mask;
+    }
+
+    struct ParkArgs {
+        inline_channel* ch;
+        Waiter* w;
+        int d;
+    };
+
+    // runs after the waiter has fallen asleep, so the wake-up can't be lost
+    static void publish(void* arg) {
+        auto a = *(ParkArgs*)arg;
+        auto& parked = a.ch->m_parked[a.d];
+        for (auto& x : parked) {
+            Waiter* expected = nullptr;
+            if (x.compare_exchange_strong(expected, a.w)) {
+                a.ch->m_nparked[a.d].fetch_add(1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (!a.ch->ready(a.d)) return;
+                expected = a.w;
+                if (!x.compare_exchange_strong(expected, nullptr))
+                    return;     // claimed, and to be woken by the claimer
+                a.ch->m_nparked[a.d].fetch_sub(1, std::memory_order_relaxed);
+                break;
+            }
+        }
+        // ready already, or the registry is full
+        wake(a.w, Waiter::WOKEN);
+    }
+
+    void park(int d, Waiter* w, Timeout timeout) {
+        ParkArgs args{this, w, d};
+        thread_usleep_defer(timeout, &publish, &args);
+        if (w->state.load(std::memory_order_acquire) == Waiter::WAITING) {
+            // timed out, or interrupted by others
+            for (auto& x : m_parked[d]) {
+                auto expected = w;
+                if (x.compare_exchange_strong(expected, nullptr)) {
+                    m_nparked[d].fetch_sub(1, std::memory_order_relaxed);
+                    return;
+                }
+            }
+            // claimed by someone else, wait for it to finish
+            while (w->state.load(std::memory_order_acquire) == Waiter::WAITING)
+                thread_yield();
+        } else if (m_nparked[d].load(std::memory_order_relaxed) >= PARK_SLOTS) {
+            thread_usleep(100);     // registry full, poll instead
+        }
+    }
+
+    Slot* m_slots;
+    size_t m_mask;
+    alignas(CACHE_LINE) std::atomic<size_t> m_tail{0};
+    alignas(CACHE_LINE) std::atomic<size_t> m_head{0};
+    alignas(CACHE_LINE) std::atomic<bool> m_closed{false};
+    std::atomic<int> m_nparked[2] = {{0}, {0}};
+    std::atomic<Waiter*> m_parked[2][PARK_SLOTS];
+};
+
 // =============================================================================
 // select - Go-style select statement
 // =============================================================================
@@ -14,6 +14,7 @@ See the License for the specific language governing permissions and
 limitations under the License.
 */
 
+#include <algorithm>
 #include <atomic>
 #include <vector>
 #include <chrono>
@@ -27,6 +28,8 @@ limitations under the License.
 DEFINE_uint64(vcpu_num, 4, "vCPU num");
 DEFINE_uint64(fires, 80000, "How many tasks to fire");
 DEFINE_uint64(workload_time_us, 0, "The workload time cost before each delivery");
+DEFINE_uint64(max_vcpu_num, 64, "Scale the workers from 1 to this number of vCPU, 0 to skip");
+DEFINE_uint64(batch, 64, "How many tasks to submit in a call_batch()");
 
 static photon::WorkPool* pool;
 static std::atomic<uint64_t> sum_time;
@@ -86,6 +89,48 @@ static inline size_t get_qps(std::chrono::time_point<std::chrono::steady_clock>
     return FLAGS_fires * 1000 * 1000 / std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
 }
 
+// Submit FLAGS_fires tasks from 4 photon threads, with async_call() or
+// call_batch(), and report the QPS against the number of worker vCPUs
+static void scaling(int sched, bool batch) {
+    for (uint64_t n = 1; n <= FLAGS_max_vcpu_num; n *= 2) {
+        pool = new photon::WorkPool(n, photon::INIT_EVENT_DEFAULT, photon::INIT_IO_NONE, -1, sched);
+        std::atomic<uint64_t> done{0};
+        auto per_thread = FLAGS_fires / 4;
+        auto start = std::chrono::steady_clock::now();
+        std::vector<photon::join_handle*> jhs;
+        for (int t = 0; t < 4; ++t) {
+            jhs.push_back(photon::thread_enable_join(photon::thread_create11([&] {
+                if (batch) {
+                    for (uint64_t i = 0; i < per_thread; i += FLAGS_batch) {
+                        auto k = std::min(FLAGS_batch, per_thread - i);
+                        pool->call_batch(k, [&](size_t) {
+                            workload(FLAGS_workload_time_us);
+                            done.fetch_add(1, std::memory_order_relaxed);
+                        });
+                    }
+                    return;
+                }
+                photon::semaphore sem(0);
+                for (uint64_t i = 0; i < per_thread; ++i) {
+                    pool->async_call(new auto([&] {
+                        workload(FLAGS_workload_time_us);
+                        done.fetch_add(1, std::memory_order_relaxed);
+                        sem.signal(1);
+                    }));
+                }
+                sem.wait(per_thread);
+            })));
+        }
+        for (auto jh : jhs) photon::thread_join(jh);
+        auto end = std::chrono::steady_clock::now();
+        delete pool;
+        pool = nullptr;
+        LOG_INFO("` scheduling, ` workers, `: QPS is `",
+                 sched == photon::WorkPool::SCHED_WORK_STEALING ? "work-stealing" : "shared-queue",
+                 n, batch ? "call_batch" : "async_call", get_qps(start, end));
+    }
+}
+
 int main(int argc, char** arg) {
     gflags::ParseCommandLineFlags(&argc, &arg, true);
     set_log_output_level(ALOG_INFO);
@@ -98,7 +143,6 @@ int main(int argc, char** arg) {
 
     // 1. thread mode WorkPool, will create thread for every task
     pool = new photon::WorkPool(FLAGS_vcpu_num, photon::INIT_EVENT_DEFAULT, photon::INIT_IO_NONE, 0);
-    DEFER(delete pool);
     auto start = std::chrono::steady_clock::now();
     task_async();
     auto end = std::chrono::steady_clock::now();
@@ -143,4 +187,13 @@ int main(int argc, char** arg) {
              FLAGS_fires, FLAGS_vcpu_num,
              get_qps(start, end),
              sum_time.load() / FLAGS_fires);
+
+    delete pool;
+    pool = nullptr;
+
+    // 5. scaling of the scheduling modes, from 1 to max_vcpu_num workers
+    for (int sched : {photon::WorkPool::SCHED_SHARED_QUEUE, photon::WorkPool::SCHED_WORK_STEALING}) {
+        scaling(sched, false);
+        scaling(sched, true);
+    }
 }
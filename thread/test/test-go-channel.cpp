@@ -25,6 +25,8 @@ limitations under the License.
 #include <vector>
 #include <string>
 #include <chrono>
+#include <memory>
+#include <thread>
 
 using namespace photon;
 
@@ -780,6 +782,158 @@ TEST_F(GoChannelTest, SelectFanIn) {
     EXPECT_EQ(out.size(), 15u);
 }
 
+// =============================================================================
+// inline_channel tests
+// =============================================================================
+
+TEST_F(GoChannelTest, InlineChannelBasic) {
+    inline_channel<int> ch(5);
+    EXPECT_EQ(ch.capacity(), 8u);
+    EXPECT_TRUE(ch.empty());
+    for (int i = 0; i < 8; i++) EXPECT_TRUE(ch.try_send(i));
+    EXPECT_FALSE(ch.try_send(8));
+    EXPECT_EQ(ch.size(), 8u);
+    for (int i = 0; i < 8; i++) {
+        int val = -1;
+        EXPECT_TRUE(ch.recv(val));
+        EXPECT_EQ(val, i);
+    }
+    int val;
+    EXPECT_FALSE(ch.try_recv(val));
+}
+
+TEST_F(GoChannelTest, InlineChannelBatch) {
+    inline_channel<int> ch(16);
+    int in[10], out[16];
+    for (int i = 0; i < 10; i++) in[i] = i * 3;
+    EXPECT_EQ(ch.send_batch(in, 10), 10u);
+    EXPECT_EQ(ch.recv_batch(out, 4), 4u);
+    EXPECT_EQ(ch.recv_batch(out + 4, 16), 6u);
+    for (int i = 0; i < 10; i++) EXPECT_EQ(out[i], i * 3);
+}
+
+TEST_F(GoChannelTest, InlineChannelTimeoutAndClose) {
+    inline_channel<int> ch(2);
+    int val;
+    EXPECT_FALSE(ch.recv(val, Timeout(10000)));
+    EXPECT_EQ(errno, ETIMEDOUT);
+    ch.send(1);
+    ch.send(2);
+    EXPECT_FALSE(ch.send(3, Timeout(10000)));
+    EXPECT_EQ(errno, ETIMEDOUT);
+
+    int in[4] = {3, 4, 5, 6};
+    go([&] {
+        thread_usleep(10000);
+        ch.close();
+    });
+    // blocks on the full channel until it is closed
+    EXPECT_EQ(ch.send_batch(in, 4), 0u);
+    EXPECT_EQ(errno, ESHUTDOWN);
+    EXPECT_TRUE(ch.recv(val));
+    EXPECT_EQ(val, 1);
+    EXPECT_TRUE(ch.recv(val));
+    EXPECT_EQ(val, 2);
+    EXPECT_FALSE(ch.recv(val));
+    EXPECT_EQ(errno, ESHUTDOWN);
+}
+
+TEST_F(GoChannelTest, InlineChannelHandoff) {
+    inline_channel<std::unique_ptr<int>> ch(4);
+    int sum = 0;
+    auto th = go([&] {
+        std::unique_ptr<int> p;
+        while (ch.recv(p)) sum += *p;
+    });
+    auto jh = thread_enable_join(th);
+    for (int i = 1; i <= 100; i++) {
+        // let the receiver park, so that values are handed over directly
+        if (i % 10 == 0) thread_usleep(1000);
+        ch.send(std::unique_ptr<int>(new int(i)));
+    }
+    ch.close();
+    thread_join(jh);
+    EXPECT_EQ(sum, 5050);
+}
+
+TEST_F(GoChannelTest, InlineChannelMultiVcpu) {
+    const int P = 4, C = 4, N = 20000;
+    inline_channel<uint64_t> ch(64);
+    std::atomic<uint64_t> sum{0};
+    std::atomic<int> producers{P};
+    std::vector<std::thread> ths;
+    for (int i = 0; i < P; i++) {
+        ths.emplace_back([&, i] {
+            photon::init(INIT_EVENT_DEFAULT, INIT_IO_NONE);
+            DEFER(photon::fini());
+            uint64_t last[1] = {0};
+            for (int j = 1; j <= N; j++) {
+                last[0] = (uint64_t)i * N + j;
+                if (j % 2) ch.send(last[0]);
+                else ch.send_batch(last, 1);
+            }
+            if (--producers == 0) ch.close();
+        });
+    }
+    for (int i = 0; i < C; i++) {
+        ths.emplace_back([&] {
+            photon::init(INIT_EVENT_DEFAULT, INIT_IO_NONE);
+            DEFER(photon::fini());
+            uint64_t buf[16], s = 0;
+            size_t n;
+            while ((n = ch.recv_batch(buf, 16)))
+                for (size_t k = 0; k < n; k++) s += buf[k];
+            sum += s;
+        });
+    }
+    for (auto& th : ths) th.join();
+    uint64_t total = (uint64_t)P * N;
+    EXPECT_EQ(sum.load(), total * (total + 1) / 2);
+}
+
+// Throughput of channel<T> vs. inline_channel<T>, with producers and
+// consumers running on their own vCPUs
+template<typename Channel>
+static double channel_throughput(int producers, int consumers, int n) {
+    Channel ch(1024);
+    std::atomic<int> alive{producers};
+    std::vector<std::thread> ths;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < producers; i++) {
+        ths.emplace_back([&] {
+            photon::init(INIT_EVENT_DEFAULT, INIT_IO_NONE);
+            DEFER(photon::fini());
+            for (int j = 0; j < n; j++) ch.send(j);
+            if (--alive == 0) ch.close();
+        });
+    }
+    for (int i = 0; i < consumers; i++) {
+        ths.emplace_back([&] {
+            photon::init(INIT_EVENT_DEFAULT, INIT_IO_NONE);
+            DEFER(photon::fini());
+            int val;
+            while (ch.recv(val)) { }
+        });
+    }
+    for (auto& th : ths) th.join();
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    return (double)producers * n / (elapsed + 1);
+}
+
+TEST_F(GoChannelTest, ChannelThroughput) {
+    const int N = 100000;
+    struct { const char* name; int producers, consumers; } cases[] = {
+        {"SPSC", 1, 1}, {"MPSC", 4, 1}, {"MPMC", 4, 4},
+    };
+    for (auto& c : cases) {
+        auto a = channel_throughput<channel<int>>(c.producers, c.consumers, N);
+        auto b = channel_throughput<inline_channel<int>>(c.producers, c.consumers, N);
+        LOG_INFO("` channel: ` Mmsg/s, inline_channel: ` Mmsg/s",
+                 c.name, FP(a).precision(3), FP(b).precision(3));
+    }
+}
+
 int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
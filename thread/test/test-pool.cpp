@@ -300,6 +300,55 @@ TEST(workpool, async_work_lambda_threadpool_append) {
     LOG_INFO("DONE");
 }
 
+TEST(workpool, work_stealing) {
+    std::unique_ptr<WorkPool> pool(new WorkPool(4, 0, 0, 0, WorkPool::SCHED_WORK_STEALING));
+
+    semaphore sem;
+    auto start = std::chrono::system_clock::now();
+    for (int i = 0; i < 8; i++) {
+        pool->async_call(new auto ([&sem]() {
+            thread_sleep(1);
+            sem.signal(1);
+        }));
+    }
+    sem.wait(8);
+    auto duration = std::chrono::system_clock::now() - start;
+    EXPECT_GE(duration, std::chrono::seconds(1));
+    EXPECT_LE(duration, std::chrono::seconds(2));
+
+    // tasks spawned by a worker go to its own deque, and get stolen by others
+    std::atomic<int> count{0};
+    std::atomic<int> on_other_vcpus{0};
+    pool->call([&] {
+        auto vcpu = get_vcpu();
+        for (int i = 0; i < 1000; i++) {
+            pool->async_call(new auto ([&, vcpu]() {
+                if (get_vcpu() != vcpu) on_other_vcpus++;
+                thread_usleep(1000);
+                count++;
+            }));
+        }
+    });
+    while (count < 1000) thread_usleep(1000);
+    LOG_INFO(VALUE(on_other_vcpus.load()));
+    EXPECT_GT(on_other_vcpus.load(), 0);
+}
+
+TEST(workpool, call_batch) {
+    for (int sched : {WorkPool::SCHED_SHARED_QUEUE, WorkPool::SCHED_WORK_STEALING}) {
+        std::unique_ptr<WorkPool> pool(new WorkPool(4, 0, 0, -1, sched));
+        std::vector<int> out(10000);
+        pool->call_batch(out.size(), [&](size_t i) { out[i] = i * 2; });
+        for (size_t i = 0; i < out.size(); i++) EXPECT_EQ((int)i * 2, out[i]);
+
+        std::thread([&] {
+            std::atomic<uint64_t> sum{0};
+            pool->call_batch<StdContext>(100, [&](size_t i) { sum += i; });
+            EXPECT_EQ(4950UL, sum.load());
+        }).join();
+    }
+}
+
 int main(int argc, char** arg)
 {
     if (!is_using_default_engine()) return 0;
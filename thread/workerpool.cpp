@@ -20,6 +20,7 @@ limitations under the License.
 #include <photon/photon.h>
 #include <photon/thread/thread-pool.h>
 #include <photon/thread/thread.h>
+#include <photon/common/alog.h>
 
 #include <algorithm>
 #include <future>
@@ -34,6 +35,43 @@ public:
     static constexpr uint32_t RING_SIZE = 65536;
     static constexpr uint64_t QUEUE_YIELD_COUNT = 256;
     static constexpr uint64_t QUEUE_YIELD_US = 1024;
+    static constexpr uint32_t DEQUE_SIZE = 4096;
+    static constexpr uint32_t STEAL_MAX = 256;
+    static constexpr uint32_t MAX_WORKERS = 1024;
+
+    // per-vcpu bounded deque for SCHED_WORK_STEALING; the owner pops from
+    // the head, while thieves take from the tail
+    struct Worker {
+        impl* pool;
+        photon::spinlock lock;
+        uint32_t head = 0, tail = 0;
+        std::atomic<bool> idle{false};
+        photon::semaphore sem;
+        Delegate<void> tasks[DEQUE_SIZE];
+
+        explicit Worker(impl* pool) : pool(pool) {}
+        uint32_t size() const { return tail - head; }
+        uint32_t push(const Delegate<void>* calls, uint32_t n) {
+            SCOPED_LOCK(lock);
+            n = std::min(n, DEQUE_SIZE - size());
+            for (uint32_t i = 0; i < n; ++i)
+                tasks[tail++ % DEQUE_SIZE] = calls[i];
+            return n;
+        }
+        bool pop(Delegate<void>& call) {
+            SCOPED_LOCK(lock);
+            if (!size()) return false;
+            call = tasks[head++ % DEQUE_SIZE];
+            return true;
+        }
+        uint32_t steal_half(Delegate<void>* calls) {
+            SCOPED_LOCK(lock);
+            auto n = std::min((size() + 1) / 2, STEAL_MAX);
+            for (uint32_t i = n; i; --i)
+                calls[i - 1] = tasks[--tail % DEQUE_SIZE];
+            return n;
+        }
+    };
 
     photon::spinlock worker_lock;
     std::vector<std::thread> owned_std_threads;
@@ -43,8 +81,15 @@ public:
         LockfreeMPMCRingQueue<Delegate<void>, RING_SIZE>>
         ring;
     int mode;
+    int sched;
+    std::atomic<bool> stopping{false};
+    std::atomic<uint32_t> nworkers{0};
+    std::atomic<uint32_t> nidle{0};
+    std::unique_ptr<Worker> workers[MAX_WORKERS];
+    static thread_local Worker* current_worker;
 
-    impl(size_t vcpu_num, int ev_engine, int io_engine, int mode) : mode(mode) {
+    impl(size_t vcpu_num, int ev_engine, int io_engine, int mode, int sched)
+        : mode(mode), sched(sched) {
         vcpus.reserve(vcpu_num);
         for (size_t i = 0; i < vcpu_num; ++i) {
             owned_std_threads.emplace_back(
@@ -55,7 +100,13 @@ public:
     }
 
     ~impl() {
-        for (auto num = vcpus.size(); num; --num) enqueue({});
+        if (sched == SCHED_WORK_STEALING) {
+            stopping.store(true, std::memory_order_seq_cst);
+            for (uint32_t i = 0; i < nworkers; ++i)
+                workers[i]->sem.signal(1);
+        } else {
+            for (auto num = vcpus.size(); num; --num) enqueue({});
+        }
         for (auto &worker : owned_std_threads) worker.join();
         if (likely(CURRENT)) {
             while (vcpus.size()) thread_yield();
@@ -65,15 +116,72 @@ public:
         worker_lock.lock();
     }
 
+    static uint64_t random() {
+        static thread_local uint64_t x = (uint64_t)&x | 1;
+        x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+        return x;
+    }
+
+    template <typename Pause>
+    void push_to_ring(Delegate<void> call) {
+        while (!ring.push(call)) Pause::pause();
+    }
+
+    // tasks submitted from a worker stay in its deque, others go to a
+    // random one; tasks overflow to the shared ring when deques are full
+    template <typename Pause>
+    void steal_enqueue(const Delegate<void>* calls, size_t n) {
+        auto w = current_worker;
+        if (!w || w->pool != this) {
+            auto cnt = nworkers.load(std::memory_order_acquire);
+            w = cnt ? workers[random() % cnt].get() : nullptr;
+        }
+        size_t pushed = w ? w->push(calls, std::min(n, (size_t)DEQUE_SIZE)) : 0;
+        for (size_t i = pushed; i < n; ++i)
+            push_to_ring<Pause>(calls[i]);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (w && w->idle.load(std::memory_order_relaxed)) {
+            w->sem.signal(1);
+            if (n == 1) return;
+        }
+        // let the idle ones steal the rest
+        for (auto k = std::min(n, (size_t)nidle.load(std::memory_order_relaxed)); k; --k)
+            if (!wake_one_idle()) break;
+    }
+
+    bool wake_one_idle() {
+        auto cnt = nworkers.load(std::memory_order_acquire);
+        if (!cnt) return false;
+        auto start = random();
+        for (uint32_t i = 0; i < cnt; ++i) {
+            auto w = workers[(start + i) % cnt].get();
+            bool expected = true;
+            if (w->idle.compare_exchange_strong(expected, false)) {
+                w->sem.signal(1);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    template <typename Pause>
+    void enqueue_batch(const Delegate<void>* calls, size_t n) {
+        if (sched == SCHED_WORK_STEALING) {
+            steal_enqueue<Pause>(calls, n);
+        } else {
+            for (size_t i = 0; i < n; ++i) ring.send<Pause>(calls[i]);
+        }
+    }
+
     void enqueue(Delegate<void> call, AutoContext = {}) {
-        if (likely(CURRENT)) ring.send<PhotonPause>(call);
-        else                 ring.send<ThreadPause>(call);
+        if (likely(CURRENT)) enqueue_batch<PhotonPause>(&call, 1);
+        else                 enqueue_batch<ThreadPause>(&call, 1);
     }
     void enqueue(Delegate<void> call, StdContext) {
-        ring.send<ThreadPause>(call);
+        enqueue_batch<ThreadPause>(&call, 1);
     }
     void enqueue(Delegate<void> call, PhotonContext) {
-        ring.send<PhotonPause>(call);
+        enqueue_batch<PhotonPause>(&call, 1);
     }
     template <typename Context>
     void do_call(Delegate<void> call) {
@@ -86,6 +194,38 @@ public:
         aop.suspend();
     }
 
+    template <typename Context>
+    struct BatchItem {
+        Delegate<void, size_t> call;
+        size_t index;
+        std::atomic<size_t>* left;
+        Awaiter<Context>* aop;
+        static void run(void* arg) {
+            auto item = (BatchItem*)arg;
+            item->call(item->index);
+            if (item->left->fetch_sub(1, std::memory_order_acq_rel) == 1)
+                item->aop->resume();
+        }
+    };
+
+    template <typename Context>
+    void do_call_batch(Delegate<void, size_t> call, size_t n) {
+        if (!n) return;
+        Awaiter<Context> aop;
+        std::atomic<size_t> left{n};
+        std::vector<BatchItem<Context>> items(n);
+        std::vector<Delegate<void>> tasks(n);
+        for (size_t i = 0; i < n; ++i) {
+            items[i] = {call, i, &left, &aop};
+            tasks[i] = {&BatchItem<Context>::run, &items[i]};
+        }
+        if (std::is_same<Context, StdContext>::value || !CURRENT)
+            enqueue_batch<ThreadPause>(tasks.data(), n);
+        else
+            enqueue_batch<PhotonPause>(tasks.data(), n);
+        aop.suspend();
+    }
+
     int get_vcpu_num() {
         return vcpus.size();
     }
@@ -108,11 +248,38 @@ public:
         vcpus.erase(it);
     }
 
+    // workers are never removed before the pool is destructed,
+    // so that submitters may index them without locking
+    Worker* add_worker() {
+        SCOPED_LOCK(worker_lock);
+        auto i = nworkers.load(std::memory_order_relaxed);
+        if (i >= MAX_WORKERS) return nullptr;
+        workers[i].reset(new Worker(this));
+        nworkers.store(i + 1, std::memory_order_release);
+        return workers[i].get();
+    }
+
     struct TaskLB {
         Delegate<void> task;
         volatile uint64_t* count;
     };
 
+    void run_task(Delegate<void> task, volatile uint64_t& running_tasks,
+                  photon::ThreadPoolBase* pool) {
+        running_tasks = running_tasks + 1; // ++ -- are deprecated for volatile in C++20
+        TaskLB tasklb{task, &running_tasks};
+        if (mode < 0) {
+            delegate_helper(&tasklb);
+        } else {
+            auto th = !pool ? thread_create(&delegate_helper, &tasklb) :
+                       pool-> thread_create(&delegate_helper, &tasklb) ;
+            (void)th;
+            // Once yield the current coroutine, the newly created coroutine will always
+            // be scheduled before the current coroutine. tasklb will not be overwritten.
+            photon::thread_yield();
+        }
+    }
+
     void main_loop() {
         add_vcpu();
         DEFER(remove_vcpu());
@@ -121,27 +288,83 @@ public:
         if (mode > 0) pool = photon::new_thread_pool(mode);
         DEFER(if (pool) delete_thread_pool(pool));
         ready_vcpu.signal(1);
-        for (;;) {
+        if (sched == SCHED_WORK_STEALING) {
+            steal_loop(running_tasks, pool);
+        } else for (;;) {
             auto yc = running_tasks ? 0 : QUEUE_YIELD_COUNT;
             auto task = ring.recv(yc, QUEUE_YIELD_US);
             if (!task) break;
-            running_tasks = running_tasks + 1; // ++ -- are deprecated for volatile in C++20
-            TaskLB tasklb{task, &running_tasks};
-            if (mode < 0) {
-                delegate_helper(&tasklb);
-            } else {
-                auto th = !pool ? thread_create(&delegate_helper, &tasklb) :
-                           pool-> thread_create(&delegate_helper, &tasklb) ;
-                (void)th;
-                // Once yield the current coroutine, the newly created coroutine will always
-                // be scheduled before the current coroutine. tasklb will not be overwritten.
-                photon::thread_yield();
-            }
+            run_task(task, running_tasks, pool);
         }
         while (running_tasks)
             photon::thread_yield();
     }
 
+    // own deque first, then the shared ring, and at last steal
+    bool next_task(Worker* me, Delegate<void>& task, uint32_t victims) {
+        if (me->pop(task) || ring.pop(task)) return true;
+        auto cnt = nworkers.load(std::memory_order_acquire);
+        if (cnt < 2) return false;
+        Delegate<void> stolen[STEAL_MAX];
+        auto start = random();
+        for (uint32_t i = 0; i < std::min(victims, cnt); ++i) {
+            auto victim = workers[(start + i) % cnt].get();
+            if (victim == me || !victim->size()) continue;
+            auto n = victim->steal_half(stolen);
+            if (!n) continue;
+            task = stolen[0];
+            // new tasks may have been pushed to my deque meanwhile
+            for (auto i = me->push(stolen + 1, n - 1) + 1; i < n; ++i)
+                push_to_ring<PhotonPause>(stolen[i]);
+            return true;
+        }
+        return false;
+    }
+
+    void steal_loop(volatile uint64_t& running_tasks, photon::ThreadPoolBase* pool) {
+        auto me = add_worker();
+        if (!me) {
+            LOG_ERROR("too many workers in work-stealing WorkPool");
+            return;
+        }
+        current_worker = me;
+        DEFER(current_worker = nullptr);
+        Delegate<void> task;
+        for (;;) {
+            if (next_task(me, task, 4)) {
+                run_task(task, running_tasks, pool);
+                continue;
+            }
+            // yield for a while, letting running tasks go on
+            auto yc = running_tasks ? 0 : QUEUE_YIELD_COUNT;
+            Timeout yield_timeout(QUEUE_YIELD_US);
+            bool found = false;
+            for (uint64_t i = 0; i < yc && !yield_timeout.expired(); ++i) {
+                photon::thread_yield();
+                if ((found = next_task(me, task, 4))) break;
+            }
+            if (found) {
+                run_task(task, running_tasks, pool);
+                continue;
+            }
+            // make sure that no task is missed before sleeping
+            me->idle.store(true, std::memory_order_relaxed);
+            nidle.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            found = next_task(me, task, -1U);
+            if (!found && !stopping.load(std::memory_order_acquire))
+                me->sem.wait(1, 100UL * 1000);
+            me->idle.store(false, std::memory_order_relaxed);
+            nidle.fetch_sub(1, std::memory_order_relaxed);
+            if (found) {
+                run_task(task, running_tasks, pool);
+            } else if (stopping.load(std::memory_order_acquire) &&
+                       !next_task(me, task, -1U)) {
+                break;
+            }
+        }
+    }
+
     static void *delegate_helper(void *arg) {
         // must copy to keep tasklb alive
         TaskLB tasklb = *(TaskLB*)arg;
@@ -197,8 +420,10 @@ private:
     StdSemaphore ready_vcpu;
 };
 
-WorkPool::WorkPool(size_t vcpu_num, int ev_engine, int io_engine, int mode)
-    : pImpl(new impl(vcpu_num, ev_engine, io_engine, mode)) {}
+thread_local WorkPool::impl::Worker* WorkPool::impl::current_worker = nullptr;
+
+WorkPool::WorkPool(size_t vcpu_num, int ev_engine, int io_engine, int mode, int sched)
+    : pImpl(new impl(vcpu_num, ev_engine, io_engine, mode, sched)) {}
 
 WorkPool::~WorkPool() { /* implicitly delete pImpl */}
 
@@ -214,6 +439,18 @@ template <>
 void WorkPool::do_call<PhotonContext>(Delegate<void> call) {
     pImpl->do_call<PhotonContext>(call);
 }
+template <>
+void WorkPool::do_call_batch<AutoContext>(Delegate<void, size_t> call, size_t n) {
+    pImpl->do_call_batch<AutoContext>(call, n);
+}
+template <>
+void WorkPool::do_call_batch<StdContext>(Delegate<void, size_t> call, size_t n) {
+    pImpl->do_call_batch<StdContext>(call, n);
+}
+template <>
+void WorkPool::do_call_batch<PhotonContext>(Delegate<void, size_t> call, size_t n) {
+    pImpl->do_call_batch<PhotonContext>(call, n);
+}
 
 void WorkPool::enqueue(Delegate<void> call) { pImpl->enqueue(call); }
 int WorkPool::thread_migrate(photon::thread* th, size_t index) {
@@ -28,6 +28,15 @@ namespace photon {
 
 class WorkPool {
 public:
+    enum Scheduling {
+        // all vcpus poll a single MPMC ring
+        SCHED_SHARED_QUEUE = 0,
+        // each vcpu owns a bounded deque; tasks submitted from a worker
+        // vcpu stay local, others go to a random deque, and idle vcpus
+        // steal half of a random victim's deque before sleeping
+        SCHED_WORK_STEALING = 1,
+    };
+
     /**
      * @brief Construct a new Work Pool object; available in non-photon environment
      *
@@ -37,9 +46,10 @@ public:
      * @param thread_mod threads work in which mode, -1 for non-thread mode, set
      * to 0 will create photon thread for every task, and >0 to create photon
      * thread in photon thread pool with this size.
+     * @param sched how tasks are distributed to vcpus, see `Scheduling`
      */
     explicit WorkPool(size_t vcpu_num, int ev_engine = 0, int io_engine = 0,
-                      int thread_mod = -1);
+                      int thread_mod = -1, int sched = SCHED_SHARED_QUEUE);
 
     WorkPool(const WorkPool& other) = delete;
     WorkPool& operator=(const WorkPool& rhs) = delete;
@@ -82,6 +92,20 @@ public:
         do_call<Context>(f);
     }
 
+    /**
+     * @brief `call_batch` submits `n` tasks at once, calling `f(i)` for each
+     * i in [0, n) concurrently in the workpool, and waits till all of them
+     * finished.
+     *
+     * @param n Number of tasks
+     * @param f Callable object taking the task index as argument
+     */
+    template <typename Context = PhotonContext, typename F>
+    void call_batch(size_t n, F&& f) {
+        auto task = [&](size_t i) { f(i); };
+        do_call_batch<Context>(task, n);
+    }
+
     /**
      * @brief `async_call` just like `call`, but do not wait for task done.
      *        available in non-photon environment.
@@ -114,6 +138,8 @@ protected:
     // Caller should keep callable object and resources alive
     template<typename Context>
     void do_call(Delegate<void> call);
+    template<typename Context>
+    void do_call_batch(Delegate<void, size_t> call, size_t n);
     void enqueue(Delegate<void> call);
 
     template<typename Task>